@@ -0,0 +1,42 @@
+// affinity.h
+#ifndef AFFINITY_H
+#define AFFINITY_H
+#include <stddef.h>
+#include <stdio.h>
+
+/* Posizionamento di memoria e thread sulle macchine multi-socket.
+ *
+ * Linux mette una pagina sul nodo NUMA del thread che la scrive per primo.
+ * Un buffer di malloc/stb riempito dal solo thread principale finisce tutto
+ * su un socket, e oltre quel socket lo speedup si appiattisce. I buffer di
+ * questo modulo sono invece toccati per primi in parallelo, con lo stesso
+ * schedule(static) sulle righe usato dai kernel: ogni thread trova le
+ * proprie righe nella memoria locale (serve anche OMP_PROC_BIND, sotto). */
+
+/* First touch parallelo attivo? Default da GRAYSCALE_FIRST_TOUCH=1,
+ * sovrascrivibile (es. --first-touch). Se è spento le funzioni sotto si
+ * riducono a pool_alloc e la copia non viene fatta. */
+int  affinity_first_touch(void);
+void affinity_set_first_touch(int on);
+
+/* rows righe da row_bytes dal pool (buffer_pool.h). Un blocco nuovo viene
+ * azzerato in parallelo; uno riusato è già stato toccato dal job prima.
+ * Contenuto indefinito. Si liberano con pool_free (o image_free). NULL se
+ * manca memoria. */
+void *affinity_alloc_rows(size_t row_bytes, int rows);
+
+/* Copia src (già decodificato dal thread principale) in un buffer di
+ * affinity_alloc_rows e ritorna la copia; il chiamante libera src.
+ * Con first touch spento ritorna src stesso. NULL se manca memoria. */
+unsigned char *affinity_adopt_rows(unsigned char *src, size_t row_bytes, int rows);
+
+/* libgomp legge OMP_PROC_BIND / OMP_PLACES solo all'avvio del processo:
+ * se bind o places (NULL = invariato) differiscono dall'ambiente, li
+ * imposta e riesegue il programma con gli stessi argv. Da chiamare in
+ * main prima di qualunque regione OpenMP. Ritorna solo se non serve
+ * rieseguire (0) o se exec fallisce (-1). */
+int affinity_apply(char **argv, const char *bind, const char *places);
+
+/* Politica di binding, place e, per ogni thread del team, CPU e nodo NUMA */
+void affinity_report(FILE *f);
+#endif
@@ -0,0 +1,76 @@
+// autotune.h
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+#include <stddef.h>
+#include "pipeline.h"
+
+/* Numero di thread scelto dalla dimensione dell'immagine.
+ *
+ * Su una miniatura il team OpenMP costa più del kernel: con tutti i thread
+ * è più lenta che con uno. Il modello è
+ *
+ *     T(t) = S / t + t * c        (T(1) = S)
+ *
+ * con S il tempo del lavoro su un core (byte / throughput di un core del
+ * kernel) e c il costo per thread di svegliare e riunire il team; t è il
+ * minimo di T fra 1 e il massimo di thread. I kernel restano a
+ * schedule(static): ogni thread riceve una striscia di height/t righe, e
+ * scegliere t è scegliere quanto è grande la striscia (con un lavoro per
+ * thread sotto ~c non conviene aprirne un'altra).
+ *
+ * Throughput e c si misurano una volta per processo, al primo uso (qualche
+ * centinaio di ms), su buffer sintetici. Con GRAYSCALE_TUNE_PROFILE=<file>
+ * il profilo viene letto da lì e, se manca o è di una macchina con un altro
+ * numero di thread, misurato e salvato: le esecuzioni successive partono
+ * già calibrate. */
+
+typedef enum {
+    TUNE_GRAY = 0,      /* convert_to_grayscale in-place */
+    TUNE_LUMA,          /* rgb_to_luma_plane */
+    TUNE_SOBEL,         /* gray_sobel_fused; vale anche per le convoluzioni */
+    TUNE_PNG,           /* png_encode_parallel, livello di default */
+    TUNE_KERNELS
+} tune_kernel_t;
+
+typedef struct {
+    int max_threads;                /* thread con cui è stato misurato */
+    double team_secs;               /* c: costo di un thread in più nel team */
+    double core_bps[TUNE_KERNELS];  /* byte d'ingresso al secondo su un core */
+} tune_profile_t;
+
+/* Thread di default del processo (OMP_NUM_THREADS o i processori
+ * disponibili), indipendente dagli omp_set_num_threads già fatti */
+int tune_max_threads(void);
+
+/* Profilo del processo: caricato o misurato al primo uso, thread-safe */
+const tune_profile_t *tune_profile(void);
+
+/* Misura su questa macchina (usa tutti i tune_max_threads() thread) */
+void tune_calibrate(tune_profile_t *p);
+
+/* Formato testo "chiave valore" per riga; 0 ok, -1 file assente/non valido */
+int tune_load(const char *path, tune_profile_t *p);
+int tune_save(const char *path, const tune_profile_t *p);
+
+/* Secondi del kernel k su bytes byte d'ingresso con un solo core */
+double tune_cost(tune_kernel_t k, size_t bytes);
+
+/* Secondi su un core degli stadi di un piano (pipeline_plan già fatto)
+ * su px pixel: quelli a finestra costano come Sobel, una convoluzione N×N
+ * (N/3)² volte tanto */
+double tune_pipeline_cost(const pipeline_t *p, size_t px);
+
+/* Thread per un'immagine width×height×channels: il massimo fra quelli del
+ * kernel (p, oppure NULL = grayscale, planar come in gs_process) e quelli
+ * dell'encode PNG della sua uscita (tune_png_threads) */
+int tune_image_threads(int width, int height, int channels, const pipeline_t *p,
+                       int planar, int max_threads);
+
+/* Thread per png_encode_parallel di bytes byte: come tune_threads, ma non
+ * più delle strisce da PNG_MIN_STRIP_BYTES in cui l'encoder li divide */
+int tune_png_threads(size_t bytes, int max_threads);
+
+/* t che minimizza T(t) per serial_secs secondi su un core, fra 1 e
+ * max_threads (<= 0: tune_max_threads()) */
+int tune_threads(double serial_secs, int max_threads);
+#endif
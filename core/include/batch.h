@@ -0,0 +1,42 @@
+// batch.h
+#ifndef BATCH_H
+#define BATCH_H
+#include "pipeline.h"
+
+/* Modalità batch: molte immagini in un'unica invocazione.
+ *
+ * spec può essere
+ *   - una directory: tutte le immagini riconosciute (jpg, png, bmp, ...);
+ *   - un pattern glob tra apici, es. "*.jpg" o "scans/img_??.png";
+ *   - un manifest: una riga per immagine, "input[TAB output]", '#' commenta.
+ * Senza output esplicito si scrive <out_dir>/<nome_senza_estensione>.png.
+ *
+ * Pipeline a tre stadi con code limitate: i thread di decode e di encode
+ * (pthread, io_threads per stadio) lavorano in overlap col kernel OpenMP,
+ * che gira sul thread chiamante con il team di default. Così il decode
+ * dell'immagine N+1 e l'encode della N-1 si sovrappongono al calcolo
+ * della N.
+ *
+ * pipe (non NULL, senza hist): al posto del kernel grayscale, pianificata
+ * sui canali di ogni immagine, come --pipeline per un'immagine sola. */
+typedef struct {
+    int passes;         /* >= 1 */
+    int planar;
+    int luma;           /* decode diretto in luminanza, kernel saltato */
+    int level;          /* compressione PNG (png_parallel.h) */
+    int io_threads;     /* thread per stadio di decode e di encode, >= 1 */
+    const pipeline_t *pipe;
+} batch_opts_t;
+
+typedef struct {
+    int images;         /* immagini elencate */
+    int failed;         /* decode, allocazione o encode falliti */
+    double wall_secs;   /* durata dell'intera pipeline */
+    double kernel_secs; /* somma dei tempi del kernel */
+    double mpixels;     /* megapixel passati dal kernel */
+} batch_stats_t;
+
+/* 0 = pipeline eseguita (vedi stats->failed), -1 = spec/out_dir non validi */
+int run_batch(const char *spec, const char *out_dir, const batch_opts_t *opts,
+              batch_stats_t *stats);
+#endif
@@ -0,0 +1,31 @@
+// buffer_pool.h
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+#include <stddef.h>
+
+/* Pool di buffer per frame riusati tra passate e job (--serve, --batch,
+ * libreria). Ogni richiesta è arrotondata a una classe di dimensione:
+ * potenze di due sotto i 2 MiB, multipli di 2 MiB sopra. pool_free
+ * rimette il blocco fra quelli liberi della sua classe, e la prossima
+ * richiesta della stessa classe lo riprende già mappato: niente mmap/munmap
+ * né page fault per ogni immagine.
+ *
+ * Allineamento: 64 byte (una linea di cache, un vettore AVX-512); i blocchi
+ * da 2 MiB in su sono allineati a 2 MiB e marcati MADV_HUGEPAGE, così il
+ * kernel può usare huge page trasparenti.
+ *
+ * Memoria trattenuta (blocchi liberi) al massimo GRAYSCALE_POOL_MB MiB,
+ * default 256; 0 disattiva il riuso. Thread-safe. */
+
+#define POOL_ALIGN 64
+
+/* Contenuto indefinito (un blocco riusato non viene azzerato). fresh, se
+ * non NULL, dice se il blocco è nuovo (pagine mai toccate). NULL se manca
+ * memoria. */
+void *pool_alloc(size_t bytes);
+void *pool_alloc_fresh(size_t bytes, int *fresh);
+
+/* Accetta anche puntatori che non vengono dal pool (malloc, stb): in quel
+ * caso è free(). NULL è ignorato. */
+void pool_free(void *p);
+#endif
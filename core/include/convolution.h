@@ -0,0 +1,61 @@
+// convolution.h
+#ifndef CONVOLUTION_H
+#define CONVOLUTION_H
+#include <stdint.h>
+#include "sobel.h"
+
+/* Convoluzione 2D a pesi interi su immagini interleaved a 8 o 16 bit.
+ *
+ * Un kernel di rango 1 (pesi = colonna × riga, come Gauss e box) viene
+ * riconosciuto e applicato come due passate 1D: 2K moltiplicazioni per
+ * campione invece di K². Le immagini sono divise in blocchi (strisce di
+ * righe × colonne) e ogni thread tiene in cache le K righe filtrate in
+ * orizzontale del proprio blocco, senza un'immagine intermedia.
+ * I lati 3, 5 e 7 hanno cicli con K costante (srotolati e vettorizzati
+ * dal compilatore), compilati per AVX2/AVX-512 e scelti a runtime come
+ * gli altri kernel (cpu_features.h); gli altri lati usano il ciclo
+ * generico.
+ *
+ * Somme in int32; per i kernel separabili la passata verticale passa a
+ * int64 quando il totale non ci sta, così Gauss e box vanno a 8 e 16 bit
+ * su tutti i lati 1..15. Un kernel non separabile deve avere
+ * |pesi| * (valore massimo + 1) sotto 2^31 (conv_supported).
+ * Risultato = somma / divisor arrotondato, saturato a [0, 255] o
+ * [0, 65535]. Con un divisore che non è una potenza di 2 la divisione
+ * passa dal reciproco in float (errore al più 1 sui valori a metà). */
+
+#define CONV_MAX_SIZE 15
+
+typedef struct {
+    int size;                                   /* lato dispari, 1..15   */
+    int weights[CONV_MAX_SIZE * CONV_MAX_SIZE]; /* riga per riga          */
+    int divisor;                                /* 0 = somma dei pesi (1
+                                                 * se la somma è 0)       */
+} conv_kernel_t;
+
+/* Gauss binomiale (3: 1 2 1, 5: 1 4 6 4 1, ...) o box di lato size
+ * (dispari, 1..15), normalizzato; 0 ok, -1 lato non valido */
+int conv_kernel_gaussian(conv_kernel_t *k, int size);
+int conv_kernel_box(conv_kernel_t *k, int size);
+
+/* "gauss3", "gauss5", "box7", ... → kernel; 0 ok, -1 nome sconosciuto */
+int conv_kernel_named(conv_kernel_t *k, const char *name);
+
+/* 1 se conv_apply_u8 (bits 8) o conv_apply_u16 (bits 16) può applicare
+ * k senza traboccare, 0 altrimenti */
+int conv_supported(const conv_kernel_t *k, int bits);
+
+/* 1 se k è di rango 1: row e col (size pesi interi ciascuno) con
+ * weights[i][j] = col[i] * row[j]; NULL ammessi */
+int conv_separable(const conv_kernel_t *k, int *row, int *col);
+
+/* src → dst (non sovrapposti), tutti i canali. Bordo come in sobel.h:
+ * replicate, reflect, zero o constant (border_value). 0 ok, -1 kernel non
+ * valido o memoria. */
+int conv_apply_u8(const unsigned char *src, unsigned char *dst,
+                  int width, int height, int channels, const conv_kernel_t *k,
+                  sobel_border_t border, unsigned char border_value);
+int conv_apply_u16(const uint16_t *src, uint16_t *dst,
+                   int width, int height, int channels, const conv_kernel_t *k,
+                   sobel_border_t border, uint16_t border_value);
+#endif
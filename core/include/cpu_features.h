@@ -0,0 +1,34 @@
+// cpu_features.h
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+/* Set di istruzioni SIMD usati dai kernel, in ordine crescente di larghezza */
+typedef enum {
+    SIMD_SCALAR = 0,
+    SIMD_NEON,
+    SIMD_AVX2,
+    SIMD_AVX512,
+} simd_isa_t;
+
+/* ISA attiva: rilevata una sola volta all'avvio (CPUID), sovrascrivibile
+ * con GRAYSCALE_SIMD=scalar|neon|avx2|avx512 */
+simd_isa_t simd_isa(void);
+
+/* Forza un'ISA (es. confronto scalare vs SIMD); se la CPU non la supporta
+ * si ricade sulla migliore disponibile. Ritorna l'ISA effettiva. */
+simd_isa_t simd_force_isa(simd_isa_t isa);
+
+const char *simd_isa_name(simd_isa_t isa);
+
+/* Attributo delle varianti generiche (_scalar) dei kernel scritti in C
+ * semplice. Su x86 vieta l'auto-vettorizzazione: con -march=native
+ * diventerebbero un'altra versione AVX e in bench_kernels la riga scalar
+ * non sarebbe più il riferimento. Su aarch64 NEON è la base e la versione
+ * generica resta vettorizzata. */
+#if defined(__GNUC__) && !defined(__clang__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_SCALAR_ATTR __attribute__((optimize("no-tree-vectorize")))
+#else
+#define SIMD_SCALAR_ATTR
+#endif
+
+#endif
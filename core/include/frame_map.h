@@ -0,0 +1,70 @@
+// frame_map.h
+#ifndef FRAME_MAP_H
+#define FRAME_MAP_H
+#include <stddef.h>
+
+/* Frame non compressi su file mappati (mmap), per passare immagini tra
+ * stadi di una pipeline attraverso la page cache o /dev/shm: i kernel
+ * leggono e scrivono direttamente le pagine del file, senza decode, encode
+ * né copie intermedie.
+ *
+ *   PGM/PPM  binari (P5 = 1 canale, P6 = 3 canali), maxval 255
+ *   raw      solo pixel, width*height*channels byte, interleaved (con 1
+ *            canale è il piano di --planar); le dimensioni non sono nel
+ *            file e vanno date a parte ("WxH" o "WxHxC") */
+
+typedef enum {
+    FRAME_PNG = 0,      /* tutto il resto: encoder PNG */
+    FRAME_PNM,          /* .pgm .ppm .pnm */
+    FRAME_RAW,          /* .raw */
+} frame_format_t;
+
+typedef struct {
+    unsigned char *pixels;      /* dentro la mappatura, dopo l'header */
+    int width, height, channels;
+    void *base;
+    size_t len;
+} frame_map_t;
+
+/* Formato d'uscita dall'estensione di path */
+frame_format_t frame_format_of(const char *path);
+
+/* Header PGM/PPM binario nei primi len byte di p: 1 = a 8 bit, con i
+ * pixel da p + *data in poi (righe contigue), 0 = non PNM o maxval != 255,
+ * -1 = header rotto */
+int frame_pnm_header(const unsigned char *p, size_t len,
+                     int *w, int *h, int *c, size_t *data);
+
+/* "WxH" o "WxHxC" (C default 1); 0 ok, -1 stringa non valida */
+int frame_parse_raw(const char *spec, int *width, int *height, int *channels);
+
+/* Mappa un ingresso raw (raw != NULL, dimensioni "WxH[xC]") o PGM/PPM a
+ * 8 bit. Mappatura privata e scrivibile: un kernel in-place può lavorarci
+ * sopra e solo le pagine scritte vengono copiate, le scritture non
+ * arrivano al file. Le pagine non ancora copiate restano però quelle del
+ * file: se qualcuno lo tronca (es. l'uscita è lo stesso file) diventano
+ * zeri o SIGBUS. In quel caso staccarla prima con frame_detach.
+ * 1 mappato, 0 non è un formato mappabile (decodificare con image_load),
+ * -1 errore con il motivo in err. */
+int frame_map_input(const char *path, const char *raw, frame_map_t *m,
+                    char *err, size_t errlen);
+
+/* 1 se a e b sono lo stesso file (stessi st_dev e st_ino, quindi anche
+ * attraverso link), 0 altrimenti o se uno dei due non esiste */
+int frame_same_file(const char *a, const char *b);
+
+/* Copia i pixel di un ingresso mappato in memoria dal pool (da liberare
+ * con pool_free/image_free) e lo smappa; NULL se l'allocazione fallisce,
+ * con m ancora mappata */
+unsigned char *frame_detach(frame_map_t *m);
+
+/* Crea (o tronca) path nel formato fmt (FRAME_PNM o FRAME_RAW) e lo mappa
+ * condiviso: quello che il kernel scrive in m->pixels finisce nel file.
+ * 0 ok, -1 errore con il motivo in err (es. PGM/PPM con 2 o 4 canali). */
+int frame_map_output(const char *path, frame_format_t fmt,
+                     int width, int height, int channels, frame_map_t *m,
+                     char *err, size_t errlen);
+
+/* munmap; m può essere già chiusa o tutta a zero. 0 ok, -1 errore */
+int frame_unmap(frame_map_t *m);
+#endif
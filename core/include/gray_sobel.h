@@ -0,0 +1,31 @@
+// gray_sobel.h
+#ifndef GRAY_SOBEL_H
+#define GRAY_SOBEL_H
+#include "sobel.h"
+/* Grayscale + Sobel in un solo passaggio sull'immagine: ogni thread converte
+ * in luminanza le proprie righe in un anello di 3 righe (più l'alone ai
+ * bordi della striscia) e scrive subito la riga dei bordi.
+ *
+ * dst_channels == 1: dst è il piano dei bordi (width*height byte);
+ * altrimenti dst ha lo stesso layout di src e il bordo è replicato su
+ * R,G,B (alpha copiato da src). dst non può coincidere con src.
+ * mag e border scelgono modulo del gradiente e bordo (vedi sobel.h):
+ * ogni pixel di dst viene scritto, senza passate extra sull'immagine.
+ * Ritorna 0, oppure -1 se un thread non ha potuto allocare il suo anello. */
+int gray_sobel_fused(const unsigned char *src, unsigned char *dst,
+                     int width, int height, int channels, int dst_channels,
+                     sobel_mag_t mag, sobel_border_t border,
+                     unsigned char border_value);
+
+/* Stesso risultato di gray_sobel_fused per le sole righe [y0, y0 + n) di
+ * un'immagine alta height, per l'elaborazione a bande (stream.h).
+ * win contiene le righe [win_y0, win_y0 + win_rows) di src, con almeno una
+ * riga di alone sopra e sotto la banda dove l'immagine continua; dst riceve
+ * le n righe della banda. luma è uno scratch di win_rows*width byte.
+ * Ritorna 0, oppure -1 se manca memoria. */
+int gray_sobel_band(const unsigned char *win, int win_y0, int win_rows,
+                    unsigned char *dst, int y0, int n,
+                    int width, int height, int channels, int dst_channels,
+                    sobel_mag_t mag, sobel_border_t border,
+                    unsigned char border_value, unsigned char *luma);
+#endif
@@ -0,0 +1,199 @@
+// grayscale_api.h
+#ifndef GRAYSCALE_API_H
+#define GRAYSCALE_API_H
+/* API in memoria esportata da libgrayscale.so (ctypes/cffi): nessun file
+ * temporaneo, l'immagine entra ed esce come buffer.
+ * Tutte le funzioni int ritornano 0 se ok, -1 in caso di errore
+ * (dettagli con gs_last_error). */
+#include <stddef.h>
+
+#if defined(__GNUC__)
+#define GS_API __attribute__((visibility("default")))
+#else
+#define GS_API
+#endif
+
+/* threads di gs_process, gs_pipeline, gs_stats_json e gs_encode_png:
+ * scelti da autotune.h in base alla dimensione di img (una miniatura ne usa
+ * uno, una foto grande tutti). Le altre funzioni lo trattano come 0. */
+#define GS_THREADS_AUTO (-1)
+
+typedef struct {
+    unsigned char *data;        /* interleaved, width*height*channels byte */
+    int width;
+    int height;
+    int channels;
+} gs_image;
+
+/* PNG/JPEG/BMP/... da buffer (image_load.h: libjpeg-turbo o stb) */
+GS_API int gs_decode(const unsigned char *buf, size_t len, gs_image *img);
+
+/* Solo luminanza, channels = 1: con libjpeg-turbo il piano Y del JPEG senza
+ * conversione colore. Il risultato è già grigio, gs_process non serve. */
+GS_API int gs_decode_luma(const unsigned char *buf, size_t len, gs_image *img);
+
+/* Thread che GS_THREADS_AUTO userebbe per l'immagine codificata in buf
+ * (basta l'intestazione): il massimo fra kernel ed encode PNG, con spec
+ * come in gs_pipeline (NULL = gs_process), fra 1 e max_threads
+ * (0 = default). 0 se il formato non è riconosciuto. */
+GS_API int gs_auto_threads(const unsigned char *buf, size_t len, const char *spec,
+                           int max_threads);
+
+/* Grayscale ×passes con threads thread OpenMP (0 = default).
+ * planar != 0: img diventa il piano di luminanza a 1 canale.
+ * secs (può essere NULL) riceve il tempo del solo kernel. */
+GS_API int gs_process(gs_image *img, int passes, int threads, int planar,
+                      double *secs);
+
+/* Pipeline di stadi (pipeline.h, es. "gray,blur5,sobel:l1,hist") al posto
+ * di gs_process: img diventa l'uscita dell'ultimo stadio (i suoi canali).
+ * passes la ripete dall'ingresso, secs come in gs_process. Con uno stadio
+ * hist e image_json non NULL, *image_json riceve le statistiche come
+ * gs_stats_json (altrimenti NULL); liberarlo con gs_free. */
+GS_API int gs_pipeline(gs_image *img, const char *spec, int passes, int threads,
+                       double *secs, char **image_json);
+
+/* Istogramma a 256 bin, media, minimo e massimo per canale di img come
+ * JSON su una riga (image_stats.h) in una stringa nuova (*json): liberarla
+ * con gs_free. Prima di gs_process per avere quelle dell'ingresso. */
+GS_API int gs_stats_json(const gs_image *img, int threads, char **json);
+
+/* PNG in un buffer nuovo (*out, *len): liberarlo con gs_free.
+ * level 0-9 (0 = store, -1 = default); encoder parallelo con threads
+ * thread OpenMP (0 = default). */
+GS_API int gs_encode_png(const gs_image *img, int level, int threads,
+                         unsigned char **out, size_t *len);
+
+/* Sorgente e destinazione a blocchi per gs_stream: read riempie al più len
+ * byte di buf e ritorna quanti (0 = fine, -1 = errore); write ritorna 0 se
+ * ha preso tutti i len byte. */
+typedef long (*gs_read_fn)(void *ctx, unsigned char *buf, size_t len);
+typedef int (*gs_write_fn)(void *ctx, const unsigned char *buf, size_t len);
+
+typedef struct {
+    int width, height, channels;
+    double decode_secs, kernel_secs, encode_secs, total_secs;
+    size_t peak_bytes;          /* finestra + banda d'uscita (stream.h) */
+} gs_stream_stats;
+
+/* gs_decode + gs_process + gs_encode_png a bande di band_rows righe
+ * (0 = default, stream.h) senza mai tenere l'immagine intera: i byte
+ * arrivano da read, il PNG esce da write a pezzi man mano che le bande
+ * sono compresse. Entrambe sono chiamate solo dal thread chiamante.
+ * Formati: quelli di gs_stream_supported. Se fallisce dopo le prime write,
+ * il PNG uscito è incompleto. st (può essere NULL) riceve dimensioni e tempi. */
+GS_API int gs_stream(gs_read_fn read, gs_write_fn write, void *ctx, int passes,
+                     int threads, int planar, int level, int band_rows,
+                     gs_stream_stats *st);
+
+/* 1 se gs_stream decodifica l'immagine che inizia con i len byte di head
+ * (ne bastano 29): JPEG con libjpeg-turbo, PNG non interlacciato, PGM/PPM
+ * binari. 0 = usare gs_decode. */
+GS_API int gs_stream_supported(const unsigned char *head, size_t len);
+
+/* Dimensioni e canali (quelli di gs_decode) dall'intestazione nei len
+ * byte di head, senza decode. Per PGM/PPM binari a 8 bit pixels_offset è
+ * il primo byte dei pixel, a righe contigue: un tile ne legge solo il suo
+ * intervallo. -1 per gli altri formati. */
+typedef struct {
+    int width, height, channels;
+    long long pixels_offset;
+} gs_info;
+
+GS_API int gs_image_info(const unsigned char *head, size_t len, gs_info *info);
+
+/* ---- tile: un'immagine divisa fra più nodi (stream.h) ----
+ *
+ * L'uscita si divide in tile di righe [y0, y0 + rows). Ogni tile riceve le
+ * righe grezze della sua finestra (gs_tile_window), anche su un'altra
+ * macchina, e scrive un frammento di PNG. Chi ricuce scrive
+ * gs_stitch_head, i frammenti in ordine e gs_stitch_tail, senza
+ * ricomprimere.
+ *
+ * spec NULL: grigio in-place ×passes come gs_stream. Altrimenti una
+ * pipeline che si riduca a gray, sobel su un canale o gray,sobel fusi
+ * (come gs_batch_process), con una riga di alone per sobel. */
+
+/* Prima riga e numero di righe d'ingresso che servono al tile, e canali
+ * dell'uscita (per gs_stitch_head). -1 se spec non va in un tile. */
+GS_API int gs_tile_window(int height, int channels, int y0, int rows, const char *spec,
+                          int *win_y0, int *win_rows, int *out_channels);
+
+typedef struct {
+    gs_stream_stats stream;     /* decode_secs: lettura delle righe grezze */
+    unsigned int adler;         /* per gs_stitch_tail */
+    unsigned long long filtered;
+} gs_tile_stats;
+
+/* Il tile [y0, y0 + rows) di un'immagine width×height×channels: read dà
+ * le righe della finestra (width*channels byte l'una, senza header), write
+ * riceve il frammento. threads, level e band_rows come in gs_stream. */
+GS_API int gs_tile(gs_read_fn read, gs_write_fn write, void *ctx,
+                   int width, int height, int channels, int y0, int rows,
+                   const char *spec, int passes, int threads, int level,
+                   int band_rows, gs_tile_stats *st);
+
+/* Righe decodificate di un'immagine, per chi la divide in tile: decode a
+ * bande di band_rows righe (0 = default) come gs_stream, e rows riceve
+ * ognuna (0 = continua) con le dimensioni dell'immagine. */
+typedef int (*gs_rows_fn)(void *ctx, const unsigned char *rows, int y0, int n,
+                          int width, int height, int channels);
+
+GS_API int gs_decode_rows(gs_read_fn read, gs_rows_fn rows, void *ctx, int band_rows);
+
+/* Inizio e fine del PNG ricucito: out ha posto per GS_STITCH_HEAD_BYTES e
+ * GS_STITCH_TAIL_BYTES; *len riceve i byte scritti. La coda combina gli
+ * adler32 degli n frammenti. level come per i tile. */
+#define GS_STITCH_HEAD_BYTES 47
+#define GS_STITCH_TAIL_BYTES 28
+
+GS_API int gs_stitch_head(int width, int height, int out_channels, int level,
+                          unsigned char *out, size_t *len);
+GS_API int gs_stitch_tail(const unsigned int *adlers, const unsigned long long *filtered,
+                          int n, unsigned char *out, size_t *len);
+
+/* Batch di immagini piccole in un solo buffer (packed_batch.h): un solo
+ * team OpenMP per decode, kernel ed encode di tutte invece che uno per
+ * immagine. */
+typedef struct {
+    size_t offset;              /* primo byte dell'immagine in data */
+    int width, height, channels;    /* 0×0: decode fallito */
+} gs_batch_item;
+
+typedef struct {
+    unsigned char *data;        /* le immagini una dopo l'altra */
+    size_t size;
+    gs_batch_item *items;
+    int count;
+} gs_batch;
+
+/* Decode delle n immagini (un thread per immagine, threads 0 = default)
+ * nel buffer del batch. Un'immagine che non si decodifica resta 0×0 e non
+ * ferma le altre; -1 solo se manca memoria. */
+GS_API int gs_batch_decode(const unsigned char *const *bufs, const size_t *lens, int n,
+                           int threads, gs_batch *b);
+
+/* Un kernel su tutto il batch, ×passes. spec NULL: grigio in-place come
+ * gs_process con planar 0; altrimenti una pipeline (pipeline.h) che si
+ * riduca a un solo stadio gray, sobel su un canale o gray,sobel fusi,
+ * e il batch diventa quello dei piani d'uscita a 1 canale. secs come in
+ * gs_process. */
+GS_API int gs_batch_process(gs_batch *b, const char *spec, int passes, int threads,
+                            double *secs);
+
+/* PNG di ogni immagine (un thread per immagine) in outs[i], lens[i]:
+ * liberarli con gs_free. NULL per le immagini 0×0 o il cui encode fallisce. */
+GS_API int gs_batch_encode_png(const gs_batch *b, int level, int threads,
+                               unsigned char **outs, size_t *lens);
+
+GS_API void gs_batch_free(gs_batch *b);
+
+GS_API void gs_image_free(gs_image *img);
+GS_API void gs_free(void *p);
+
+/* Messaggio dell'ultimo errore nel thread chiamante */
+GS_API const char *gs_last_error(void);
+
+/* Versione del core (core/VERSION), es. "1.0.0" */
+GS_API const char *gs_version(void);
+#endif
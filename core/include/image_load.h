@@ -0,0 +1,51 @@
+// image_load.h
+#ifndef IMAGE_LOAD_H
+#define IMAGE_LOAD_H
+#include <stddef.h>
+#include <stdint.h>
+
+/* Decode con backend scelto in compilazione.
+ *
+ * Con -DUSE_LIBJPEG (make JPEG=turbo) i JPEG passano da libjpeg-turbo
+ * (IDCT e upsampling SIMD); il resto, o un JPEG che turbo rifiuta
+ * (es. CMYK), ricade su stb. Senza la macro è sempre stb.
+ *
+ * I buffer ritornati si liberano con image_free: vengono da stb (malloc)
+ * o dal pool di buffer_pool.h (turbo, piano di luminanza). */
+
+/* Pixel interleaved con i canali del file (1-4), NULL in caso di errore */
+unsigned char *image_load(const char *path, int *width, int *height, int *channels);
+unsigned char *image_load_from_memory(const unsigned char *buf, size_t len,
+                                      int *width, int *height, int *channels);
+
+/* Solo il piano di luminanza (1 canale). Con libjpeg-turbo un JPEG viene
+ * decodificato direttamente in JCS_GRAYSCALE: niente upsampling della
+ * crominanza né conversione colore. Y è quello salvato nel file: rispetto
+ * a rgb_to_luma_plane sull'RGB decodificato differisce di poco (PSNR > 60 dB,
+ * qualche unità sui bordi saturi dove l'RGB viene clippato).
+ * Altrimenti decode completo + rgb_to_luma_plane. */
+unsigned char *image_load_luma(const char *path, int *width, int *height);
+unsigned char *image_load_luma_from_memory(const unsigned char *buf, size_t len,
+                                           int *width, int *height);
+
+/* Campioni a 16 bit (PNG e PGM/PPM a 16 bit da stbi_load_16; un file a
+ * 8 bit viene scalato, v * 257). Si libera con image_free. */
+uint16_t *image_load_16(const char *path, int *width, int *height, int *channels);
+
+/* 1 se il file ha campioni a 16 bit (PNG, PGM/PPM con maxval > 255) */
+int image_is_16_bit(const char *path);
+
+/* Dimensioni e canali dall'intestazione, senza decodificare i pixel;
+ * 0 ok, -1 formato non riconosciuto */
+int image_info(const char *path, int *width, int *height, int *channels);
+int image_info_from_memory(const unsigned char *buf, size_t len,
+                           int *width, int *height, int *channels);
+
+void image_free(void *pixels);
+
+/* Motivo dell'ultimo errore nel thread chiamante */
+const char *image_failure_reason(void);
+
+/* "libjpeg-turbo" oppure "stb" */
+const char *image_jpeg_backend(void);
+#endif
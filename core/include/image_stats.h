@@ -0,0 +1,49 @@
+// image_stats.h
+#ifndef IMAGE_STATS_H
+#define IMAGE_STATS_H
+#include <stdint.h>
+#include <stdio.h>
+
+/* Statistiche per canale di un'immagine interleaved a 8 bit: istogramma a
+ * 256 bin, media, minimo e massimo (per le decisioni di esposizione senza
+ * un secondo decode).
+ *
+ * Il ciclo sui pixel fa solo gli incrementi: ogni thread ha istogrammi
+ * privati a 32 bit, in 4 copie per canale che si alternano pixel per pixel
+ * (incrementi consecutivi dello stesso bin non aspettano il caricamento
+ * precedente). Le copie si sommano in quello condiviso a fine regione;
+ * media, minimo e massimo si ricavano dall'istogramma, esatti, con
+ * riduzioni vettoriali sui bin. */
+
+#define STATS_BINS 256
+#define STATS_MAX_CHANNELS 4
+
+typedef struct {
+    int channels;
+    uint64_t pixels;
+    uint64_t hist[STATS_MAX_CHANNELS][STATS_BINS];
+    double mean[STATS_MAX_CHANNELS];
+    int min[STATS_MAX_CHANNELS], max[STATS_MAX_CHANNELS];
+    double secs;                /* tempo di tutte le image_stats_add */
+} image_stats_t;
+
+/* Azzera st per immagini a channels canali (1..4) */
+void image_stats_reset(image_stats_t *st, int channels);
+
+/* Aggiunge rows righe di width pixel (una banda o l'immagine intera);
+ * parallelo sul team OpenMP corrente. Gli istogrammi privati (16 KiB per
+ * thread) stanno sullo stack. */
+void image_stats_add(image_stats_t *st, const unsigned char *pix, int width, int rows);
+
+/* Media, minimo e massimo dagli istogrammi (dopo l'ultima add) */
+void image_stats_finish(image_stats_t *st);
+
+/* reset + add + finish */
+void image_stats_compute(image_stats_t *st, const unsigned char *pix,
+                         int width, int height, int channels);
+
+/* Un oggetto JSON su una riga (senza a capo):
+ * {"pixels":N,"channels":C,"mean":[...],"min":[...],"max":[...],
+ *  "hist":[[256 valori],...],"stats_s":T} */
+void image_stats_print_json(FILE *f, const image_stats_t *st);
+#endif
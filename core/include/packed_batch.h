@@ -0,0 +1,49 @@
+// packed_batch.h
+#ifndef PACKED_BATCH_H
+#define PACKED_BATCH_H
+#include <stddef.h>
+#include "sobel.h"
+
+/* Molte immagini piccole in un solo buffer, una dopo l'altra, elaborate da
+ * un solo team OpenMP. Un'immagine 200×200 da sola ha 200 righe e il team
+ * costa quanto il kernel; qui il lavoro si divide sulle righe dell'intero
+ * batch (32 miniature = 6400 righe), con una tabella riga globale →
+ * immagine, e il team parte una volta per tutte.
+ *
+ * I risultati sono identici byte per byte a quelli dei kernel sulle singole
+ * immagini (convert_to_grayscale, rgb_to_luma_plane, gray_sobel_fused). */
+
+typedef struct {
+    size_t offset;      /* primo byte dell'immagine nel buffer */
+    int width, height, channels;
+} packed_image_t;
+
+/* Allineamento degli offset di packed_layout: due thread che finiscono su
+ * immagini vicine non si contendono una linea di cache */
+#define PACKED_ALIGN 64
+
+/* Offset delle n immagini di dims (solo dimensioni e canali letti) una
+ * dopo l'altra, con channels canali (0 = quelli di dims): scritti in out,
+ * che può coincidere con dims. Ritorna i byte del buffer. */
+size_t packed_layout(const packed_image_t *dims, int n, int channels,
+                     packed_image_t *out);
+
+/* Y in-place su R,G,B di ogni immagine; 1-2 canali restano invariati.
+ * 0 ok, -1 se manca memoria per la tabella delle righe. */
+int packed_grayscale(unsigned char *data, const packed_image_t *imgs, int n);
+
+/* Piano di luminanza di ogni immagine in dst, con gli offset di dst_imgs
+ * (1 canale, es. da packed_layout). 0 ok, -1 memoria. */
+int packed_luma(const unsigned char *src, const packed_image_t *imgs, int n,
+                unsigned char *dst, const packed_image_t *dst_imgs);
+
+/* Luminanza + Sobel come gray_sobel_fused con dst_channels 1: i piani di
+ * luminanza vanno in luma (stessi offset di dst_imgs), poi i bordi in dst.
+ * Due fasi nella stessa regione parallela: ogni riga di luminanza è
+ * calcolata una volta sola, anche quelle di confine fra due thread.
+ * 0 ok, -1 memoria. */
+int packed_gray_sobel(const unsigned char *src, const packed_image_t *imgs, int n,
+                      unsigned char *dst, const packed_image_t *dst_imgs,
+                      unsigned char *luma, sobel_mag_t mag,
+                      sobel_border_t border, unsigned char border_value);
+#endif
@@ -0,0 +1,32 @@
+// parallel_to_grayscale.h
+#ifndef PARALLEL_TO_GRAYSCALE_H
+#define PARALLEL_TO_GRAYSCALE_H
+#include <stdint.h>
+
+/* Y = (77 R + 150 G + 29 B + 128) >> 8 scritto in-place su R,G,B.
+ * Il kernel SIMD (AVX2/AVX-512/NEON) è scelto a runtime, vedi cpu_features.h */
+void convert_to_grayscale(unsigned char *data, int width, int height, int channels);
+
+/* Stessa Y, scritta come piano a un canale: dst ha width*height byte.
+ * Con channels < 3 copia il primo canale. */
+void rgb_to_luma_plane(const unsigned char *src, unsigned char *dst,
+                       int width, int height, int channels);
+
+/* Una sola riga di rgb_to_luma_plane, senza OpenMP: per i kernel che si
+ * dividono le righe da soli (es. gray_sobel_fused) */
+void rgb_to_luma_row(const unsigned char *src, unsigned char *dst,
+                     int width, int channels);
+
+/* Una sola riga di convert_to_grayscale (in-place), senza OpenMP: per chi
+ * spartisce da sé le righe di più immagini (packed_batch.h) */
+void convert_to_grayscale_row(unsigned char *row, int width, int channels);
+
+/* Le stesse due operazioni su campioni a 16 bit (stessi pesi Q8, somme in
+ * int32) e in float (pesi Q8 / 256, nessun arrotondamento né saturazione) */
+void convert_to_grayscale_u16(uint16_t *data, int width, int height, int channels);
+void rgb_to_luma_plane_u16(const uint16_t *src, uint16_t *dst,
+                           int width, int height, int channels);
+void convert_to_grayscale_f32(float *data, int width, int height, int channels);
+void rgb_to_luma_plane_f32(const float *src, float *dst,
+                           int width, int height, int channels);
+#endif
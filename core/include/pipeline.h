@@ -0,0 +1,125 @@
+// pipeline.h
+#ifndef PIPELINE_H
+#define PIPELINE_H
+#include <stddef.h>
+#include <stdio.h>
+#include "sobel.h"
+#include "convolution.h"
+#include "image_stats.h"
+
+/* Pipeline di stadi descritta da una stringa, es. "gray,blur5,sobel:l1,hist":
+ *
+ *   gray                 luminanza → piano a 1 canale
+ *   gaussN | blurN       Gauss binomiale NxN (N dispari, 1..15)   [:bordo]
+ *   boxN                 media NxN                                [:bordo]
+ *   sobel                modulo del gradiente, 1 canale   [:l2|l1|maxmin][:bordo]
+ *                        [:unfused]
+ *   expand               piano a 1 canale → layout dell'ingresso: R=G=B,
+ *                        alpha copiato dall'ingresso
+ *   hist                 istogramma/media/min/max del buffer a quel punto
+ *                        (image_stats.h), non produce un buffer
+ *
+ * bordo = replicate (default), reflect, zero o constant=V, come in sobel.h.
+ *
+ * pipeline_plan fonde gli stadi compatibili (gray seguito da sobel diventa
+ * gray_sobel_fused: una lettura dell'immagine, nessun piano intermedio; con
+ * expand subito dopo scrive direttamente il layout dell'ingresso) e
+ * assegna i buffer: l'ultimo stadio scrive nell'uscita, gli altri si
+ * alternano su al più due buffer intermedi, allocati solo se servono.
+ * Ogni stadio usa i blocchi del proprio kernel (strisce di righe per
+ * Sobel, blocchi di righe × colonne per la convoluzione). sobel:unfused
+ * lascia gray e sobel come due passate, per confrontarle con la fusa. */
+
+#define PIPE_MAX_STAGES 8
+
+typedef enum {
+    PIPE_GRAY = 0,
+    PIPE_CONV,
+    PIPE_SOBEL,
+    PIPE_GRAY_SOBEL,    /* gray + sobel fusi (+ expand) */
+    PIPE_EXPAND,
+    PIPE_HIST,
+} pipe_op_t;
+
+/* Buffer di uno stadio */
+enum { PIPE_BUF_INPUT = -1, PIPE_BUF_OUTPUT = -2 };   /* oppure 0, 1 */
+
+typedef struct {
+    pipe_op_t op;
+    sobel_mag_t mag;
+    sobel_border_t border;
+    int border_value;           /* SOBEL_BORDER_CONSTANT */
+    int unfused;                /* sobel: non fondere con il gray prima */
+    int expand;                 /* PIPE_GRAY_SOBEL: uscita nel layout
+                                 * dell'ingresso (expand fuso) */
+    conv_kernel_t kernel;       /* PIPE_CONV */
+    char name[48];              /* come scritto nella spec */
+    int in_channels, out_channels;
+    int src, dst;               /* PIPE_BUF_* o buffer intermedio 0/1 */
+} pipe_step_t;
+
+typedef struct {
+    int nsteps;
+    pipe_step_t steps[PIPE_MAX_STAGES];
+    /* dopo pipeline_plan */
+    int channels, out_channels;
+    int ntemp;                  /* buffer intermedi, 0..2 */
+    int temp_channels[2];       /* canali massimi che ciascuno deve tenere */
+    int has_hist;
+    int depth;                  /* 8 o 16 bit per campione */
+} pipeline_t;
+
+/* Stringa → stadi; 0 ok, -1 con il motivo in err */
+int pipeline_parse(const char *spec, pipeline_t *p, char *err, size_t errlen);
+
+/* Fusioni, canali e buffer per un ingresso a channels canali e depth bit
+ * (8 o 16: a 16 bit gray e sobel restano stadi separati e hist non c'è).
+ * 0 ok, -1 (es. sobel su più canali senza gray prima) con il motivo in err */
+int pipeline_plan(pipeline_t *p, int channels, int depth, char *err, size_t errlen);
+
+/* Esegue il piano: in (width*height*channels) → out
+ * (width*height*out_channels); temp[i] ha width*height*temp_channels[i]
+ * byte. hist (se la pipeline ha uno stadio hist) riceve le statistiche.
+ * 0 ok, -1 memoria. */
+int pipeline_run(const pipeline_t *p, const unsigned char *in, unsigned char *out,
+                 unsigned char *const temp[2], int width, int height,
+                 image_stats_t *hist);
+
+/* Lo stesso piano (depth 16) su campioni a 16 bit: buffer e temp in
+ * uint16_t, stessi canali. 0 ok, -1 memoria. */
+int pipeline_run_u16(const pipeline_t *p, const uint16_t *in, uint16_t *out,
+                     uint16_t *const temp[2], int width, int height);
+
+/* Righe di alone sopra e sotto che una banda deve avere perché
+ * pipeline_run sulla finestra dia le sue righe esatte: la somma degli
+ * aloni degli stadi (sobel 1, convoluzione N/2) */
+int pipeline_halo(const pipeline_t *p);
+
+/* ---- a bande (stream.h) ----
+ *
+ * Kernel di stream_process per un ingresso a 8 bit, senza hist: pipeline_run
+ * sull'intera finestra, poi solo le righe della banda. Le righe entro
+ * l'alone dai bordi della finestra escono sbagliate e vengono scartate,
+ * quelle della banda coincidono con la pipeline sull'immagine intera.
+ * ctx = pipeline_band_t con plan pianificato e il resto a zero; i buffer
+ * della finestra crescono dal pool, pipeline_band_free li rende. */
+typedef struct {
+    const pipeline_t *plan;
+    unsigned char *win_out, *temp[2];
+    size_t cap_rows;
+    double *pass_secs;          /* NULL o un tempo per passata, sommato sulle bande */
+    int passes;                 /* >= 1, ogni passata dalla finestra */
+} pipeline_band_t;
+
+int pipeline_band(void *ctx, unsigned char *win, int win_y0, int win_rows,
+                  unsigned char *out, int y0, int n,
+                  int width, int height, int channels);
+void pipeline_band_free(pipeline_band_t *b);
+
+/* Byte letti + scritti da una pipeline_run o pipeline_run_u16 (per la
+ * banda nominale) */
+double pipeline_bytes(const pipeline_t *p, int width, int height);
+
+/* Il piano su una riga, es. "gray+sobel:l1 -> hist" */
+void pipeline_describe(FILE *f, const pipeline_t *p);
+#endif
@@ -0,0 +1,92 @@
+// png_parallel.h
+#ifndef PNG_PARALLEL_H
+#define PNG_PARALLEL_H
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Encoder PNG parallelo (8 o 16 bit, 1-4 canali) al posto di stbi_write_png.
+ *
+ * Il filtraggio delle righe e il deflate girano a strisce di righe in
+ * parallelo. Ogni striscia è uno stream deflate raw che riceve i 32 KiB
+ * precedenti come dizionario, chiuso con Z_SYNC_FLUSH (l'ultima con
+ * Z_FINISH). Le strisce concatenate formano un unico stream zlib in un
+ * solo IDAT, con adler32 e crc32 ricombinati (adler32_combine, crc32_combine).
+ *
+ * level:  0     store: filtro None, blocchi non compressi (risultati intermedi)
+ *         1-5   filtro Paeth fisso, deflate al livello indicato
+ *         6-9   filtro adattivo per riga (minima somma assoluta), come stb
+ *         -1    default (3): più compatto e circa 2× più veloce di stb su foto
+ * threads: 0 = team OpenMP di default, 1 = seriale (es. dentro un pthread) */
+#define PNG_LEVEL_STORE    0
+#define PNG_LEVEL_DEFAULT (-1)
+
+/* Sotto questa soglia di byte filtrati per striscia non conviene dividere:
+ * il deflate usa al più width*height*channels / PNG_MIN_STRIP_BYTES thread */
+#define PNG_MIN_STRIP_BYTES (256 * 1024)
+
+/* PNG in un buffer nuovo (*out dal pool di buffer_pool.h, *len byte), da
+ * liberare con pool_free; 0 ok, -1 errore */
+int png_encode_parallel(const unsigned char *pixels, int width, int height,
+                        int channels, int level, int threads,
+                        unsigned char **out, size_t *len);
+
+/* Come sopra ma scrive su file; 0 ok, -1 errore */
+int png_write_parallel(const char *path, const unsigned char *pixels,
+                       int width, int height, int channels, int level,
+                       int threads);
+
+/* Le stesse a 16 bit per campione: pixels nell'ordine dei byte della
+ * macchina, portati in big-endian riga per riga durante il filtraggio */
+int png_encode_parallel16(const uint16_t *pixels, int width, int height,
+                          int channels, int level, int threads,
+                          unsigned char **out, size_t *len);
+int png_write_parallel16(const char *path, const uint16_t *pixels,
+                         int width, int height, int channels, int level,
+                         int threads);
+
+/* Scrittura a bande (8 bit) per immagini più grandi della RAM: le righe arrivano a
+ * gruppi (in ordine, height in totale) e ogni gruppo viene filtrato e
+ * compresso in parallelo come sopra, con il dizionario dalla coda del
+ * gruppo precedente. Ogni striscia diventa un chunk IDAT scritto subito:
+ * la memoria resta proporzionale al gruppo, non all'immagine. */
+typedef struct png_stream png_stream_t;
+
+/* NULL se il file non si apre o i parametri non sono validi */
+png_stream_t *png_stream_open(const char *path, int width, int height, int channels,
+                              int level, int threads);
+/* Lo stesso su uno stream già aperto (solo scritture in avanti): close
+ * fa fflush ma non lo chiude */
+png_stream_t *png_stream_fopen(FILE *f, int width, int height, int channels,
+                               int level, int threads);
+/* nrows righe contigue di width*channels byte; 0 ok, -1 errore */
+int png_stream_write_rows(png_stream_t *s, const unsigned char *rows, int nrows);
+/* IEND e chiusura; -1 se mancano righe o la scrittura è fallita. Libera s. */
+int png_stream_close(png_stream_t *s);
+
+/* Frammenti: le righe [y0, y0 + rows) di un PNG width×height compresse su
+ * una macchina, quelle di altri frammenti su altre, e ricucite senza
+ * ricomprimere. Un frammento sono solo chunk IDAT: lo stream deflate raw di
+ * quelle righe, chiuso con Z_SYNC_FLUSH (Z_FINISH se arriva a height),
+ * senza dizionario all'inizio. Concatenati in ordine fra png_stitch_head e
+ * png_stitch_tail fanno un PNG valido con gli stessi pixel di
+ * png_stream_open; cambia solo il deflate ai bordi dei frammenti.
+ *
+ * Con y0 > 0 la prima riga passata a png_stream_write_rows è la y0 - 1:
+ * serve come riga sopra per il filtro e non viene scritta. */
+png_stream_t *png_fragment_fopen(FILE *f, int width, int height, int channels,
+                                 int level, int threads, int y0, int rows);
+/* Chiude il frammento come png_stream_close (senza IEND): *adler riceve
+ * l'adler32 delle sue righe filtrate, *filtered quanti byte sono */
+int png_fragment_close(png_stream_t *s, uint32_t *adler, unsigned long long *filtered);
+
+/* Firma, IHDR e un IDAT con l'header zlib (PNG_STITCH_HEAD_BYTES byte in
+ * out), e dopo i frammenti l'IDAT con l'adler32 ricombinato dei loro n
+ * (adlers, filtered) più IEND (PNG_STITCH_TAIL_BYTES byte); level come per
+ * i frammenti. Ritornano i byte scritti. */
+#define PNG_STITCH_HEAD_BYTES 47
+#define PNG_STITCH_TAIL_BYTES 28
+size_t png_stitch_head(unsigned char *out, int width, int height, int channels, int level);
+size_t png_stitch_tail(unsigned char *out, const uint32_t *adlers,
+                       const unsigned long long *filtered, int n);
+#endif
@@ -0,0 +1,38 @@
+// row_reader.h
+#ifndef ROW_READER_H
+#define ROW_READER_H
+#include <stddef.h>
+#include <stdio.h>
+
+/* Decode a righe, in ordine dall'alto, senza mai tenere l'immagine intera.
+ *
+ *   JPEG     solo con libjpeg-turbo (make JPEG=turbo): stb non decodifica
+ *            a righe. CMYK/YCCK non supportati.
+ *   PNG      non interlacciato, tutti i tipi colore; 1/2/4/8/16 bit
+ *            (16 bit ridotti a 8, come stb). tRNS solo per la palette.
+ *   PGM/PPM  binari (P5/P6), maxval fino a 65535: 16 bit ridotti al byte
+ *            alto del campione big-endian (stb qui prende il byte basso),
+ *            maxval non riscalato come in stb.
+ *
+ * I pixel escono interleaved, 8 bit, con i canali dell'immagine (1-4).
+ * gray = 1 chiede un solo canale se il formato lo dà gratis (Y del JPEG):
+ * controllare row_reader_dims. */
+typedef struct row_reader row_reader_t;
+
+/* NULL in caso di errore, con il motivo in err */
+row_reader_t *row_reader_open(const char *path, int gray, char *err, size_t errlen);
+
+/* Lo stesso da uno stream già aperto e posizionato all'inizio
+ * dell'immagine. Si legge solo in avanti (nessun fseek): vanno bene anche
+ * pipe e fopencookie. row_reader_close non chiude f. */
+row_reader_t *row_reader_fopen(FILE *f, int gray, char *err, size_t errlen);
+
+void row_reader_dims(const row_reader_t *r, int *width, int *height, int *channels);
+
+/* Le prossime nrows righe (width*channels byte ciascuna, contigue) in dst;
+ * 0 ok, -1 se il file è troncato o corrotto (motivo in err) */
+int row_reader_read(row_reader_t *r, unsigned char *dst, int nrows,
+                    char *err, size_t errlen);
+
+void row_reader_close(row_reader_t *r);
+#endif
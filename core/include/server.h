@@ -0,0 +1,51 @@
+// server.h
+#ifndef SERVER_H
+#define SERVER_H
+#include <stdio.h>
+
+/* Modalità residente: un job per riga, campi key=value separati da TAB
+ *
+ *   in=<path>  out=<path>  [passes=N]  [threads=N|auto]  [planar=1]  [luma=1]  [level=0-9]
+ *   [raw=WxH[xC]]  [stats=1]  [perf=1]  [histogram=1]  [pipeline=stadi]  [depth=8|16]
+ *
+ * risposta su una riga: "ok <secondi_kernel>" oppure "error <messaggio>".
+ * Con stats=1: "ok <secondi_kernel> <json>", i tempi per stadio di timing.h
+ * (perf=1 aggiunge i contatori hardware, histogram=1 il campo "image" con
+ * istogramma e media/min/max per canale dell'ingresso, e implica stats=1).
+ * pipeline= è la stringa di --pipeline (pipeline.h), es. gray,sobel:l1,hist;
+ * con uno stadio hist il campo "image" è quello dello stadio. depth=8|16 come
+ * --depth (senza, auto). threads=auto sceglie il numero di thread dalla
+ * dimensione dell'immagine (autotune.h).
+ * "quit" chiude la sessione. Il processo (e il team OpenMP) resta vivo tra
+ * un job e l'altro. */
+#define SERVER_THREADS_AUTO (-1)
+
+typedef struct {
+    const char *input;
+    const char *output;
+    int passes;         /* >= 1 */
+    int threads;        /* 0 = numero di thread di default, o SERVER_THREADS_AUTO */
+    int planar;
+    int luma;           /* decode diretto in Y, kernel saltato */
+    int level;          /* compressione PNG, -1 = default */
+    const char *raw;    /* dimensioni di un ingresso raw, NULL se non lo è */
+    int stats;
+    int perf;
+    int histogram;
+    const char *pipeline;   /* NULL = kernel grayscale */
+    int depth;              /* 0 = auto, 8 o 16 (--depth) */
+} server_job_t;
+
+/* 0 = ok (secs = tempo del kernel), altrimenti err contiene il motivo.
+ * Con job->stats il handler può mettere in *stats un JSON su una riga
+ * (malloc, lo libera il server). */
+typedef int (*server_handler_fn)(const server_job_t *job, double *secs,
+                                 char **stats, char *err, size_t errlen);
+
+/* Job da in, risposte su out, fino a EOF o "quit" */
+int serve_stream(FILE *in, FILE *out, server_handler_fn handler);
+
+/* Socket Unix in ascolto su path: una connessione alla volta, ognuna è una
+ * sessione serve_stream. Ritorna solo in caso di errore. */
+int serve_unix_socket(const char *path, server_handler_fn handler);
+#endif
@@ -0,0 +1,66 @@
+#ifndef SOBEL_H
+#define SOBEL_H
+#include <stdint.h>
+
+/* Modulo del gradiente (gx, gy), sempre saturato a 255 */
+typedef enum {
+    SOBEL_MAG_L2 = 0,   /* (int)sqrt(gx² + gy²), esatto                 */
+    SOBEL_MAG_L1,       /* |gx| + |gy|                                  */
+    SOBEL_MAG_MAXMIN,   /* 15/16 max(|gx|,|gy|) + 15/32 min, err. < 7%  */
+} sobel_mag_t;
+
+/* Valore dei pixel fuori dall'immagine letti dalla finestra 3×3 */
+typedef enum {
+    SOBEL_BORDER_REPLICATE = 0, /* aaa|abcd|ddd                        */
+    SOBEL_BORDER_REFLECT,       /* cb|abcd|cb (il bordo non si ripete) */
+    SOBEL_BORDER_ZERO,          /* 000|abcd|000                        */
+    SOBEL_BORDER_CONSTANT,      /* vvv|abcd|vvv, v = border_value      */
+} sobel_border_t;
+
+/* L2 + REPLICATE: ogni pixel di dst viene scritto, bordo compreso */
+void sobel_edge(const unsigned char *src,
+                unsigned char *dst,
+                int width, int height);
+
+/* Come sobel_edge con modulo e bordo scelti. Kernel di riga SIMD
+ * (AVX2/AVX-512/NEON) con accumulatori int16; prima/ultima riga e
+ * prima/ultima colonna sono calcolate a parte, così il ciclo interno
+ * non ha rami. Ritorna 0, oppure -1 se manca memoria per la riga
+ * costante di ZERO/CONSTANT. */
+int sobel_edge_ex(const unsigned char *src,
+                  unsigned char *dst,
+                  int width, int height, sobel_mag_t mag,
+                  sobel_border_t border, unsigned char border_value);
+
+/* Una riga di uscita dalle tre righe di ingresso y-1, y, y+1: scrive
+ * out[1..width-2]. Nessun OpenMP dentro: la usa chi ha già diviso le righe. */
+void sobel_row(const unsigned char *above,
+               const unsigned char *row,
+               const unsigned char *below,
+               unsigned char *out, int width, sobel_mag_t mag);
+
+/* Come sobel_row ma scrive tutta la riga, colonne 0 e width-1 comprese.
+ * Per la prima/ultima riga above/below vanno scelte con sobel_border_index
+ * (o una riga piena di border_value se l'indice è -1). */
+void sobel_row_border(const unsigned char *above,
+                      const unsigned char *row,
+                      const unsigned char *below,
+                      unsigned char *out, int width, sobel_mag_t mag,
+                      sobel_border_t border, unsigned char border_value);
+
+/* Come sobel_edge_ex su campioni a 16 bit: accumulatori int32
+ * (|gx|, |gy| <= 4*65535), L2 in double (floor esatto), modulo saturato a
+ * 65535. Stesso bordo e stessi valori di ritorno. */
+int sobel_edge_u16(const uint16_t *src, uint16_t *dst,
+                   int width, int height, sobel_mag_t mag,
+                   sobel_border_t border, uint16_t border_value);
+
+/* In float: moduli senza saturazione né troncamento */
+int sobel_edge_f32(const float *src, float *dst,
+                   int width, int height, sobel_mag_t mag,
+                   sobel_border_t border, float border_value);
+
+/* Indice in [0, n) da leggere al posto di i secondo il bordo, oppure -1
+ * se va usato il valore costante (ZERO/CONSTANT) */
+int sobel_border_index(int i, int n, sobel_border_t border);
+#endif
@@ -0,0 +1,82 @@
+// stream.h
+#ifndef STREAM_H
+#define STREAM_H
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Elaborazione a bande per immagini che non stanno in RAM.
+ *
+ * row_reader (row_reader.h) legge al massimo band_rows righe alla volta più
+ * l'alone richiesto dal kernel (halo righe sopra e sotto la banda, es. 1
+ * per Sobel), il kernel elabora la banda in parallelo e png_stream
+ * (png_parallel.h) la comprime e la scrive subito. Tra una banda e la
+ * successiva restano in memoria solo le 2*halo righe di contesto: il picco
+ * dipende da band_rows e dalla larghezza, non dall'altezza dell'immagine. */
+
+typedef struct {
+    int halo;           /* righe di contesto sopra/sotto la banda        */
+    int out_channels;   /* canali del PNG, 0 = come l'ingresso           */
+    int in_place;       /* solo con halo 0: il kernel scrive in win, che
+                         * viene salvata così com'è (out = win)          */
+    /* win: righe [win_y0, win_y0 + win_rows) dell'ingresso, contigue,
+     * width*channels byte ciascuna (tagliate ai bordi dell'immagine);
+     * out: le n righe della banda [y0, y0 + n) con out_channels canali.
+     * 0 ok, -1 errore. */
+    int (*run)(void *ctx, unsigned char *win, int win_y0, int win_rows,
+               unsigned char *out, int y0, int n,
+               int width, int height, int channels);
+    void *ctx;
+} stream_kernel_t;
+
+typedef struct {
+    int    width, height, channels;
+    int    bands;
+    size_t peak_bytes;  /* finestra + banda d'uscita */
+    double read_secs, kernel_secs, write_secs, total_secs;
+} stream_stats_t;
+
+/* Righe per banda se band_rows <= 0 */
+#define STREAM_BAND_DEFAULT 256
+
+/* in_path → kernel a bande → out_path (PNG). gray come row_reader_open.
+ * Se out_path è lo stesso file di in_path si scrive su un temporaneo
+ * accanto, rinominato alla fine. st può essere NULL. 0 ok, -1 errore con
+ * il motivo in err. */
+int stream_process(const char *in_path, const char *out_path, int gray,
+                   int band_rows, int level, const stream_kernel_t *k,
+                   stream_stats_t *st, char *err, size_t errlen);
+
+/* Lo stesso tra due stream aperti (row_reader_fopen, png_stream_fopen),
+ * entrambi percorsi solo in avanti e lasciati aperti. Se fallisce dopo le
+ * prime bande out ha già ricevuto un PNG incompleto. */
+int stream_process_file(FILE *in, FILE *out, int gray, int band_rows, int level,
+                        const stream_kernel_t *k, stream_stats_t *st,
+                        char *err, size_t errlen);
+
+/* ---- tile: una striscia di righe dell'uscita, su un altro nodo ----
+ *
+ * Un'immagine troppo grande per una macchina si divide in tile di righe
+ * [y0, y0 + rows): ognuno riceve solo la sua finestra d'ingresso, produce
+ * un frammento di PNG (png_fragment_fopen) e i frammenti si ricuciono in
+ * ordine con png_stitch_head/png_stitch_tail, senza ricomprimere. */
+
+/* Righe d'ingresso [*win_y0, *win_y0 + *win_rows) del tile [y0, y0 + rows)
+ * di un'immagine alta height con un kernel ad alone halo: l'alone sopra e
+ * sotto più, per y0 > 0, la riga y0 - 1 (contesto del filtro PNG) */
+void stream_tile_window(int height, int y0, int rows, int halo, int *win_y0, int *win_rows);
+
+typedef struct {
+    uint32_t adler;                 /* per png_stitch_tail */
+    unsigned long long filtered;
+} stream_tile_t;
+
+/* Il tile [y0, y0 + rows) di un'immagine width×height×channels: da in le
+ * righe grezze della finestra di stream_tile_window (width*channels byte
+ * l'una, contigue, senza header), su out il frammento. k, band_rows, level
+ * e st come in stream_process_file; tile riceve adler32 e byte filtrati. */
+int stream_tile_file(FILE *in, FILE *out, int width, int height, int channels,
+                     int y0, int rows, int band_rows, int level,
+                     const stream_kernel_t *k, stream_tile_t *tile,
+                     stream_stats_t *st, char *err, size_t errlen);
+#endif
@@ -0,0 +1,64 @@
+// timing.h
+#ifndef TIMING_H
+#define TIMING_H
+#include <stdint.h>
+#include <stdio.h>
+#include "image_stats.h"
+
+/* Tempi per stadio di un job decode → kernel → encode, contatori hardware
+ * opzionali (perf_event) e banda ottenuta, in JSON o CSV. */
+
+typedef enum {
+    STAGE_DECODE = 0,
+    STAGE_THREADS,      /* avvio/risveglio del team OpenMP */
+    STAGE_ALLOC,        /* buffer di uscita (piano --planar) */
+    STAGE_KERNEL,       /* tutte le passate */
+    STAGE_ENCODE,
+    STAGE_COUNT
+} stage_id_t;
+
+typedef struct {
+    int available;      /* 0: perf_event non disponibile (permessi, VM, ...) */
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t llc_misses;
+} perf_counts_t;
+
+typedef struct {
+    double secs[STAGE_COUNT];
+    double total;           /* dall'inizio del decode alla fine dell'encode */
+    double *pass_secs;      /* passes elementi, di malloc (timing_report_free) */
+    int passes;
+    int threads;
+    int width, height, channels;
+    int depth;              /* bit per campione: 8 o 16 */
+    double kernel_bytes;    /* traffico nominale lettura+scrittura, tutte le passate */
+    double mem_bw_gbps;     /* banda di riferimento, 0 = non misurata */
+    perf_counts_t perf;     /* solo durante il kernel */
+    image_stats_t *image;   /* istogramma dell'ingresso (malloc), NULL = non chiesto */
+} timing_report_t;
+
+double timing_now(void);
+
+/* Azzera il report e alloca pass_secs; 0 ok, -1 memoria.
+ * timing_report_free libera anche image */
+int timing_report_init(timing_report_t *r, int passes);
+void timing_report_free(timing_report_t *r);
+
+/* Contatori cycles/instructions/LLC miss aperti su ogni thread del team
+ * OpenMP (stessa dimensione del kernel che segue), in user space. Ritorna
+ * NULL se perf_event_open non è permesso: perf_end lascia available = 0. */
+typedef struct perf_session perf_session_t;
+perf_session_t *perf_begin(void);
+void perf_end(perf_session_t *s, perf_counts_t *out);
+
+/* Copia parallela su buffer ben oltre la LLC, miglior tempo di 3:
+ * banda di memoria sostenibile in GB/s (calcolata una volta, poi in cache) */
+double timing_memory_bandwidth(void);
+
+/* Una riga ciascuna; input è il file di partenza. Il JSON include
+ * "image" (image_stats_print_json) se r->image c'è, il CSV no */
+void timing_csv_header(FILE *f);
+void timing_print_csv(FILE *f, const timing_report_t *r, const char *input);
+void timing_print_json(FILE *f, const timing_report_t *r, const char *input);
+#endif
@@ -0,0 +1,9 @@
+// version.h
+#ifndef VERSION_H
+#define VERSION_H
+/* Versione del core, da core/VERSION: il Makefile la passa con -DGS_VERSION.
+ * La maggiore cambia quando cambia l'ABI di libgrayscale.so (soname). */
+#ifndef GS_VERSION
+#define GS_VERSION "dev"
+#endif
+#endif
@@ -0,0 +1,127 @@
+// affinity.c
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <omp.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#include "affinity.h"
+#include "buffer_pool.h"
+
+/* -1 = non ancora letto dall'ambiente */
+static int first_touch = -1;
+
+int affinity_first_touch(void)
+{
+    if (first_touch < 0) {
+        const char *env = getenv("GRAYSCALE_FIRST_TOUCH");
+        first_touch = env && *env && strcmp(env, "0") != 0;
+    }
+    return first_touch;
+}
+
+void affinity_set_first_touch(int on)
+{
+    first_touch = on != 0;
+}
+
+/* ---- buffer ---- */
+
+void *affinity_alloc_rows(size_t row_bytes, int rows)
+{
+    const size_t total = row_bytes * (size_t)(rows > 0 ? rows : 0);
+    int fresh = 0;
+    void *p = pool_alloc_fresh(total, &fresh);
+    /* un blocco riusato è già stato toccato: dallo stesso schedule del
+     * job precedente, se il first touch era attivo */
+    if (!p || !fresh || !affinity_first_touch())
+        return p;
+
+    /* stessa partizione delle righe dei kernel: schedule(static) */
+    unsigned char *b = p;
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < rows; y++)
+        memset(b + (size_t)y * row_bytes, 0, row_bytes);
+    return p;
+}
+
+unsigned char *affinity_adopt_rows(unsigned char *src, size_t row_bytes, int rows)
+{
+    if (!affinity_first_touch())
+        return src;
+
+    unsigned char *dst = pool_alloc(row_bytes * (size_t)(rows > 0 ? rows : 0));
+    if (!dst)
+        return NULL;
+
+    /* la copia stessa è il first touch (per un blocco nuovo) */
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < rows; y++)
+        memcpy(dst + (size_t)y * row_bytes, src + (size_t)y * row_bytes, row_bytes);
+    return dst;
+}
+
+/* ---- binding ---- */
+
+static int env_differs(const char *name, const char *want)
+{
+    if (!want) return 0;
+    const char *cur = getenv(name);
+    return !cur || strcmp(cur, want) != 0;
+}
+
+int affinity_apply(char **argv, const char *bind, const char *places)
+{
+    if (!env_differs("OMP_PROC_BIND", bind) && !env_differs("OMP_PLACES", places))
+        return 0;
+    if (bind)   setenv("OMP_PROC_BIND", bind, 1);
+    if (places) setenv("OMP_PLACES", places, 1);
+    fflush(NULL);
+    /* al secondo avvio l'ambiente coincide e si prosegue */
+    execv("/proc/self/exe", argv);
+    execvp(argv[0], argv);
+    return -1;
+}
+
+static const char *bind_name(omp_proc_bind_t b)
+{
+    switch (b) {
+    case omp_proc_bind_false:  return "false";
+    case omp_proc_bind_true:   return "true";
+    case omp_proc_bind_master: return "master";
+    case omp_proc_bind_close:  return "close";
+    case omp_proc_bind_spread: return "spread";
+    default:                   return "?";
+    }
+}
+
+void affinity_report(FILE *f)
+{
+    const char *places = getenv("OMP_PLACES");
+    fprintf(f, "OMP_PROC_BIND=%s OMP_PLACES=%s (%d place), first touch %s\n",
+            bind_name(omp_get_proc_bind()), places ? places : "(default)",
+            omp_get_num_places(), affinity_first_touch() ? "parallelo" : "spento");
+
+    const int n = omp_get_max_threads();
+    int *cpu = malloc(2 * n * sizeof *cpu);
+    if (!cpu) return;
+    int *node = cpu + n;
+    #pragma omp parallel num_threads(n)
+    {
+        const int t = omp_get_thread_num();
+        unsigned c = 0, nd = 0;
+#ifdef __linux__
+        if (syscall(SYS_getcpu, &c, &nd, NULL) != 0) c = nd = (unsigned)-1;
+#else
+        c = nd = (unsigned)-1;
+#endif
+        cpu[t] = (int)c;
+        node[t] = (int)nd;
+    }
+    for (int t = 0; t < n; t++)
+        fprintf(f, "  thread %2d → cpu %d, nodo %d\n", t, cpu[t], node[t]);
+    free(cpu);
+}
@@ -0,0 +1,268 @@
+// autotune.c
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <omp.h>
+#include "autotune.h"
+#include "buffer_pool.h"
+#include "gray_sobel.h"
+#include "parallel_to_grayscale.h"
+#include "png_parallel.h"
+
+/* 1.5 MiB RGB: oltre la L2, come le immagini vere; il PNG su metà righe */
+#define CAL_W 1024
+#define CAL_H 512
+#define CAL_RUNS 3
+/* risvegli del team misurati, ognuno dopo una pausa da job a job */
+#define CAL_WAKEUPS 20
+#define CAL_PAUSE_NS 2000000L
+
+static const char *const KEYS[TUNE_KERNELS] = {
+    "gray_mbps", "luma_mbps", "sobel_mbps", "png_mbps",
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int tune_max_threads(void)
+{
+    /* OMP_NUM_THREADS può essere una lista per livello: conta il primo */
+    const char *env = getenv("OMP_NUM_THREADS");
+    const int n = env ? atoi(env) : 0;
+    return n > 0 ? n : omp_get_num_procs();
+}
+
+/* ---- calibrazione ---- */
+
+/* miglior tempo di CAL_RUNS esecuzioni di k su un core, dopo una di riscaldamento */
+static double time_kernel(tune_kernel_t k, unsigned char *img, unsigned char *work,
+                          unsigned char *plane)
+{
+    const size_t bytes = (size_t)CAL_W * CAL_H * 3;
+    double best = 0;
+    for (int r = 0; r <= CAL_RUNS; ++r) {
+        memcpy(work, img, bytes);
+        unsigned char *png = NULL;
+        size_t len;
+        const double t0 = now();
+        switch (k) {
+        case TUNE_GRAY:
+            convert_to_grayscale(work, CAL_W, CAL_H, 3);
+            break;
+        case TUNE_LUMA:
+            rgb_to_luma_plane(work, plane, CAL_W, CAL_H, 3);
+            break;
+        case TUNE_SOBEL:
+            gray_sobel_fused(work, plane, CAL_W, CAL_H, 3, 1, SOBEL_MAG_L2,
+                             SOBEL_BORDER_REPLICATE, 0);
+            break;
+        default:
+            png_encode_parallel(work, CAL_W, CAL_H / 2, 3, -1, 1, &png, &len);
+            break;
+        }
+        const double dt = now() - t0;
+        pool_free(png);
+        if (r > 0 && (best == 0 || dt < best))
+            best = dt;
+    }
+    return best;
+}
+
+void tune_calibrate(tune_profile_t *p)
+{
+    memset(p, 0, sizeof *p);
+    p->max_threads = tune_max_threads();
+
+    /* foto sintetica: gradiente + rumore, né piatta né incomprimibile */
+    const size_t bytes = (size_t)CAL_W * CAL_H * 3;
+    unsigned char *img = pool_alloc(bytes), *work = pool_alloc(bytes);
+    unsigned char *plane = pool_alloc((size_t)CAL_W * CAL_H);
+    if (img && work && plane) {
+        unsigned seed = 12345;
+        for (int y = 0; y < CAL_H; ++y)
+            for (int x = 0; x < CAL_W; ++x)
+                for (int c = 0; c < 3; ++c) {
+                    seed = seed * 1103515245u + 12345u;
+                    img[((size_t)y * CAL_W + x) * 3 + c] =
+                        (unsigned char)((x / 4 + y / 2 + 60 * c + (seed >> 28)) & 0xFF);
+                }
+
+        /* nthreads-var è per thread: ripristinato alla fine */
+        const int saved = omp_get_max_threads();
+        omp_set_num_threads(1);
+        for (int k = 0; k < TUNE_KERNELS; ++k) {
+            const double secs = time_kernel(k, img, work, plane);
+            const double in = k == TUNE_PNG ? bytes / 2.0 : (double)bytes;
+            p->core_bps[k] = secs > 0 ? in / secs : 0;
+        }
+        omp_set_num_threads(saved);
+    }
+    pool_free(img);
+    pool_free(work);
+    pool_free(plane);
+
+    /* tra un job e l'altro i thread del team dormono: si misura il
+     * risveglio dopo una pausa, non una regione dietro l'altra */
+    if (p->max_threads > 1) {
+        const struct timespec pause = { 0, CAL_PAUSE_NS };
+        double total = 0;
+        int joined = 0;     /* una regione vuota il compilatore la toglie */
+        #pragma omp parallel num_threads(p->max_threads)
+        {
+            #pragma omp atomic
+            joined++;
+        }
+        for (int i = 0; i < CAL_WAKEUPS; ++i) {
+            nanosleep(&pause, NULL);
+            const double t0 = now();
+            #pragma omp parallel num_threads(p->max_threads)
+            {
+                #pragma omp atomic
+                joined++;
+            }
+            total += now() - t0;
+        }
+        p->team_secs = total / CAL_WAKEUPS / p->max_threads;
+    }
+}
+
+/* ---- profilo su file ---- */
+
+int tune_load(const char *path, tune_profile_t *p)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return -1;
+    memset(p, 0, sizeof *p);
+    p->team_secs = -1;
+    char line[128], key[64];
+    double v;
+    while (fgets(line, sizeof line, f)) {
+        if (line[0] == '#' || sscanf(line, "%63s %lf", key, &v) != 2)
+            continue;
+        if (!strcmp(key, "max_threads"))
+            p->max_threads = (int)v;
+        else if (!strcmp(key, "team_us"))
+            p->team_secs = v / 1e6;
+        for (int k = 0; k < TUNE_KERNELS; ++k)
+            if (!strcmp(key, KEYS[k]))
+                p->core_bps[k] = v * 1e6;
+    }
+    fclose(f);
+    int ok = p->max_threads > 0 && p->team_secs >= 0;
+    for (int k = 0; k < TUNE_KERNELS; ++k)
+        ok = ok && p->core_bps[k] > 0;
+    return ok ? 0 : -1;
+}
+
+int tune_save(const char *path, const tune_profile_t *p)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return -1;
+    fprintf(f, "# profilo di autotune.h: throughput di un core e costo del team\n");
+    fprintf(f, "max_threads %d\n", p->max_threads);
+    fprintf(f, "team_us %.3f\n", p->team_secs * 1e6);
+    for (int k = 0; k < TUNE_KERNELS; ++k)
+        fprintf(f, "%s %.1f\n", KEYS[k], p->core_bps[k] / 1e6);
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+/* ---- profilo del processo ---- */
+
+static tune_profile_t profile;
+static pthread_once_t profile_once = PTHREAD_ONCE_INIT;
+
+static void profile_init(void)
+{
+    const char *path = getenv("GRAYSCALE_TUNE_PROFILE");
+    if (path && *path && tune_load(path, &profile) == 0 &&
+        profile.max_threads == tune_max_threads())
+        return;
+    tune_calibrate(&profile);
+    if (path && *path && tune_save(path, &profile) != 0)
+        fprintf(stderr, "autotune: impossibile salvare il profilo in \"%s\"\n", path);
+}
+
+const tune_profile_t *tune_profile(void)
+{
+    pthread_once(&profile_once, profile_init);
+    return &profile;
+}
+
+double tune_cost(tune_kernel_t k, size_t bytes)
+{
+    const double bps = tune_profile()->core_bps[k];
+    return bps > 0 ? bytes / bps : 0;
+}
+
+int tune_threads(double serial_secs, int max_threads)
+{
+    if (max_threads <= 0)
+        max_threads = tune_max_threads();
+    const double c = tune_profile()->team_secs;
+    int best = 1;
+    double best_secs = serial_secs;
+    for (int t = 2; t <= max_threads; ++t) {
+        const double secs = serial_secs / t + t * c;
+        if (secs < best_secs) {
+            best_secs = secs;
+            best = t;
+        }
+    }
+    return best;
+}
+
+int tune_png_threads(size_t bytes, int max_threads)
+{
+    /* oltre una striscia per thread il deflate non si divide */
+    const size_t strips = bytes / PNG_MIN_STRIP_BYTES;
+    const int t = tune_threads(tune_cost(TUNE_PNG, bytes), max_threads);
+    if ((size_t)t <= strips)
+        return t;
+    return strips > 0 ? (int)strips : 1;
+}
+
+double tune_pipeline_cost(const pipeline_t *p, size_t px)
+{
+    double secs = 0;
+    for (int i = 0; i < p->nsteps; ++i) {
+        const pipe_step_t *s = &p->steps[i];
+        const size_t bytes = px * s->in_channels;
+        if (s->op == PIPE_GRAY)
+            secs += tune_cost(TUNE_LUMA, bytes);
+        else if (s->op == PIPE_CONV)
+            secs += tune_cost(TUNE_SOBEL, bytes) * s->kernel.size * s->kernel.size / 9.0;
+        else if (s->op != PIPE_HIST)
+            secs += tune_cost(TUNE_SOBEL, bytes);
+    }
+    return secs;
+}
+
+int tune_image_threads(int width, int height, int channels, const pipeline_t *p,
+                       int planar, int max_threads)
+{
+    const size_t px = (size_t)width * height;
+    double kernel;
+    int out_channels = channels;
+    if (p) {
+        kernel = tune_pipeline_cost(p, px);
+        out_channels = p->out_channels;
+    } else if (planar) {
+        kernel = tune_cost(TUNE_LUMA, px * channels);
+        out_channels = 1;
+    } else {
+        kernel = tune_cost(TUNE_GRAY, px * channels);
+    }
+    const int k = tune_threads(kernel, max_threads);
+    const int e = tune_png_threads(px * out_channels, max_threads);
+    return k > e ? k : e;
+}
@@ -0,0 +1,505 @@
+// batch.c
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <glob.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "batch.h"
+#include "image_load.h"
+#include "affinity.h"
+#include "buffer_pool.h"
+#include "parallel_to_grayscale.h"
+#include "png_parallel.h"
+
+/* Immagini in volo per coda: limita la memoria a pochi frame decodificati */
+#define BATCH_QUEUE_CAP 2
+
+/* ---- elenco dei job ---- */
+
+typedef struct {
+    char *input;
+    char *output;
+    int named;              /* output esplicito dal manifest */
+} batch_job_t;
+
+typedef struct {
+    batch_job_t *jobs;
+    int count, cap;
+} job_list_t;
+
+static const char *image_exts[] = {
+    "jpg", "jpeg", "png", "bmp", "tga", "gif", "psd", "hdr", "pic",
+    "pnm", "ppm", "pgm", NULL
+};
+
+static int has_image_ext(const char *path)
+{
+    const char *dot = strrchr(path, '.');
+    if (!dot || strchr(dot, '/')) return 0;
+    for (const char **e = image_exts; *e; ++e)
+        if (!strcasecmp(dot + 1, *e)) return 1;
+    return 0;
+}
+
+/* <out_dir>/<basename senza estensione>.png, o con l'estensione se keep_ext */
+static char *default_output(const char *input, const char *out_dir, int keep_ext)
+{
+    const char *base = strrchr(input, '/');
+    base = base ? base + 1 : input;
+    const char *dot = strrchr(base, '.');
+    size_t stem = dot && dot != base && !keep_ext ? (size_t)(dot - base) : strlen(base);
+    size_t len = strlen(out_dir) + 1 + stem + sizeof ".png";
+    char *out = malloc(len);
+    if (out)
+        snprintf(out, len, "%s/%.*s.png", out_dir, (int)stem, base);
+    return out;
+}
+
+static int add_job(job_list_t *list, const char *input, const char *output,
+                   const char *out_dir)
+{
+    if (list->count == list->cap) {
+        int cap = list->cap ? list->cap * 2 : 64;
+        batch_job_t *jobs = realloc(list->jobs, cap * sizeof *jobs);
+        if (!jobs) return -1;
+        list->jobs = jobs;
+        list->cap = cap;
+    }
+    batch_job_t *job = &list->jobs[list->count];
+    job->input = strdup(input);
+    job->output = output ? strdup(output) : default_output(input, out_dir, 0);
+    job->named = output != NULL;
+    if (!job->input || !job->output) {
+        free(job->input);
+        free(job->output);
+        return -1;
+    }
+    list->count++;
+    return 0;
+}
+
+static void free_jobs(job_list_t *list)
+{
+    for (int i = 0; i < list->count; ++i) {
+        free(list->jobs[i].input);
+        free(list->jobs[i].output);
+    }
+    free(list->jobs);
+}
+
+static int cmp_output(const void *a, const void *b)
+{
+    return strcmp((*(batch_job_t *const *)a)->output, (*(batch_job_t *const *)b)->output);
+}
+
+/* Due input con lo stesso nome a meno dell'estensione (a.jpg, a.png)
+ * finirebbero sullo stesso <out_dir>/a.png: gli output impliciti in
+ * conflitto tengono l'estensione (a.jpg.png). Un conflitto che resta,
+ * p.es. tra output espliciti del manifest, è un errore */
+static int unique_outputs(job_list_t *list, const char *out_dir)
+{
+    if (list->count < 2) return 0;
+    batch_job_t **by = malloc(list->count * sizeof *by);
+    char *clash = calloc(list->count, 1);
+    int rc = -1;
+    if (!by || !clash) goto done;
+    for (int i = 0; i < list->count; ++i)
+        by[i] = &list->jobs[i];
+    qsort(by, list->count, sizeof *by, cmp_output);
+    for (int i = 1; i < list->count; ++i)
+        if (!strcmp(by[i - 1]->output, by[i]->output))
+            clash[by[i - 1] - list->jobs] = clash[by[i] - list->jobs] = 1;
+    for (int i = 0; i < list->count; ++i) {
+        batch_job_t *job = &list->jobs[i];
+        if (!clash[i] || job->named) continue;
+        char *out = default_output(job->input, out_dir, 1);
+        if (!out) goto done;
+        free(job->output);
+        job->output = out;
+    }
+    for (int i = 0; i < list->count; ++i)
+        by[i] = &list->jobs[i];
+    qsort(by, list->count, sizeof *by, cmp_output);
+    for (int i = 1; i < list->count; ++i)
+        if (!strcmp(by[i - 1]->output, by[i]->output)) {
+            const batch_job_t *a = by[i - 1] < by[i] ? by[i - 1] : by[i];
+            const batch_job_t *b = by[i - 1] < by[i] ? by[i] : by[i - 1];
+            fprintf(stderr, "\"%s\" e \"%s\" scriverebbero entrambi su \"%s\"\n",
+                    a->input, b->input, a->output);
+            goto done;
+        }
+    rc = 0;
+done:
+    free(by);
+    free(clash);
+    return rc;
+}
+
+static int collect_glob(const char *pattern, int filter_ext, const char *out_dir,
+                        job_list_t *list)
+{
+    glob_t g;
+    int rc = glob(pattern, 0, NULL, &g);
+    if (rc == GLOB_NOMATCH) return 0;
+    if (rc != 0) {
+        fprintf(stderr, "Errore espandendo \"%s\"\n", pattern);
+        return -1;
+    }
+    for (size_t i = 0; i < g.gl_pathc; ++i) {
+        if (filter_ext && !has_image_ext(g.gl_pathv[i])) continue;
+        if (add_job(list, g.gl_pathv[i], NULL, out_dir) != 0) {
+            globfree(&g);
+            return -1;
+        }
+    }
+    globfree(&g);
+    return 0;
+}
+
+static int collect_manifest(const char *path, const char *out_dir, job_list_t *list)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Errore aprendo il manifest \"%s\": %s\n", path, strerror(errno));
+        return -1;
+    }
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    int rc = 0;
+    while (rc == 0 && (len = getline(&line, &cap, f)) >= 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        if (len == 0 || line[0] == '#') continue;
+        char *tab = strchr(line, '\t');
+        if (tab) *tab = '\0';
+        rc = add_job(list, line, tab && tab[1] ? tab + 1 : NULL, out_dir);
+    }
+    free(line);
+    fclose(f);
+    return rc;
+}
+
+static int collect_jobs(const char *spec, const char *out_dir, job_list_t *list)
+{
+    struct stat st;
+    if (stat(spec, &st) == 0 && S_ISDIR(st.st_mode)) {
+        size_t len = strlen(spec) + 3;
+        char *pattern = malloc(len);
+        if (!pattern) return -1;
+        snprintf(pattern, len, "%s/*", spec);
+        int rc = collect_glob(pattern, 1, out_dir, list);
+        free(pattern);
+        return rc;
+    }
+    if (strpbrk(spec, "*?["))
+        return collect_glob(spec, 0, out_dir, list);
+    return collect_manifest(spec, out_dir, list);
+}
+
+/* ---- coda limitata produttore/consumatore ---- */
+
+typedef struct {
+    int job;
+    int width, height, channels;
+    unsigned char *data;    /* da image_load */
+    unsigned char *plane;   /* --planar o --pipeline */
+    int plane_channels;
+} batch_item_t;
+
+typedef struct {
+    batch_item_t *items[BATCH_QUEUE_CAP];
+    int head, count;
+    int producers;          /* chiusa quando arriva a 0 */
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty, not_full;
+} bqueue_t;
+
+static void bqueue_init(bqueue_t *q, int producers)
+{
+    memset(q, 0, sizeof *q);
+    q->producers = producers;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+}
+
+static void bqueue_destroy(bqueue_t *q)
+{
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+}
+
+static void bqueue_push(bqueue_t *q, batch_item_t *it)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->count == BATCH_QUEUE_CAP)
+        pthread_cond_wait(&q->not_full, &q->lock);
+    q->items[(q->head + q->count++) % BATCH_QUEUE_CAP] = it;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* NULL quando la coda è vuota e tutti i produttori hanno finito */
+static batch_item_t *bqueue_pop(bqueue_t *q)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && q->producers > 0)
+        pthread_cond_wait(&q->not_empty, &q->lock);
+    batch_item_t *it = NULL;
+    if (q->count > 0) {
+        it = q->items[q->head];
+        q->head = (q->head + 1) % BATCH_QUEUE_CAP;
+        q->count--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return it;
+}
+
+static void bqueue_producer_done(bqueue_t *q)
+{
+    pthread_mutex_lock(&q->lock);
+    if (--q->producers == 0)
+        pthread_cond_broadcast(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* ---- stadi della pipeline ---- */
+
+typedef struct {
+    const job_list_t *list;
+    const batch_opts_t *opts;
+    atomic_int next_job;
+    atomic_int failed;
+    bqueue_t decoded;       /* decode -> kernel */
+    bqueue_t computed;      /* kernel -> encode */
+} batch_run_t;
+
+static void free_item(batch_item_t *it)
+{
+    image_free(it->data);
+    pool_free(it->plane);
+    free(it);
+}
+
+static void *decode_stage(void *arg)
+{
+    batch_run_t *pl = arg;
+    int j;
+    while ((j = atomic_fetch_add(&pl->next_job, 1)) < pl->list->count) {
+        const char *in = pl->list->jobs[j].input;
+        batch_item_t *it = calloc(1, sizeof *it);
+        if (!it) {
+            fprintf(stderr, "Impossibile allocare il job per \"%s\"\n", in);
+            atomic_fetch_add(&pl->failed, 1);
+            continue;
+        }
+        it->job = j;
+        it->channels = 1;
+        it->data = pl->opts->luma
+            ? image_load_luma(in, &it->width, &it->height)
+            : image_load(in, &it->width, &it->height, &it->channels);
+        if (!it->data) {
+            fprintf(stderr, "Errore caricando immagine \"%s\": %s\n", in,
+                    image_failure_reason());
+            atomic_fetch_add(&pl->failed, 1);
+            free(it);
+            continue;
+        }
+        bqueue_push(&pl->decoded, it);
+    }
+    bqueue_producer_done(&pl->decoded);
+    return NULL;
+}
+
+static void *encode_stage(void *arg)
+{
+    batch_run_t *pl = arg;
+    batch_item_t *it;
+    while ((it = bqueue_pop(&pl->computed))) {
+        const char *out = pl->list->jobs[it->job].output;
+        /* seriale: il parallelismo qui viene dagli io_threads */
+        int rc = it->plane
+            ? png_write_parallel(out, it->plane, it->width, it->height,
+                                 it->plane_channels, pl->opts->level, 1)
+            : png_write_parallel(out, it->data, it->width, it->height, it->channels,
+                                 pl->opts->level, 1);
+        if (rc != 0) {
+            fprintf(stderr, "Errore nel salvataggio di \"%s\"\n", out);
+            atomic_fetch_add(&pl->failed, 1);
+        }
+        free_item(it);
+    }
+    return NULL;
+}
+
+static double elapsed(const struct timespec *t0, const struct timespec *t1)
+{
+    return (t1->tv_sec - t0->tv_sec) + (t1->tv_nsec - t0->tv_nsec) / 1e9;
+}
+
+int run_batch(const char *spec, const char *out_dir, const batch_opts_t *opts,
+              batch_stats_t *stats)
+{
+    memset(stats, 0, sizeof *stats);
+
+    struct stat st;
+    if (stat(out_dir, &st) == 0) {
+        if (!S_ISDIR(st.st_mode)) {
+            fprintf(stderr, "\"%s\" non è una directory\n", out_dir);
+            return -1;
+        }
+    } else if (mkdir(out_dir, 0777) != 0) {
+        fprintf(stderr, "Impossibile creare \"%s\": %s\n", out_dir, strerror(errno));
+        return -1;
+    }
+
+    job_list_t list = {0};
+    if (collect_jobs(spec, out_dir, &list) != 0 || unique_outputs(&list, out_dir) != 0) {
+        free_jobs(&list);
+        return -1;
+    }
+    stats->images = list.count;
+
+    int io = opts->io_threads > 0 ? opts->io_threads : 1;
+    batch_run_t pl = { .list = &list, .opts = opts };
+    atomic_init(&pl.next_job, 0);
+    atomic_init(&pl.failed, 0);
+    bqueue_init(&pl.decoded, io);
+    bqueue_init(&pl.computed, 1);
+
+    pthread_t *tids = malloc(2 * io * sizeof *tids);
+    if (!tids) {
+        free_jobs(&list);
+        return -1;
+    }
+
+    struct timespec t0, t1, k0, k1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int decoders = 0, encoders = 0, err = 0;
+    while (decoders < io && err == 0) {
+        if ((err = pthread_create(&tids[decoders], NULL, decode_stage, &pl)) != 0) break;
+        decoders++;
+        if ((err = pthread_create(&tids[io + encoders], NULL, encode_stage, &pl)) != 0) break;
+        encoders++;
+    }
+    if (err != 0) {
+        /* ferma i thread già partiti: niente più job, code chiuse */
+        fprintf(stderr, "Impossibile avviare i thread del batch: %s\n", strerror(err));
+        atomic_store(&pl.next_job, list.count);
+        for (int i = decoders; i < io; ++i)
+            bqueue_producer_done(&pl.decoded);
+        batch_item_t *it;
+        while ((it = bqueue_pop(&pl.decoded)))
+            free_item(it);
+        bqueue_producer_done(&pl.computed);
+        for (int i = 0; i < decoders; ++i)
+            pthread_join(tids[i], NULL);
+        for (int i = 0; i < encoders; ++i)
+            pthread_join(tids[io + i], NULL);
+        free(tids);
+        bqueue_destroy(&pl.decoded);
+        bqueue_destroy(&pl.computed);
+        free_jobs(&list);
+        return -1;
+    }
+
+    /* stadio kernel: thread chiamante, team OpenMP di default.
+     * Con luma il decode ha già prodotto il piano Y: nessuna passata, a
+     * meno che la pipeline non parta da lì */
+    const int passes = opts->luma && !opts->pipe ? 0 : opts->passes;
+    batch_item_t *it;
+    while ((it = bqueue_pop(&pl.decoded))) {
+        /* first touch (se attivo) dal team del kernel, non dal decoder */
+        unsigned char *local = affinity_adopt_rows(it->data, (size_t)it->width * it->channels,
+                                                   it->height);
+        if (!local) {
+            fprintf(stderr, "Impossibile allocare il buffer per \"%s\"\n",
+                    list.jobs[it->job].input);
+            atomic_fetch_add(&pl.failed, 1);
+            free_item(it);
+            continue;
+        }
+        if (local != it->data) {
+            image_free(it->data);
+            it->data = local;
+        }
+        /* la pipeline si pianifica sui canali di ogni immagine */
+        pipeline_t plan;
+        unsigned char *temp[2] = {NULL, NULL};
+        if (opts->pipe) {
+            char why[256];
+            plan = *opts->pipe;
+            if (pipeline_plan(&plan, it->channels, 8, why, sizeof why) != 0) {
+                fprintf(stderr, "Pipeline per \"%s\": %s\n", list.jobs[it->job].input, why);
+                atomic_fetch_add(&pl.failed, 1);
+                free_item(it);
+                continue;
+            }
+        }
+        if (opts->pipe || (opts->planar && !opts->luma)) {
+            it->plane_channels = opts->pipe ? plan.out_channels : 1;
+            it->plane = affinity_alloc_rows((size_t)it->width * it->plane_channels,
+                                            it->height);
+            for (int i = 0; opts->pipe && i < plan.ntemp; ++i)
+                temp[i] = affinity_alloc_rows((size_t)it->width * plan.temp_channels[i],
+                                              it->height);
+            if (!it->plane || (opts->pipe && plan.ntemp > 0 && !temp[0]) ||
+                (opts->pipe && plan.ntemp > 1 && !temp[1])) {
+                fprintf(stderr, "Impossibile allocare il piano di luminanza per \"%s\"\n",
+                        list.jobs[it->job].input);
+                atomic_fetch_add(&pl.failed, 1);
+                pool_free(temp[0]); pool_free(temp[1]);
+                free_item(it);
+                continue;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &k0);
+        int prc = 0;
+        for (int p = 0; p < passes && prc == 0; ++p) {
+            if (opts->pipe)
+                prc = pipeline_run(&plan, it->data, it->plane, temp, it->width,
+                                   it->height, NULL);
+            else if (opts->planar)
+                rgb_to_luma_plane(it->data, it->plane, it->width, it->height, it->channels);
+            else
+                convert_to_grayscale(it->data, it->width, it->height, it->channels);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &k1);
+        pool_free(temp[0]);
+        pool_free(temp[1]);
+        if (prc != 0) {
+            fprintf(stderr, "Pipeline per \"%s\": memoria esaurita\n",
+                    list.jobs[it->job].input);
+            atomic_fetch_add(&pl.failed, 1);
+            free_item(it);
+            continue;
+        }
+        stats->kernel_secs += elapsed(&k0, &k1);
+        stats->mpixels += (double)it->width * it->height / 1e6;
+        bqueue_push(&pl.computed, it);
+    }
+    bqueue_producer_done(&pl.computed);
+
+    for (int i = 0; i < 2 * io; ++i)
+        pthread_join(tids[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    stats->wall_secs = elapsed(&t0, &t1);
+    stats->failed = atomic_load(&pl.failed);
+
+    free(tids);
+    bqueue_destroy(&pl.decoded);
+    bqueue_destroy(&pl.computed);
+    free_jobs(&list);
+    return 0;
+}
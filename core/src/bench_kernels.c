@@ -0,0 +1,503 @@
+// bench_kernels.c
+// Micro-benchmark dei soli kernel su buffer sintetici: niente decode/encode,
+// niente avvio del processo nei tempi. Una riga CSV per kernel × ISA × thread.
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <omp.h>
+#include "parallel_to_grayscale.h"
+#include "sobel.h"
+#include "gray_sobel.h"
+#include "convolution.h"
+#include "cpu_features.h"
+#include "timing.h"
+
+#define MAX_THREAD_COUNTS 64
+#define MAX_ISAS 4
+
+typedef enum {
+    K_GRAY_INPLACE = 0,
+    K_GRAY_PLANAR,
+    K_SOBEL_L2,
+    K_SOBEL_L1,
+    K_SOBEL_MAXMIN,
+    K_FUSED,
+    K_GAUSS5,
+    K_GRAY_U16,         /* planar, campioni a 16 bit */
+    K_SOBEL_U16,
+    K_GRAY_F32,
+    K_SOBEL_F32,
+    K_COUNT
+} kernel_id_t;
+
+static const char *kernel_names[K_COUNT] = {
+    "gray_inplace", "gray_planar", "sobel_l2", "sobel_l1", "sobel_maxmin", "fused",
+    "gauss5", "gray_u16", "sobel_u16", "gray_f32", "sobel_f32"
+};
+
+typedef struct {
+    int width, height, channels;
+    unsigned char *rgb;     /* sorgente intatta */
+    unsigned char *work;    /* copia per il kernel in-place */
+    unsigned char *plane;   /* luminanza: ingresso di Sobel, uscita di gray_planar */
+    unsigned char *edges;   /* uscita di Sobel / fused */
+    /* stessi tre buffer a 16 bit e in float, solo se quei kernel girano */
+    uint16_t *rgb16, *plane16, *edges16;
+    float *rgbf, *planef, *edgesf;
+} buffers_t;
+
+/* ---- buffer sintetici ---- */
+
+static unsigned char *alloc_buf(size_t n)
+{
+    /* multiplo di 64 per aligned_alloc */
+    return aligned_alloc(64, (n + 63) & ~(size_t)63);
+}
+
+/* Gradiente + rumore deterministico: contenuto "da foto" per Sobel.
+ * Riempito con lo stesso schedule dei kernel (first touch). */
+static void fill_synthetic(unsigned char *p, int width, int height, int channels)
+{
+    const long stride = (long)width * channels;
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++) {
+        unsigned int s = 2463534242u ^ (unsigned int)y * 2654435761u;
+        unsigned char *row = p + y * stride;
+        for (long i = 0; i < stride; i++) {
+            s ^= s << 13; s ^= s >> 17; s ^= s << 5;
+            row[i] = (unsigned char)(((i / channels + y) >> 3) + (s & 31));
+        }
+    }
+}
+
+static void touch(unsigned char *p, size_t row_bytes, int height)
+{
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++)
+        memset(p + (size_t)y * row_bytes, 0, row_bytes);
+}
+
+/* Valori a 8 bit portati sull'intera scala: v * 257 o v / 255 */
+static void widen(const unsigned char *src, uint16_t *d16, float *df, size_t n)
+{
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < n; i++) {
+        if (d16) d16[i] = (uint16_t)(src[i] * 257);
+        if (df)  df[i] = src[i] * (1.0f / 255.0f);
+    }
+}
+
+static int buffers_init(buffers_t *b, int width, int height, int channels,
+                        int want16, int wantf)
+{
+    const size_t px = (size_t)width * height;
+    b->width = width;
+    b->height = height;
+    b->channels = channels;
+    b->rgb = alloc_buf(px * channels);
+    b->work = alloc_buf(px * channels);
+    b->plane = alloc_buf(px);
+    b->edges = alloc_buf(px);
+    if (!b->rgb || !b->work || !b->plane || !b->edges)
+        return -1;
+    fill_synthetic(b->rgb, width, height, channels);
+    touch(b->work, (size_t)width * channels, height);
+    rgb_to_luma_plane(b->rgb, b->plane, width, height, channels);
+    touch(b->edges, width, height);
+
+    if (want16) {
+        b->rgb16 = (uint16_t *)alloc_buf(px * channels * sizeof *b->rgb16);
+        b->plane16 = (uint16_t *)alloc_buf(px * sizeof *b->plane16);
+        b->edges16 = (uint16_t *)alloc_buf(px * sizeof *b->edges16);
+        if (!b->rgb16 || !b->plane16 || !b->edges16)
+            return -1;
+        widen(b->rgb, b->rgb16, NULL, px * channels);
+        widen(b->plane, b->plane16, NULL, px);
+        touch((unsigned char *)b->edges16, width * sizeof *b->edges16, height);
+    }
+    if (wantf) {
+        b->rgbf = (float *)alloc_buf(px * channels * sizeof *b->rgbf);
+        b->planef = (float *)alloc_buf(px * sizeof *b->planef);
+        b->edgesf = (float *)alloc_buf(px * sizeof *b->edgesf);
+        if (!b->rgbf || !b->planef || !b->edgesf)
+            return -1;
+        widen(b->rgb, NULL, b->rgbf, px * channels);
+        widen(b->plane, NULL, b->planef, px);
+        touch((unsigned char *)b->edgesf, width * sizeof *b->edgesf, height);
+    }
+    return 0;
+}
+
+static void buffers_free(buffers_t *b)
+{
+    free(b->rgb);
+    free(b->work);
+    free(b->plane);
+    free(b->edges);
+    free(b->rgb16);
+    free(b->plane16);
+    free(b->edges16);
+    free(b->rgbf);
+    free(b->planef);
+    free(b->edgesf);
+}
+
+/* ---- thread ---- */
+
+/* Thread i del team → i-esima CPU permessa (come OMP_PROC_BIND=close su
+ * OMP_PLACES=threads). Le variabili OMP_* sono lette all'avvio di libgomp,
+ * quindi il pinning si fa qui; libgomp riusa gli stessi thread del pool
+ * finché la dimensione del team non cresce. */
+static void pin_team(int nthreads)
+{
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof allowed, &allowed) != 0) return;
+    int cpus[CPU_SETSIZE], ncpu = 0;
+    for (int c = 0; c < CPU_SETSIZE; c++)
+        if (CPU_ISSET(c, &allowed)) cpus[ncpu++] = c;
+    if (ncpu == 0) return;
+
+    #pragma omp parallel num_threads(nthreads)
+    {
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(cpus[omp_get_thread_num() % ncpu], &one);
+        sched_setaffinity(0, sizeof one, &one);
+    }
+}
+
+/* ---- misura ---- */
+
+/* Byte letti + scritti da una chiamata del kernel */
+static double kernel_bytes(kernel_id_t k, const buffers_t *b)
+{
+    const double px = (double)b->width * b->height;
+    switch (k) {
+    case K_GRAY_INPLACE: return px * b->channels * 2;
+    case K_GRAY_PLANAR:  return px * (b->channels + 1);
+    case K_FUSED:        return px * (b->channels + 1);
+    case K_GRAY_U16:     return px * (b->channels + 1) * 2;
+    case K_SOBEL_U16:    return px * 2 * 2;
+    case K_GRAY_F32:     return px * (b->channels + 1) * 4;
+    case K_SOBEL_F32:    return px * 2 * 4;
+    default:             return px * 2;   /* Sobel, gauss5: piano → piano */
+    }
+}
+
+/* -1 se il kernel ha fallito (memoria) */
+static int run_kernel(kernel_id_t k, buffers_t *b)
+{
+    const int w = b->width, h = b->height, ch = b->channels;
+    switch (k) {
+    case K_GRAY_INPLACE:
+        convert_to_grayscale(b->work, w, h, ch);
+        return 0;
+    case K_GRAY_PLANAR:
+        rgb_to_luma_plane(b->rgb, b->plane, w, h, ch);
+        return 0;
+    case K_SOBEL_L2:
+        return sobel_edge_ex(b->plane, b->edges, w, h, SOBEL_MAG_L2, SOBEL_BORDER_REPLICATE, 0);
+    case K_SOBEL_L1:
+        return sobel_edge_ex(b->plane, b->edges, w, h, SOBEL_MAG_L1, SOBEL_BORDER_REPLICATE, 0);
+    case K_SOBEL_MAXMIN:
+        return sobel_edge_ex(b->plane, b->edges, w, h, SOBEL_MAG_MAXMIN, SOBEL_BORDER_REPLICATE, 0);
+    case K_FUSED:
+        return gray_sobel_fused(b->rgb, b->edges, w, h, ch, 1,
+                                SOBEL_MAG_L2, SOBEL_BORDER_REPLICATE, 0);
+    case K_GAUSS5: {
+        /* separabile: due passate 1D dentro a blocchi, piano → piano */
+        conv_kernel_t g;
+        conv_kernel_gaussian(&g, 5);
+        return conv_apply_u8(b->plane, b->edges, w, h, 1, &g, SOBEL_BORDER_REPLICATE, 0);
+    }
+    case K_GRAY_U16:
+        rgb_to_luma_plane_u16(b->rgb16, b->plane16, w, h, ch);
+        return 0;
+    case K_SOBEL_U16:
+        return sobel_edge_u16(b->plane16, b->edges16, w, h, SOBEL_MAG_L2,
+                              SOBEL_BORDER_REPLICATE, 0);
+    case K_GRAY_F32:
+        rgb_to_luma_plane_f32(b->rgbf, b->planef, w, h, ch);
+        return 0;
+    case K_SOBEL_F32:
+        return sobel_edge_f32(b->planef, b->edgesf, w, h, SOBEL_MAG_L2,
+                              SOBEL_BORDER_REPLICATE, 0);
+    default:
+        return -1;
+    }
+}
+
+/* Prima di ogni iterazione, fuori dal tempo: il kernel in-place deve
+ * ripartire dall'RGB, non rifare la conversione su dati già grigi */
+static void reset_input(kernel_id_t k, buffers_t *b)
+{
+    if (k != K_GRAY_INPLACE) return;
+    const long stride = (long)b->width * b->channels;
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < b->height; y++)
+        memcpy(b->work + y * stride, b->rgb + y * stride, stride);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double cpu_seconds(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6
+         + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static long max_rss_kb(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+typedef struct {
+    double mean, std, median, p99, min;
+    double cpu_pct;
+} sample_stats_t;
+
+static void summarize(double *t, int n, double cpu_secs, sample_stats_t *s)
+{
+    double sum = 0, sum2 = 0;
+    for (int i = 0; i < n; i++) {
+        sum += t[i];
+        sum2 += t[i] * t[i];
+    }
+    qsort(t, n, sizeof *t, cmp_double);
+    s->mean = sum / n;
+    double var = sum2 / n - s->mean * s->mean;
+    s->std = var > 0 ? sqrt(var) : 0.0;
+    s->median = n % 2 ? t[n / 2] : 0.5 * (t[n / 2 - 1] + t[n / 2]);
+    /* nearest rank */
+    int r = (99 * n + 99) / 100 - 1;
+    s->p99 = t[r < 0 ? 0 : r];
+    s->min = t[0];
+    s->cpu_pct = sum > 0 ? 100.0 * cpu_secs / sum : 0.0;
+}
+
+/* ---- opzioni ---- */
+
+static int parse_size(const char *s, int *w, int *h)
+{
+    return sscanf(s, "%dx%d", w, h) == 2 && *w >= 3 && *h >= 3 ? 0 : -1;
+}
+
+/* "1,2,4" oppure "1 2 4" */
+static int parse_list(const char *s, int *out, int max)
+{
+    int n = 0;
+    while (*s && n < max) {
+        char *end;
+        long v = strtol(s, &end, 10);
+        if (end == s) {
+            s++;
+            continue;
+        }
+        if (v > 0) out[n++] = (int)v;
+        s = end;
+    }
+    return n;
+}
+
+static int default_threads(int *out)
+{
+    int max = omp_get_max_threads(), n = 0;
+    for (int t = 1; t < max && n < MAX_THREAD_COUNTS - 1; t *= 2)
+        out[n++] = t;
+    out[n++] = max;
+    return n;
+}
+
+static int parse_isa(const char *s, simd_isa_t *out)
+{
+    if      (!strcmp(s, "scalar")) *out = SIMD_SCALAR;
+    else if (!strcmp(s, "neon"))   *out = SIMD_NEON;
+    else if (!strcmp(s, "avx2"))   *out = SIMD_AVX2;
+    else if (!strcmp(s, "avx512")) *out = SIMD_AVX512;
+    else return -1;
+    return 0;
+}
+
+/* both: scalare + migliore; all: ogni ISA supportata; altrimenti quella data */
+static int select_isas(const char *spec, simd_isa_t *out)
+{
+    int n = 0;
+    if (!strcmp(spec, "both") || !strcmp(spec, "all")) {
+        const int all = !strcmp(spec, "all");
+        for (int i = SIMD_SCALAR; i <= SIMD_AVX512; i++) {
+            simd_isa_t eff = simd_force_isa((simd_isa_t)i);
+            if (eff != (simd_isa_t)i) continue;     /* non supportata */
+            if (!all && n == 2) out[1] = eff;       /* tiene la più larga */
+            else out[n++] = eff;
+        }
+        return n;
+    }
+    simd_isa_t isa;
+    if (parse_isa(spec, &isa) != 0) return -1;
+    simd_isa_t eff = simd_force_isa(isa);
+    if (eff != isa)
+        fprintf(stderr, "ISA %s non supportata, uso %s\n",
+                simd_isa_name(isa), simd_isa_name(eff));
+    out[n++] = eff;
+    return n;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Uso: %s [--size=WxH] [--channels=3|4] [--threads=1,2,4] [--warmup=N]\n"
+                    "          [--iters=N] [--isa=both|all|scalar|neon|avx2|avx512]\n"
+                    "          [--kernel=nome[,nome]] [--no-pin] [--out=file.csv]\n", prog);
+    fprintf(stderr, "  kernel: ");
+    for (int k = 0; k < K_COUNT; k++)
+        fprintf(stderr, "%s%s", kernel_names[k], k + 1 < K_COUNT ? " " : "\n");
+    fprintf(stderr, "  default: 3840x2160, 3 canali, thread 1,2,4,..,max, warmup 3, iters 30,\n"
+                    "           isa both (scalare e migliore), tutti i kernel, CSV su stdout\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int width = 3840, height = 2160, channels = 3;
+    int warmup = 3, iters = 30, pin = 1;
+    int threads[MAX_THREAD_COUNTS], nthreads = default_threads(threads);
+    const char *isa_spec = "both", *kernel_spec = NULL, *out_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        if (!strncmp(a, "--size=", 7)) {
+            if (parse_size(a + 7, &width, &height) != 0) {
+                fprintf(stderr, "--size vuole WxH, almeno 3x3\n");
+                return 1;
+            }
+        }
+        else if (!strncmp(a, "--channels=", 11)) channels = atoi(a + 11);
+        else if (!strncmp(a, "--threads=", 10)) nthreads = parse_list(a + 10, threads, MAX_THREAD_COUNTS);
+        else if (!strncmp(a, "--warmup=", 9)) warmup = atoi(a + 9);
+        else if (!strncmp(a, "--iters=", 8)) iters = atoi(a + 8);
+        else if (!strncmp(a, "--isa=", 6)) isa_spec = a + 6;
+        else if (!strncmp(a, "--kernel=", 9)) kernel_spec = a + 9;
+        else if (!strcmp(a, "--no-pin")) pin = 0;
+        else if (!strncmp(a, "--out=", 6)) out_path = a + 6;
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if ((channels != 3 && channels != 4) || iters < 1 || warmup < 0 || nthreads < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int enabled[K_COUNT];
+    for (int k = 0; k < K_COUNT; k++)
+        enabled[k] = kernel_spec == NULL;
+    if (kernel_spec) {
+        char *spec = strdup(kernel_spec), *save = NULL;
+        for (char *tok = strtok_r(spec, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+            int k = 0;
+            while (k < K_COUNT && strcmp(tok, kernel_names[k])) k++;
+            if (k == K_COUNT) {
+                fprintf(stderr, "Kernel sconosciuto: %s\n", tok);
+                free(spec);
+                return 1;
+            }
+            enabled[k] = 1;
+        }
+        free(spec);
+    }
+
+    simd_isa_t isas[MAX_ISAS];
+    int nisas = select_isas(isa_spec, isas);
+    if (nisas <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+
+    buffers_t b;
+    memset(&b, 0, sizeof b);
+    if (buffers_init(&b, width, height, channels,
+                     enabled[K_GRAY_U16] || enabled[K_SOBEL_U16],
+                     enabled[K_GRAY_F32] || enabled[K_SOBEL_F32]) != 0) {
+        fprintf(stderr, "Impossibile allocare i buffer %dx%dx%d\n", width, height, channels);
+        buffers_free(&b);
+        return 1;
+    }
+    double *samples = malloc(iters * sizeof *samples);
+    if (!samples) {
+        fprintf(stderr, "Memoria insufficiente\n");
+        buffers_free(&b);
+        return 1;
+    }
+
+    /* le prime cinque colonne sono quelle di monolithic_bench.csv */
+    fprintf(out, "threads,avg_real_sec,std_real_sec,avg_cpu_pct,avg_mem_kb,"
+                 "kernel,isa,width,height,channels,iters,median_sec,p99_sec,min_sec,"
+                 "mpix_per_sec,gbps\n");
+
+    int rc = 0;
+    for (int ti = 0; ti < nthreads && rc == 0; ti++) {
+        const int t = threads[ti];
+        omp_set_num_threads(t);
+        if (pin) pin_team(t);
+
+        for (int ii = 0; ii < nisas && rc == 0; ii++) {
+            simd_force_isa(isas[ii]);
+            for (int k = 0; k < K_COUNT && rc == 0; k++) {
+                if (!enabled[k]) continue;
+
+                for (int w = 0; w < warmup && rc == 0; w++) {
+                    reset_input(k, &b);
+                    rc = run_kernel(k, &b);
+                }
+                double cpu = 0.0;
+                for (int it = 0; it < iters && rc == 0; it++) {
+                    reset_input(k, &b);
+                    const double c0 = cpu_seconds(), t0 = timing_now();
+                    rc = run_kernel(k, &b);
+                    samples[it] = timing_now() - t0;
+                    cpu += cpu_seconds() - c0;
+                }
+                if (rc != 0) {
+                    fprintf(stderr, "Kernel %s fallito (memoria)\n", kernel_names[k]);
+                    break;
+                }
+
+                sample_stats_t s;
+                summarize(samples, iters, cpu, &s);
+                const double mpix = (double)width * height / 1e6;
+                fprintf(out, "%d,%.6f,%.6f,%.1f,%ld,%s,%s,%d,%d,%d,%d,%.6f,%.6f,%.6f,%.1f,%.3f\n",
+                        t, s.mean, s.std, s.cpu_pct, max_rss_kb(),
+                        kernel_names[k], simd_isa_name(isas[ii]), width, height, channels,
+                        iters, s.median, s.p99, s.min,
+                        mpix / s.median, kernel_bytes(k, &b) / s.median / 1e9);
+                fflush(out);
+                fprintf(stderr, "%2d thread  %-7s %-13s mediana %8.3f ms  p99 %8.3f ms\n",
+                        t, simd_isa_name(isas[ii]), kernel_names[k],
+                        s.median * 1e3, s.p99 * 1e3);
+            }
+        }
+    }
+
+    free(samples);
+    buffers_free(&b);
+    if (out != stdout) fclose(out);
+    return rc == 0 ? 0 : 1;
+}
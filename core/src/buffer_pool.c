@@ -0,0 +1,135 @@
+// buffer_pool.c
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "buffer_pool.h"
+
+#define POOL_HUGE       ((size_t)2 << 20)
+#define POOL_MIN_CLASS  ((size_t)4 << 10)
+#define POOL_MAX_BLOCKS 128
+
+/* Tabella dei blocchi del pool: serve a pool_free per riconoscerli (un
+ * header davanti al blocco romperebbe l'allineamento). Pochi frame vivi
+ * alla volta: la ricerca lineare costa meno di un page fault. */
+typedef struct {
+    void  *ptr;         /* NULL = slot vuoto */
+    size_t cap;         /* classe di dimensione */
+    int    busy;
+} pool_block_t;
+
+static pool_block_t blocks[POOL_MAX_BLOCKS];
+static size_t idle_bytes;
+static long limit_bytes = -1;   /* -1 = non ancora letto dall'ambiente */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t size_class(size_t bytes)
+{
+    if (bytes >= POOL_HUGE)
+        return (bytes + POOL_HUGE - 1) & ~(POOL_HUGE - 1);
+    size_t c = POOL_MIN_CLASS;
+    while (c < bytes) c <<= 1;
+    return c;
+}
+
+/* chiamata con lock preso */
+static size_t pool_limit(void)
+{
+    if (limit_bytes < 0) {
+        const char *env = getenv("GRAYSCALE_POOL_MB");
+        long mb = env && *env ? atol(env) : 256;
+        limit_bytes = mb > 0 ? mb << 20 : 0;
+    }
+    return (size_t)limit_bytes;
+}
+
+static void *new_block(size_t cap)
+{
+    void *p = NULL;
+    if (posix_memalign(&p, cap >= POOL_HUGE ? POOL_HUGE : POOL_ALIGN, cap) != 0)
+        return NULL;
+#ifdef MADV_HUGEPAGE
+    /* solo un suggerimento: senza THP resta memoria normale */
+    if (cap >= POOL_HUGE) madvise(p, cap, MADV_HUGEPAGE);
+#endif
+    return p;
+}
+
+void *pool_alloc_fresh(size_t bytes, int *fresh)
+{
+    const size_t cap = size_class(bytes ? bytes : 1);
+
+    pthread_mutex_lock(&lock);
+    if (pool_limit() > 0) {
+        for (int i = 0; i < POOL_MAX_BLOCKS; ++i) {
+            if (blocks[i].ptr && !blocks[i].busy && blocks[i].cap == cap) {
+                blocks[i].busy = 1;
+                idle_bytes -= cap;
+                pthread_mutex_unlock(&lock);
+                if (fresh) *fresh = 0;
+                return blocks[i].ptr;
+            }
+        }
+    }
+    pthread_mutex_unlock(&lock);
+
+    void *p = new_block(cap);
+    if (!p) return NULL;
+    if (fresh) *fresh = 1;
+
+    /* tabella piena: il blocco resta fuori dal pool, pool_free farà free() */
+    pthread_mutex_lock(&lock);
+    for (int i = 0; i < POOL_MAX_BLOCKS; ++i) {
+        if (!blocks[i].ptr) {
+            blocks[i] = (pool_block_t){ .ptr = p, .cap = cap, .busy = 1 };
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return p;
+}
+
+void *pool_alloc(size_t bytes)
+{
+    return pool_alloc_fresh(bytes, NULL);
+}
+
+void pool_free(void *p)
+{
+    if (!p) return;
+
+    void *evicted[POOL_MAX_BLOCKS];
+    int nevicted = 0;
+
+    pthread_mutex_lock(&lock);
+    int i = 0;
+    while (i < POOL_MAX_BLOCKS && blocks[i].ptr != p) ++i;
+    if (i == POOL_MAX_BLOCKS) {
+        pthread_mutex_unlock(&lock);
+        free(p);            /* non è del pool (malloc, stb, tabella piena) */
+        return;
+    }
+
+    const size_t cap = blocks[i].cap, limit = pool_limit();
+    if (cap > limit) {
+        blocks[i].ptr = NULL;
+        evicted[nevicted++] = p;
+    } else {
+        /* fa posto liberando altri blocchi inattivi */
+        for (int j = 0; j < POOL_MAX_BLOCKS && idle_bytes + cap > limit; ++j) {
+            if (blocks[j].ptr && !blocks[j].busy) {
+                idle_bytes -= blocks[j].cap;
+                evicted[nevicted++] = blocks[j].ptr;
+                blocks[j].ptr = NULL;
+            }
+        }
+        blocks[i].busy = 0;
+        idle_bytes += cap;
+    }
+    pthread_mutex_unlock(&lock);
+
+    for (int k = 0; k < nevicted; ++k)
+        free(evicted[k]);
+}
@@ -0,0 +1,462 @@
+// convolution.c
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "convolution.h"
+#include "cpu_features.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_SIMD 1
+#endif
+
+/* Blocco di lavoro di un thread: le K righe filtrate di una striscia
+ * larga CONV_TILE_PX pixel stanno in L2 (7 × 1024 × 3 × 4 byte = 84 KiB) */
+#define CONV_TILE_PX    1024
+#define CONV_STRIP_ROWS 64
+
+/* ---- pesi ---- */
+
+static int valid_size(int size)
+{
+    return size >= 1 && size <= CONV_MAX_SIZE && (size & 1);
+}
+
+int conv_kernel_gaussian(conv_kernel_t *k, int size)
+{
+    if (!valid_size(size)) return -1;
+    /* riga size-1 del triangolo di Tartaglia */
+    int b[CONV_MAX_SIZE] = {1};
+    for (int n = 1; n < size; ++n)
+        for (int j = n; j > 0; --j) b[j] += b[j - 1];
+    memset(k, 0, sizeof *k);
+    k->size = size;
+    for (int i = 0; i < size; ++i)
+        for (int j = 0; j < size; ++j) k->weights[i * size + j] = b[i] * b[j];
+    return 0;
+}
+
+int conv_kernel_box(conv_kernel_t *k, int size)
+{
+    if (!valid_size(size)) return -1;
+    memset(k, 0, sizeof *k);
+    k->size = size;
+    for (int i = 0; i < size * size; ++i) k->weights[i] = 1;
+    return 0;
+}
+
+int conv_kernel_named(conv_kernel_t *k, const char *name)
+{
+    char *end;
+    if (!strncmp(name, "gauss", 5)) {
+        long n = strtol(name + 5, &end, 10);
+        return *end || end == name + 5 ? -1 : conv_kernel_gaussian(k, (int)n);
+    }
+    if (!strncmp(name, "box", 3)) {
+        long n = strtol(name + 3, &end, 10);
+        return *end || end == name + 3 ? -1 : conv_kernel_box(k, (int)n);
+    }
+    return -1;
+}
+
+static int gcd(int a, int b)
+{
+    a = abs(a); b = abs(b);
+    while (b) { int t = a % b; a = b; b = t; }
+    return a;
+}
+
+int conv_separable(const conv_kernel_t *k, int *row, int *col)
+{
+    const int n = k->size;
+    const int *w = k->weights;
+    int r0 = -1, c0 = -1;
+    for (int i = 0; i < n * n && r0 < 0; ++i)
+        if (w[i]) { r0 = i / n; c0 = i % n; }
+    if (r0 < 0) return 0;
+
+    /* riga pivot ridotta ai minimi termini: se il kernel è di rango 1 ogni
+     * riga ne è un multiplo intero */
+    int g = 0, r[CONV_MAX_SIZE], c[CONV_MAX_SIZE];
+    for (int j = 0; j < n; ++j) g = gcd(g, w[r0 * n + j]);
+    for (int j = 0; j < n; ++j) r[j] = w[r0 * n + j] / g;
+    for (int i = 0; i < n; ++i) {
+        if (w[i * n + c0] % r[c0]) return 0;
+        c[i] = w[i * n + c0] / r[c0];
+        for (int j = 0; j < n; ++j)
+            if ((long long)c[i] * r[j] != w[i * n + j]) return 0;
+    }
+    if (row) memcpy(row, r, n * sizeof *r);
+    if (col) memcpy(col, c, n * sizeof *c);
+    return 1;
+}
+
+/* ---- cicli interni ----
+ *
+ * Un corpo sempre inline per ogni ciclo; le versioni con K costante (3, 5,
+ * 7) e quella generica sono istanziate per ISA con l'attributo target, così
+ * il compilatore srotola la somma sui pesi e vettorizza sui campioni.
+ * p è una riga con r pixel di bordo a sinistra: il campione i del blocco
+ * con il peso j sta in p[i + j*ch]. */
+
+#define INLINE static inline __attribute__((always_inline))
+
+INLINE void hpass_body(const int32_t *restrict p, const int *restrict w, int K,
+                       int32_t *restrict out, int n, int ch, int acc)
+{
+    if (acc) {
+        for (int i = 0; i < n; ++i) {
+            int32_t s = 0;
+            for (int j = 0; j < K; ++j) s += w[j] * p[i + j * ch];
+            out[i] += s;
+        }
+    } else {
+        for (int i = 0; i < n; ++i) {
+            int32_t s = 0;
+            for (int j = 0; j < K; ++j) s += w[j] * p[i + j * ch];
+            out[i] = s;
+        }
+    }
+}
+
+/* somma pesata di K righe, divisa e saturata a [0, maxv] */
+#define VSTORE_BODY(T)                                                        \
+    const int32_t *r[CONV_MAX_SIZE];                                          \
+    for (int k = 0; k < K; ++k) r[k] = rows[k];                               \
+    if (shift >= 0) {                                                         \
+        const int32_t half = shift ? 1 << (shift - 1) : 0;                    \
+        for (int i = 0; i < n; ++i) {                                         \
+            int32_t s = half;                                                 \
+            for (int k = 0; k < K; ++k) s += c[k] * r[k][i];                  \
+            s >>= shift;                                                      \
+            dst[i] = (T)(s < 0 ? 0 : (s > maxv ? maxv : s));                  \
+        }                                                                     \
+    } else {                                                                  \
+        for (int i = 0; i < n; ++i) {                                         \
+            int32_t s = 0;                                                    \
+            for (int k = 0; k < K; ++k) s += c[k] * r[k][i];                  \
+            const float f = (float)s * inv;                                   \
+            dst[i] = (T)(f <= 0.0f ? 0                                        \
+                       : (f >= maxv ? maxv : (int32_t)(f + 0.5f)));           \
+        }                                                                     \
+    }
+
+INLINE void vstore_u8_body(const int32_t *const *rows, const int *restrict c, int K,
+                           unsigned char *restrict dst, int n, int shift, float inv)
+{
+    const int32_t maxv = 255;
+    VSTORE_BODY(unsigned char)
+}
+
+INLINE void vstore_u16_body(const int32_t *const *rows, const int *restrict c, int K,
+                            uint16_t *restrict dst, int n, int shift, float inv)
+{
+    const int32_t maxv = 65535;
+    VSTORE_BODY(uint16_t)
+}
+
+/* Passata verticale con la somma in int64, per i kernel separabili il cui
+ * totale non sta in int32 (gauss13/15 a 8 bit, gauss9..15 a 16 bit): un
+ * solo ciclo generico, più lento ma esatto; divisione in double */
+#define VSTORE_WIDE_BODY(T)                                                   \
+    if (shift >= 0) {                                                         \
+        const int64_t half = shift ? (int64_t)1 << (shift - 1) : 0;           \
+        for (int i = 0; i < n; ++i) {                                         \
+            int64_t s = half;                                                 \
+            for (int k = 0; k < K; ++k) s += (int64_t)c[k] * rows[k][i];      \
+            s >>= shift;                                                      \
+            dst[i] = (T)(s < 0 ? 0 : (s > maxv ? maxv : s));                  \
+        }                                                                     \
+    } else {                                                                  \
+        for (int i = 0; i < n; ++i) {                                         \
+            int64_t s = 0;                                                    \
+            for (int k = 0; k < K; ++k) s += (int64_t)c[k] * rows[k][i];      \
+            const double f = (double)s * inv;                                 \
+            dst[i] = (T)(f <= 0.0 ? 0 : (f >= maxv ? maxv : (int64_t)(f + 0.5))); \
+        }                                                                     \
+    }
+
+static void vstore_u8_wide(const int32_t *const *rows, const int *c, int K,
+                           unsigned char *dst, int n, int shift, double inv)
+{
+    const int64_t maxv = 255;
+    VSTORE_WIDE_BODY(unsigned char)
+}
+
+static void vstore_u16_wide(const int32_t *const *rows, const int *c, int K,
+                            uint16_t *dst, int n, int shift, double inv)
+{
+    const int64_t maxv = 65535;
+    VSTORE_WIDE_BODY(uint16_t)
+}
+
+typedef void (*hpass_fn)(const int32_t *p, const int *w, int K,
+                         int32_t *out, int n, int ch, int acc);
+typedef void (*vstore_u8_fn)(const int32_t *const *rows, const int *c, int K,
+                             unsigned char *dst, int n, int shift, float inv);
+typedef void (*vstore_u16_fn)(const int32_t *const *rows, const int *c, int K,
+                              uint16_t *dst, int n, int shift, float inv);
+
+/* indice 0 = K generico, 1/2/3 = K 3/5/7 */
+typedef struct {
+    hpass_fn      hpass[4];
+    vstore_u8_fn  vstore_u8[4];
+    vstore_u16_fn vstore_u16[4];
+} conv_ops_t;
+
+#define CONV_ISA(ATTR, SFX)                                                   \
+    ATTR static void hpass_kn##SFX(const int32_t *p, const int *w, int K,     \
+                                   int32_t *out, int n, int ch, int acc)      \
+    { hpass_body(p, w, K, out, n, ch, acc); }                                 \
+    ATTR static void vstore_u8_kn##SFX(const int32_t *const *rows, const int *c, \
+                                       int K, unsigned char *dst, int n,      \
+                                       int shift, float inv)                  \
+    { vstore_u8_body(rows, c, K, dst, n, shift, inv); }                       \
+    ATTR static void vstore_u16_kn##SFX(const int32_t *const *rows, const int *c, \
+                                        int K, uint16_t *dst, int n,          \
+                                        int shift, float inv)                 \
+    { vstore_u16_body(rows, c, K, dst, n, shift, inv); }                      \
+    CONV_ISA_K(ATTR, SFX, 3)                                                  \
+    CONV_ISA_K(ATTR, SFX, 5)                                                  \
+    CONV_ISA_K(ATTR, SFX, 7)                                                  \
+    static const conv_ops_t conv_ops##SFX = {                                 \
+        { hpass_kn##SFX, hpass_k3##SFX, hpass_k5##SFX, hpass_k7##SFX },       \
+        { vstore_u8_kn##SFX, vstore_u8_k3##SFX, vstore_u8_k5##SFX,            \
+          vstore_u8_k7##SFX },                                                \
+        { vstore_u16_kn##SFX, vstore_u16_k3##SFX, vstore_u16_k5##SFX,         \
+          vstore_u16_k7##SFX },                                               \
+    };
+
+/* K ignorato: la costante KV lo sostituisce nel corpo */
+#define CONV_ISA_K(ATTR, SFX, KV)                                             \
+    ATTR static void hpass_k##KV##SFX(const int32_t *p, const int *w, int K,  \
+                                      int32_t *out, int n, int ch, int acc)   \
+    { (void)K; hpass_body(p, w, KV, out, n, ch, acc); }                       \
+    ATTR static void vstore_u8_k##KV##SFX(const int32_t *const *rows,         \
+                                          const int *c, int K,                \
+                                          unsigned char *dst, int n,          \
+                                          int shift, float inv)               \
+    { (void)K; vstore_u8_body(rows, c, KV, dst, n, shift, inv); }             \
+    ATTR static void vstore_u16_k##KV##SFX(const int32_t *const *rows,        \
+                                           const int *c, int K,               \
+                                           uint16_t *dst, int n,              \
+                                           int shift, float inv)              \
+    { (void)K; vstore_u16_body(rows, c, KV, dst, n, shift, inv); }
+
+CONV_ISA(SIMD_SCALAR_ATTR, _scalar)
+#if HAVE_X86_SIMD
+CONV_ISA(__attribute__((target("avx2"))), _avx2)
+CONV_ISA(__attribute__((target("avx512f,avx512bw"))), _avx512)
+#endif
+
+/* NEON è la base di aarch64: la versione generica è già vettorizzata */
+static const conv_ops_t *select_conv_ops(void)
+{
+    switch (simd_isa()) {
+#if HAVE_X86_SIMD
+    case SIMD_AVX512: return &conv_ops_avx512;
+    case SIMD_AVX2:   return &conv_ops_avx2;
+#endif
+    default:          return &conv_ops_scalar;
+    }
+}
+
+static int k_slot(int K)
+{
+    return K == 3 ? 1 : K == 5 ? 2 : K == 7 ? 3 : 0;
+}
+
+/* ---- righe con bordo ---- */
+
+/* Pixel [x0 - r, x1 + r) della riga src (NULL = riga fuori immagine con il
+ * valore costante) convertiti in int32 */
+static void load_row(const void *src, int bits, int width, int ch, int x0, int x1,
+                     int r, sobel_border_t border, int32_t value, int32_t *p)
+{
+    const int lo = x0 - r, hi = x1 + r;
+    if (!src) {
+        for (long i = 0; i < (long)(hi - lo) * ch; ++i) p[i] = value;
+        return;
+    }
+    /* interno senza rami, poi le colonne fuori immagine */
+    const int in_lo = lo < 0 ? 0 : lo, in_hi = hi > width ? width : hi;
+    int32_t *q = p + (long)(in_lo - lo) * ch;
+    const long n = (long)(in_hi - in_lo) * ch;
+    if (bits == 8) {
+        const unsigned char *s = (const unsigned char *)src + (long)in_lo * ch;
+        for (long i = 0; i < n; ++i) q[i] = s[i];
+    } else {
+        const uint16_t *s = (const uint16_t *)src + (long)in_lo * ch;
+        for (long i = 0; i < n; ++i) q[i] = s[i];
+    }
+    for (int x = lo; x < hi; ++x) {
+        if (x >= in_lo && x < in_hi) continue;
+        const int m = sobel_border_index(x, width, border);
+        int32_t *d = p + (long)(x - lo) * ch;
+        for (int c = 0; c < ch; ++c) {
+            if (m < 0)          d[c] = value;
+            else if (bits == 8) d[c] = ((const unsigned char *)src)[(long)m * ch + c];
+            else                d[c] = ((const uint16_t *)src)[(long)m * ch + c];
+        }
+    }
+}
+
+/* ---- limiti delle somme ----
+ *
+ * La passata orizzontale (l'unica dei kernel non separabili) somma in
+ * int32: sum(|riga|) × (valore massimo + 1), con l'arrotondamento, deve
+ * stare sotto 2^31. La verticale dei separabili passa a int64 quando il
+ * totale sum(|pesi|) × (massimo + 1) non ci sta. 1 in int64, 0 in int32,
+ * -1 kernel non applicabile a quella profondità. */
+static int conv_range(const conv_kernel_t *k, int bits, const int *row, int separable)
+{
+    const long long top = bits == 8 ? 256 : 65536;
+    long long abs_sum = 0, row_sum = 0;
+    for (int i = 0; i < k->size * k->size; ++i) abs_sum += llabs(k->weights[i]);
+    if (abs_sum * top <= INT_MAX) return 0;
+    if (!separable) return -1;
+    for (int j = 0; j < k->size; ++j) row_sum += llabs(row[j]);
+    return row_sum * top <= INT_MAX ? 1 : -1;
+}
+
+int conv_supported(const conv_kernel_t *k, int bits)
+{
+    int row[CONV_MAX_SIZE];
+    if (!valid_size(k->size) || (bits != 8 && bits != 16)) return 0;
+    return conv_range(k, bits, row, conv_separable(k, row, NULL)) >= 0;
+}
+
+/* ---- driver comune a 8 e 16 bit ---- */
+
+static int conv_apply(const void *src, void *dst, int bits, int width, int height,
+                      int channels, const conv_kernel_t *k,
+                      sobel_border_t border, int32_t value)
+{
+    const int K = k->size;
+    if (!valid_size(K) || width < 1 || height < 1 || channels < 1) return -1;
+    if (border == SOBEL_BORDER_ZERO) value = 0;
+
+    int row[CONV_MAX_SIZE], col[CONV_MAX_SIZE];
+    const int separable = conv_separable(k, row, col);
+    const int wide = conv_range(k, bits, row, separable);
+    if (wide < 0) return -1;
+
+    long long sum = 0;
+    for (int i = 0; i < K * K; ++i) sum += k->weights[i];
+    const int divisor = k->divisor ? k->divisor : (sum ? (int)sum : 1);
+    int shift = -1;
+    for (int s = 0; s < 31; ++s)
+        if (divisor == 1 << s) shift = s;
+    const float inv = 1.0f / (float)divisor;
+    const conv_ops_t *ops = select_conv_ops();
+    const hpass_fn hpass = ops->hpass[k_slot(K)];
+    const vstore_u8_fn vst8 = ops->vstore_u8[separable ? k_slot(K) : 0];
+    const vstore_u16_fn vst16 = ops->vstore_u16[separable ? k_slot(K) : 0];
+
+    const int r = K / 2;
+    const long stride = (long)width * channels;
+    const int tiles = (width + CONV_TILE_PX - 1) / CONV_TILE_PX;
+    const int strips = (height + CONV_STRIP_ROWS - 1) / CONV_STRIP_ROWS;
+    const size_t pad_len = (size_t)(CONV_TILE_PX + 2 * r) * channels;
+    const size_t tile_len = (size_t)CONV_TILE_PX * channels;
+    /* separabile: righe già filtrate in orizzontale; altrimenti righe con
+     * bordo, combinate per ogni uscita */
+    const size_t slot_len = separable ? tile_len : pad_len;
+    int failed = 0;
+
+    #pragma omp parallel
+    {
+        int32_t *pad = malloc((pad_len + K * slot_len + tile_len) * sizeof *pad);
+        int32_t *slots = pad ? pad + pad_len : NULL;
+        int32_t *acc = slots ? slots + K * slot_len : NULL;
+        int tag[CONV_MAX_SIZE];
+        if (!pad) {
+            #pragma omp atomic write
+            failed = 1;
+        }
+
+        #pragma omp for schedule(static)
+        for (int b = 0; b < tiles * strips; ++b) {
+            if (!pad) continue;
+            const int x0 = (b % tiles) * CONV_TILE_PX;
+            const int x1 = x0 + CONV_TILE_PX < width ? x0 + CONV_TILE_PX : width;
+            const int y0 = (b / tiles) * CONV_STRIP_ROWS;
+            const int y1 = y0 + CONV_STRIP_ROWS < height ? y0 + CONV_STRIP_ROWS : height;
+            const int n = (x1 - x0) * channels;
+            /* tag = riga sorgente nello slot: -1 costante, -2 vuoto */
+            for (int s = 0; s < K; ++s) tag[s] = -2;
+
+            for (int y = y0; y < y1; ++y) {
+                const int32_t *rows[CONV_MAX_SIZE];
+                int need[CONV_MAX_SIZE];
+                for (int j = 0; j < K; ++j)
+                    need[j] = sobel_border_index(y - r + j, height, border);
+
+                /* solo la riga nuova in fondo alla finestra manca di solito:
+                 * uno slot il cui tag non serve più viene riusato */
+                for (int j = 0; j < K; ++j) {
+                    int s = 0;
+                    while (s < K && tag[s] != need[j]) ++s;
+                    if (s == K) {
+                        for (s = 0; s < K; ++s) {
+                            int used = 0;
+                            for (int q = 0; q < K; ++q) used |= tag[s] == need[q];
+                            if (!used) break;
+                        }
+                        int32_t *slot = slots + s * slot_len;
+                        const void *line = need[j] < 0 ? NULL
+                            : (const char *)src + (size_t)need[j] * stride * (bits / 8);
+                        if (separable) {
+                            load_row(line, bits, width, channels, x0, x1, r, border, value, pad);
+                            hpass(pad, row, K, slot, n, channels, 0);
+                        } else {
+                            load_row(line, bits, width, channels, x0, x1, r, border, value, slot);
+                        }
+                        tag[s] = need[j];
+                    }
+                    rows[j] = slots + s * slot_len;
+                }
+
+                const int one = 1;
+                const int32_t *sum_row = acc;
+                const int *vw = col;
+                int vk = K;
+                if (!separable) {
+                    /* K passate orizzontali accumulate, poi solo lo store */
+                    for (int j = 0; j < K; ++j)
+                        hpass(rows[j], k->weights + j * K, K, acc, n, channels, j > 0);
+                    rows[0] = sum_row;
+                    vw = &one;
+                    vk = 1;
+                }
+                const size_t off = (size_t)y * stride + (size_t)x0 * channels;
+                if (wide && bits == 8)
+                    vstore_u8_wide(rows, vw, vk, (unsigned char *)dst + off, n, shift,
+                                   1.0 / divisor);
+                else if (wide)
+                    vstore_u16_wide(rows, vw, vk, (uint16_t *)dst + off, n, shift,
+                                    1.0 / divisor);
+                else if (bits == 8)
+                    vst8(rows, vw, vk, (unsigned char *)dst + off, n, shift, inv);
+                else
+                    vst16(rows, vw, vk, (uint16_t *)dst + off, n, shift, inv);
+            }
+        }
+        free(pad);
+    }
+    return failed ? -1 : 0;
+}
+
+int conv_apply_u8(const unsigned char *src, unsigned char *dst,
+                  int width, int height, int channels, const conv_kernel_t *k,
+                  sobel_border_t border, unsigned char border_value)
+{
+    return conv_apply(src, dst, 8, width, height, channels, k, border, border_value);
+}
+
+int conv_apply_u16(const uint16_t *src, uint16_t *dst,
+                   int width, int height, int channels, const conv_kernel_t *k,
+                   sobel_border_t border, uint16_t border_value)
+{
+    return conv_apply(src, dst, 16, width, height, channels, k, border, border_value);
+}
@@ -0,0 +1,69 @@
+// cpu_features.c
+#include <stdlib.h>
+#include <string.h>
+#include "cpu_features.h"
+
+static simd_isa_t best_isa = SIMD_SCALAR;
+static simd_isa_t active_isa = SIMD_SCALAR;
+
+static simd_isa_t detect_isa(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return SIMD_AVX2;
+    return SIMD_SCALAR;
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+    return SIMD_NEON;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+static int isa_supported(simd_isa_t isa)
+{
+    if (isa == SIMD_SCALAR) return 1;
+    if (isa == SIMD_NEON)   return best_isa == SIMD_NEON;
+    /* AVX-512 implica AVX2 */
+    return best_isa != SIMD_NEON && isa <= best_isa;
+}
+
+/* L'ISA viene scelta una volta sola prima di main(): i kernel leggono solo
+ * active_isa, senza rifare il CPUID ad ogni chiamata. */
+__attribute__((constructor))
+static void init_isa(void)
+{
+    best_isa = active_isa = detect_isa();
+
+    const char *env = getenv("GRAYSCALE_SIMD");
+    if (!env || !*env) return;
+    if      (!strcmp(env, "scalar")) simd_force_isa(SIMD_SCALAR);
+    else if (!strcmp(env, "neon"))   simd_force_isa(SIMD_NEON);
+    else if (!strcmp(env, "avx2"))   simd_force_isa(SIMD_AVX2);
+    else if (!strcmp(env, "avx512")) simd_force_isa(SIMD_AVX512);
+}
+
+simd_isa_t simd_isa(void)
+{
+    return active_isa;
+}
+
+simd_isa_t simd_force_isa(simd_isa_t isa)
+{
+    while (!isa_supported(isa))
+        isa = (simd_isa_t)(isa - 1);
+    active_isa = isa;
+    return active_isa;
+}
+
+const char *simd_isa_name(simd_isa_t isa)
+{
+    switch (isa) {
+    case SIMD_NEON:   return "neon";
+    case SIMD_AVX2:   return "avx2";
+    case SIMD_AVX512: return "avx512";
+    default:          return "scalar";
+    }
+}
@@ -0,0 +1,215 @@
+// frame_map.c
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "frame_map.h"
+#include "buffer_pool.h"
+
+frame_format_t frame_format_of(const char *path)
+{
+    const char *dot = strrchr(path, '.');
+    if (!dot || strchr(dot, '/')) return FRAME_PNG;
+    if (!strcasecmp(dot, ".pgm") || !strcasecmp(dot, ".ppm") || !strcasecmp(dot, ".pnm"))
+        return FRAME_PNM;
+    if (!strcasecmp(dot, ".raw")) return FRAME_RAW;
+    return FRAME_PNG;
+}
+
+int frame_parse_raw(const char *spec, int *width, int *height, int *channels)
+{
+    int w = 0, h = 0, c = 1;
+    char tail;
+    const int n = sscanf(spec, "%dx%dx%d%c", &w, &h, &c, &tail);
+    if (n < 2 || n > 3 || w <= 0 || h <= 0 || c < 1 || c > 4) return -1;
+    *width = w;
+    *height = h;
+    *channels = c;
+    return 0;
+}
+
+/* ---- header PGM/PPM in memoria ---- */
+
+static int pnm_int(const unsigned char *p, size_t len, size_t *pos, int *v)
+{
+    size_t i = *pos;
+    for (;;) {
+        if (i >= len) return -1;
+        if (p[i] == '#') {
+            while (i < len && p[i] != '\n') ++i;
+        } else if (p[i] == ' ' || p[i] == '\t' || p[i] == '\r' || p[i] == '\n') {
+            ++i;
+        } else {
+            break;
+        }
+    }
+    long n = 0;
+    if (p[i] < '0' || p[i] > '9') return -1;
+    while (i < len && p[i] >= '0' && p[i] <= '9') {
+        n = n * 10 + (p[i++] - '0');
+        if (n > 0x7fffffff) return -1;
+    }
+    *v = (int)n;
+    *pos = i;
+    return 0;
+}
+
+int frame_pnm_header(const unsigned char *p, size_t len,
+                     int *w, int *h, int *c, size_t *data)
+{
+    if (len < 2 || p[0] != 'P' || (p[1] != '5' && p[1] != '6')) return 0;
+    size_t pos = 2;
+    int maxval;
+    if (pnm_int(p, len, &pos, w) || pnm_int(p, len, &pos, h) ||
+        pnm_int(p, len, &pos, &maxval) || pos >= len || *w <= 0 || *h <= 0)
+        return -1;
+    if (maxval != 255) return 0;
+    *c = p[1] == '5' ? 1 : 3;
+    *data = pos + 1;            /* un solo spazio prima dei pixel */
+    return 1;
+}
+
+/* ---- API ---- */
+
+int frame_map_input(const char *path, const char *raw, frame_map_t *m,
+                    char *err, size_t errlen)
+{
+    memset(m, 0, sizeof *m);
+    int w = 0, h = 0, c = 0;
+    if (raw && frame_parse_raw(raw, &w, &h, &c) != 0) {
+        snprintf(err, errlen, "dimensioni raw non valide: \"%s\" (WxH o WxHxC)", raw);
+        return -1;
+    }
+
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        if (!raw) return 0;     /* lo segnala il decoder */
+        snprintf(err, errlen, "impossibile aprire: %s", strerror(errno));
+        return -1;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode) || sb.st_size == 0) {
+        close(fd);
+        if (!raw) return 0;
+        snprintf(err, errlen, "non è un file regolare non vuoto");
+        return -1;
+    }
+    const size_t len = (size_t)sb.st_size;
+
+    size_t data = 0;            /* offset dei pixel */
+    if (!raw) {
+        /* solo l'header, prima di mappare tutto */
+        unsigned char head[512];
+        const ssize_t got = pread(fd, head, sizeof head, 0);
+        const int rc = got > 0 ? frame_pnm_header(head, (size_t)got, &w, &h, &c, &data) : 0;
+        if (rc <= 0) {
+            close(fd);
+            return 0;           /* header rotto o 16 bit: ci pensa stb */
+        }
+    }
+
+    const size_t need = (size_t)w * h * c + data;
+    if (len < need) {
+        close(fd);
+        snprintf(err, errlen, "%zu byte, ne servono %zu per %dx%dx%d",
+                 len, need, w, h, c);
+        return -1;
+    }
+
+    /* senza MAP_POPULATE: su una mappatura privata scrivibile copierebbe
+     * tutte le pagine (COW anticipato) */
+    void *base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        snprintf(err, errlen, "mmap: %s", strerror(errno));
+        return -1;
+    }
+    madvise(base, len, MADV_WILLNEED);
+    m->pixels = (unsigned char *)base + data;
+    m->base = base;
+    m->len = len;
+    m->width = w;
+    m->height = h;
+    m->channels = c;
+    return 1;
+}
+
+int frame_same_file(const char *a, const char *b)
+{
+    struct stat sa, sb;
+    if (stat(a, &sa) != 0 || stat(b, &sb) != 0) return 0;
+    return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+unsigned char *frame_detach(frame_map_t *m)
+{
+    const size_t n = (size_t)m->width * m->height * m->channels;
+    unsigned char *copy = pool_alloc(n);
+    if (!copy) return NULL;
+    memcpy(copy, m->pixels, n);
+    frame_unmap(m);
+    return copy;
+}
+
+int frame_map_output(const char *path, frame_format_t fmt,
+                     int width, int height, int channels, frame_map_t *m,
+                     char *err, size_t errlen)
+{
+    memset(m, 0, sizeof *m);
+    char header[64] = "";
+    if (fmt == FRAME_PNM) {
+        if (channels != 1 && channels != 3) {
+            snprintf(err, errlen, "PGM/PPM: solo 1 o 3 canali (qui %d), usare .raw o .png",
+                     channels);
+            return -1;
+        }
+        snprintf(header, sizeof header, "P%c\n%d %d\n255\n",
+                 channels == 1 ? '5' : '6', width, height);
+    } else if (fmt != FRAME_RAW) {
+        snprintf(err, errlen, "formato d'uscita non mappabile");
+        return -1;
+    }
+    const size_t hlen = strlen(header);
+    const size_t len = hlen + (size_t)width * height * channels;
+
+    const int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        snprintf(err, errlen, "impossibile creare il file: %s", strerror(errno));
+        return -1;
+    }
+    /* niente write: ftruncate crea il file sparso, le pagine nascono al
+     * primo accesso del kernel (su /dev/shm direttamente nella page cache) */
+    if (ftruncate(fd, (off_t)len) != 0) {
+        snprintf(err, errlen, "ftruncate: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    void *base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        snprintf(err, errlen, "mmap: %s", strerror(errno));
+        return -1;
+    }
+    memcpy(base, header, hlen);
+    m->base = base;
+    m->len = len;
+    m->pixels = (unsigned char *)base + hlen;
+    m->width = width;
+    m->height = height;
+    m->channels = channels;
+    return 0;
+}
+
+int frame_unmap(frame_map_t *m)
+{
+    int rc = 0;
+    if (m->base) rc = munmap(m->base, m->len);
+    memset(m, 0, sizeof *m);
+    return rc;
+}
@@ -0,0 +1,130 @@
+// gray_sobel.c
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "gray_sobel.h"
+#include "parallel_to_grayscale.h"
+#include "sobel.h"
+
+/* riga di bordi → pixel interleaved (alpha, se c'è, resta quello di src) */
+static void expand_row(const unsigned char *edge, const unsigned char *src,
+                       unsigned char *dst, int width, int channels)
+{
+    const int color = channels < 3 ? 1 : 3;
+    const int alpha = (channels == 2 || channels == 4);
+    for (int x = 0; x < width; ++x) {
+        const long i = (long)x * channels;
+        for (int c = 0; c < color; ++c) dst[i + c] = edge[x];
+        if (alpha) dst[i + channels - 1] = src[i + channels - 1];
+    }
+}
+
+int gray_sobel_fused(const unsigned char *src, unsigned char *dst,
+                     int width, int height, int channels, int dst_channels,
+                     sobel_mag_t mag, sobel_border_t border,
+                     unsigned char border_value)
+{
+    const long stride = (long)width * channels;
+    const int planar = (dst_channels == 1);
+    const int use_pad = (border == SOBEL_BORDER_ZERO || border == SOBEL_BORDER_CONSTANT);
+    int failed = 0;
+
+    #pragma omp parallel
+    {
+        /* anello di 3 righe di luminanza + riga d'uscita + riga costante
+         * per i bordi zero/constant: restano in L1/L2 */
+        unsigned char *ring = malloc((size_t)width * 5);
+        unsigned char *line = ring ? ring + 3L * width : NULL;
+        unsigned char *pad  = ring ? ring + 4L * width : NULL;
+        int next = -1;          /* prossima riga attesa nella striscia */
+        if (!ring) {
+            #pragma omp atomic write
+            failed = 1;
+        } else if (use_pad) {
+            memset(pad, border == SOBEL_BORDER_ZERO ? 0 : border_value, width);
+        }
+
+        /* stesso schedule statico dei kernel separati: ogni thread riceve
+         * una striscia contigua di righe */
+        #pragma omp for schedule(static)
+        for (int y = 0; y < height; ++y) {
+            if (!ring) continue;
+            unsigned char *r0 = ring + (long)((y + 2) % 3) * width;  /* y-1 */
+            unsigned char *r1 = ring + (long)(y % 3) * width;        /* y   */
+            unsigned char *r2 = ring + (long)((y + 1) % 3) * width;  /* y+1 */
+
+            if (y != next) {
+                /* inizio striscia: ricalcola l'alone sopra e la riga y */
+                if (y > 0) rgb_to_luma_row(src + (y - 1) * stride, r0, width, channels);
+                rgb_to_luma_row(src + y * stride, r1, width, channels);
+            }
+            if (y + 1 < height)
+                rgb_to_luma_row(src + (y + 1) * stride, r2, width, channels);
+            next = y + 1;
+
+            unsigned char *out = planar ? dst + (long)y * width : line;
+            if (y > 0 && y < height - 1) {
+                sobel_row_border(r0, r1, r2, out, width, mag, border, border_value);
+            } else {
+                /* prima/ultima riga: la vicina fuori immagine secondo il bordo;
+                 * le righe y-1..y+1 esistenti sono nell'anello allo slot i%3 */
+                int ya = sobel_border_index(y - 1, height, border);
+                int yb = sobel_border_index(y + 1, height, border);
+                sobel_row_border(ya < 0 ? pad : ring + (long)(ya % 3) * width, r1,
+                                 yb < 0 ? pad : ring + (long)(yb % 3) * width,
+                                 out, width, mag, border, border_value);
+            }
+            if (!planar)
+                expand_row(out, src + y * stride, dst + y * stride, width, channels);
+        }
+        free(ring);
+    }
+    return failed ? -1 : 0;
+}
+
+int gray_sobel_band(const unsigned char *win, int win_y0, int win_rows,
+                    unsigned char *dst, int y0, int n,
+                    int width, int height, int channels, int dst_channels,
+                    sobel_mag_t mag, sobel_border_t border,
+                    unsigned char border_value, unsigned char *luma)
+{
+    const long stride = (long)width * channels;
+    const int planar = (dst_channels == 1);
+    const int use_pad = (border == SOBEL_BORDER_ZERO || border == SOBEL_BORDER_CONSTANT);
+    int failed = 0;
+
+    /* tutta la finestra in luminanza, alone compreso: le righe vicine
+     * servono a due thread e qui si calcolano una volta sola */
+    rgb_to_luma_plane(win, luma, width, win_rows, channels);
+
+    #pragma omp parallel
+    {
+        unsigned char *tmp = malloc((size_t)width * 2);
+        unsigned char *line = tmp;
+        unsigned char *pad  = tmp ? tmp + width : NULL;
+        if (!tmp) {
+            #pragma omp atomic write
+            failed = 1;
+        } else if (use_pad) {
+            memset(pad, border == SOBEL_BORDER_ZERO ? 0 : border_value, width);
+        }
+
+        #pragma omp for schedule(static)
+        for (int y = y0; y < y0 + n; ++y) {
+            if (!tmp) continue;
+            /* fuori immagine secondo il bordo; dentro è sempre nella finestra */
+            const int ya = sobel_border_index(y - 1, height, border);
+            const int yb = sobel_border_index(y + 1, height, border);
+            unsigned char *out = planar ? dst + (long)(y - y0) * width : line;
+            sobel_row_border(ya < 0 ? pad : luma + (long)(ya - win_y0) * width,
+                             luma + (long)(y - win_y0) * width,
+                             yb < 0 ? pad : luma + (long)(yb - win_y0) * width,
+                             out, width, mag, border, border_value);
+            if (!planar)
+                expand_row(out, win + (y - win_y0) * stride,
+                           dst + (y - y0) * stride, width, channels);
+        }
+        free(tmp);
+    }
+    return failed ? -1 : 0;
+}
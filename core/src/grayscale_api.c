@@ -0,0 +1,741 @@
+// grayscale_api.c
+#define _GNU_SOURCE     /* fopencookie */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <omp.h>
+#include "grayscale_api.h"
+#include "image_load.h"
+#include "parallel_to_grayscale.h"
+#include "png_parallel.h"
+#include "buffer_pool.h"
+#include "image_stats.h"
+#include "pipeline.h"
+#include "stream.h"
+#include "packed_batch.h"
+#include "autotune.h"
+#include "frame_map.h"
+#include "gray_sobel.h"
+#include "row_reader.h"
+#include "version.h"
+
+static __thread char last_error[256];
+
+static int fail(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(last_error, sizeof last_error, fmt, ap);
+    va_end(ap);
+    return -1;
+}
+
+const char *gs_last_error(void)
+{
+    return last_error;
+}
+
+const char *gs_version(void)
+{
+    return GS_VERSION;
+}
+
+/* ---- thread: espliciti, default o GS_THREADS_AUTO ---- */
+
+/* nthreads-var è per thread: il valore non tocca gli altri chiamanti */
+static void use_threads(int threads, double serial_secs)
+{
+    if (threads == GS_THREADS_AUTO)
+        threads = tune_threads(serial_secs, 0);
+    if (threads > 0)
+        omp_set_num_threads(threads);
+}
+
+int gs_auto_threads(const unsigned char *buf, size_t len, const char *spec,
+                    int max_threads)
+{
+    int width, height, channels;
+    if (image_info_from_memory(buf, len, &width, &height, &channels) != 0)
+        return 0;
+    pipeline_t *p = NULL;
+    if (spec && *spec) {
+        char why[256];
+        p = malloc(sizeof *p);
+        if (!p)
+            return 0;
+        /* una spec non valida fallirà dopo; qui vale come grayscale */
+        if (pipeline_parse(spec, p, why, sizeof why) != 0 ||
+            pipeline_plan(p, channels, 8, why, sizeof why) != 0) {
+            free(p);
+            p = NULL;
+        }
+    }
+    const int t = tune_image_threads(width, height, channels, p, 0, max_threads);
+    free(p);
+    return t;
+}
+
+int gs_decode(const unsigned char *buf, size_t len, gs_image *img)
+{
+    memset(img, 0, sizeof *img);
+    img->data = image_load_from_memory(buf, len, &img->width, &img->height,
+                                       &img->channels);
+    if (!img->data)
+        return fail("decode fallito: %s", image_failure_reason());
+    return 0;
+}
+
+int gs_decode_luma(const unsigned char *buf, size_t len, gs_image *img)
+{
+    memset(img, 0, sizeof *img);
+    img->channels = 1;
+    img->data = image_load_luma_from_memory(buf, len, &img->width, &img->height);
+    if (!img->data)
+        return fail("decode fallito: %s", image_failure_reason());
+    return 0;
+}
+
+int gs_process(gs_image *img, int passes, int threads, int planar, double *secs)
+{
+    if (!img->data)
+        return fail("immagine vuota");
+    if (passes < 1) passes = 1;
+    const size_t bytes = (size_t)img->width * img->height * img->channels;
+    use_threads(threads, threads == GS_THREADS_AUTO ?
+                passes * tune_cost(planar ? TUNE_LUMA : TUNE_GRAY, bytes) : 0);
+
+    unsigned char *plane = NULL;
+    if (planar) {
+        plane = pool_alloc((size_t)img->width * img->height);
+        if (!plane)
+            return fail("impossibile allocare il piano di luminanza");
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int p = 0; p < passes; ++p) {
+        if (planar)
+            rgb_to_luma_plane(img->data, plane, img->width, img->height, img->channels);
+        else
+            convert_to_grayscale(img->data, img->width, img->height, img->channels);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (secs)
+        *secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    if (planar) {
+        image_free(img->data);
+        img->data = plane;
+        img->channels = 1;
+    }
+    return 0;
+}
+
+int gs_pipeline(gs_image *img, const char *spec, int passes, int threads,
+                double *secs, char **image_json)
+{
+    if (image_json) *image_json = NULL;
+    if (!img->data)
+        return fail("immagine vuota");
+    if (passes < 1) passes = 1;
+
+    char why[256];
+    pipeline_t *p = malloc(sizeof *p);
+    if (!p)
+        return fail("impossibile allocare la pipeline");
+    if (pipeline_parse(spec, p, why, sizeof why) != 0 ||
+        pipeline_plan(p, img->channels, 8, why, sizeof why) != 0) {
+        free(p);
+        return fail("pipeline: %s", why);
+    }
+
+    const size_t px = (size_t)img->width * img->height;
+    use_threads(threads, threads == GS_THREADS_AUTO ? passes * tune_pipeline_cost(p, px) : 0);
+    unsigned char *out = pool_alloc(px * p->out_channels), *temp[2] = {NULL, NULL};
+    for (int i = 0; i < p->ntemp; ++i)
+        temp[i] = pool_alloc(px * p->temp_channels[i]);
+    image_stats_t *st = p->has_hist ? malloc(sizeof *st) : NULL;
+    int rc = 0;
+    if (!out || (p->ntemp > 0 && !temp[0]) || (p->ntemp > 1 && !temp[1]) ||
+        (p->has_hist && !st)) {
+        rc = fail("impossibile allocare i buffer della pipeline");
+    } else {
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (int k = 0; k < passes && rc == 0; ++k)
+            if (pipeline_run(p, img->data, out, temp, img->width, img->height, st) != 0)
+                rc = fail("pipeline: memoria esaurita");
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if (secs)
+            *secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    }
+    if (rc == 0 && st && image_json) {
+        size_t len;
+        FILE *f = open_memstream(image_json, &len);
+        if (f) {
+            image_stats_print_json(f, st);
+            fclose(f);
+        }
+    }
+    pool_free(temp[0]);
+    pool_free(temp[1]);
+    free(st);
+    if (rc == 0) {
+        image_free(img->data);
+        img->data = out;
+        img->channels = p->out_channels;
+    } else {
+        pool_free(out);
+    }
+    free(p);
+    return rc;
+}
+
+int gs_stats_json(const gs_image *img, int threads, char **json)
+{
+    if (!img->data)
+        return fail("immagine vuota");
+    use_threads(threads, threads == GS_THREADS_AUTO ?
+                tune_cost(TUNE_GRAY, (size_t)img->width * img->height * img->channels) : 0);
+    image_stats_t *st = malloc(sizeof *st);
+    if (!st)
+        return fail("impossibile allocare le statistiche");
+    image_stats_compute(st, img->data, img->width, img->height, img->channels);
+
+    size_t len;
+    FILE *f = open_memstream(json, &len);
+    if (!f) {
+        free(st);
+        return fail("impossibile allocare il JSON delle statistiche");
+    }
+    image_stats_print_json(f, st);
+    fclose(f);
+    free(st);
+    return 0;
+}
+
+int gs_encode_png(const gs_image *img, int level, int threads,
+                  unsigned char **out, size_t *len)
+{
+    if (!img->data)
+        return fail("immagine vuota");
+    if (threads == GS_THREADS_AUTO)
+        threads = tune_png_threads((size_t)img->width * img->height * img->channels, 0);
+    if (png_encode_parallel(img->data, img->width, img->height, img->channels,
+                            level, threads, out, len) != 0)
+        return fail("encode PNG fallito");
+    return 0;
+}
+
+/* ---- gs_stream: bande di righe tra due callback ---- */
+
+typedef struct {
+    gs_read_fn read;
+    gs_write_fn write;
+    void *ctx;
+} gs_io_t;
+
+static ssize_t io_read(void *cookie, char *buf, size_t len)
+{
+    const gs_io_t *io = cookie;
+    const long n = io->read(io->ctx, (unsigned char *)buf, len);
+    return n < 0 ? -1 : (ssize_t)n;
+}
+
+static ssize_t io_write(void *cookie, const char *buf, size_t len)
+{
+    const gs_io_t *io = cookie;
+    /* 0 per stdio è un errore di scrittura */
+    return io->write(io->ctx, (const unsigned char *)buf, len) == 0 ? (ssize_t)len : 0;
+}
+
+typedef struct {
+    int passes, planar;
+    double secs;            /* kernel, sommato su tutte le bande */
+} gs_band_t;
+
+/* halo 0: la finestra è esattamente la banda */
+static int gs_band(void *ctx, unsigned char *win, int win_y0, int win_rows,
+                   unsigned char *out, int y0, int n,
+                   int width, int height, int channels)
+{
+    gs_band_t *g = ctx;
+    (void)win_y0; (void)win_rows; (void)y0; (void)height;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int p = 0; p < g->passes; ++p) {
+        if (g->planar)
+            rgb_to_luma_plane(win, out, width, n, channels);
+        else
+            convert_to_grayscale(win, width, n, channels);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    g->secs += (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    return 0;
+}
+
+int gs_stream_supported(const unsigned char *head, size_t len)
+{
+    if (len >= 3 && head[0] == 0xFF && head[1] == 0xD8 && head[2] == 0xFF) {
+#ifdef USE_LIBJPEG
+        return 1;
+#else
+        return 0;
+#endif
+    }
+    /* PNG: firma, IHDR e metodo di interlacciamento (byte 28) a 0 */
+    if (len >= 29 && !memcmp(head, "\x89PNG\r\n\x1a\n", 8) && !memcmp(head + 12, "IHDR", 4))
+        return head[28] == 0;
+    return len >= 2 && head[0] == 'P' && (head[1] == '5' || head[1] == '6');
+}
+
+int gs_stream(gs_read_fn read, gs_write_fn write, void *ctx, int passes, int threads,
+              int planar, int level, int band_rows, gs_stream_stats *st)
+{
+    if (st) memset(st, 0, sizeof *st);
+    if (passes < 1) passes = 1;
+    if (threads > 0)
+        omp_set_num_threads(threads);
+
+    gs_io_t io = { read, write, ctx };
+    FILE *in = fopencookie(&io, "rb", (cookie_io_functions_t){ .read = io_read });
+    FILE *out = fopencookie(&io, "wb", (cookie_io_functions_t){ .write = io_write });
+    if (!in || !out) {
+        if (in) fclose(in);
+        if (out) fclose(out);
+        return fail("impossibile aprire gli stream");
+    }
+
+    gs_band_t g = { .passes = passes, .planar = planar };
+    stream_kernel_t k = { .halo = 0, .out_channels = planar ? 1 : 0,
+                          .in_place = !planar, .run = gs_band, .ctx = &g };
+    stream_stats_t ss;
+    char why[256];
+    const int rc = stream_process_file(in, out, 0, band_rows, level, &k, &ss,
+                                       why, sizeof why);
+    fclose(in);
+    /* il PNG è già stato svuotato da png_stream_close */
+    fclose(out);
+    if (rc != 0)
+        return fail("streaming: %s", why);
+    if (st) {
+        st->width = ss.width;
+        st->height = ss.height;
+        st->channels = ss.channels;
+        st->decode_secs = ss.read_secs;
+        st->kernel_secs = g.secs;
+        st->encode_secs = ss.write_secs;
+        st->total_secs = ss.total_secs;
+        st->peak_bytes = ss.peak_bytes;
+    }
+    return 0;
+}
+
+/* ---- tile: un'immagine divisa fra più nodi ---- */
+
+int gs_image_info(const unsigned char *head, size_t len, gs_info *info)
+{
+    memset(info, 0, sizeof *info);
+    info->pixels_offset = -1;
+    size_t data;
+    const int pnm = frame_pnm_header(head, len, &info->width, &info->height,
+                                     &info->channels, &data);
+    if (pnm > 0) {
+        info->pixels_offset = (long long)data;
+        return 0;
+    }
+    if (pnm == 0 && image_info_from_memory(head, len, &info->width, &info->height,
+                                           &info->channels) == 0)
+        return 0;
+    return fail("intestazione non riconosciuta");
+}
+
+typedef struct {
+    gs_band_t gray;             /* spec NULL o gray */
+    pipe_step_t step;           /* sobel, fuso con gray */
+    int passes;
+    unsigned char *luma;        /* scratch della finestra, dal pool */
+    size_t luma_cap;
+} gs_tile_kernel_t;
+
+static int gs_tile_sobel(void *ctx, unsigned char *win, int win_y0, int win_rows,
+                         unsigned char *out, int y0, int n,
+                         int width, int height, int channels)
+{
+    gs_tile_kernel_t *t = ctx;
+    const size_t need = (size_t)width * win_rows;
+    if (need > t->luma_cap) {
+        pool_free(t->luma);
+        t->luma = pool_alloc(need);
+        t->luma_cap = t->luma ? need : 0;
+        if (!t->luma) return -1;
+    }
+    for (int p = 0; p < t->passes; ++p)
+        if (gray_sobel_band(win, win_y0, win_rows, out, y0, n, width, height, channels,
+                            1, t->step.mag, t->step.border,
+                            (unsigned char)t->step.border_value, t->luma) != 0)
+            return -1;
+    return 0;
+}
+
+/* Kernel a bande di un tile per spec (vedi grayscale_api.h) */
+static int tile_kernel(const char *spec, int channels, int passes, gs_tile_kernel_t *t,
+                       stream_kernel_t *k)
+{
+    memset(t, 0, sizeof *t);
+    t->passes = t->gray.passes = passes < 1 ? 1 : passes;
+    if (!(spec && *spec)) {
+        *k = (stream_kernel_t){ .halo = 0, .out_channels = 0, .in_place = 1,
+                                .run = gs_band, .ctx = &t->gray };
+        return 0;
+    }
+    char why[256];
+    pipeline_t *p = malloc(sizeof *p);
+    if (!p)
+        return fail("impossibile allocare la pipeline");
+    if (pipeline_parse(spec, p, why, sizeof why) != 0 ||
+        pipeline_plan(p, channels, 8, why, sizeof why) != 0) {
+        free(p);
+        return fail("pipeline: %s", why);
+    }
+    const pipe_op_t op = p->steps[0].op;
+    if (p->nsteps != 1 || p->out_channels != 1 ||
+        (op != PIPE_GRAY && op != PIPE_GRAY_SOBEL && op != PIPE_SOBEL)) {
+        free(p);
+        return fail("pipeline non supportata in un tile: %s", spec);
+    }
+    t->step = p->steps[0];
+    free(p);
+    if (op == PIPE_GRAY) {
+        t->gray.planar = 1;
+        *k = (stream_kernel_t){ .halo = 0, .out_channels = 1, .run = gs_band,
+                                .ctx = &t->gray };
+    } else {
+        /* sobel su un canale: la "luminanza" è il canale stesso */
+        *k = (stream_kernel_t){ .halo = 1, .out_channels = 1, .run = gs_tile_sobel,
+                                .ctx = t };
+    }
+    return 0;
+}
+
+int gs_tile_window(int height, int channels, int y0, int rows, const char *spec,
+                   int *win_y0, int *win_rows, int *out_channels)
+{
+    gs_tile_kernel_t t;
+    stream_kernel_t k = { 0 };
+    if (tile_kernel(spec, channels, 1, &t, &k) != 0)
+        return -1;
+    if (y0 < 0 || rows <= 0 || y0 + rows > height)
+        return fail("tile [%d, %d) fuori da un'immagine alta %d", y0, y0 + rows, height);
+    stream_tile_window(height, y0, rows, k.halo, win_y0, win_rows);
+    *out_channels = k.out_channels > 0 ? k.out_channels : channels;
+    return 0;
+}
+
+int gs_tile(gs_read_fn read, gs_write_fn write, void *ctx,
+            int width, int height, int channels, int y0, int rows,
+            const char *spec, int passes, int threads, int level,
+            int band_rows, gs_tile_stats *st)
+{
+    if (st) memset(st, 0, sizeof *st);
+    gs_tile_kernel_t t;
+    stream_kernel_t k = { 0 };
+    if (tile_kernel(spec, channels, passes, &t, &k) != 0)
+        return -1;
+    if (threads > 0)
+        omp_set_num_threads(threads);
+
+    gs_io_t io = { read, write, ctx };
+    FILE *in = fopencookie(&io, "rb", (cookie_io_functions_t){ .read = io_read });
+    FILE *out = fopencookie(&io, "wb", (cookie_io_functions_t){ .write = io_write });
+    if (!in || !out) {
+        if (in) fclose(in);
+        if (out) fclose(out);
+        return fail("impossibile aprire gli stream");
+    }
+    stream_tile_t tile;
+    stream_stats_t ss;
+    char why[256];
+    const int rc = stream_tile_file(in, out, width, height, channels, y0, rows, band_rows,
+                                    level, &k, &tile, &ss, why, sizeof why);
+    fclose(in);
+    fclose(out);
+    pool_free(t.luma);
+    if (rc != 0)
+        return fail("tile [%d, %d): %s", y0, y0 + rows, why);
+    if (st) {
+        st->stream.width = ss.width;
+        st->stream.height = ss.height;
+        st->stream.channels = ss.channels;
+        st->stream.decode_secs = ss.read_secs;
+        st->stream.kernel_secs = ss.kernel_secs;
+        st->stream.encode_secs = ss.write_secs;
+        st->stream.total_secs = ss.total_secs;
+        st->stream.peak_bytes = ss.peak_bytes;
+        st->adler = tile.adler;
+        st->filtered = tile.filtered;
+    }
+    return 0;
+}
+
+int gs_decode_rows(gs_read_fn read, gs_rows_fn rows, void *ctx, int band_rows)
+{
+    if (band_rows <= 0) band_rows = STREAM_BAND_DEFAULT;
+    gs_io_t io = { read, NULL, ctx };
+    FILE *in = fopencookie(&io, "rb", (cookie_io_functions_t){ .read = io_read });
+    if (!in)
+        return fail("impossibile aprire lo stream");
+    char why[256];
+    row_reader_t *r = row_reader_fopen(in, 0, why, sizeof why);
+    if (!r) {
+        fclose(in);
+        return fail("decode: %s", why);
+    }
+    int width, height, channels;
+    row_reader_dims(r, &width, &height, &channels);
+    const size_t row = (size_t)width * channels;
+    unsigned char *band = pool_alloc(row * band_rows);
+    int rc = band ? 0 : fail("impossibile allocare la banda");
+    for (int y0 = 0; rc == 0 && y0 < height; y0 += band_rows) {
+        const int n = height - y0 < band_rows ? height - y0 : band_rows;
+        if (row_reader_read(r, band, n, why, sizeof why) != 0)
+            rc = fail("decode: %s", why);
+        else if (rows(ctx, band, y0, n, width, height, channels) != 0)
+            rc = fail("righe rifiutate alla riga %d", y0);
+    }
+    pool_free(band);
+    row_reader_close(r);
+    fclose(in);
+    return rc;
+}
+
+int gs_stitch_head(int width, int height, int out_channels, int level,
+                   unsigned char *out, size_t *len)
+{
+    if (width <= 0 || height <= 0 || out_channels < 1 || out_channels > 4)
+        return fail("dimensioni non valide: %dx%dx%d", width, height, out_channels);
+    *len = png_stitch_head(out, width, height, out_channels, level);
+    return 0;
+}
+
+int gs_stitch_tail(const unsigned int *adlers, const unsigned long long *filtered,
+                   int n, unsigned char *out, size_t *len)
+{
+    if (n < 1)
+        return fail("nessun frammento");
+    *len = png_stitch_tail(out, adlers, filtered, n);
+    return 0;
+}
+
+/* ---- batch: molte immagini, un team ---- */
+
+static void batch_dims(const gs_batch *b, packed_image_t *imgs)
+{
+    for (int i = 0; i < b->count; ++i) {
+        imgs[i].offset = b->items[i].offset;
+        imgs[i].width = b->items[i].width;
+        imgs[i].height = b->items[i].height;
+        imgs[i].channels = b->items[i].channels;
+    }
+}
+
+int gs_batch_decode(const unsigned char *const *bufs, const size_t *lens, int n,
+                    int threads, gs_batch *b)
+{
+    memset(b, 0, sizeof *b);
+    if (threads > 0)
+        omp_set_num_threads(threads);
+    unsigned char **pixels = calloc(n > 0 ? n : 1, sizeof *pixels);
+    packed_image_t *imgs = calloc(n > 0 ? n : 1, sizeof *imgs);
+    b->items = calloc(n > 0 ? n : 1, sizeof *b->items);
+    if (!pixels || !imgs || !b->items) {
+        free(pixels);
+        free(imgs);
+        free(b->items);
+        b->items = NULL;
+        return fail("impossibile allocare il batch");
+    }
+    b->count = n;
+
+    /* immagini piccole: una per thread, poi tutte nello stesso buffer */
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int i = 0; i < n; ++i) {
+        pixels[i] = image_load_from_memory(bufs[i], lens[i], &imgs[i].width,
+                                           &imgs[i].height, &imgs[i].channels);
+        if (!pixels[i])
+            imgs[i].width = imgs[i].height = imgs[i].channels = 0;
+    }
+
+    b->size = packed_layout(imgs, n, 0, imgs);
+    b->data = pool_alloc(b->size > 0 ? b->size : 1);
+    int rc = b->data ? 0 : fail("impossibile allocare il buffer del batch");
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int i = 0; i < n; ++i) {
+        if (pixels[i] && b->data)
+            memcpy(b->data + imgs[i].offset, pixels[i],
+                   (size_t)imgs[i].width * imgs[i].height * imgs[i].channels);
+        image_free(pixels[i]);
+    }
+    for (int i = 0; i < n; ++i) {
+        b->items[i].offset = imgs[i].offset;
+        b->items[i].width = imgs[i].width;
+        b->items[i].height = imgs[i].height;
+        b->items[i].channels = imgs[i].channels;
+    }
+    free(pixels);
+    free(imgs);
+    if (rc != 0)
+        gs_batch_free(b);
+    return rc;
+}
+
+int gs_batch_process(gs_batch *b, const char *spec, int passes, int threads,
+                     double *secs)
+{
+    if (!b->data)
+        return fail("batch vuoto");
+    if (passes < 1) passes = 1;
+    if (threads > 0)
+        omp_set_num_threads(threads);
+
+    packed_image_t *imgs = malloc((b->count > 0 ? b->count : 1) * sizeof *imgs);
+    if (!imgs)
+        return fail("impossibile allocare il batch");
+    batch_dims(b, imgs);
+
+    /* la pipeline deve ridursi a un solo kernel per riga, uguale per ogni
+     * numero di canali presente nel batch */
+    const int in_place = !(spec && *spec);
+    pipe_step_t step = { .op = PIPE_GRAY };
+    if (!in_place) {
+        char why[256];
+        pipeline_t *p = malloc(sizeof *p);
+        if (!p) {
+            free(imgs);
+            return fail("impossibile allocare la pipeline");
+        }
+        if (pipeline_parse(spec, p, why, sizeof why) != 0) {
+            free(p);
+            free(imgs);
+            return fail("pipeline: %s", why);
+        }
+        for (int i = 0; i < b->count; ++i) {
+            if (imgs[i].width == 0)
+                continue;
+            pipeline_t plan = *p;
+            if (pipeline_plan(&plan, imgs[i].channels, 8, why, sizeof why) != 0) {
+                free(p);
+                free(imgs);
+                return fail("pipeline: %s", why);
+            }
+            const pipe_op_t op = plan.steps[0].op;
+            if (plan.nsteps != 1 || plan.out_channels != 1 ||
+                (op != PIPE_GRAY && op != PIPE_GRAY_SOBEL && op != PIPE_SOBEL)) {
+                free(p);
+                free(imgs);
+                return fail("pipeline non supportata in batch: %s", spec);
+            }
+            step = plan.steps[0];
+            /* sobel su un canale: la "luminanza" è il canale stesso */
+            if (step.op == PIPE_SOBEL)
+                step.op = PIPE_GRAY_SOBEL;
+        }
+        free(p);
+    }
+
+    packed_image_t *out_imgs = NULL;
+    unsigned char *out = NULL, *luma = NULL;
+    size_t out_size = 0;
+    int rc = 0;
+    if (!in_place) {
+        out_imgs = malloc((b->count > 0 ? b->count : 1) * sizeof *out_imgs);
+        if (out_imgs)
+            out_size = packed_layout(imgs, b->count, 1, out_imgs);
+        out = out_imgs ? pool_alloc(out_size > 0 ? out_size : 1) : NULL;
+        if (step.op == PIPE_GRAY_SOBEL && out)
+            luma = pool_alloc(out_size > 0 ? out_size : 1);
+        if (!out || (step.op == PIPE_GRAY_SOBEL && !luma))
+            rc = fail("impossibile allocare i piani del batch");
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int k = 0; k < passes && rc == 0; ++k) {
+        int r;
+        if (in_place)
+            r = packed_grayscale(b->data, imgs, b->count);
+        else if (step.op == PIPE_GRAY)
+            r = packed_luma(b->data, imgs, b->count, out, out_imgs);
+        else
+            r = packed_gray_sobel(b->data, imgs, b->count, out, out_imgs, luma,
+                                  step.mag, step.border, (unsigned char)step.border_value);
+        if (r != 0)
+            rc = fail("batch: memoria esaurita");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (secs)
+        *secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+    pool_free(luma);
+    if (rc == 0 && out) {
+        pool_free(b->data);
+        b->data = out;
+        b->size = out_size;
+        for (int i = 0; i < b->count; ++i) {
+            b->items[i].offset = out_imgs[i].offset;
+            b->items[i].channels = b->items[i].width ? 1 : 0;
+        }
+    } else {
+        pool_free(out);
+    }
+    free(out_imgs);
+    free(imgs);
+    return rc;
+}
+
+int gs_batch_encode_png(const gs_batch *b, int level, int threads,
+                        unsigned char **outs, size_t *lens)
+{
+    if (!b->data)
+        return fail("batch vuoto");
+    if (threads > 0)
+        omp_set_num_threads(threads);
+
+    /* un PNG per thread: l'encoder parallelo su una miniatura non rende */
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int i = 0; i < b->count; ++i) {
+        const gs_batch_item *it = &b->items[i];
+        outs[i] = NULL;
+        lens[i] = 0;
+        if (it->width == 0 ||
+            png_encode_parallel(b->data + it->offset, it->width, it->height,
+                                it->channels, level, 1, &outs[i], &lens[i]) != 0) {
+            outs[i] = NULL;
+            lens[i] = 0;
+        }
+    }
+    return 0;
+}
+
+void gs_batch_free(gs_batch *b)
+{
+    pool_free(b->data);
+    free(b->items);
+    memset(b, 0, sizeof *b);
+}
+
+void gs_image_free(gs_image *img)
+{
+    /* decode (stb o pool) e piano planar (pool): pool_free li gestisce tutti */
+    image_free(img->data);
+    img->data = NULL;
+}
+
+void gs_free(void *p)
+{
+    pool_free(p);
+}
@@ -0,0 +1,280 @@
+// image_load.c
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stb_image.h"
+#include "image_load.h"
+#include "parallel_to_grayscale.h"
+#include "buffer_pool.h"
+
+#ifdef USE_LIBJPEG
+#include <setjmp.h>
+#include <jpeglib.h>
+#endif
+
+static __thread char last_error[256];
+
+const char *image_failure_reason(void)
+{
+    return last_error;
+}
+
+static void set_error(const char *msg)
+{
+    snprintf(last_error, sizeof last_error, "%s", msg);
+}
+
+#ifdef USE_LIBJPEG
+/* ---- libjpeg-turbo ---- */
+
+const char *image_jpeg_backend(void)
+{
+    return "libjpeg-turbo";
+}
+
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf jmp;
+} jpeg_err_t;
+
+static void jpeg_err_exit(j_common_ptr cinfo)
+{
+    jpeg_err_t *err = (jpeg_err_t *)cinfo->err;
+    cinfo->err->format_message(cinfo, last_error);
+    longjmp(err->jmp, 1);
+}
+
+/* i warning (es. dati corrotti recuperabili) non vanno su stderr */
+static void jpeg_err_silent(j_common_ptr cinfo)
+{
+    (void)cinfo;
+}
+
+static int is_jpeg(const unsigned char *p, size_t len)
+{
+    return len >= 3 && p[0] == 0xFF && p[1] == 0xD8 && p[2] == 0xFF;
+}
+
+/* Da file (f) o da memoria (buf, len). NULL se turbo non può decodificare:
+ * il chiamante ricade su stb. luma = 1 chiede direttamente il piano Y. */
+static unsigned char *turbo_decode(FILE *f, const unsigned char *buf, size_t len,
+                                   int luma, int *width, int *height, int *channels)
+{
+    struct jpeg_decompress_struct cinfo;
+    jpeg_err_t err;
+    unsigned char *volatile pixels = NULL;
+
+    cinfo.err = jpeg_std_error(&err.pub);
+    err.pub.error_exit = jpeg_err_exit;
+    err.pub.output_message = jpeg_err_silent;
+    if (setjmp(err.jmp)) {
+        jpeg_destroy_decompress(&cinfo);
+        pool_free(pixels);
+        return NULL;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    if (f) jpeg_stdio_src(&cinfo, f);
+    else   jpeg_mem_src(&cinfo, buf, (unsigned long)len);
+    jpeg_read_header(&cinfo, TRUE);
+
+    if (cinfo.jpeg_color_space == JCS_CMYK || cinfo.jpeg_color_space == JCS_YCCK) {
+        set_error("JPEG CMYK/YCCK");
+        jpeg_destroy_decompress(&cinfo);
+        return NULL;
+    }
+    cinfo.out_color_space =
+        (luma || cinfo.jpeg_color_space == JCS_GRAYSCALE) ? JCS_GRAYSCALE : JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+
+    const size_t stride = (size_t)cinfo.output_width * cinfo.output_components;
+    pixels = pool_alloc(stride * cinfo.output_height);
+    if (!pixels) {
+        set_error("memoria insufficiente");
+        jpeg_destroy_decompress(&cinfo);
+        return NULL;
+    }
+
+    /* rec_outbuf_height righe per chiamata: evita il buffer intermedio */
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW rows[4];
+        JDIMENSION n = cinfo.output_height - cinfo.output_scanline;
+        if (n > (JDIMENSION)cinfo.rec_outbuf_height) n = cinfo.rec_outbuf_height;
+        if (n > 4) n = 4;
+        for (JDIMENSION k = 0; k < n; ++k)
+            rows[k] = pixels + (cinfo.output_scanline + k) * stride;
+        jpeg_read_scanlines(&cinfo, rows, n);
+    }
+    jpeg_finish_decompress(&cinfo);
+
+    *width = cinfo.output_width;
+    *height = cinfo.output_height;
+    *channels = cinfo.output_components;
+    jpeg_destroy_decompress(&cinfo);
+    return pixels;
+}
+
+static unsigned char *turbo_decode_file(const char *path, int luma,
+                                        int *width, int *height, int *channels)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    unsigned char magic[3];
+    unsigned char *pixels = NULL;
+    if (fread(magic, 1, 3, f) == 3 && is_jpeg(magic, 3)) {
+        rewind(f);
+        pixels = turbo_decode(f, NULL, 0, luma, width, height, channels);
+    }
+    fclose(f);
+    return pixels;
+}
+
+static unsigned char *turbo_decode_mem(const unsigned char *buf, size_t len, int luma,
+                                       int *width, int *height, int *channels)
+{
+    if (!is_jpeg(buf, len)) return NULL;
+    return turbo_decode(NULL, buf, len, luma, width, height, channels);
+}
+
+#else
+/* ---- solo stb ---- */
+
+const char *image_jpeg_backend(void)
+{
+    return "stb";
+}
+
+static unsigned char *turbo_decode_file(const char *path, int luma,
+                                        int *width, int *height, int *channels)
+{
+    (void)path; (void)luma; (void)width; (void)height; (void)channels;
+    return NULL;
+}
+
+static unsigned char *turbo_decode_mem(const unsigned char *buf, size_t len, int luma,
+                                       int *width, int *height, int *channels)
+{
+    (void)buf; (void)len; (void)luma; (void)width; (void)height; (void)channels;
+    return NULL;
+}
+#endif
+
+/* ---- API ---- */
+
+static unsigned char *stb_result(unsigned char *pixels)
+{
+    if (!pixels) set_error(stbi_failure_reason());
+    return pixels;
+}
+
+unsigned char *image_load(const char *path, int *width, int *height, int *channels)
+{
+    unsigned char *pixels = turbo_decode_file(path, 0, width, height, channels);
+    if (pixels) return pixels;
+    return stb_result(stbi_load(path, width, height, channels, 0));
+}
+
+unsigned char *image_load_from_memory(const unsigned char *buf, size_t len,
+                                      int *width, int *height, int *channels)
+{
+    unsigned char *pixels = turbo_decode_mem(buf, len, 0, width, height, channels);
+    if (pixels) return pixels;
+    if (len > (size_t)0x7fffffff) {
+        set_error("buffer troppo grande");
+        return NULL;
+    }
+    return stb_result(stbi_load_from_memory(buf, (int)len, width, height, channels, 0));
+}
+
+/* decode completo già fatto: riduce a un canale con il kernel SIMD */
+static unsigned char *to_luma(unsigned char *pixels, int width, int height, int channels)
+{
+    if (!pixels || channels == 1) return pixels;
+    unsigned char *plane = pool_alloc((size_t)width * height);
+    if (!plane) set_error("memoria insufficiente");
+    else rgb_to_luma_plane(pixels, plane, width, height, channels);
+    stbi_image_free(pixels);
+    return plane;
+}
+
+unsigned char *image_load_luma(const char *path, int *width, int *height)
+{
+    int channels;
+    unsigned char *pixels = turbo_decode_file(path, 1, width, height, &channels);
+    if (pixels) return pixels;
+    pixels = stb_result(stbi_load(path, width, height, &channels, 0));
+    return to_luma(pixels, *width, *height, channels);
+}
+
+unsigned char *image_load_luma_from_memory(const unsigned char *buf, size_t len,
+                                           int *width, int *height)
+{
+    int channels;
+    unsigned char *pixels = turbo_decode_mem(buf, len, 1, width, height, &channels);
+    if (pixels) return pixels;
+    if (len > (size_t)0x7fffffff) {
+        set_error("buffer troppo grande");
+        return NULL;
+    }
+    pixels = stb_result(stbi_load_from_memory(buf, (int)len, width, height, &channels, 0));
+    return to_luma(pixels, *width, *height, channels);
+}
+
+/* 1 se path inizia con l'header di un PGM/PPM binario */
+static int is_pnm(const char *path)
+{
+    unsigned char magic[2] = {0};
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    const size_t got = fread(magic, 1, 2, f);
+    fclose(f);
+    return got == 2 && magic[0] == 'P' && (magic[1] == '5' || magic[1] == '6');
+}
+
+uint16_t *image_load_16(const char *path, int *width, int *height, int *channels)
+{
+    uint16_t *pixels = stbi_load_16(path, width, height, channels, 0);
+    if (!pixels) {
+        set_error(stbi_failure_reason());
+        return NULL;
+    }
+    /* stb (v2.30) copia i campioni PNM a 16 bit nell'ordine del file, big
+     * endian come da specifica, senza girarli come fa per il PNG */
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (image_is_16_bit(path) && is_pnm(path)) {
+        const size_t n = (size_t)*width * *height * *channels;
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < n; ++i)
+            pixels[i] = (uint16_t)(pixels[i] << 8 | pixels[i] >> 8);
+    }
+#endif
+    return pixels;
+}
+
+int image_is_16_bit(const char *path)
+{
+    return stbi_is_16_bit(path);
+}
+
+int image_info(const char *path, int *width, int *height, int *channels)
+{
+    return stbi_info(path, width, height, channels) ? 0 : -1;
+}
+
+int image_info_from_memory(const unsigned char *buf, size_t len,
+                           int *width, int *height, int *channels)
+{
+    if (len > (size_t)0x7fffffff) {
+        set_error("buffer troppo grande");
+        return -1;
+    }
+    return stbi_info_from_memory(buf, (int)len, width, height, channels) ? 0 : -1;
+}
+
+void image_free(void *pixels)
+{
+    /* turbo e to_luma prendono dal pool, stb da malloc: pool_free gestisce entrambi */
+    pool_free(pixels);
+}
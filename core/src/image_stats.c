@@ -0,0 +1,121 @@
+// image_stats.c
+#include <string.h>
+#include <omp.h>
+#include "image_stats.h"
+
+#define STATS_COPIES 4
+
+typedef uint32_t local_hist_t[STATS_COPIES][STATS_MAX_CHANNELS][STATS_BINS];
+
+void image_stats_reset(image_stats_t *st, int channels)
+{
+    memset(st, 0, sizeof *st);
+    st->channels = channels < 1 ? 1
+                 : (channels > STATS_MAX_CHANNELS ? STATS_MAX_CHANNELS : channels);
+}
+
+/* CH costante dopo l'inline: gli incrementi dei 4 pixel di un gruppo vanno
+ * in 4 copie diverse, senza dipendenze fra loro */
+static inline __attribute__((always_inline))
+void count_row(local_hist_t h, const unsigned char *r, int width, int CH)
+{
+    int x = 0;
+    for (; x + STATS_COPIES <= width; x += STATS_COPIES, r += STATS_COPIES * CH)
+        for (int p = 0; p < STATS_COPIES; ++p)
+            for (int c = 0; c < CH; ++c)
+                h[p][c][r[p * CH + c]]++;
+    for (; x < width; ++x, r += CH)
+        for (int c = 0; c < CH; ++c)
+            h[0][c][r[c]]++;
+}
+
+void image_stats_add(image_stats_t *st, const unsigned char *pix, int width, int rows)
+{
+    const int ch = st->channels;
+    const size_t stride = (size_t)width * ch;
+    const double t0 = omp_get_wtime();
+
+    #pragma omp parallel
+    {
+        local_hist_t h;
+        for (int p = 0; p < STATS_COPIES; ++p)
+            memset(h[p], 0, (size_t)ch * sizeof h[p][0]);
+
+        #pragma omp for schedule(static) nowait
+        for (int y = 0; y < rows; ++y) {
+            const unsigned char *r = pix + (size_t)y * stride;
+            switch (ch) {
+            case 1:  count_row(h, r, width, 1); break;
+            case 2:  count_row(h, r, width, 2); break;
+            case 3:  count_row(h, r, width, 3); break;
+            default: count_row(h, r, width, 4); break;
+            }
+        }
+
+        /* 4 copie → una, poi nell'istogramma condiviso */
+        uint64_t sum[STATS_MAX_CHANNELS][STATS_BINS];
+        for (int c = 0; c < ch; ++c) {
+            #pragma omp simd
+            for (int b = 0; b < STATS_BINS; ++b)
+                sum[c][b] = (uint64_t)h[0][c][b] + h[1][c][b] + h[2][c][b] + h[3][c][b];
+        }
+        #pragma omp critical(image_stats_merge)
+        for (int c = 0; c < ch; ++c) {
+            #pragma omp simd
+            for (int b = 0; b < STATS_BINS; ++b)
+                st->hist[c][b] += sum[c][b];
+        }
+    }
+    st->pixels += (uint64_t)width * rows;
+    st->secs += omp_get_wtime() - t0;
+}
+
+void image_stats_finish(image_stats_t *st)
+{
+    for (int c = 0; c < st->channels; ++c) {
+        const uint64_t *h = st->hist[c];
+        uint64_t n = 0, weighted = 0;
+        #pragma omp simd reduction(+:n, weighted)
+        for (int b = 0; b < STATS_BINS; ++b) {
+            n += h[b];
+            weighted += h[b] * (uint64_t)b;
+        }
+        int lo = 0, hi = STATS_BINS - 1;
+        while (lo < STATS_BINS - 1 && !h[lo]) ++lo;
+        while (hi > 0 && !h[hi]) --hi;
+        st->mean[c] = n ? (double)weighted / (double)n : 0.0;
+        st->min[c] = n ? lo : 0;
+        st->max[c] = n ? hi : 0;
+    }
+}
+
+void image_stats_compute(image_stats_t *st, const unsigned char *pix,
+                         int width, int height, int channels)
+{
+    image_stats_reset(st, channels);
+    image_stats_add(st, pix, width, height);
+    image_stats_finish(st);
+}
+
+void image_stats_print_json(FILE *f, const image_stats_t *st)
+{
+    fprintf(f, "{\"pixels\":%llu,\"channels\":%d", (unsigned long long)st->pixels,
+            st->channels);
+    fputs(",\"mean\":[", f);
+    for (int c = 0; c < st->channels; ++c)
+        fprintf(f, "%s%.3f", c ? "," : "", st->mean[c]);
+    fputs("],\"min\":[", f);
+    for (int c = 0; c < st->channels; ++c)
+        fprintf(f, "%s%d", c ? "," : "", st->min[c]);
+    fputs("],\"max\":[", f);
+    for (int c = 0; c < st->channels; ++c)
+        fprintf(f, "%s%d", c ? "," : "", st->max[c]);
+    fputs("],\"hist\":[", f);
+    for (int c = 0; c < st->channels; ++c) {
+        fputs(c ? ",[" : "[", f);
+        for (int b = 0; b < STATS_BINS; ++b)
+            fprintf(f, "%s%llu", b ? "," : "", (unsigned long long)st->hist[c][b]);
+        fputc(']', f);
+    }
+    fprintf(f, "],\"stats_s\":%.6f}", st->secs);
+}
@@ -0,0 +1,813 @@
+// main.c
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "image_load.h"
+#include "parallel_to_grayscale.h"
+#include "server.h"
+#include "batch.h"
+#include "png_parallel.h"
+#include "timing.h"
+#include "affinity.h"
+#include "buffer_pool.h"
+#include "stream.h"
+#include "frame_map.h"
+#include "image_stats.h"
+#include "pipeline.h"
+#include "autotune.h"
+#include "version.h"
+
+static int default_threads = 1;
+
+/* Copia parallela di rows righe (stesso schedule dei kernel) */
+static void copy_rows(unsigned char *dst, const unsigned char *src, size_t row_bytes, int rows)
+{
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < rows; y++)
+        memcpy(dst + (size_t)y * row_bytes, src + (size_t)y * row_bytes, row_bytes);
+}
+
+/* Come process_image su campioni a 16 bit: stbi_load_16, kernel u16
+ * (grayscale in-place o piano Y, oppure la pipeline) e PNG a 16 bit.
+ * Niente mmap (i frame mappati sono a 8 bit) né istogramma; luma vale
+ * planar, non c'è un decoder che dia Y a 16 bit. */
+static int process_image16(const char *in_path, const char *out_path, const char *raw,
+                           int passes, int planar, int level, int perf, int histogram,
+                           const pipeline_t *pipe, timing_report_t *rep,
+                           char *err, size_t errlen)
+{
+    if (timing_report_init(rep, passes) != 0) {
+        snprintf(err, errlen, "Impossibile allocare il report dei tempi");
+        return -1;
+    }
+    rep->depth = 16;
+    if (raw || histogram) {
+        snprintf(err, errlen, "A 16 bit niente --raw né --histogram (--depth=8)");
+        return -1;
+    }
+    if (frame_format_of(out_path) != FRAME_PNG) {
+        snprintf(err, errlen, "A 16 bit l'uscita è solo PNG: \"%s\"", out_path);
+        return -1;
+    }
+    const double start = timing_now();
+    double t = start;
+
+    int width, height, channels;
+    uint16_t *img = image_load_16(in_path, &width, &height, &channels);
+    if (!img) {
+        snprintf(err, errlen, "Errore caricando immagine \"%s\": %s",
+                 in_path, image_failure_reason());
+        return -1;
+    }
+    rep->secs[STAGE_DECODE] = timing_now() - t;
+    rep->width = width;
+    rep->height = height;
+    rep->channels = channels;
+    rep->threads = omp_get_max_threads();
+
+    t = timing_now();
+    #pragma omp parallel
+    { }
+    rep->secs[STAGE_THREADS] = timing_now() - t;
+
+    t = timing_now();
+    const size_t row = (size_t)width * channels * sizeof *img;
+    uint16_t *local = (uint16_t *)affinity_adopt_rows((unsigned char *)img, row, height);
+    if (!local) {
+        snprintf(err, errlen, "Impossibile allocare il buffer dell'immagine");
+        image_free(img);
+        return -1;
+    }
+    if (local != img) {
+        image_free(img);
+        img = local;
+    }
+
+    pipeline_t plan;
+    char why[256];
+    if (pipe) {
+        plan = *pipe;
+        if (pipeline_plan(&plan, channels, 16, why, sizeof why) != 0) {
+            snprintf(err, errlen, "Pipeline: %s", why);
+            image_free(img);
+            return -1;
+        }
+    }
+    const int out_ch = pipe ? plan.out_channels : planar ? 1 : channels;
+    uint16_t *plane = NULL, *temp[2] = {NULL, NULL};
+    if (pipe || planar) {
+        plane = affinity_alloc_rows((size_t)width * out_ch * sizeof *plane, height);
+        for (int i = 0; pipe && i < plan.ntemp; ++i)
+            temp[i] = affinity_alloc_rows((size_t)width * plan.temp_channels[i] *
+                                          sizeof *plane, height);
+        if (!plane || (pipe && plan.ntemp > 0 && !temp[0]) ||
+            (pipe && plan.ntemp > 1 && !temp[1])) {
+            snprintf(err, errlen, "Impossibile allocare il piano di luminanza");
+            pool_free(plane);
+            pool_free(temp[0]); pool_free(temp[1]);
+            image_free(img);
+            return -1;
+        }
+    }
+    rep->secs[STAGE_ALLOC] = timing_now() - t;
+
+    perf_session_t *ps = perf ? perf_begin() : NULL;
+    const double k0 = timing_now();
+    int prc = 0;
+    for (int p = 0; p < passes && prc == 0; ++p) {
+        t = timing_now();
+        if (pipe)
+            prc = pipeline_run_u16(&plan, img, plane, temp, width, height);
+        else if (planar)
+            rgb_to_luma_plane_u16(img, plane, width, height, channels);
+        else
+            convert_to_grayscale_u16(img, width, height, channels);
+        rep->pass_secs[p] = timing_now() - t;
+    }
+    rep->secs[STAGE_KERNEL] = timing_now() - k0;
+    perf_end(ps, &rep->perf);
+    pool_free(temp[0]);
+    pool_free(temp[1]);
+    if (prc != 0) {
+        snprintf(err, errlen, "Pipeline: memoria esaurita");
+        pool_free(plane);
+        image_free(img);
+        return -1;
+    }
+    const double px = (double)width * height * sizeof *img;
+    if (pipe)               rep->kernel_bytes = passes * pipeline_bytes(&plan, width, height);
+    else if (planar)        rep->kernel_bytes = passes * px * (channels + 1);
+    else if (channels >= 3) rep->kernel_bytes = passes * px * channels * 2;
+
+    t = timing_now();
+    const int rc = plane
+        ? png_write_parallel16(out_path, plane, width, height, out_ch, level, 0)
+        : png_write_parallel16(out_path, img, width, height, channels, level, 0);
+    pool_free(plane);
+    image_free(img);
+    if (rc != 0) {
+        snprintf(err, errlen, "Errore nel salvataggio di \"%s\"", out_path);
+        return -1;
+    }
+    rep->secs[STAGE_ENCODE] = timing_now() - t;
+    rep->total = timing_now() - start;
+    return 0;
+}
+
+/* decode → kernel ×passes → PNG, con il tempo di ogni stadio in rep
+ * (timing_report_free a carico del chiamante, anche in caso di errore).
+ * depth: 16 passa da process_image16; 0 (auto) sceglie 16 per un ingresso
+ * PNG/PGM/PPM a 16 bit verso un PNG, se non serve l'istogramma; 8 tronca
+ * come stbi_load. 
+ * luma: decode direttamente nel piano Y (PNG a 1 canale), kernel saltato.
+ * perf: contatori hardware attorno al kernel.
+ * histogram: istogramma e media/min/max per canale dell'ingresso decodificato
+ * (di Y con luma) in rep->image, prima del kernel.
+ * pipe (non NULL): al posto del kernel grayscale la pipeline (pipeline.h),
+ * pianificata sui canali dell'ingresso; il suo stadio hist va in rep->image.
+ * Ingresso raw (raw = "WxH[xC]") o PGM/PPM e uscita .raw/.pgm/.ppm passano
+ * da frame_map.h: il kernel lavora sulle pagine mappate, senza decode né
+ * encode. Un ingresso mappato con luma usa il kernel planar (una passata):
+ * non c'è un decoder che dia Y gratis. */
+static int process_image(const char *in_path, const char *out_path, const char *raw,
+                         int passes, int planar, int luma, int level, int perf,
+                         int histogram, const pipeline_t *pipe, int depth,
+                         timing_report_t *rep, char *err, size_t errlen)
+{
+    const int want_hist = histogram || (pipe && pipe->has_hist);
+    if (depth == 0)
+        depth = !raw && !want_hist && frame_format_of(out_path) == FRAME_PNG &&
+                image_is_16_bit(in_path) ? 16 : 8;
+    if (depth == 16)
+        return process_image16(in_path, out_path, raw, passes, planar || luma, level,
+                               perf, histogram, pipe, rep, err, errlen);
+    if (pipe && pipe->has_hist) histogram = 0;     /* vale lo stadio hist */
+    if (timing_report_init(rep, luma && !pipe ? 0 : passes) != 0 ||
+        ((histogram || (pipe && pipe->has_hist)) &&
+         !(rep->image = malloc(sizeof *rep->image)))) {
+        snprintf(err, errlen, "Impossibile allocare il report dei tempi");
+        return -1;
+    }
+    const double start = timing_now();
+    double t = start;
+
+    int width, height, channels = 1;
+    unsigned char *img;
+    frame_map_t in_map, out_map = {0};
+    char why[256];
+    int mapped = frame_map_input(in_path, raw, &in_map, why, sizeof why);
+    if (mapped < 0) {
+        snprintf(err, errlen, "Errore caricando immagine \"%s\": %s", in_path, why);
+        return -1;
+    }
+    if (mapped) {
+        img = in_map.pixels;
+        width = in_map.width;
+        height = in_map.height;
+        channels = in_map.channels;
+        if (luma && !pipe) {
+            planar = 1;
+            passes = rep->passes = 1;
+        }
+        luma = 0;
+        /* uscita sullo stesso file: crearla lo troncherebbe sotto la
+         * mappatura privata (zeri o SIGBUS), si lavora su una copia */
+        if (frame_same_file(in_path, out_path)) {
+            img = frame_detach(&in_map);
+            if (!img) {
+                frame_unmap(&in_map);
+                snprintf(err, errlen, "Impossibile allocare il buffer dell'immagine");
+                return -1;
+            }
+            mapped = 0;
+        }
+    } else {
+        img = luma
+            ? image_load_luma(in_path, &width, &height)
+            : image_load(in_path, &width, &height, &channels);
+        if (!img) {
+            snprintf(err, errlen, "Errore caricando immagine \"%s\": %s",
+                     in_path, image_failure_reason());
+            return -1;
+        }
+    }
+    rep->secs[STAGE_DECODE] = timing_now() - t;
+    rep->width = width;
+    rep->height = height;
+    rep->channels = channels;
+    rep->threads = omp_get_max_threads();
+
+    /* regione vuota: avvio del team (CLI) o risveglio (--serve) fuori dal kernel */
+    t = timing_now();
+    #pragma omp parallel
+    { }
+    rep->secs[STAGE_THREADS] = timing_now() - t;
+
+    /* first touch (se attivo): le righe di img passano sul nodo del thread
+     * che le elaborerà; il decode le ha scritte tutte dal thread principale.
+     * Le pagine mappate restano dove sono: copiarle annullerebbe lo zero-copy */
+    t = timing_now();
+    if (!mapped) {
+        unsigned char *local = affinity_adopt_rows(img, (size_t)width * channels, height);
+        if (!local) {
+            snprintf(err, errlen, "Impossibile allocare il buffer dell'immagine");
+            image_free(img);
+            return -1;
+        }
+        if (local != img) {
+            image_free(img);
+            img = local;
+        }
+    }
+
+    pipeline_t plan;
+    if (pipe) {
+        plan = *pipe;
+        if (pipeline_plan(&plan, channels, 8, why, sizeof why) != 0) {
+            snprintf(err, errlen, "Pipeline: %s", why);
+            if (mapped) frame_unmap(&in_map); else image_free(img);
+            return -1;
+        }
+    }
+
+    /* uscita mappata: il kernel scrive direttamente nel file */
+    const frame_format_t out_fmt = frame_format_of(out_path);
+    const int out_ch = pipe ? plan.out_channels : (planar || luma) ? 1 : channels;
+    if (out_fmt != FRAME_PNG &&
+        frame_map_output(out_path, out_fmt, width, height, out_ch, &out_map,
+                         why, sizeof why) != 0) {
+        snprintf(err, errlen, "Errore nel salvataggio di \"%s\": %s", out_path, why);
+        if (mapped) frame_unmap(&in_map); else image_free(img);
+        return -1;
+    }
+
+    /* piano Y a 1 canale: niente scrittura ×3 né PNG RGB da codificare.
+     * La pipeline scrive anche lei in plane, con out_ch canali, passando
+     * per i soli buffer intermedi del piano */
+    unsigned char *plane = NULL, *work = img, *temp[2] = {NULL, NULL};
+    if (pipe || (planar && !luma)) {
+        plane = out_map.pixels ? out_map.pixels
+                               : affinity_alloc_rows((size_t)width * out_ch, height);
+        for (int i = 0; pipe && i < plan.ntemp; ++i)
+            temp[i] = affinity_alloc_rows((size_t)width * plan.temp_channels[i], height);
+        if (!plane || (pipe && plan.ntemp > 0 && !temp[0]) ||
+            (pipe && plan.ntemp > 1 && !temp[1])) {
+            snprintf(err, errlen, "Impossibile allocare il piano di luminanza");
+            if (plane != out_map.pixels) pool_free(plane);
+            pool_free(temp[0]); pool_free(temp[1]);
+            frame_unmap(&out_map);
+            if (mapped) frame_unmap(&in_map); else image_free(img);
+            return -1;
+        }
+    } else if (out_map.pixels) {
+        /* in-place (o Y già decodificata): l'unica copia è verso il file */
+        copy_rows(out_map.pixels, img, (size_t)width * channels, height);
+        work = out_map.pixels;
+    }
+    rep->secs[STAGE_ALLOC] = timing_now() - t;
+
+    /* stesso team del kernel; i pixel sono quelli che il kernel leggerà */
+    if (histogram)
+        image_stats_compute(rep->image, work, width, height, channels);
+
+    if (pipe) {
+        /* ogni passata riparte dall'ingresso */
+        perf_session_t *ps = perf ? perf_begin() : NULL;
+        const double k0 = timing_now();
+        int prc = 0;
+        for (int p = 0; p < passes && prc == 0; ++p) {
+            t = timing_now();
+            prc = pipeline_run(&plan, work, plane, temp, width, height, rep->image);
+            rep->pass_secs[p] = timing_now() - t;
+        }
+        rep->secs[STAGE_KERNEL] = timing_now() - k0;
+        perf_end(ps, &rep->perf);
+        rep->kernel_bytes = passes * pipeline_bytes(&plan, width, height);
+        pool_free(temp[0]);
+        pool_free(temp[1]);
+        if (prc != 0) {
+            snprintf(err, errlen, "Pipeline: memoria esaurita");
+            if (plane != out_map.pixels) pool_free(plane);
+            frame_unmap(&out_map);
+            if (mapped) frame_unmap(&in_map); else image_free(img);
+            return -1;
+        }
+    } else if (!luma) {
+        perf_session_t *ps = perf ? perf_begin() : NULL;
+        const double k0 = timing_now();
+        for (int p = 0; p < passes; ++p) {
+            t = timing_now();
+            if (planar)
+                rgb_to_luma_plane(work, plane, width, height, channels);
+            else
+                convert_to_grayscale(work, width, height, channels);
+            rep->pass_secs[p] = timing_now() - t;
+        }
+        rep->secs[STAGE_KERNEL] = timing_now() - k0;
+        perf_end(ps, &rep->perf);
+
+        /* in-place con meno di 3 canali il kernel non tocca nulla */
+        const double px = (double)width * height;
+        if (planar)            rep->kernel_bytes = passes * px * (channels + 1);
+        else if (channels >= 3) rep->kernel_bytes = passes * px * channels * 2;
+    }
+
+    /* encoder parallelo sullo stesso team del kernel; con l'uscita mappata
+     * resta solo munmap (le pagine sono già nella page cache) */
+    t = timing_now();
+    int rc;
+    if (out_map.base) {
+        rc = frame_unmap(&out_map);
+    } else {
+        rc = plane
+            ? png_write_parallel(out_path, plane, width, height, out_ch, level, 0)
+            : png_write_parallel(out_path, img, width, height, channels, level, 0);
+        pool_free(plane);
+    }
+    if (mapped) frame_unmap(&in_map); else image_free(img);
+    if (rc != 0) {
+        snprintf(err, errlen, "Errore nel salvataggio di \"%s\"", out_path);
+        return -1;
+    }
+    rep->secs[STAGE_ENCODE] = timing_now() - t;
+    rep->total = timing_now() - start;
+    return 0;
+}
+
+/* ---- --stream: stesso job a bande di righe ---- */
+
+typedef struct {
+    int passes, planar;
+    double *pass_secs;      /* sommati su tutte le bande */
+    image_stats_t *image;   /* NULL = senza istogramma */
+} gray_band_t;
+
+/* halo 0: la finestra è esattamente la banda */
+static int gray_band(void *ctx, unsigned char *win, int win_y0, int win_rows,
+                     unsigned char *out, int y0, int n,
+                     int width, int height, int channels)
+{
+    const gray_band_t *g = ctx;
+    (void)win_y0; (void)win_rows; (void)y0; (void)height;
+    if (g->image) {
+        if (!g->image->pixels) image_stats_reset(g->image, channels);
+        image_stats_add(g->image, win, width, n);
+    }
+    for (int p = 0; p < g->passes; ++p) {
+        const double t = timing_now();
+        if (g->planar)
+            rgb_to_luma_plane(win, out, width, n, channels);
+        else
+            convert_to_grayscale(win, width, n, channels);
+        g->pass_secs[p] += timing_now() - t;
+    }
+    return 0;
+}
+
+/* Come process_image ma senza mai tenere l'immagine intera: decode, kernel
+ * ed encode si alternano banda per banda (stream.h), le passate si ripetono
+ * su ogni banda. luma: Y dal decoder (JPEG) o piano di luminanza
+ * dall'ingresso, con una sola passata (la pipeline parte da Y).
+ * pipe (non NULL, senza hist): pianificata sui canali dell'intestazione,
+ * ogni banda con l'alone della pipeline (pipeline_band). */
+static int stream_image(const char *in_path, const char *out_path,
+                        int passes, int planar, int luma, int level, int band_rows,
+                        int histogram, const pipeline_t *pipe, timing_report_t *rep,
+                        stream_stats_t *st, char *err, size_t errlen)
+{
+    if (timing_report_init(rep, luma && !pipe ? 0 : passes) != 0 ||
+        (histogram && !(rep->image = calloc(1, sizeof *rep->image)))) {
+        snprintf(err, errlen, "Impossibile allocare il report dei tempi");
+        return -1;
+    }
+    char why[256];
+    if (frame_format_of(out_path) != FRAME_PNG) {
+        snprintf(err, errlen, "--stream scrive solo PNG: \"%s\"", out_path);
+        return -1;
+    }
+
+    /* con luma la passata c'è comunque (1 canale → copia), ma non si conta */
+    double luma_secs = 0;
+    gray_band_t g = { .passes = luma ? 1 : passes, .planar = planar || luma,
+                      .pass_secs = luma ? &luma_secs : rep->pass_secs,
+                      .image = rep->image };
+    stream_kernel_t k = { .halo = 0, .out_channels = g.planar ? 1 : 0,
+                          .in_place = !g.planar, .run = gray_band, .ctx = &g };
+    pipeline_t plan;
+    pipeline_band_t band = { .plan = &plan, .pass_secs = rep->pass_secs,
+                             .passes = passes };
+    if (pipe) {
+        int width, height, channels;
+        if (image_info(in_path, &width, &height, &channels) != 0) {
+            snprintf(err, errlen, "Errore leggendo l'intestazione di \"%s\"", in_path);
+            return -1;
+        }
+        plan = *pipe;
+        if (pipeline_plan(&plan, luma ? 1 : channels, 8, why, sizeof why) != 0) {
+            snprintf(err, errlen, "Pipeline: %s", why);
+            return -1;
+        }
+        k = (stream_kernel_t){ .halo = pipeline_halo(&plan),
+                               .out_channels = plan.out_channels,
+                               .run = pipeline_band, .ctx = &band };
+    }
+    const int rc = stream_process(in_path, out_path, luma, band_rows, level, &k, st,
+                                  why, sizeof why);
+    pipeline_band_free(&band);
+    if (rc != 0) {
+        snprintf(err, errlen, "Errore in streaming \"%s\": %s", in_path, why);
+        return -1;
+    }
+    if (rep->image) image_stats_finish(rep->image);
+    rep->secs[STAGE_DECODE] = st->read_secs;
+    rep->secs[STAGE_KERNEL] = st->kernel_secs;
+    rep->secs[STAGE_ENCODE] = st->write_secs;
+    rep->total = st->total_secs;
+    rep->width = st->width;
+    rep->height = st->height;
+    rep->channels = st->channels;
+    rep->threads = omp_get_max_threads();
+    const double px = (double)st->width * st->height;
+    if (pipe)                  rep->kernel_bytes = passes * pipeline_bytes(&plan, st->width,
+                                                                           st->height);
+    else if (luma)             rep->kernel_bytes = 0;
+    else if (planar)           rep->kernel_bytes = passes * px * (st->channels + 1);
+    else if (st->channels >= 3) rep->kernel_bytes = passes * px * st->channels * 2;
+    return 0;
+}
+
+/* threads=auto: dalla dimensione nell'intestazione, con il kernel del job e
+ * l'encode; un ingresso raw o illeggibile resta ai thread di default */
+static int job_threads(const server_job_t *job, const pipeline_t *pipe)
+{
+    if (job->threads > 0)
+        return job->threads;
+    int width, height, channels;
+    if (job->threads != SERVER_THREADS_AUTO || job->raw ||
+        image_info(job->input, &width, &height, &channels) != 0)
+        return default_threads;
+    pipeline_t plan;
+    char why[256];
+    const pipeline_t *p = NULL;
+    if (pipe) {
+        plan = *pipe;
+        if (pipeline_plan(&plan, channels, 8, why, sizeof why) == 0)
+            p = &plan;
+    }
+    return tune_image_threads(width, height, channels, p, job->planar || job->luma,
+                              default_threads);
+}
+
+static int serve_job(const server_job_t *job, double *secs, char **stats,
+                     char *err, size_t errlen)
+{
+    timing_report_t rep;
+    pipeline_t pipe;
+    if (job->pipeline && pipeline_parse(job->pipeline, &pipe, err, errlen) != 0)
+        return -1;
+    omp_set_num_threads(job_threads(job, job->pipeline ? &pipe : NULL));
+    int rc = process_image(job->input, job->output, job->raw, job->passes, job->planar,
+                           job->luma, job->level, job->perf, job->histogram,
+                           job->pipeline ? &pipe : NULL, job->depth, &rep, err, errlen);
+    if (rc == 0) {
+        *secs = rep.secs[STAGE_KERNEL];
+        /* l'istogramma viaggia solo nel JSON di stats */
+        if (job->stats || rep.image) {
+            size_t len;
+            FILE *f = open_memstream(stats, &len);
+            if (f) {
+                timing_print_json(f, &rep, job->input);
+                fclose(f);
+                /* una sola riga di risposta */
+                if (len > 0 && (*stats)[len - 1] == '\n') (*stats)[len - 1] = '\0';
+            }
+        }
+    }
+    timing_report_free(&rep);
+    return rc;
+}
+
+/* grayscale_sobel è un link a questo binario: le sue opzioni storiche
+ * diventano una --pipeline (vedi usage), che poi vale ovunque, anche con
+ * --stream, --batch e a 16 bit */
+static int sobel_spec(char *spec, size_t len, const char *mag, const char *border,
+                      int unfused, const char *blur, int planar)
+{
+    char b[32];
+    snprintf(b, sizeof b, "%s", border);
+    if (!strncmp(b, "constant:", 9)) b[8] = '=';    /* ':' separa le opzioni */
+    char smooth[64] = "";
+    if (blur) snprintf(smooth, sizeof smooth, ",%s:%s", blur, b);
+    const int n = snprintf(spec, len, "gray%s,sobel:%s:%s%s%s", smooth, mag, b,
+                           unfused ? ":unfused" : "", planar ? "" : ",expand");
+    return n > 0 && (size_t)n < len ? 0 : -1;
+}
+
+/* Valore intero di arg = "--opzione=N" (prefix caratteri prima di N) in
+ * [min, max]: atoi trasformerebbe un valore sbagliato in 0 in silenzio */
+static int int_option(const char *arg, size_t prefix, int min, int max, int *out)
+{
+    const char *val = arg + prefix;
+    char *end;
+    errno = 0;
+    const long n = strtol(val, &end, 10);
+    if (end == val || *end || errno || n < min || n > max) {
+        if (max == INT_MAX)
+            fprintf(stderr, "%.*s vale un intero >= %d: %s\n", (int)prefix - 1, arg, min, val);
+        else
+            fprintf(stderr, "%.*s vale un intero tra %d e %d: %s\n", (int)prefix - 1, arg,
+                    min, max, val);
+        return -1;
+    }
+    *out = (int)n;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *base = strrchr(argv[0], '/');
+    const int sobel_cli = !strcmp(base ? base + 1 : argv[0], "grayscale_sobel");
+    const char *sobel_mag = "l2", *sobel_border = "replicate", *sobel_blur = NULL;
+    int sobel_unfused = 0;
+
+    /* opzioni --xxx in qualunque posizione, il resto è posizionale */
+    int planar = 0, luma = 0, serve = 0, batch = 0, io_threads = 1;
+    int level = PNG_LEVEL_DEFAULT;
+    int perf = 0, mem_bw = 0, report = 0, stream = 0, band_rows = 0, histogram = 0;
+    const char *socket_path = NULL, *stats = NULL, *bind = NULL, *places = NULL;
+    const char *raw = NULL, *spec = NULL, *depth_opt = "auto";
+    char *pos[3] = {NULL, NULL, NULL};
+    int npos = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--planar")) planar = 1;
+        else if (!strcmp(argv[i], "--luma")) luma = 1;
+        else if (!strcmp(argv[i], "--serve")) serve = 1;
+        else if (!strcmp(argv[i], "--version")) {
+            printf("grayscale %s\n", GS_VERSION);
+            return 0;
+        }
+        else if (!strncmp(argv[i], "--serve=", 8)) { serve = 1; socket_path = argv[i] + 8; }
+        else if (!strcmp(argv[i], "--batch")) batch = 1;
+        else if (!strncmp(argv[i], "--level=", 8)) {
+            if (int_option(argv[i], 8, 0, 9, &level) != 0) return 1;
+        }
+        else if (!strncmp(argv[i], "--io-threads=", 13)) {
+            if (int_option(argv[i], 13, 1, INT_MAX, &io_threads) != 0) return 1;
+        }
+        else if (!strncmp(argv[i], "--stats=", 8)) stats = argv[i] + 8;
+        else if (!strncmp(argv[i], "--raw=", 6)) raw = argv[i] + 6;
+        else if (!strcmp(argv[i], "--perf")) perf = 1;
+        else if (!strcmp(argv[i], "--histogram")) histogram = 1;
+        else if (!strncmp(argv[i], "--pipeline=", 11)) spec = argv[i] + 11;
+        else if (!strncmp(argv[i], "--depth=", 8)) depth_opt = argv[i] + 8;
+        else if (!strcmp(argv[i], "--mem-bw")) mem_bw = 1;
+        else if (!strcmp(argv[i], "--first-touch")) affinity_set_first_touch(1);
+        else if (!strncmp(argv[i], "--bind=", 7)) bind = argv[i] + 7;
+        else if (!strncmp(argv[i], "--places=", 9)) places = argv[i] + 9;
+        else if (!strcmp(argv[i], "--affinity-report")) report = 1;
+        else if (!strcmp(argv[i], "--stream")) stream = 1;
+        else if (!strncmp(argv[i], "--stream=", 9)) {
+            if (int_option(argv[i], 9, 1, INT_MAX, &band_rows) != 0) return 1;
+            stream = 1;
+        }
+        else if (sobel_cli && !strncmp(argv[i], "--mag=", 6)) sobel_mag = argv[i] + 6;
+        else if (sobel_cli && !strncmp(argv[i], "--border=", 9)) sobel_border = argv[i] + 9;
+        else if (sobel_cli && !strcmp(argv[i], "--unfused")) sobel_unfused = 1;
+        else if (sobel_cli && !strncmp(argv[i], "--blur=", 7)) sobel_blur = argv[i] + 7;
+        else if (npos < 3) pos[npos++] = argv[i];
+    }
+
+    /* una --pipeline esplicita vince; --planar = senza expand */
+    char sobel_pipe[160];
+    if (sobel_cli && !spec) {
+        if (sobel_spec(sobel_pipe, sizeof sobel_pipe, sobel_mag, sobel_border,
+                       sobel_unfused, sobel_blur, planar) != 0) {
+            fprintf(stderr, "Opzioni di grayscale_sobel troppo lunghe\n");
+            return 1;
+        }
+        spec = sobel_pipe;
+        planar = 0;
+    }
+
+    /* prima di ogni regione OpenMP: può rieseguire il programma */
+    if (affinity_apply(argv, bind, places) != 0) {
+        perror("exec per OMP_PROC_BIND/OMP_PLACES");
+        return 1;
+    }
+    /* stderr: stdout porta le risposte di --serve e le righe di --stats */
+    if (report) affinity_report(stderr);
+
+    if (serve) {
+        /* crea subito il team OpenMP: resta caldo per tutti i job */
+        default_threads = omp_get_max_threads();
+        #pragma omp parallel
+        { }
+        if (socket_path)
+            return serve_unix_socket(socket_path, serve_job) == 0 ? 0 : 1;
+        return serve_stream(stdin, stdout, serve_job);
+    }
+
+    const int depth = !strcmp(depth_opt, "8") ? 8 : !strcmp(depth_opt, "16") ? 16
+                    : !strcmp(depth_opt, "auto") ? 0 : -1;
+    if (depth < 0) {
+        fprintf(stderr, "--depth accetta auto, 8 o 16\n");
+        return 1;
+    }
+
+    if (stats && strcmp(stats, "json") && strcmp(stats, "csv")) {
+        fprintf(stderr, "--stats accetta json o csv\n");
+        return 1;
+    }
+
+    if (npos < 2) {
+        fprintf(stderr, "Uso: %s [--planar|--luma] [--level=N] [--stats=json|csv [--perf] [--mem-bw]]\n"
+                        "          [--histogram] [--pipeline=stadi] [--depth=auto|8|16]\n"
+                        "          [--stream[=righe]] [--raw=WxH[xC]]\n"
+                        "          <input_img> <output_img> [passaggi_kernel]\n", argv[0]);
+        fprintf(stderr, "     %s --batch [--io-threads=N] [--planar|--luma] [--pipeline=stadi] [--level=N]\n"
+                        "          <dir|glob|manifest> <out_dir> [passaggi_kernel]\n", argv[0]);
+        fprintf(stderr, "     %s --serve[=<socket_unix>]\n", argv[0]);
+        fprintf(stderr, "     %s --version\n", argv[0]);
+        fprintf(stderr, "     grayscale_sobel [--planar] [--mag=l2|l1|maxmin] [--unfused]\n"
+                        "          [--border=replicate|reflect|zero|constant:V] [--blur=gaussN|boxN]\n"
+                        "          ...: link a questo binario, --pipeline=gray[,blur:bordo],\n"
+                        "          sobel:mag:bordo[:unfused][,expand se non --planar]\n");
+        fprintf(stderr, "  in ogni modo: [--first-touch] [--bind=close|spread|...] [--places=cores|...]\n"
+                        "                [--affinity-report]\n");
+        fprintf(stderr, "  --planar  salva un PNG a 1 canale (solo luminanza)\n");
+        fprintf(stderr, "  --luma    come --planar ma decodifica direttamente la luminanza (Y del\n"
+                        "            JPEG con libjpeg-turbo), senza kernel; decoder JPEG: %s\n",
+                image_jpeg_backend());
+        fprintf(stderr, "  uscita    .png, oppure .pgm/.ppm/.raw scritti via mmap senza encode;\n"
+                        "            un ingresso PGM/PPM a 8 bit o raw viene mappato senza decode\n"
+                        "  --raw     dimensioni dell'ingresso raw (pixel interleaved, C default 1)\n");
+        fprintf(stderr, "  --level   compressione PNG 0-9: 0 = store (veloce, intermedi), default 3\n");
+        fprintf(stderr, "  --stats   tempi per stadio (decode, avvio thread, alloc, kernel per\n"
+                        "            passata, encode, totale) e GB/s del kernel su stdout\n"
+                        "  --perf    con --stats: cycles, instructions, LLC miss (perf_event)\n"
+                        "  --mem-bw  con --stats: misura la banda di memoria di riferimento\n"
+                        "  --histogram  istogramma a 256 bin, media, min e max per canale\n"
+                        "            dell'ingresso (di Y con --luma), nello stesso decode: campo\n"
+                        "            \"image\" di --stats=json, altrimenti una riga JSON su stdout\n"
+                        "  --pipeline  stadi separati da virgola al posto del kernel grayscale,\n"
+                        "            es. gray,blur5,sobel:l1,hist (gray, gaussN|blurN|boxN[:bordo],\n"
+                        "            sobel[:l2|l1|maxmin][:bordo][:unfused], expand, hist; bordo =\n"
+                        "            replicate|reflect|zero|constant=V): gray+sobel(+expand) fusi, solo\n"
+                        "            i buffer intermedi necessari; l'uscita ha i canali dell'ultimo\n"
+                        "            stadio, expand la riporta al layout dell'ingresso. Anche con\n"
+                        "            --stream (alone dagli stadi) e --batch, lì senza hist\n"
+                        "  --depth   bit per campione di kernel e PNG: auto (default) = 16 per un\n"
+                        "            PNG/PGM/PPM a 16 bit verso un PNG senza istogramma, 8 tronca come\n"
+                        "            prima; a 16 bit la pipeline non fonde gray+sobel e non ha hist\n");
+        fprintf(stderr, "  --first-touch  copia l'immagine decodificata in un buffer toccato in\n"
+                        "            parallelo dai thread del kernel (pagine sul nodo NUMA giusto)\n"
+                        "  --bind, --places  OMP_PROC_BIND / OMP_PLACES (il programma si riesegue)\n"
+                        "  --affinity-report  binding e CPU/nodo di ogni thread su stderr\n");
+        fprintf(stderr, "  --stream  a bande di righe (default %d): memoria proporzionale alla\n"
+                        "            banda, non all'immagine; solo JPEG (libjpeg-turbo), PNG, PGM/PPM\n",
+                STREAM_BAND_DEFAULT);
+        fprintf(stderr, "  --batch   molte immagini in pipeline: decode e encode (N thread per\n"
+                        "            stadio, default 1) in overlap con il kernel; il manifest ha\n"
+                        "            una riga \"input[TAB output]\" per immagine\n");
+        fprintf(stderr, "  --serve   processo residente: un job per riga su stdin (o sul socket),\n"
+                        "            campi in=, out=, passes=, threads=, planar=, luma=, level=,\n"
+                        "            raw=, stats=, perf=, histogram=, pipeline=, depth= separati da TAB\n"
+                        "            (threads=auto: dalla dimensione dell'immagine)\n");
+        return 1;
+    }
+
+    int passes = (npos >= 3) ? atoi(pos[2]) : 1;
+    if (passes < 1) passes = 1;
+
+    if (stream && batch) {
+        fprintf(stderr, "--stream vale per una sola immagine, non con --batch\n");
+        return 1;
+    }
+    if (depth == 16 && (stream || batch)) {
+        fprintf(stderr, "--depth=16 non si combina con --stream o --batch\n");
+        return 1;
+    }
+
+    char err[512];
+    pipeline_t pipe;
+    if (spec) {
+        if (planar) {
+            fprintf(stderr, "--pipeline non si combina con --planar\n");
+            return 1;
+        }
+        if (pipeline_parse(spec, &pipe, err, sizeof err) != 0) {
+            fprintf(stderr, "--pipeline: %s\n", err);
+            return 1;
+        }
+        if ((stream || batch) && pipe.has_hist) {
+            fprintf(stderr, "--pipeline: hist non è disponibile con --stream o --batch\n");
+            return 1;
+        }
+    }
+
+    if (batch) {
+        batch_opts_t opts = { .passes = passes, .planar = planar, .luma = luma,
+                              .level = level, .io_threads = io_threads,
+                              .pipe = spec ? &pipe : NULL };
+        batch_stats_t st;
+        if (run_batch(pos[0], pos[1], &opts, &st) != 0)
+            return 1;
+        printf("Batch: %d immagini (%d errori) in %.4f s, %.2f img/s, %.2f MPix/s\n",
+               st.images, st.failed, st.wall_secs,
+               st.wall_secs > 0 ? (st.images - st.failed) / st.wall_secs : 0.0,
+               st.wall_secs > 0 ? st.mpixels / st.wall_secs : 0.0);
+        printf("Compute kernel ×%d: %.4f s\n", luma && !spec ? 0 : passes, st.kernel_secs);
+        return st.failed ? 1 : 0;
+    }
+
+    timing_report_t rep;
+    stream_stats_t st;
+    const int rc = stream
+        ? stream_image(pos[0], pos[1], passes, planar, luma, level, band_rows,
+                       histogram, spec ? &pipe : NULL, &rep, &st, err, sizeof err)
+        : process_image(pos[0], pos[1], raw, passes, planar, luma, level, perf,
+                        histogram, spec ? &pipe : NULL, depth, &rep, err, sizeof err);
+    if (rc != 0) {
+        fprintf(stderr, "%s\n", err);
+        timing_report_free(&rep);
+        return 1;
+    }
+    if (stats) {
+        /* dopo il job: la misura non deve sporcare cache e tempi */
+        if (mem_bw) rep.mem_bw_gbps = timing_memory_bandwidth();
+        if (!strcmp(stats, "json")) {
+            timing_print_json(stdout, &rep, pos[0]);
+        } else {
+            timing_csv_header(stdout);
+            timing_print_csv(stdout, &rep, pos[0]);
+        }
+    } else if (stream) {
+        printf("Streaming: %d bande, buffer %.1f MiB; lettura %.4f s, kernel ×%d %.4f s, "
+               "scrittura %.4f s\n", st.bands, st.peak_bytes / 1048576.0,
+               st.read_secs, luma && !spec ? 0 : passes, st.kernel_secs, st.write_secs);
+    } else if (spec) {
+        /* stesso piano di process_image, ripianificato solo per stamparlo */
+        if (pipeline_plan(&pipe, rep.channels, rep.depth, err, sizeof err) == 0) {
+            printf("Pipeline%s: ", rep.depth == 16 ? " (16 bit)" : "");
+            pipeline_describe(stdout, &pipe);
+        }
+        printf("Compute kernel ×%d: %.4f s\n", passes, rep.secs[STAGE_KERNEL]);
+    } else if (rep.depth == 16) {
+        printf("Compute kernel ×%d a 16 bit: %.4f s\n", passes, rep.secs[STAGE_KERNEL]);
+    } else if (luma) {
+        printf("Decode diretto in luminanza: kernel saltato\n");
+    } else {
+        printf("Compute kernel ×%d: %.4f s\n", passes, rep.secs[STAGE_KERNEL]);
+    }
+    /* con --stats=json è già nel report */
+    if (rep.image && (!stats || strcmp(stats, "json"))) {
+        image_stats_print_json(stdout, rep.image);
+        fputc('\n', stdout);
+    }
+    timing_report_free(&rep);
+    return 0;
+}
@@ -0,0 +1,147 @@
+// packed_batch.c
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "packed_batch.h"
+#include "parallel_to_grayscale.h"
+
+/* riga globale del batch → immagine e riga al suo interno */
+typedef struct {
+    int img, y;
+} packed_row_t;
+
+/* tabella delle righe di tutte le immagini in ordine; NULL se manca memoria
+ * (con *rows = 0 anche per un batch vuoto, che non ha bisogno di tabella) */
+static packed_row_t *row_table(const packed_image_t *imgs, int n, long *rows)
+{
+    long total = 0;
+    for (int i = 0; i < n; ++i)
+        total += imgs[i].height;
+    *rows = total;
+    if (total == 0)
+        return NULL;
+    packed_row_t *t = malloc(total * sizeof *t);
+    if (!t)
+        return NULL;
+    long r = 0;
+    for (int i = 0; i < n; ++i)
+        for (int y = 0; y < imgs[i].height; ++y, ++r) {
+            t[r].img = i;
+            t[r].y = y;
+        }
+    return t;
+}
+
+size_t packed_layout(const packed_image_t *dims, int n, int channels,
+                     packed_image_t *out)
+{
+    size_t off = 0;
+    for (int i = 0; i < n; ++i) {
+        const int c = channels > 0 ? channels : dims[i].channels;
+        const size_t bytes = (size_t)dims[i].width * dims[i].height * c;
+        out[i].width = dims[i].width;
+        out[i].height = dims[i].height;
+        out[i].channels = c;
+        out[i].offset = off;
+        off += (bytes + PACKED_ALIGN - 1) & ~(size_t)(PACKED_ALIGN - 1);
+    }
+    return off;
+}
+
+int packed_grayscale(unsigned char *data, const packed_image_t *imgs, int n)
+{
+    long rows;
+    packed_row_t *t = row_table(imgs, n, &rows);
+    if (!t)
+        return rows ? -1 : 0;
+
+    #pragma omp parallel for schedule(static)
+    for (long r = 0; r < rows; ++r) {
+        const packed_image_t *im = &imgs[t[r].img];
+        const long stride = (long)im->width * im->channels;
+        convert_to_grayscale_row(data + im->offset + t[r].y * stride,
+                                 im->width, im->channels);
+    }
+    free(t);
+    return 0;
+}
+
+int packed_luma(const unsigned char *src, const packed_image_t *imgs, int n,
+                unsigned char *dst, const packed_image_t *dst_imgs)
+{
+    long rows;
+    packed_row_t *t = row_table(imgs, n, &rows);
+    if (!t)
+        return rows ? -1 : 0;
+
+    #pragma omp parallel for schedule(static)
+    for (long r = 0; r < rows; ++r) {
+        const packed_image_t *im = &imgs[t[r].img];
+        const long stride = (long)im->width * im->channels;
+        rgb_to_luma_row(src + im->offset + t[r].y * stride,
+                        dst + dst_imgs[t[r].img].offset + (long)t[r].y * im->width,
+                        im->width, im->channels);
+    }
+    free(t);
+    return 0;
+}
+
+int packed_gray_sobel(const unsigned char *src, const packed_image_t *imgs, int n,
+                      unsigned char *dst, const packed_image_t *dst_imgs,
+                      unsigned char *luma, sobel_mag_t mag,
+                      sobel_border_t border, unsigned char border_value)
+{
+    long rows;
+    packed_row_t *t = row_table(imgs, n, &rows);
+    if (!t)
+        return rows ? -1 : 0;
+
+    int width_max = 0;
+    for (int i = 0; i < n; ++i)
+        if (imgs[i].width > width_max) width_max = imgs[i].width;
+    const int use_pad = (border == SOBEL_BORDER_ZERO || border == SOBEL_BORDER_CONSTANT);
+    int failed = 0;
+
+    #pragma omp parallel
+    {
+        /* riga costante per i bordi zero/constant, larga quanto la più larga */
+        unsigned char *pad = NULL;
+        if (use_pad) {
+            pad = malloc(width_max);
+            if (!pad) {
+                #pragma omp atomic write
+                failed = 1;
+            } else {
+                memset(pad, border == SOBEL_BORDER_ZERO ? 0 : border_value, width_max);
+            }
+        }
+
+        #pragma omp for schedule(static)
+        for (long r = 0; r < rows; ++r) {
+            const packed_image_t *im = &imgs[t[r].img];
+            const long stride = (long)im->width * im->channels;
+            rgb_to_luma_row(src + im->offset + t[r].y * stride,
+                            luma + dst_imgs[t[r].img].offset + (long)t[r].y * im->width,
+                            im->width, im->channels);
+        }
+        /* barriera implicita: le righe vicine di ogni immagine sono pronte */
+
+        #pragma omp for schedule(static)
+        for (long r = 0; r < rows; ++r) {
+            if (use_pad && !pad) continue;
+            const packed_image_t *im = &imgs[t[r].img];
+            const int w = im->width, h = im->height, y = t[r].y;
+            const unsigned char *plane = luma + dst_imgs[t[r].img].offset;
+            const int ya = sobel_border_index(y - 1, h, border);
+            const int yb = sobel_border_index(y + 1, h, border);
+            sobel_row_border(ya < 0 ? pad : plane + (long)ya * w,
+                             plane + (long)y * w,
+                             yb < 0 ? pad : plane + (long)yb * w,
+                             dst + dst_imgs[t[r].img].offset + (long)y * w,
+                             w, mag, border, border_value);
+        }
+        free(pad);
+    }
+    free(t);
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,541 @@
+// parallel_to_grayscale.c
+#include <omp.h>
+#include "parallel_to_grayscale.h"
+#include "cpu_features.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_NEON 1
+#endif
+
+/* Pesi BT.601 (0.299, 0.587, 0.114) in virgola fissa Q8: la somma è 256,
+ * quindi un pixel già grigio resta invariato e nessuna somma esce da 16 bit */
+#define GRAY_WR 77
+#define GRAY_WG 150
+#define GRAY_WB 29
+
+static inline unsigned char luma_q8(unsigned r, unsigned g, unsigned b)
+{
+    return (unsigned char)((GRAY_WR * r + GRAY_WG * g + GRAY_WB * b + 128) >> 8);
+}
+
+/* Ogni kernel SIMD elabora i blocchi completi della riga e ritorna quanti
+ * pixel ha coperto; la coda viene chiusa dal percorso scalare.
+ * planar=0: Y replicata su R,G,B di dst (dst può coincidere con src);
+ * planar=1: un byte di Y per pixel in dst. */
+typedef int (*gray_row_fn)(const unsigned char *src, unsigned char *dst,
+                           int n, int channels, int planar);
+
+#if HAVE_X86_SIMD
+/* pshufb per 16 pixel RGB (48 byte in tre registri a,b,c): per ogni canale
+ * la maschera di ciascun registro sorgente, -1 azzera il byte */
+static const signed char DEINT3[3][3][16] = {
+    { { 0, 3, 6, 9,12,15,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1},
+      {-1,-1,-1,-1,-1,-1, 2, 5, 8,11,14,-1,-1,-1,-1,-1},
+      {-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, 1, 4, 7,10,13} },
+    { { 1, 4, 7,10,13,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1},
+      {-1,-1,-1,-1,-1, 0, 3, 6, 9,12,15,-1,-1,-1,-1,-1},
+      {-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, 2, 5, 8,11,14} },
+    { { 2, 5, 8,11,14,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1},
+      {-1,-1,-1,-1,-1, 1, 4, 7,10,13,-1,-1,-1,-1,-1,-1},
+      {-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, 0, 3, 6, 9,12,15} },
+};
+/* luma di 16 pixel replicata su R,G,B: byte j del blocco = Y[j/3] */
+static const signed char REP3[3][16] = {
+    { 0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5},
+    { 5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9,10,10},
+    {10,11,11,11,12,12,12,13,13,13,14,14,14,15,15,15},
+};
+/* RGBA: 4 pixel per registro → [R×4 G×4 B×4 A×4], poi trasposizione 4×4 */
+static const signed char DEINT4[16] = {0,4,8,12, 1,5,9,13, 2,6,10,14, 3,7,11,15};
+/* Y del pixel 4k+q su R,G,B; l'alpha (-1) viene ripreso dal sorgente */
+static const signed char REP4[4][16] = {
+    { 0, 0, 0,-1,  1, 1, 1,-1,  2, 2, 2,-1,  3, 3, 3,-1},
+    { 4, 4, 4,-1,  5, 5, 5,-1,  6, 6, 6,-1,  7, 7, 7,-1},
+    { 8, 8, 8,-1,  9, 9, 9,-1, 10,10,10,-1, 11,11,11,-1},
+    {12,12,12,-1, 13,13,13,-1, 14,14,14,-1, 15,15,15,-1},
+};
+
+/* ------------------------------------------------------------------ */
+/* AVX2: ogni lane da 128 bit lavora su 16 pixel consecutivi          */
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i mask_avx2(const signed char *m)
+{
+    return _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)m));
+}
+
+AVX2 static inline __m256i load2_avx2(const unsigned char *p0, const unsigned char *p1)
+{
+    __m256i v = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p0));
+    return _mm256_inserti128_si256(v, _mm_loadu_si128((const __m128i *)p1), 1);
+}
+
+AVX2 static inline void store2_avx2(unsigned char *p0, unsigned char *p1, __m256i v)
+{
+    _mm_storeu_si128((__m128i *)p0, _mm256_castsi256_si128(v));
+    _mm_storeu_si128((__m128i *)p1, _mm256_extracti128_si256(v, 1));
+}
+
+AVX2 static inline __m256i luma_avx2(__m256i r, __m256i g, __m256i b)
+{
+    const __m256i z   = _mm256_setzero_si256();
+    const __m256i wr  = _mm256_set1_epi16(GRAY_WR);
+    const __m256i wg  = _mm256_set1_epi16(GRAY_WG);
+    const __m256i wb  = _mm256_set1_epi16(GRAY_WB);
+    const __m256i rnd = _mm256_set1_epi16(128);
+
+    __m256i lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(r, z), wr);
+    lo = _mm256_add_epi16(lo, _mm256_mullo_epi16(_mm256_unpacklo_epi8(g, z), wg));
+    lo = _mm256_add_epi16(lo, _mm256_mullo_epi16(_mm256_unpacklo_epi8(b, z), wb));
+    lo = _mm256_srli_epi16(_mm256_add_epi16(lo, rnd), 8);
+
+    __m256i hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(r, z), wr);
+    hi = _mm256_add_epi16(hi, _mm256_mullo_epi16(_mm256_unpackhi_epi8(g, z), wg));
+    hi = _mm256_add_epi16(hi, _mm256_mullo_epi16(_mm256_unpackhi_epi8(b, z), wb));
+    hi = _mm256_srli_epi16(_mm256_add_epi16(hi, rnd), 8);
+
+    /* packus lavora per lane: l'ordine dei pixel dentro la lane resta quello */
+    return _mm256_packus_epi16(lo, hi);
+}
+
+AVX2 static inline __m256i deint3_avx2(__m256i a, __m256i b, __m256i c, int ch)
+{
+    __m256i v = _mm256_shuffle_epi8(a, mask_avx2(DEINT3[ch][0]));
+    v = _mm256_or_si256(v, _mm256_shuffle_epi8(b, mask_avx2(DEINT3[ch][1])));
+    return _mm256_or_si256(v, _mm256_shuffle_epi8(c, mask_avx2(DEINT3[ch][2])));
+}
+
+AVX2 static int gray_row_avx2(const unsigned char *src, unsigned char *dst,
+                              int n, int channels, int planar)
+{
+    int i = 0;
+    if (channels == 3) {
+        for (; i + 32 <= n; i += 32) {
+            const unsigned char *p = src + 3 * i;
+            __m256i a = load2_avx2(p,      p + 48);
+            __m256i b = load2_avx2(p + 16, p + 64);
+            __m256i c = load2_avx2(p + 32, p + 80);
+            __m256i y = luma_avx2(deint3_avx2(a, b, c, 0),
+                                  deint3_avx2(a, b, c, 1),
+                                  deint3_avx2(a, b, c, 2));
+            if (planar) {
+                /* le lane contengono i pixel 0-15 e 16-31: già in ordine */
+                _mm256_storeu_si256((__m256i *)(dst + i), y);
+                continue;
+            }
+            unsigned char *q = dst + 3 * i;
+            store2_avx2(q,      q + 48, _mm256_shuffle_epi8(y, mask_avx2(REP3[0])));
+            store2_avx2(q + 16, q + 64, _mm256_shuffle_epi8(y, mask_avx2(REP3[1])));
+            store2_avx2(q + 32, q + 80, _mm256_shuffle_epi8(y, mask_avx2(REP3[2])));
+        }
+    } else if (channels == 4) {
+        const __m256i alpha = _mm256_set1_epi32((int)0xFF000000u);
+        for (; i + 32 <= n; i += 32) {
+            const __m256i *p = (const __m256i *)(src + 4 * i);
+            __m256i v[4], t[4];
+            for (int k = 0; k < 4; ++k)
+                v[k] = _mm256_loadu_si256(p + k);
+            for (int k = 0; k < 4; ++k)
+                t[k] = _mm256_shuffle_epi8(v[k], mask_avx2(DEINT4));
+            __m256i rg01 = _mm256_unpacklo_epi32(t[0], t[1]);
+            __m256i ba01 = _mm256_unpackhi_epi32(t[0], t[1]);
+            __m256i rg23 = _mm256_unpacklo_epi32(t[2], t[3]);
+            __m256i ba23 = _mm256_unpackhi_epi32(t[2], t[3]);
+            __m256i y = luma_avx2(_mm256_unpacklo_epi64(rg01, rg23),
+                                  _mm256_unpackhi_epi64(rg01, rg23),
+                                  _mm256_unpacklo_epi64(ba01, ba23));
+            __m256i *q = (__m256i *)(dst + (planar ? 1 : 4) * i);
+            if (planar) {
+                /* la dword j di Y contiene i pixel 4..7 di v[j%4] se j>=4:
+                 * lane0 = px 0-3,8-11,16-19,24-27, lane1 = px 4-7,12-15,... */
+                const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+                _mm256_storeu_si256(q, _mm256_permutevar8x32_epi32(y, order));
+                continue;
+            }
+            for (int k = 0; k < 4; ++k) {
+                __m256i o = _mm256_shuffle_epi8(y, mask_avx2(REP4[k]));
+                _mm256_storeu_si256(q + k, _mm256_or_si256(o, _mm256_and_si256(v[k], alpha)));
+            }
+        }
+    }
+    return i;
+}
+
+/* ------------------------------------------------------------------ */
+/* AVX-512BW: stesso schema su 4 lane, 64 pixel per iterazione        */
+
+#define AVX512 __attribute__((target("avx512f,avx512bw")))
+
+AVX512 static inline __m512i mask_avx512(const signed char *m)
+{
+    return _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)m));
+}
+
+AVX512 static inline __m512i load4_avx512(const unsigned char *p, int stride)
+{
+    __m512i v = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i *)p));
+    v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i *)(p + stride)), 1);
+    v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i *)(p + 2 * stride)), 2);
+    return _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i *)(p + 3 * stride)), 3);
+}
+
+AVX512 static inline void store4_avx512(unsigned char *p, int stride, __m512i v)
+{
+    _mm_storeu_si128((__m128i *)p,                _mm512_extracti32x4_epi32(v, 0));
+    _mm_storeu_si128((__m128i *)(p + stride),     _mm512_extracti32x4_epi32(v, 1));
+    _mm_storeu_si128((__m128i *)(p + 2 * stride), _mm512_extracti32x4_epi32(v, 2));
+    _mm_storeu_si128((__m128i *)(p + 3 * stride), _mm512_extracti32x4_epi32(v, 3));
+}
+
+AVX512 static inline __m512i luma_avx512(__m512i r, __m512i g, __m512i b)
+{
+    const __m512i z   = _mm512_setzero_si512();
+    const __m512i wr  = _mm512_set1_epi16(GRAY_WR);
+    const __m512i wg  = _mm512_set1_epi16(GRAY_WG);
+    const __m512i wb  = _mm512_set1_epi16(GRAY_WB);
+    const __m512i rnd = _mm512_set1_epi16(128);
+
+    __m512i lo = _mm512_mullo_epi16(_mm512_unpacklo_epi8(r, z), wr);
+    lo = _mm512_add_epi16(lo, _mm512_mullo_epi16(_mm512_unpacklo_epi8(g, z), wg));
+    lo = _mm512_add_epi16(lo, _mm512_mullo_epi16(_mm512_unpacklo_epi8(b, z), wb));
+    lo = _mm512_srli_epi16(_mm512_add_epi16(lo, rnd), 8);
+
+    __m512i hi = _mm512_mullo_epi16(_mm512_unpackhi_epi8(r, z), wr);
+    hi = _mm512_add_epi16(hi, _mm512_mullo_epi16(_mm512_unpackhi_epi8(g, z), wg));
+    hi = _mm512_add_epi16(hi, _mm512_mullo_epi16(_mm512_unpackhi_epi8(b, z), wb));
+    hi = _mm512_srli_epi16(_mm512_add_epi16(hi, rnd), 8);
+
+    return _mm512_packus_epi16(lo, hi);
+}
+
+AVX512 static inline __m512i deint3_avx512(__m512i a, __m512i b, __m512i c, int ch)
+{
+    __m512i v = _mm512_shuffle_epi8(a, mask_avx512(DEINT3[ch][0]));
+    v = _mm512_or_si512(v, _mm512_shuffle_epi8(b, mask_avx512(DEINT3[ch][1])));
+    return _mm512_or_si512(v, _mm512_shuffle_epi8(c, mask_avx512(DEINT3[ch][2])));
+}
+
+AVX512 static int gray_row_avx512(const unsigned char *src, unsigned char *dst,
+                                 int n, int channels, int planar)
+{
+    int i = 0;
+    if (channels == 3) {
+        for (; i + 64 <= n; i += 64) {
+            const unsigned char *p = src + 3 * i;
+            __m512i a = load4_avx512(p,      48);
+            __m512i b = load4_avx512(p + 16, 48);
+            __m512i c = load4_avx512(p + 32, 48);
+            __m512i y = luma_avx512(deint3_avx512(a, b, c, 0),
+                                    deint3_avx512(a, b, c, 1),
+                                    deint3_avx512(a, b, c, 2));
+            if (planar) {
+                _mm512_storeu_si512(dst + i, y);
+                continue;
+            }
+            unsigned char *q = dst + 3 * i;
+            store4_avx512(q,      48, _mm512_shuffle_epi8(y, mask_avx512(REP3[0])));
+            store4_avx512(q + 16, 48, _mm512_shuffle_epi8(y, mask_avx512(REP3[1])));
+            store4_avx512(q + 32, 48, _mm512_shuffle_epi8(y, mask_avx512(REP3[2])));
+        }
+    } else if (channels == 4) {
+        const __m512i alpha = _mm512_set1_epi32((int)0xFF000000u);
+        for (; i + 64 <= n; i += 64) {
+            const unsigned char *p = src + 4 * i;
+            __m512i v[4], t[4];
+            for (int k = 0; k < 4; ++k)
+                v[k] = _mm512_loadu_si512(p + 64 * k);
+            for (int k = 0; k < 4; ++k)
+                t[k] = _mm512_shuffle_epi8(v[k], mask_avx512(DEINT4));
+            __m512i rg01 = _mm512_unpacklo_epi32(t[0], t[1]);
+            __m512i ba01 = _mm512_unpackhi_epi32(t[0], t[1]);
+            __m512i rg23 = _mm512_unpacklo_epi32(t[2], t[3]);
+            __m512i ba23 = _mm512_unpackhi_epi32(t[2], t[3]);
+            __m512i y = luma_avx512(_mm512_unpacklo_epi64(rg01, rg23),
+                                    _mm512_unpackhi_epi64(rg01, rg23),
+                                    _mm512_unpacklo_epi64(ba01, ba23));
+            if (planar) {
+                /* dword 4L+k di Y = pixel 16k+4L..+3: ritorna in ordine */
+                const __m512i order = _mm512_setr_epi32(0, 4, 8, 12, 1, 5, 9, 13,
+                                                        2, 6, 10, 14, 3, 7, 11, 15);
+                _mm512_storeu_si512(dst + i, _mm512_permutexvar_epi32(order, y));
+                continue;
+            }
+            unsigned char *q = dst + 4 * i;
+            for (int k = 0; k < 4; ++k) {
+                __m512i o = _mm512_shuffle_epi8(y, mask_avx512(REP4[k]));
+                _mm512_storeu_si512(q + 64 * k,
+                                    _mm512_or_si512(o, _mm512_and_si512(v[k], alpha)));
+            }
+        }
+    }
+    return i;
+}
+#endif /* HAVE_X86_SIMD */
+
+#if HAVE_NEON
+/* NEON: vld3/vld4 deinterleavano già in hardware */
+static inline uint8x16_t luma_neon(uint8x16_t r, uint8x16_t g, uint8x16_t b)
+{
+    uint16x8_t lo = vmull_u8(vget_low_u8(r), vdup_n_u8(GRAY_WR));
+    lo = vmlal_u8(lo, vget_low_u8(g), vdup_n_u8(GRAY_WG));
+    lo = vmlal_u8(lo, vget_low_u8(b), vdup_n_u8(GRAY_WB));
+    uint16x8_t hi = vmull_u8(vget_high_u8(r), vdup_n_u8(GRAY_WR));
+    hi = vmlal_u8(hi, vget_high_u8(g), vdup_n_u8(GRAY_WG));
+    hi = vmlal_u8(hi, vget_high_u8(b), vdup_n_u8(GRAY_WB));
+    /* vrshrn = (x + 128) >> 8, come luma_q8 */
+    return vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8));
+}
+
+static int gray_row_neon(const unsigned char *src, unsigned char *dst,
+                         int n, int channels, int planar)
+{
+    int i = 0;
+    if (channels == 3) {
+        for (; i + 16 <= n; i += 16) {
+            uint8x16x3_t v = vld3q_u8(src + 3 * i);
+            uint8x16_t y = luma_neon(v.val[0], v.val[1], v.val[2]);
+            if (planar) {
+                vst1q_u8(dst + i, y);
+                continue;
+            }
+            v.val[0] = v.val[1] = v.val[2] = y;
+            vst3q_u8(dst + 3 * i, v);
+        }
+    } else if (channels == 4) {
+        for (; i + 16 <= n; i += 16) {
+            uint8x16x4_t v = vld4q_u8(src + 4 * i);
+            uint8x16_t y = luma_neon(v.val[0], v.val[1], v.val[2]);
+            if (planar) {
+                vst1q_u8(dst + i, y);
+                continue;
+            }
+            v.val[0] = v.val[1] = v.val[2] = y;
+            vst4q_u8(dst + 4 * i, v);
+        }
+    }
+    return i;
+}
+#endif /* HAVE_NEON */
+
+static gray_row_fn select_gray_row(void)
+{
+    switch (simd_isa()) {
+#if HAVE_X86_SIMD
+    case SIMD_AVX512: return gray_row_avx512;
+    case SIMD_AVX2:   return gray_row_avx2;
+#endif
+#if HAVE_NEON
+    case SIMD_NEON:   return gray_row_neon;
+#endif
+    default:          return NULL;
+    }
+}
+
+/* Una riga intera: blocchi SIMD + coda scalare */
+static inline void gray_row(gray_row_fn simd_row, const unsigned char *src,
+                            unsigned char *dst, int n, int channels, int planar)
+{
+    int x = simd_row ? simd_row(src, dst, n, channels, planar) : 0;
+    for (; x < n; x++) {
+        const unsigned char *px = src + (long)x * channels;
+        unsigned char lum = luma_q8(px[0], px[1], px[2]);
+        if (planar) {
+            dst[x] = lum;
+        } else {
+            unsigned char *q = dst + (long)x * channels;
+            q[0] = q[1] = q[2] = lum;
+            // se c'è canale alpha (channels==4), rimane invariato
+        }
+    }
+}
+
+void convert_to_grayscale(unsigned char *data, int width, int height, int channels) {
+    if (channels < 3) return;            /* già a un canale (+ alpha) */
+
+    const gray_row_fn simd_row = select_gray_row();
+    const long stride = (long)width * channels;
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++)
+        gray_row(simd_row, data + y * stride, data + y * stride, width, channels, 0);
+}
+
+void convert_to_grayscale_row(unsigned char *row, int width, int channels)
+{
+    if (channels < 3) return;
+    gray_row(select_gray_row(), row, row, width, channels, 0);
+}
+
+void rgb_to_luma_row(const unsigned char *src, unsigned char *dst,
+                     int width, int channels)
+{
+    if (channels < 3) {
+        for (int x = 0; x < width; x++)
+            dst[x] = src[(long)x * channels];
+        return;
+    }
+    gray_row(select_gray_row(), src, dst, width, channels, 1);
+}
+
+void rgb_to_luma_plane(const unsigned char *src, unsigned char *dst,
+                       int width, int height, int channels)
+{
+    const long stride = (long)width * channels;
+
+    if (channels < 3) {
+        /* grigio (+ alpha): basta estrarre il primo canale */
+        #pragma omp parallel for schedule(static)
+        for (int y = 0; y < height; y++) {
+            const unsigned char *s = src + y * stride;
+            unsigned char *d = dst + (long)y * width;
+            for (int x = 0; x < width; x++)
+                d[x] = s[(long)x * channels];
+        }
+        return;
+    }
+
+    const gray_row_fn simd_row = select_gray_row();
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++)
+        gray_row(simd_row, src + y * stride, dst + (long)y * width, width, channels, 1);
+}
+
+/* ---- 16 bit e float ----
+ *
+ * Un corpo sempre inline per tipo con channels costante (3 o 4), istanziato
+ * per ISA con l'attributo target come in convolution.c: il compilatore
+ * vettorizza il ciclo sui pixel (deinterleave compreso). In-place legge e
+ * scrive lo stesso puntatore, così non servono controlli di alias. */
+
+#define INLINE static inline __attribute__((always_inline))
+
+/* 77+150+29 = 256: 65535 resta 65535, le somme stanno sotto 2^24 */
+INLINE uint16_t luma_u16(uint32_t r, uint32_t g, uint32_t b)
+{
+    return (uint16_t)((GRAY_WR * r + GRAY_WG * g + GRAY_WB * b + 128) >> 8);
+}
+
+INLINE float luma_f32(float r, float g, float b)
+{
+    return r * (GRAY_WR / 256.0f) + g * (GRAY_WG / 256.0f) + b * (GRAY_WB / 256.0f);
+}
+
+#define GRAY_WIDE_BODIES(T, SFX, LUMA)                                        \
+    INLINE void gray_inplace##SFX##_body(T *d, int n, int ch)                 \
+    {                                                                         \
+        for (int x = 0; x < n; ++x) {                                         \
+            T *p = d + (long)x * ch;                                          \
+            const T y = LUMA(p[0], p[1], p[2]);                               \
+            p[0] = p[1] = p[2] = y;                                           \
+        }                                                                     \
+    }                                                                         \
+    INLINE void gray_plane##SFX##_body(const T *restrict s, T *restrict d,    \
+                                       int n, int ch)                         \
+    {                                                                         \
+        for (int x = 0; x < n; ++x) {                                         \
+            const T *p = s + (long)x * ch;                                    \
+            d[x] = LUMA(p[0], p[1], p[2]);                                    \
+        }                                                                     \
+    }
+
+GRAY_WIDE_BODIES(uint16_t, _u16, luma_u16)
+GRAY_WIDE_BODIES(float, _f32, luma_f32)
+
+/* Una riga; planar = 0 in-place su R,G,B (alpha invariato), 1 piano Y */
+typedef void (*gray_u16_fn)(const uint16_t *src, uint16_t *dst, int n, int ch, int planar);
+typedef void (*gray_f32_fn)(const float *src, float *dst, int n, int ch, int planar);
+
+typedef struct {
+    gray_u16_fn u16;
+    gray_f32_fn f32;
+} gray_wide_ops_t;
+
+#define GRAY_WIDE_ISA_T(ATTR, ISA, T, SFX)                                    \
+    ATTR static void gray_row##SFX##ISA(const T *src, T *dst, int n, int ch,  \
+                                        int planar)                           \
+    {                                                                         \
+        if (planar) {                                                         \
+            if (ch == 3) gray_plane##SFX##_body(src, dst, n, 3);              \
+            else         gray_plane##SFX##_body(src, dst, n, 4);              \
+        } else {                                                              \
+            if (ch == 3) gray_inplace##SFX##_body(dst, n, 3);                 \
+            else         gray_inplace##SFX##_body(dst, n, 4);                 \
+        }                                                                     \
+    }
+
+#define GRAY_WIDE_ISA(ATTR, ISA)                                              \
+    GRAY_WIDE_ISA_T(ATTR, ISA, uint16_t, _u16)                                \
+    GRAY_WIDE_ISA_T(ATTR, ISA, float, _f32)                                   \
+    static const gray_wide_ops_t gray_wide##ISA = { gray_row_u16##ISA,        \
+                                                    gray_row_f32##ISA };
+
+GRAY_WIDE_ISA(SIMD_SCALAR_ATTR, _scalar)
+#if HAVE_X86_SIMD
+GRAY_WIDE_ISA(AVX2, _avx2)
+GRAY_WIDE_ISA(AVX512, _avx512)
+#endif
+
+/* NEON è la base di aarch64: la versione generica è già vettorizzata */
+static const gray_wide_ops_t *select_gray_wide(void)
+{
+    switch (simd_isa()) {
+#if HAVE_X86_SIMD
+    case SIMD_AVX512: return &gray_wide_avx512;
+    case SIMD_AVX2:   return &gray_wide_avx2;
+#endif
+    default:          return &gray_wide_scalar;
+    }
+}
+
+/* Immagine intera per entrambi i tipi; in-place richiede src == dst */
+#define GRAY_WIDE_IMAGE(T, SFX)                                               \
+    static void gray_image_##SFX(const T *src, T *dst, int width, int height,  \
+                                int channels, int planar)                     \
+    {                                                                         \
+        const long stride = (long)width * channels;                           \
+        const long dstride = planar ? width : stride;                         \
+        if (channels < 3) {                                                   \
+            if (!planar) return;          /* già a un canale (+ alpha) */     \
+            _Pragma("omp parallel for schedule(static)")                      \
+            for (int y = 0; y < height; y++)                                  \
+                for (int x = 0; x < width; x++)                               \
+                    dst[y * dstride + x] = src[y * stride + (long)x * channels]; \
+            return;                                                           \
+        }                                                                     \
+        const gray_##SFX##_fn row = select_gray_wide()->SFX;                  \
+        _Pragma("omp parallel for schedule(static)")                          \
+        for (int y = 0; y < height; y++)                                      \
+            row(src + y * stride, dst + y * dstride, width, channels, planar); \
+    }
+
+GRAY_WIDE_IMAGE(uint16_t, u16)
+GRAY_WIDE_IMAGE(float, f32)
+
+void convert_to_grayscale_u16(uint16_t *data, int width, int height, int channels)
+{
+    gray_image_u16(data, data, width, height, channels, 0);
+}
+
+void rgb_to_luma_plane_u16(const uint16_t *src, uint16_t *dst,
+                           int width, int height, int channels)
+{
+    gray_image_u16(src, dst, width, height, channels, 1);
+}
+
+void convert_to_grayscale_f32(float *data, int width, int height, int channels)
+{
+    gray_image_f32(data, data, width, height, channels, 0);
+}
+
+void rgb_to_luma_plane_f32(const float *src, float *dst,
+                           int width, int height, int channels)
+{
+    gray_image_f32(src, dst, width, height, channels, 1);
+}
@@ -0,0 +1,417 @@
+// pipeline.c
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "pipeline.h"
+#include "parallel_to_grayscale.h"
+#include "gray_sobel.h"
+#include "buffer_pool.h"
+
+/* ---- parsing ---- */
+
+/* replicate | reflect | zero | constant=V (V intero >= 0, il massimo
+ * dipende dalla profondità e lo controlla pipeline_plan) */
+static int parse_border(const char *s, sobel_border_t *b, int *value)
+{
+    if      (!strcmp(s, "replicate")) *b = SOBEL_BORDER_REPLICATE;
+    else if (!strcmp(s, "reflect"))   *b = SOBEL_BORDER_REFLECT;
+    else if (!strcmp(s, "zero"))      *b = SOBEL_BORDER_ZERO;
+    else if (!strncmp(s, "constant=", 9)) {
+        char *end;
+        const long v = strtol(s + 9, &end, 10);
+        if (end == s + 9 || *end || v < 0 || v > 65535) return -1;
+        *b = SOBEL_BORDER_CONSTANT;
+        *value = (int)v;
+    } else return -1;
+    return 0;
+}
+
+/* Un token "nome[:opzione...]" */
+static int parse_step(char *tok, pipe_step_t *s, char *err, size_t errlen)
+{
+    memset(s, 0, sizeof *s);
+    snprintf(s->name, sizeof s->name, "%s", tok);
+    s->mag = SOBEL_MAG_L2;
+    s->border = SOBEL_BORDER_REPLICATE;
+
+    char *save = NULL;
+    const char *head = strtok_r(tok, ":", &save);
+    if (!head) {
+        snprintf(err, errlen, "stadio vuoto");
+        return -1;
+    }
+    if (!strcmp(head, "gray")) {
+        s->op = PIPE_GRAY;
+    } else if (!strcmp(head, "sobel")) {
+        s->op = PIPE_SOBEL;
+    } else if (!strcmp(head, "expand")) {
+        s->op = PIPE_EXPAND;
+    } else if (!strcmp(head, "hist")) {
+        s->op = PIPE_HIST;
+    } else {
+        /* blurN è un alias di gaussN */
+        char kname[32];
+        snprintf(kname, sizeof kname, "%s%s", strncmp(head, "blur", 4) ? "" : "gauss",
+                 strncmp(head, "blur", 4) ? head : head + 4);
+        if (conv_kernel_named(&s->kernel, kname) != 0) {
+            snprintf(err, errlen, "stadio sconosciuto \"%s\" (gray, gaussN, blurN, boxN, "
+                                  "sobel, expand, hist)", head);
+            return -1;
+        }
+        s->op = PIPE_CONV;
+    }
+
+    for (const char *opt = strtok_r(NULL, ":", &save); opt; opt = strtok_r(NULL, ":", &save)) {
+        int ok = -1;
+        if (s->op == PIPE_SOBEL || s->op == PIPE_CONV)
+            ok = parse_border(opt, &s->border, &s->border_value);
+        if (ok != 0 && s->op == PIPE_SOBEL) {
+            ok = 0;
+            if      (!strcmp(opt, "l2"))      s->mag = SOBEL_MAG_L2;
+            else if (!strcmp(opt, "l1"))      s->mag = SOBEL_MAG_L1;
+            else if (!strcmp(opt, "maxmin"))  s->mag = SOBEL_MAG_MAXMIN;
+            else if (!strcmp(opt, "unfused")) s->unfused = 1;
+            else ok = -1;
+        }
+        if (ok != 0) {
+            snprintf(err, errlen, "opzione \"%s\" non valida per %s", opt, head);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int pipeline_parse(const char *spec, pipeline_t *p, char *err, size_t errlen)
+{
+    memset(p, 0, sizeof *p);
+    char *copy = strdup(spec);
+    if (!copy) {
+        snprintf(err, errlen, "memoria esaurita");
+        return -1;
+    }
+    int rc = 0;
+    char *save = NULL;
+    for (char *tok = strtok_r(copy, ",", &save); tok && rc == 0;
+         tok = strtok_r(NULL, ",", &save)) {
+        if (p->nsteps == PIPE_MAX_STAGES) {
+            snprintf(err, errlen, "al massimo %d stadi", PIPE_MAX_STAGES);
+            rc = -1;
+        } else if (parse_step(tok, &p->steps[p->nsteps], err, errlen) != 0) {
+            rc = -1;
+        } else if (p->steps[p->nsteps].op == PIPE_HIST && p->has_hist) {
+            snprintf(err, errlen, "hist una sola volta");
+            rc = -1;
+        } else {
+            p->has_hist |= p->steps[p->nsteps].op == PIPE_HIST;
+            p->nsteps++;
+        }
+    }
+    free(copy);
+    if (rc == 0 && p->nsteps == 0) {
+        snprintf(err, errlen, "pipeline vuota");
+        rc = -1;
+    }
+    return rc;
+}
+
+/* ---- piano ---- */
+
+int pipeline_plan(pipeline_t *p, int channels, int depth, char *err, size_t errlen)
+{
+    if (depth == 16 && p->has_hist) {
+        snprintf(err, errlen, "hist solo a 8 bit");
+        return -1;
+    }
+    p->depth = depth;
+
+    const int max_value = (1 << depth) - 1;
+    for (int i = 0; i < p->nsteps; ++i) {
+        const pipe_step_t *s = &p->steps[i];
+        if (s->border == SOBEL_BORDER_CONSTANT && s->border_value > max_value) {
+            snprintf(err, errlen, "%s: constant=%d oltre %d a %d bit", s->name,
+                     s->border_value, max_value, depth);
+            return -1;
+        }
+    }
+
+    /* gray,sobel → un solo passaggio (il kernel fuso è solo a 8 bit), e
+     * con expand subito dopo il fuso scrive già il layout dell'ingresso */
+    for (int i = 0; depth == 8 && i + 1 < p->nsteps; ++i) {
+        pipe_step_t *g = &p->steps[i], *s = &p->steps[i + 1];
+        if (g->op != PIPE_GRAY || s->op != PIPE_SOBEL || s->unfused) continue;
+        const int fold = i + 2 < p->nsteps && p->steps[i + 2].op == PIPE_EXPAND;
+        char name[sizeof g->name];
+        snprintf(name, sizeof name, "%s+%s%s", g->name, s->name, fold ? "+expand" : "");
+        *g = *s;
+        g->op = PIPE_GRAY_SOBEL;
+        g->expand = fold;
+        memcpy(g->name, name, sizeof name);
+        memmove(s, s + 1 + fold, (size_t)(p->nsteps - i - 2 - fold) * sizeof *s);
+        p->nsteps -= 1 + fold;
+    }
+
+    int ch = channels, produced = 0, materialized = 0;
+    for (int i = 0; i < p->nsteps; ++i)
+        materialized += p->steps[i].op != PIPE_HIST;
+
+    p->channels = channels;
+    p->ntemp = 0;
+    p->temp_channels[0] = p->temp_channels[1] = 0;
+    int cur = PIPE_BUF_INPUT;
+    for (int i = 0; i < p->nsteps; ++i) {
+        pipe_step_t *s = &p->steps[i];
+        s->in_channels = ch;
+        switch (s->op) {
+        case PIPE_GRAY:
+            ch = 1;
+            break;
+        case PIPE_GRAY_SOBEL:
+            ch = s->expand ? channels : 1;
+            break;
+        case PIPE_EXPAND:
+            if (ch != 1) {
+                snprintf(err, errlen, "%s vuole un piano a 1 canale (qui %d)", s->name, ch);
+                return -1;
+            }
+            ch = channels;
+            break;
+        case PIPE_SOBEL:
+            if (ch != 1) {
+                snprintf(err, errlen, "%s vuole un piano a 1 canale (qui %d): mettere gray "
+                                      "prima", s->name, ch);
+                return -1;
+            }
+            break;
+        case PIPE_CONV:
+            if (!conv_supported(&s->kernel, depth)) {
+                snprintf(err, errlen, "%s: kernel troppo grande per le somme a 32 bit",
+                         s->name);
+                return -1;
+            }
+            break;
+        case PIPE_HIST:
+            break;
+        }
+        s->out_channels = ch;
+        s->src = cur;
+        if (s->op == PIPE_HIST) {
+            s->dst = cur;       /* solo lettura */
+            continue;
+        }
+        /* l'ultimo stadio scrive nell'uscita, gli altri si alternano su 0/1 */
+        s->dst = produced == materialized - 1 ? PIPE_BUF_OUTPUT : produced % 2;
+        if (s->dst >= 0) {
+            if (ch > p->temp_channels[s->dst]) p->temp_channels[s->dst] = ch;
+            if (s->dst + 1 > p->ntemp) p->ntemp = s->dst + 1;
+        }
+        cur = s->dst;
+        produced++;
+    }
+    p->out_channels = ch;
+    return 0;
+}
+
+/* ---- esecuzione ---- */
+
+/* piano → layout dell'ingresso, come i bordi di gray_sobel_fused: il
+ * valore su R,G,B (o sull'unico canale di colore), alpha dall'ingresso */
+#define EXPAND_BODY(T)                                                        \
+    const int color = channels < 3 ? 1 : 3;                                   \
+    const int alpha = (channels == 2 || channels == 4);                       \
+    _Pragma("omp parallel for schedule(static)")                              \
+    for (int y = 0; y < height; ++y) {                                        \
+        const T *p = plane + (size_t)y * width;                               \
+        const T *a = in + (size_t)y * width * channels;                       \
+        T *o = out + (size_t)y * width * channels;                            \
+        for (int x = 0; x < width; ++x, a += channels, o += channels) {       \
+            for (int c = 0; c < color; ++c) o[c] = p[x];                      \
+            if (alpha) o[channels - 1] = a[channels - 1];                     \
+        }                                                                     \
+    }
+
+static void expand_u8(const unsigned char *plane, const unsigned char *in,
+                      unsigned char *out, int width, int height, int channels)
+{
+    EXPAND_BODY(unsigned char)
+}
+
+static void expand_u16(const uint16_t *plane, const uint16_t *in, uint16_t *out,
+                       int width, int height, int channels)
+{
+    EXPAND_BODY(uint16_t)
+}
+
+int pipeline_run(const pipeline_t *p, const unsigned char *in, unsigned char *out,
+                 unsigned char *const temp[2], int width, int height,
+                 image_stats_t *hist)
+{
+    int produced = 0;
+    for (int i = 0; i < p->nsteps; ++i) {
+        const pipe_step_t *s = &p->steps[i];
+        const unsigned char *src = s->src == PIPE_BUF_INPUT ? in
+                                 : s->src == PIPE_BUF_OUTPUT ? out : temp[s->src];
+        unsigned char *dst = s->dst == PIPE_BUF_OUTPUT ? out
+                           : s->dst >= 0 ? temp[s->dst] : NULL;
+        int rc = 0;
+        switch (s->op) {
+        case PIPE_GRAY:
+            rgb_to_luma_plane(src, dst, width, height, s->in_channels);
+            break;
+        case PIPE_CONV:
+            rc = conv_apply_u8(src, dst, width, height, s->in_channels, &s->kernel,
+                               s->border, (unsigned char)s->border_value);
+            break;
+        case PIPE_SOBEL:
+            rc = sobel_edge_ex(src, dst, width, height, s->mag, s->border,
+                               (unsigned char)s->border_value);
+            break;
+        case PIPE_GRAY_SOBEL:
+            rc = gray_sobel_fused(src, dst, width, height, s->in_channels,
+                                  s->out_channels, s->mag, s->border,
+                                  (unsigned char)s->border_value);
+            break;
+        case PIPE_EXPAND:
+            expand_u8(src, in, dst, width, height, p->channels);
+            break;
+        case PIPE_HIST:
+            if (hist) image_stats_compute(hist, src, width, height, s->in_channels);
+            break;
+        }
+        if (rc != 0) return -1;
+        produced += s->op != PIPE_HIST;
+    }
+
+    /* solo hist: l'uscita è l'ingresso */
+    if (!produced) {
+        const size_t row = (size_t)width * p->channels;
+        #pragma omp parallel for schedule(static)
+        for (int y = 0; y < height; ++y)
+            memcpy(out + (size_t)y * row, in + (size_t)y * row, row);
+    }
+    return 0;
+}
+
+int pipeline_run_u16(const pipeline_t *p, const uint16_t *in, uint16_t *out,
+                     uint16_t *const temp[2], int width, int height)
+{
+    for (int i = 0; i < p->nsteps; ++i) {
+        const pipe_step_t *s = &p->steps[i];
+        const uint16_t *src = s->src == PIPE_BUF_INPUT ? in
+                            : s->src == PIPE_BUF_OUTPUT ? out : temp[s->src];
+        uint16_t *dst = s->dst == PIPE_BUF_OUTPUT ? out
+                      : s->dst >= 0 ? temp[s->dst] : NULL;
+        int rc = 0;
+        switch (s->op) {
+        case PIPE_GRAY:
+            rgb_to_luma_plane_u16(src, dst, width, height, s->in_channels);
+            break;
+        case PIPE_CONV:
+            rc = conv_apply_u16(src, dst, width, height, s->in_channels, &s->kernel,
+                                s->border, (uint16_t)s->border_value);
+            break;
+        case PIPE_SOBEL:
+            rc = sobel_edge_u16(src, dst, width, height, s->mag, s->border,
+                                (uint16_t)s->border_value);
+            break;
+        case PIPE_EXPAND:
+            expand_u16(src, in, dst, width, height, p->channels);
+            break;
+        case PIPE_GRAY_SOBEL:   /* non pianificati a 16 bit */
+        case PIPE_HIST:
+            rc = -1;
+            break;
+        }
+        if (rc != 0) return -1;
+    }
+    return 0;
+}
+
+int pipeline_halo(const pipeline_t *p)
+{
+    int halo = 0;
+    for (int i = 0; i < p->nsteps; ++i) {
+        const pipe_step_t *s = &p->steps[i];
+        if (s->op == PIPE_SOBEL || s->op == PIPE_GRAY_SOBEL) halo += 1;
+        else if (s->op == PIPE_CONV)                         halo += s->kernel.size / 2;
+    }
+    return halo;
+}
+
+/* ---- a bande ---- */
+
+static unsigned char *band_buf(unsigned char *old, size_t bytes)
+{
+    pool_free(old);
+    return bytes ? pool_alloc(bytes) : NULL;
+}
+
+int pipeline_band(void *ctx, unsigned char *win, int win_y0, int win_rows,
+                  unsigned char *out, int y0, int n,
+                  int width, int height, int channels)
+{
+    pipeline_band_t *b = ctx;
+    const pipeline_t *p = b->plan;
+    (void)height;
+    if (channels != p->channels) return -1;     /* pianificata su altri canali */
+    if ((size_t)win_rows > b->cap_rows) {
+        b->win_out = band_buf(b->win_out, (size_t)width * p->out_channels * win_rows);
+        for (int i = 0; i < 2; ++i)
+            b->temp[i] = band_buf(b->temp[i], i < p->ntemp
+                                  ? (size_t)width * p->temp_channels[i] * win_rows : 0);
+        b->cap_rows = win_rows;
+        if (!b->win_out || (p->ntemp > 0 && !b->temp[0]) || (p->ntemp > 1 && !b->temp[1])) {
+            pipeline_band_free(b);
+            return -1;
+        }
+    }
+    const int passes = b->passes > 0 ? b->passes : 1;
+    for (int i = 0; i < passes; ++i) {
+        const double t = omp_get_wtime();
+        if (pipeline_run(p, win, b->win_out, b->temp, width, win_rows, NULL) != 0)
+            return -1;
+        if (b->pass_secs) b->pass_secs[i] += omp_get_wtime() - t;
+    }
+    const size_t row = (size_t)width * p->out_channels;
+    memcpy(out, b->win_out + (size_t)(y0 - win_y0) * row, row * n);
+    return 0;
+}
+
+void pipeline_band_free(pipeline_band_t *b)
+{
+    pool_free(b->win_out);
+    pool_free(b->temp[0]);
+    pool_free(b->temp[1]);
+    b->win_out = b->temp[0] = b->temp[1] = NULL;
+    b->cap_rows = 0;
+}
+
+double pipeline_bytes(const pipeline_t *p, int width, int height)
+{
+    const double px = (double)width * height * (p->depth == 16 ? 2 : 1);
+    double bytes = 0;
+    int produced = 0;
+    for (int i = 0; i < p->nsteps; ++i) {
+        const pipe_step_t *s = &p->steps[i];
+        switch (s->op) {
+        case PIPE_GRAY:
+        case PIPE_GRAY_SOBEL: bytes += px * (s->in_channels + s->out_channels); break;
+        case PIPE_EXPAND:     bytes += px * (1 + 2 * p->channels); break;
+        case PIPE_CONV:       bytes += px * s->in_channels * 2; break;
+        case PIPE_SOBEL:      bytes += px * 2; break;
+        case PIPE_HIST:       bytes += px * s->in_channels; break;
+        }
+        produced += s->op != PIPE_HIST;
+    }
+    if (!produced) bytes += px * p->channels * 2;
+    return bytes;
+}
+
+void pipeline_describe(FILE *f, const pipeline_t *p)
+{
+    for (int i = 0; i < p->nsteps; ++i)
+        fprintf(f, "%s%s", i ? " -> " : "", p->steps[i].name);
+    fprintf(f, " (%d buffer intermedi, uscita a %d %s)\n", p->ntemp, p->out_channels,
+            p->out_channels == 1 ? "canale" : "canali");
+}
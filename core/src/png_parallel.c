@@ -0,0 +1,645 @@
+// png_parallel.c
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include <zlib.h>
+#include "png_parallel.h"
+#include "buffer_pool.h"
+
+#define PNG_DICT_BYTES      32768
+
+enum { F_NONE = 0, F_SUB, F_UP, F_AVG, F_PAETH, F_COUNT };
+
+/* ---- filtri di riga (bpp = byte per pixel: canali, ×2 a 16 bit) ---- */
+
+static inline unsigned char paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return (unsigned char)a;
+    return (unsigned char)(pb <= pc ? b : c);
+}
+
+/* prev == NULL per la prima riga dell'immagine (riga precedente a zero) */
+static void filter_row(int type, const unsigned char *cur, const unsigned char *prev,
+                       unsigned char *out, int n, int bpp)
+{
+    int i;
+    switch (type) {
+    case F_NONE:
+        memcpy(out, cur, n);
+        break;
+    case F_SUB:
+        for (i = 0; i < bpp; ++i) out[i] = cur[i];
+        for (; i < n; ++i) out[i] = cur[i] - cur[i - bpp];
+        break;
+    case F_UP:
+        if (!prev) { memcpy(out, cur, n); break; }
+        for (i = 0; i < n; ++i) out[i] = cur[i] - prev[i];
+        break;
+    case F_AVG:
+        if (!prev) {
+            for (i = 0; i < bpp; ++i) out[i] = cur[i];
+            for (; i < n; ++i) out[i] = cur[i] - (cur[i - bpp] >> 1);
+            break;
+        }
+        for (i = 0; i < bpp; ++i) out[i] = cur[i] - (prev[i] >> 1);
+        for (; i < n; ++i) out[i] = cur[i] - ((cur[i - bpp] + prev[i]) >> 1);
+        break;
+    case F_PAETH:
+        /* senza riga sopra Paeth degenera in Sub */
+        if (!prev) { filter_row(F_SUB, cur, prev, out, n, bpp); break; }
+        for (i = 0; i < bpp; ++i) out[i] = cur[i] - prev[i];
+        for (; i < n; ++i)
+            out[i] = cur[i] - paeth(cur[i - bpp], prev[i], prev[i - bpp]);
+        break;
+    }
+}
+
+static unsigned long row_cost(const unsigned char *f, int n)
+{
+    unsigned long s = 0;
+    for (int i = 0; i < n; ++i)
+        s += (unsigned)abs((signed char)f[i]);
+    return s;
+}
+
+/* Riga filtrata con il byte di tipo davanti; scratch = F_COUNT*n per adattivo */
+static void encode_row(const unsigned char *cur, const unsigned char *prev,
+                       unsigned char *dst, int n, int bpp, int level,
+                       unsigned char *scratch)
+{
+    if (level == 0) {
+        dst[0] = F_NONE;
+        memcpy(dst + 1, cur, n);
+        return;
+    }
+    if (level <= 5) {
+        dst[0] = F_PAETH;
+        filter_row(F_PAETH, cur, prev, dst + 1, n, bpp);
+        return;
+    }
+    int best = F_NONE;
+    unsigned long best_cost = ~0UL;
+    for (int t = 0; t < F_COUNT; ++t) {
+        unsigned char *f = scratch + (size_t)t * n;
+        filter_row(t, cur, prev, f, n, bpp);
+        unsigned long c = row_cost(f, n);
+        if (c < best_cost) { best_cost = c; best = t; }
+    }
+    dst[0] = (unsigned char)best;
+    memcpy(dst + 1, scratch + (size_t)best * n, n);
+}
+
+/* ---- assemblaggio ---- */
+
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    uLong adler, crc;
+    size_t in_len;
+} strip_t;
+
+static void put_be32(unsigned char *p, uint32_t v)
+{
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static unsigned char *put_chunk(unsigned char *p, const char *type,
+                                const unsigned char *data, uint32_t len)
+{
+    put_be32(p, len);
+    memcpy(p + 4, type, 4);
+    if (len) memcpy(p + 8, data, len);
+    put_be32(p + 8 + len, (uint32_t)crc32(0L, p + 4, 4 + len));
+    return p + 12 + len;
+}
+
+/* Comprime filt[off, off+len) come stream raw; dizionario dai byte precedenti */
+static int deflate_strip(const unsigned char *filt, size_t off, size_t len,
+                         int level, int last, strip_t *s)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof zs);
+    /* Z_FILTERED peggiora il rapporto sulle foto a parità di tempo */
+    if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return -1;
+    if (off > 0) {
+        size_t dict = off < PNG_DICT_BYTES ? off : PNG_DICT_BYTES;
+        deflateSetDictionary(&zs, filt + off - dict, (uInt)dict);
+    }
+
+    /* margine per il marker del sync flush */
+    size_t cap = deflateBound(&zs, len) + 64;
+    s->data = pool_alloc(cap);
+    if (!s->data) {
+        deflateEnd(&zs);
+        return -1;
+    }
+
+    zs.next_in = (Bytef *)(filt + off);
+    zs.next_out = s->data;
+    zs.avail_out = (uInt)cap;
+    int rc = Z_OK;
+    /* avail_in è uInt: a blocchi per strisce molto grandi */
+    size_t left = len;
+    while (left > 0 && rc == Z_OK) {
+        uInt chunk = left > (1u << 30) ? (1u << 30) : (uInt)left;
+        zs.avail_in = chunk;
+        left -= chunk;
+        int flush = left ? Z_NO_FLUSH : (last ? Z_FINISH : Z_SYNC_FLUSH);
+        rc = deflate(&zs, flush);
+    }
+    s->len = cap - zs.avail_out;
+    deflateEnd(&zs);
+    if (rc != (last ? Z_STREAM_END : Z_OK) || zs.avail_in != 0)
+        return -1;
+
+    s->in_len = len;
+    s->adler = adler32(0L, Z_NULL, 0);
+    for (size_t done = 0; done < len; ) {
+        uInt chunk = len - done > (1u << 30) ? (1u << 30) : (uInt)(len - done);
+        s->adler = adler32(s->adler, filt + off + done, chunk);
+        done += chunk;
+    }
+    s->crc = crc32(0L, s->data, (uInt)s->len);
+    return 0;
+}
+
+static const unsigned char color_type[5] = {0, 0, 4, 2, 6};
+
+static void put_ihdr(unsigned char ihdr[13], int width, int height, int channels,
+                     int depth)
+{
+    put_be32(ihdr, (uint32_t)width);
+    put_be32(ihdr + 4, (uint32_t)height);
+    ihdr[8] = (unsigned char)depth;
+    ihdr[9] = color_type[channels];
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+}
+
+/* Header zlib (CMF, FLG) coerente con il livello */
+static void put_zlib_header(unsigned char *p, int level)
+{
+    p[0] = 0x78;
+    p[1] = level <= 1 ? 0x01 : level <= 5 ? 0x5e : level == 6 ? 0x9c : 0xda;
+}
+
+/* n byte di campioni a 16 bit nell'ordine della macchina → big-endian */
+static void to_be16(const unsigned char *src, unsigned char *dst, size_t n)
+{
+    const uint16_t *s = (const uint16_t *)src;
+    for (size_t i = 0; i < n / 2; ++i) {
+        dst[2 * i] = (unsigned char)(s[i] >> 8);
+        dst[2 * i + 1] = (unsigned char)s[i];
+    }
+}
+
+/* rows righe di n byte in filt (n + 1 byte ciascuna), in parallelo.
+ * prev0 è la riga sopra la prima (NULL all'inizio dell'immagine).
+ * depth 16: ogni thread porta le righe in big-endian in due righe di
+ * appoggio alternate, la riga sopra è quasi sempre quella già convertita. */
+static int filter_rows(const unsigned char *pixels, const unsigned char *prev0,
+                       unsigned char *filt, int rows, size_t n, int bpp,
+                       int depth, int level, int nt)
+{
+    const size_t row_bytes = n + 1;
+    const int swap = depth == 16;
+    int failed = 0;
+
+    #pragma omp parallel num_threads(nt)
+    {
+        unsigned char *scratch = level > 5 ? malloc(F_COUNT * n) : NULL;
+        unsigned char *be = swap ? malloc(2 * n) : NULL;
+        const int ok = (level <= 5 || scratch) && (!swap || be);
+        if (!ok) {
+            #pragma omp atomic write
+            failed = 1;
+        }
+        int last = -2;
+        #pragma omp for schedule(static)
+        for (int y = 0; y < rows; ++y) {
+            if (!ok) continue;
+            const unsigned char *cur = pixels + (size_t)y * n;
+            const unsigned char *prev = y ? cur - n : prev0;
+            if (swap) {
+                unsigned char *bc = be + (size_t)(y & 1) * n, *bp = be + (size_t)(~y & 1) * n;
+                if (prev && last != y - 1) to_be16(prev, bp, n);
+                to_be16(cur, bc, n);
+                cur = bc;
+                prev = prev ? bp : NULL;
+                last = y;
+            }
+            encode_row(cur, prev, filt + (size_t)y * row_bytes,
+                       (int)n, bpp, level, scratch);
+        }
+        free(be);
+        free(scratch);
+    }
+    return failed ? -1 : 0;
+}
+
+static void free_strips(strip_t *strips, size_t ns)
+{
+    if (!strips) return;
+    for (size_t i = 0; i < ns; ++i) pool_free(strips[i].data);
+    free(strips);
+}
+
+/* Divide le rows righe filtrate a partire da base + off in strisce e le
+ * comprime in parallelo; il dizionario della prima viene da base[0, off).
+ * finish: l'ultima striscia chiude lo stream. */
+static int deflate_rows(const unsigned char *base, size_t off, int rows,
+                        size_t row_bytes, int level, int finish, int nt,
+                        strip_t **out, size_t *nstrips)
+{
+    const size_t total = row_bytes * rows;
+    size_t ns = total / PNG_MIN_STRIP_BYTES;
+    if (ns > (size_t)nt) ns = nt;
+    if (ns > (size_t)rows) ns = rows;
+    if (ns < 1) ns = 1;
+
+    strip_t *strips = calloc(ns, sizeof *strips);
+    if (!strips) return -1;
+
+    int failed = 0;
+    #pragma omp parallel for schedule(static) num_threads(nt)
+    for (int i = 0; i < (int)ns; ++i) {
+        size_t r0 = (size_t)rows * i / ns, r1 = (size_t)rows * (i + 1) / ns;
+        if (deflate_strip(base, off + r0 * row_bytes, (r1 - r0) * row_bytes, level,
+                          finish && i == (int)ns - 1, &strips[i]) != 0) {
+            #pragma omp atomic write
+            failed = 1;
+        }
+    }
+    if (failed) {
+        free_strips(strips, ns);
+        return -1;
+    }
+    *out = strips;
+    *nstrips = ns;
+    return 0;
+}
+
+/* pixels: righe di width*channels campioni da depth bit */
+static int encode_png(const unsigned char *pixels, int width, int height,
+                      int channels, int depth, int level, int threads,
+                      unsigned char **out, size_t *len)
+{
+    *out = NULL;
+    *len = 0;
+    if (width <= 0 || height <= 0 || channels < 1 || channels > 4)
+        return -1;
+    if (level < 0 || level > 9) level = 3;
+
+    int nt = threads > 0 ? threads : omp_get_max_threads();
+    const int bpp = channels * depth / 8;
+    size_t n = (size_t)width * bpp;
+    size_t row_bytes = n + 1;
+    size_t total = row_bytes * height;
+
+    /* frame intero di righe filtrate: dal pool, riusato tra le immagini */
+    unsigned char *filt = pool_alloc(total);
+    if (!filt) return -1;
+
+    strip_t *strips = NULL;
+    size_t ns = 0;
+    int rc = filter_rows(pixels, NULL, filt, height, n, bpp, depth, level, nt);
+    if (rc == 0)
+        rc = deflate_rows(filt, 0, height, row_bytes, level, 1, nt, &strips, &ns);
+    pool_free(filt);
+    if (rc != 0) return -1;
+
+    size_t payload = 2 + 4;
+    for (size_t i = 0; i < ns; ++i) payload += strips[i].len;
+
+    unsigned char *png = NULL;
+    if (payload <= 0x7fffffff)
+        png = pool_alloc(8 + 25 + 12 + payload + 12);
+    if (!png) {
+        free_strips(strips, ns);
+        return -1;
+    }
+
+    unsigned char *p = png;
+    memcpy(p, "\x89PNG\r\n\x1a\n", 8);
+    p += 8;
+
+    unsigned char ihdr[13];
+    put_ihdr(ihdr, width, height, channels, depth);
+    p = put_chunk(p, "IHDR", ihdr, 13);
+
+    /* IDAT: header zlib + strisce + adler32, crc ricombinato per striscia */
+    put_be32(p, (uint32_t)payload);
+    memcpy(p + 4, "IDAT", 4);
+    unsigned char *idat = p + 4;
+    p += 8;
+    put_zlib_header(p, level);
+    uLong crc = crc32(0L, idat, 6);
+    uLong adler = adler32(0L, NULL, 0);
+    p += 2;
+    for (size_t i = 0; i < ns; ++i) {
+        memcpy(p, strips[i].data, strips[i].len);
+        p += strips[i].len;
+        crc = crc32_combine(crc, strips[i].crc, (z_off_t)strips[i].len);
+        adler = adler32_combine(adler, strips[i].adler, (z_off_t)strips[i].in_len);
+    }
+    free_strips(strips, ns);
+    put_be32(p, (uint32_t)adler);
+    crc = crc32(crc, p, 4);
+    p += 4;
+    put_be32(p, (uint32_t)crc);
+    p += 4;
+
+    p = put_chunk(p, "IEND", NULL, 0);
+
+    *out = png;
+    *len = (size_t)(p - png);
+    return 0;
+}
+
+int png_encode_parallel(const unsigned char *pixels, int width, int height,
+                        int channels, int level, int threads,
+                        unsigned char **out, size_t *len)
+{
+    return encode_png(pixels, width, height, channels, 8, level, threads, out, len);
+}
+
+int png_encode_parallel16(const uint16_t *pixels, int width, int height,
+                          int channels, int level, int threads,
+                          unsigned char **out, size_t *len)
+{
+    return encode_png((const unsigned char *)pixels, width, height, channels, 16,
+                      level, threads, out, len);
+}
+
+static int write_png(const char *path, const unsigned char *pixels, int width,
+                     int height, int channels, int depth, int level, int threads)
+{
+    unsigned char *png;
+    size_t len;
+    if (encode_png(pixels, width, height, channels, depth, level, threads,
+                   &png, &len) != 0)
+        return -1;
+    FILE *f = fopen(path, "wb");
+    int rc = -1;
+    if (f) {
+        rc = fwrite(png, 1, len, f) == len ? 0 : -1;
+        if (fclose(f) != 0) rc = -1;
+    }
+    pool_free(png);
+    return rc;
+}
+
+int png_write_parallel(const char *path, const unsigned char *pixels,
+                       int width, int height, int channels, int level,
+                       int threads)
+{
+    return write_png(path, pixels, width, height, channels, 8, level, threads);
+}
+
+int png_write_parallel16(const char *path, const uint16_t *pixels,
+                         int width, int height, int channels, int level,
+                         int threads)
+{
+    return write_png(path, (const unsigned char *)pixels, width, height, channels, 16,
+                     level, threads);
+}
+
+/* ---- scrittura a bande ---- */
+
+struct png_stream {
+    FILE *f;
+    int own_f;              /* aperto da png_stream_open */
+    int width, height, channels, level, nt;
+    size_t n;               /* byte di pixel per riga */
+    int rows_done;          /* riga globale della prossima da scrivere */
+    int y_end;              /* height, o la fine del frammento */
+    int fragment;           /* solo IDAT: firma, zlib e IEND da png_stitch_* */
+    int need_prev;          /* frammento: la prima riga ricevuta è il contesto */
+    unsigned long long filtered;    /* byte filtrati compressi finora */
+    unsigned char *prev;    /* ultima riga della banda precedente (n byte) */
+    unsigned char *filt;    /* coda di dizionario + righe filtrate della banda */
+    size_t filt_cap;
+    size_t dict_len;        /* byte validi di coda davanti alla banda */
+    uLong adler;
+};
+
+/* Un chunk IDAT = [prefix] data [suffix]; il CRC copre tipo e contenuto */
+static int write_idat(FILE *f, const unsigned char *prefix, size_t plen,
+                      const unsigned char *data, size_t len,
+                      const unsigned char *suffix, size_t slen)
+{
+    unsigned char head[8], tail[4];
+    put_be32(head, (uint32_t)(plen + len + slen));
+    memcpy(head + 4, "IDAT", 4);
+    uLong crc = crc32(0L, head + 4, 4);
+    if (plen) crc = crc32(crc, prefix, (uInt)plen);
+    crc = crc32(crc, data, (uInt)len);
+    if (slen) crc = crc32(crc, suffix, (uInt)slen);
+    put_be32(tail, (uint32_t)crc);
+    return fwrite(head, 1, 8, f) == 8
+        && (!plen || fwrite(prefix, 1, plen, f) == plen)
+        && fwrite(data, 1, len, f) == len
+        && (!slen || fwrite(suffix, 1, slen, f) == slen)
+        && fwrite(tail, 1, 4, f) == 4 ? 0 : -1;
+}
+
+static int write_chunk(FILE *f, const char *type, const unsigned char *data, uint32_t len)
+{
+    unsigned char buf[12 + 13];
+    if (len > 13) return -1;
+    unsigned char *end = put_chunk(buf, type, data, len);
+    return fwrite(buf, 1, end - buf, f) == (size_t)(end - buf) ? 0 : -1;
+}
+
+static png_stream_t *stream_new(FILE *f, int width, int height, int channels,
+                                int level, int threads)
+{
+    if (width <= 0 || height <= 0 || channels < 1 || channels > 4)
+        return NULL;
+    png_stream_t *s = calloc(1, sizeof *s);
+    if (!s) return NULL;
+    s->f = f;
+    s->width = width;
+    s->height = height;
+    s->channels = channels;
+    s->level = level < 0 || level > 9 ? 3 : level;
+    s->nt = threads > 0 ? threads : omp_get_max_threads();
+    s->n = (size_t)width * channels;
+    s->y_end = height;
+    s->adler = adler32(0L, NULL, 0);
+    s->prev = malloc(s->n);
+    if (!s->prev) {
+        png_stream_close(s);
+        return NULL;
+    }
+    return s;
+}
+
+static png_stream_t *stream_open(FILE *f, int width, int height, int channels,
+                                 int level, int threads)
+{
+    png_stream_t *s = stream_new(f, width, height, channels, level, threads);
+    if (!s) return NULL;
+    unsigned char ihdr[13];
+    put_ihdr(ihdr, width, height, channels, 8);
+    if (fwrite("\x89PNG\r\n\x1a\n", 1, 8, s->f) != 8 ||
+        write_chunk(s->f, "IHDR", ihdr, 13) != 0) {
+        png_stream_close(s);
+        return NULL;
+    }
+    return s;
+}
+
+png_stream_t *png_stream_open(const char *path, int width, int height, int channels,
+                              int level, int threads)
+{
+    if (width <= 0 || height <= 0 || channels < 1 || channels > 4)
+        return NULL;
+    FILE *f = fopen(path, "wb");
+    if (!f) return NULL;
+    png_stream_t *s = stream_open(f, width, height, channels, level, threads);
+    if (!s) {
+        fclose(f);
+        return NULL;
+    }
+    s->own_f = 1;
+    return s;
+}
+
+png_stream_t *png_stream_fopen(FILE *f, int width, int height, int channels,
+                               int level, int threads)
+{
+    return stream_open(f, width, height, channels, level, threads);
+}
+
+png_stream_t *png_fragment_fopen(FILE *f, int width, int height, int channels,
+                                 int level, int threads, int y0, int rows)
+{
+    if (y0 < 0 || rows <= 0 || y0 + rows > height)
+        return NULL;
+    png_stream_t *s = stream_new(f, width, height, channels, level, threads);
+    if (!s) return NULL;
+    s->fragment = 1;
+    s->need_prev = y0 > 0;
+    s->rows_done = y0;
+    s->y_end = y0 + rows;
+    return s;
+}
+
+int png_stream_write_rows(png_stream_t *s, const unsigned char *rows, int nrows)
+{
+    if (nrows <= 0) return 0;
+    if (s->need_prev) {
+        /* riga y0 - 1: fa da riga sopra per il filtro, non si scrive */
+        memcpy(s->prev, rows, s->n);
+        s->need_prev = 0;
+        rows += s->n;
+        if (--nrows == 0) return 0;
+    }
+    if (s->rows_done + nrows > s->y_end) return -1;
+
+    const size_t row_bytes = s->n + 1;
+    const size_t need = PNG_DICT_BYTES + row_bytes * nrows;
+    if (need > s->filt_cap) {
+        unsigned char *f = pool_alloc(need);
+        if (!f) return -1;
+        if (s->dict_len) memcpy(f + PNG_DICT_BYTES - s->dict_len,
+                                s->filt + PNG_DICT_BYTES - s->dict_len, s->dict_len);
+        pool_free(s->filt);
+        s->filt = f;
+        s->filt_cap = need;
+    }
+
+    /* le righe filtrate partono dopo lo spazio del dizionario */
+    unsigned char *band = s->filt + PNG_DICT_BYTES;
+    if (filter_rows(rows, s->rows_done ? s->prev : NULL, band, nrows, s->n,
+                    s->channels, 8, s->level, s->nt) != 0)
+        return -1;
+
+    /* un frammento in mezzo finisce con un sync flush, l'ultimo chiude lo stream */
+    const int last = s->rows_done + nrows == s->y_end;
+    strip_t *strips = NULL;
+    size_t ns = 0;
+    if (deflate_rows(s->filt + PNG_DICT_BYTES - s->dict_len, s->dict_len, nrows,
+                     row_bytes, s->level, last && s->y_end == s->height, s->nt,
+                     &strips, &ns) != 0)
+        return -1;
+
+    unsigned char zhead[2], trailer[4];
+    put_zlib_header(zhead, s->level);
+    int rc = 0;
+    for (size_t i = 0; i < ns && rc == 0; ++i) {
+        s->adler = adler32_combine(s->adler, strips[i].adler, (z_off_t)strips[i].in_len);
+        const int first = !s->fragment && s->rows_done == 0 && i == 0;
+        const int final = !s->fragment && last && i == ns - 1;
+        if (final) put_be32(trailer, (uint32_t)s->adler);
+        rc = write_idat(s->f, first ? zhead : NULL, first ? 2 : 0,
+                        strips[i].data, strips[i].len,
+                        final ? trailer : NULL, final ? 4 : 0);
+    }
+    free_strips(strips, ns);
+    if (rc != 0) return -1;
+    s->filtered += row_bytes * nrows;
+
+    /* riga sopra e dizionario per la banda successiva */
+    memcpy(s->prev, rows + (size_t)(nrows - 1) * s->n, s->n);
+    const size_t avail = s->dict_len + row_bytes * nrows;
+    const size_t keep = avail < PNG_DICT_BYTES ? avail : PNG_DICT_BYTES;
+    memmove(s->filt + PNG_DICT_BYTES - keep, band + row_bytes * nrows - keep, keep);
+    s->dict_len = keep;
+    s->rows_done += nrows;
+    return 0;
+}
+
+int png_stream_close(png_stream_t *s)
+{
+    if (!s) return -1;
+    int rc = s->rows_done == s->y_end ? 0 : -1;
+    if (rc == 0 && !s->fragment) rc = write_chunk(s->f, "IEND", NULL, 0);
+    if (s->own_f ? fclose(s->f) != 0 : fflush(s->f) != 0) rc = -1;
+    pool_free(s->filt);
+    free(s->prev);
+    free(s);
+    return rc;
+}
+
+int png_fragment_close(png_stream_t *s, uint32_t *adler, unsigned long long *filtered)
+{
+    if (!s) return -1;
+    *adler = (uint32_t)s->adler;
+    *filtered = s->filtered;
+    return png_stream_close(s);
+}
+
+/* ---- ricucitura dei frammenti ---- */
+
+size_t png_stitch_head(unsigned char *out, int width, int height, int channels, int level)
+{
+    if (level < 0 || level > 9) level = 3;
+    unsigned char ihdr[13], zhead[2];
+    put_ihdr(ihdr, width, height, channels, 8);
+    put_zlib_header(zhead, level);
+    memcpy(out, "\x89PNG\r\n\x1a\n", 8);
+    unsigned char *p = put_chunk(out + 8, "IHDR", ihdr, 13);
+    p = put_chunk(p, "IDAT", zhead, 2);
+    return (size_t)(p - out);
+}
+
+size_t png_stitch_tail(unsigned char *out, const uint32_t *adlers,
+                       const unsigned long long *filtered, int n)
+{
+    uLong adler = adler32(0L, NULL, 0);
+    for (int i = 0; i < n; ++i)
+        adler = adler32_combine(adler, adlers[i], (z_off_t)filtered[i]);
+    unsigned char trailer[4];
+    put_be32(trailer, (uint32_t)adler);
+    unsigned char *p = put_chunk(out, "IDAT", trailer, 4);
+    p = put_chunk(p, "IEND", NULL, 0);
+    return (size_t)(p - out);
+}
@@ -0,0 +1,490 @@
+// row_reader.c
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "row_reader.h"
+
+#ifdef USE_LIBJPEG
+#include <setjmp.h>
+#include <jpeglib.h>
+#endif
+
+enum { RR_JPEG = 0, RR_PNG, RR_PNM };
+
+#define PNG_IN_BYTES 65536
+
+#ifdef USE_LIBJPEG
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf jmp;
+    char msg[JMSG_LENGTH_MAX];
+} rr_jpeg_err_t;
+#endif
+
+struct row_reader {
+    int kind;
+    FILE *f;
+    int own_f;                  /* aperto da row_reader_open: lo chiude close */
+    int width, height, channels;
+    int row;                    /* prossima riga da leggere */
+
+#ifdef USE_LIBJPEG
+    struct jpeg_decompress_struct cinfo;
+    rr_jpeg_err_t jerr;
+    int jpeg_started;
+#endif
+
+    /* PNG: stream zlib che attraversa i chunk IDAT */
+    z_stream zs;
+    int zs_init;
+    unsigned char *zin;
+    uint32_t idat_left;         /* byte del chunk IDAT corrente ancora da leggere */
+    int idat_crc;               /* CRC del chunk corrente da saltare */
+    int depth, ctype;
+    int bpp;                    /* byte per pixel per i filtri (almeno 1) */
+    size_t raw_bytes;           /* byte di una riga compressa, senza il tipo di filtro */
+    unsigned char *cur, *prev;  /* 1 + raw_bytes ciascuna */
+    unsigned char palette[256][4];
+    int has_trns;
+
+    /* PNM */
+    int maxval;
+    unsigned char *pnm_row;     /* riga a 16 bit (maxval > 255) */
+};
+
+static void set_err(char *err, size_t errlen, const char *msg)
+{
+    if (err && errlen) snprintf(err, errlen, "%s", msg);
+}
+
+static uint32_t be32(const unsigned char *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+/* Salta n byte leggendoli: niente fseek, lo stream può non essere
+ * posizionabile (pipe, fopencookie) */
+static int skip(FILE *f, size_t n)
+{
+    unsigned char buf[4096];
+    while (n > 0) {
+        const size_t k = n < sizeof buf ? n : sizeof buf;
+        if (fread(buf, 1, k, f) != k) return -1;
+        n -= k;
+    }
+    return 0;
+}
+
+/* ---- JPEG (libjpeg-turbo) ---- */
+
+#ifdef USE_LIBJPEG
+static void rr_jpeg_exit(j_common_ptr cinfo)
+{
+    rr_jpeg_err_t *e = (rr_jpeg_err_t *)cinfo->err;
+    cinfo->err->format_message(cinfo, e->msg);
+    longjmp(e->jmp, 1);
+}
+
+static void rr_jpeg_silent(j_common_ptr cinfo)
+{
+    (void)cinfo;
+}
+
+static int jpeg_open(row_reader_t *r, int gray, char *err, size_t errlen)
+{
+    r->cinfo.err = jpeg_std_error(&r->jerr.pub);
+    r->jerr.pub.error_exit = rr_jpeg_exit;
+    r->jerr.pub.output_message = rr_jpeg_silent;
+    if (setjmp(r->jerr.jmp)) {
+        set_err(err, errlen, r->jerr.msg);
+        return -1;
+    }
+    jpeg_create_decompress(&r->cinfo);
+    r->jpeg_started = 1;
+    jpeg_stdio_src(&r->cinfo, r->f);
+    jpeg_read_header(&r->cinfo, TRUE);
+    if (r->cinfo.jpeg_color_space == JCS_CMYK || r->cinfo.jpeg_color_space == JCS_YCCK) {
+        set_err(err, errlen, "JPEG CMYK/YCCK non supportato in streaming");
+        return -1;
+    }
+    r->cinfo.out_color_space =
+        (gray || r->cinfo.jpeg_color_space == JCS_GRAYSCALE) ? JCS_GRAYSCALE : JCS_RGB;
+    jpeg_start_decompress(&r->cinfo);
+    r->width = r->cinfo.output_width;
+    r->height = r->cinfo.output_height;
+    r->channels = r->cinfo.output_components;
+    return 0;
+}
+
+static int jpeg_read(row_reader_t *r, unsigned char *dst, int nrows, char *err, size_t errlen)
+{
+    if (setjmp(r->jerr.jmp)) {
+        set_err(err, errlen, r->jerr.msg);
+        return -1;
+    }
+    const size_t stride = (size_t)r->width * r->channels;
+    for (int k = 0; k < nrows; ) {
+        JSAMPROW rows[4];
+        int n = nrows - k < 4 ? nrows - k : 4;
+        for (int i = 0; i < n; ++i) rows[i] = dst + (size_t)(k + i) * stride;
+        JDIMENSION got = jpeg_read_scanlines(&r->cinfo, rows, n);
+        if (got == 0) {
+            set_err(err, errlen, "JPEG troncato");
+            return -1;
+        }
+        k += got;
+    }
+    return 0;
+}
+#endif
+
+/* ---- PNG ---- */
+
+static int png_open(row_reader_t *r, char *err, size_t errlen)
+{
+    unsigned char sig[8], hdr[8], ihdr[13];
+    if (fread(sig, 1, 8, r->f) != 8 || memcmp(sig, "\x89PNG\r\n\x1a\n", 8) != 0 ||
+        fread(hdr, 1, 8, r->f) != 8 || be32(hdr) != 13 || memcmp(hdr + 4, "IHDR", 4) != 0 ||
+        fread(ihdr, 1, 13, r->f) != 13 || skip(r->f, 4) != 0) {
+        set_err(err, errlen, "PNG: header non valido");
+        return -1;
+    }
+    r->width = (int)be32(ihdr);
+    r->height = (int)be32(ihdr + 4);
+    r->depth = ihdr[8];
+    r->ctype = ihdr[9];
+    if (ihdr[12] != 0) {
+        set_err(err, errlen, "PNG interlacciato non supportato in streaming");
+        return -1;
+    }
+    static const int spp_of[7] = {1, 0, 3, 1, 2, 0, 4};
+    const int spp = r->ctype <= 6 ? spp_of[r->ctype] : 0;
+    const int d = r->depth;
+    const int depth_ok = d == 8 || (d == 16 && r->ctype != 3) ||
+                         ((d == 1 || d == 2 || d == 4) && (r->ctype == 0 || r->ctype == 3));
+    if (r->width <= 0 || r->height <= 0 || spp == 0 || !depth_ok) {
+        set_err(err, errlen, "PNG: tipo colore o profondità non validi");
+        return -1;
+    }
+    r->bpp = spp * d >= 8 ? spp * d / 8 : 1;
+    r->raw_bytes = ((size_t)r->width * spp * d + 7) / 8;
+
+    /* chunk fino al primo IDAT: serve la palette (e tRNS) prima dei pixel */
+    for (;;) {
+        if (fread(hdr, 1, 8, r->f) != 8) {
+            set_err(err, errlen, "PNG: IDAT mancante");
+            return -1;
+        }
+        uint32_t len = be32(hdr);
+        if (!memcmp(hdr + 4, "IDAT", 4)) {
+            r->idat_left = len;
+            break;
+        }
+        if (!memcmp(hdr + 4, "PLTE", 4) && len <= 768 && len % 3 == 0) {
+            unsigned char pal[768];
+            if (fread(pal, 1, len, r->f) != len) break;
+            for (uint32_t i = 0; i < len / 3; ++i) {
+                memcpy(r->palette[i], pal + 3 * i, 3);
+                r->palette[i][3] = 255;
+            }
+            len = 0;
+        } else if (!memcmp(hdr + 4, "tRNS", 4) && r->ctype == 3 && len <= 256) {
+            unsigned char a[256];
+            if (fread(a, 1, len, r->f) != len) break;
+            for (uint32_t i = 0; i < len; ++i) r->palette[i][3] = a[i];
+            r->has_trns = 1;
+            len = 0;
+        }
+        if (skip(r->f, (size_t)len + 4) != 0) break;
+    }
+    r->idat_crc = 1;
+
+    static const int out_ch[7] = {1, 0, 3, 3, 2, 0, 4};
+    r->channels = r->ctype == 3 && r->has_trns ? 4 : out_ch[r->ctype];
+
+    r->zin = malloc(PNG_IN_BYTES);
+    r->cur = calloc(1, r->raw_bytes + 1);
+    r->prev = calloc(1, r->raw_bytes + 1);
+    if (!r->zin || !r->cur || !r->prev || inflateInit(&r->zs) != Z_OK) {
+        set_err(err, errlen, "memoria insufficiente");
+        return -1;
+    }
+    r->zs_init = 1;
+    return 0;
+}
+
+/* Riempie l'ingresso di zlib dal chunk IDAT corrente o dai successivi;
+ * 0 ok, -1 dati finiti */
+static int png_fill(row_reader_t *r)
+{
+    while (r->idat_left == 0) {
+        unsigned char hdr[8];
+        if (r->idat_crc && skip(r->f, 4) != 0) return -1;
+        r->idat_crc = 0;
+        if (fread(hdr, 1, 8, r->f) != 8 || memcmp(hdr + 4, "IDAT", 4) != 0)
+            return -1;      /* i chunk IDAT devono essere consecutivi */
+        r->idat_left = be32(hdr);
+        r->idat_crc = 1;
+    }
+    size_t n = r->idat_left < PNG_IN_BYTES ? r->idat_left : PNG_IN_BYTES;
+    if (fread(r->zin, 1, n, r->f) != n) return -1;
+    r->idat_left -= (uint32_t)n;
+    r->zs.next_in = r->zin;
+    r->zs.avail_in = (uInt)n;
+    return 0;
+}
+
+static inline unsigned char paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return (unsigned char)a;
+    return (unsigned char)(pb <= pc ? b : c);
+}
+
+static int png_unfilter(unsigned char *x, const unsigned char *p, size_t n, int bpp, int type)
+{
+    size_t i;
+    switch (type) {
+    case 0: break;
+    case 1: for (i = bpp; i < n; ++i) x[i] += x[i - bpp]; break;
+    case 2: for (i = 0; i < n; ++i) x[i] += p[i]; break;
+    case 3:
+        for (i = 0; i < (size_t)bpp && i < n; ++i) x[i] += p[i] >> 1;
+        for (; i < n; ++i) x[i] += (x[i - bpp] + p[i]) >> 1;
+        break;
+    case 4:
+        for (i = 0; i < (size_t)bpp && i < n; ++i) x[i] += p[i];
+        for (; i < n; ++i) x[i] += paeth(x[i - bpp], p[i], p[i - bpp]);
+        break;
+    default: return -1;
+    }
+    return 0;
+}
+
+/* riga decompressa e non filtrata di cur → pixel a 8 bit */
+static void png_expand(const row_reader_t *r, const unsigned char *raw, unsigned char *out)
+{
+    const int w = r->width, d = r->depth;
+    if (r->ctype == 3) {
+        const int ppb = 8 / d, mask = (1 << d) - 1;
+        for (int x = 0; x < w; ++x) {
+            int idx = d == 8 ? raw[x]
+                    : (raw[x / ppb] >> ((ppb - 1 - x % ppb) * d)) & mask;
+            memcpy(out + (size_t)x * r->channels, r->palette[idx], r->channels);
+        }
+    } else if (d == 16) {
+        const size_t n = (size_t)w * r->channels;
+        for (size_t i = 0; i < n; ++i) out[i] = raw[2 * i];
+    } else if (d == 8) {
+        memcpy(out, raw, (size_t)w * r->channels);
+    } else {
+        /* grigio a 1/2/4 bit, scalato a 0-255 */
+        const int ppb = 8 / d, mask = (1 << d) - 1, scale = 255 / mask;
+        for (int x = 0; x < w; ++x)
+            out[x] = (unsigned char)(((raw[x / ppb] >> ((ppb - 1 - x % ppb) * d)) & mask) * scale);
+    }
+}
+
+static int png_read(row_reader_t *r, unsigned char *dst, int nrows, char *err, size_t errlen)
+{
+    const size_t stride = (size_t)r->width * r->channels;
+    for (int k = 0; k < nrows; ++k) {
+        r->zs.next_out = r->cur;
+        r->zs.avail_out = (uInt)(r->raw_bytes + 1);
+        while (r->zs.avail_out > 0) {
+            if (r->zs.avail_in == 0 && png_fill(r) != 0) {
+                set_err(err, errlen, "PNG troncato");
+                return -1;
+            }
+            int rc = inflate(&r->zs, Z_NO_FLUSH);
+            if (rc == Z_STREAM_END && r->zs.avail_out > 0) {
+                set_err(err, errlen, "PNG: dati compressi finiti prima dell'ultima riga");
+                return -1;
+            }
+            if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) {
+                set_err(err, errlen, "PNG: dati compressi corrotti");
+                return -1;
+            }
+        }
+        if (png_unfilter(r->cur + 1, r->prev + 1, r->raw_bytes, r->bpp, r->cur[0]) != 0) {
+            set_err(err, errlen, "PNG: tipo di filtro non valido");
+            return -1;
+        }
+        png_expand(r, r->cur + 1, dst + (size_t)k * stride);
+        unsigned char *t = r->prev; r->prev = r->cur; r->cur = t;
+    }
+    return 0;
+}
+
+/* ---- PGM/PPM binari ---- */
+
+/* prossimo intero dell'header, saltando spazi e commenti */
+static int pnm_int(FILE *f, int *v)
+{
+    int c;
+    for (;;) {
+        c = fgetc(f);
+        if (c == '#') {
+            while (c != '\n' && c != EOF) c = fgetc(f);
+        } else if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+            break;
+        }
+    }
+    if (c < '0' || c > '9') return -1;
+    long n = 0;
+    while (c >= '0' && c <= '9') {
+        n = n * 10 + (c - '0');
+        if (n > 0x7fffffff) return -1;
+        c = fgetc(f);
+    }
+    /* un solo spazio separa l'header dai pixel: già consumato da fgetc */
+    *v = (int)n;
+    return 0;
+}
+
+static int pnm_open(row_reader_t *r, char *err, size_t errlen)
+{
+    char magic[2];
+    if (fread(magic, 1, 2, r->f) != 2 || magic[0] != 'P' || (magic[1] != '5' && magic[1] != '6') ||
+        pnm_int(r->f, &r->width) || pnm_int(r->f, &r->height) || pnm_int(r->f, &r->maxval) ||
+        r->width <= 0 || r->height <= 0 || r->maxval <= 0 || r->maxval > 65535) {
+        set_err(err, errlen, "PGM/PPM: header non valido (solo P5/P6)");
+        return -1;
+    }
+    r->channels = magic[1] == '5' ? 1 : 3;
+    if (r->maxval > 255) {
+        r->pnm_row = malloc((size_t)r->width * r->channels * 2);
+        if (!r->pnm_row) {
+            set_err(err, errlen, "memoria insufficiente");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* 16 bit big-endian → byte alto; maxval non riscalato, come stb */
+static int pnm_read(row_reader_t *r, unsigned char *dst, int nrows, char *err, size_t errlen)
+{
+    const size_t n = (size_t)r->width * r->channels;
+    for (int k = 0; k < nrows; ++k) {
+        unsigned char *out = dst + (size_t)k * n;
+        const int ok = r->pnm_row ? fread(r->pnm_row, 2, n, r->f) == n
+                                  : fread(out, 1, n, r->f) == n;
+        if (!ok) {
+            set_err(err, errlen, "PGM/PPM troncato");
+            return -1;
+        }
+        for (size_t i = 0; r->pnm_row && i < n; ++i) out[i] = r->pnm_row[2 * i];
+    }
+    return 0;
+}
+
+/* ---- API ---- */
+
+row_reader_t *row_reader_open(const char *path, int gray, char *err, size_t errlen)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        set_err(err, errlen, "impossibile aprire il file");
+        return NULL;
+    }
+    row_reader_t *r = row_reader_fopen(f, gray, err, errlen);
+    if (!r) {
+        fclose(f);
+        return NULL;
+    }
+    r->own_f = 1;
+    return r;
+}
+
+row_reader_t *row_reader_fopen(FILE *f, int gray, char *err, size_t errlen)
+{
+    row_reader_t *r = calloc(1, sizeof *r);
+    if (!r) {
+        set_err(err, errlen, "memoria insufficiente");
+        return NULL;
+    }
+    r->f = f;
+
+    /* il primo byte basta a scegliere il formato (il resto lo controlla
+     * l'header); ungetc di un carattere è garantito anche senza fseek */
+    const int c = getc(f);
+    if (c == EOF || ungetc(c, f) == EOF) {
+        set_err(err, errlen, "file vuoto");
+        free(r);
+        return NULL;
+    }
+    int rc;
+    if (c == 0xFF) {
+        r->kind = RR_JPEG;
+#ifdef USE_LIBJPEG
+        rc = jpeg_open(r, gray, err, errlen);
+#else
+        (void)gray;
+        set_err(err, errlen, "JPEG a righe solo con libjpeg-turbo (make JPEG=turbo)");
+        rc = -1;
+#endif
+    } else if (c == 0x89) {
+        r->kind = RR_PNG;
+        rc = png_open(r, err, errlen);
+    } else if (c == 'P') {
+        r->kind = RR_PNM;
+        rc = pnm_open(r, err, errlen);
+    } else {
+        set_err(err, errlen, "formato non supportato a righe (JPEG, PNG, PGM/PPM)");
+        rc = -1;
+    }
+    if (rc != 0) {
+        row_reader_close(r);
+        return NULL;
+    }
+    return r;
+}
+
+void row_reader_dims(const row_reader_t *r, int *width, int *height, int *channels)
+{
+    *width = r->width;
+    *height = r->height;
+    *channels = r->channels;
+}
+
+int row_reader_read(row_reader_t *r, unsigned char *dst, int nrows, char *err, size_t errlen)
+{
+    if (nrows <= 0) return 0;
+    if (r->row + nrows > r->height) {
+        set_err(err, errlen, "lettura oltre l'ultima riga");
+        return -1;
+    }
+    int rc;
+    switch (r->kind) {
+#ifdef USE_LIBJPEG
+    case RR_JPEG: rc = jpeg_read(r, dst, nrows, err, errlen); break;
+#endif
+    case RR_PNG:  rc = png_read(r, dst, nrows, err, errlen); break;
+    case RR_PNM:  rc = pnm_read(r, dst, nrows, err, errlen); break;
+    default:      rc = -1;
+    }
+    if (rc == 0) r->row += nrows;
+    return rc;
+}
+
+void row_reader_close(row_reader_t *r)
+{
+    if (!r) return;
+#ifdef USE_LIBJPEG
+    /* senza finish_decompress: le righe restanti non interessano */
+    if (r->jpeg_started) jpeg_destroy_decompress(&r->cinfo);
+#endif
+    if (r->zs_init) inflateEnd(&r->zs);
+    free(r->zin);
+    free(r->cur);
+    free(r->prev);
+    free(r->pnm_row);
+    if (r->own_f) fclose(r->f);
+    free(r);
+}
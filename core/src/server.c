@@ -0,0 +1,148 @@
+// server.c
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "server.h"
+
+/* Divide la riga sui TAB e riempie job; ritorna 0 o -1 con err compilato */
+static int parse_job(char *line, server_job_t *job, char *err, size_t errlen)
+{
+    memset(job, 0, sizeof *job);
+    job->passes = 1;
+    job->level = -1;
+
+    for (char *save = NULL, *tok = strtok_r(line, "\t", &save); tok;
+         tok = strtok_r(NULL, "\t", &save)) {
+        char *eq = strchr(tok, '=');
+        if (!eq) {
+            snprintf(err, errlen, "campo senza '=': %s", tok);
+            return -1;
+        }
+        *eq = '\0';
+        const char *key = tok, *val = eq + 1;
+        if      (!strcmp(key, "in"))      job->input = val;
+        else if (!strcmp(key, "out"))     job->output = val;
+        else if (!strcmp(key, "passes"))  job->passes = atoi(val);
+        else if (!strcmp(key, "threads")) {
+            /* un numero sbagliato non deve diventare 0 (= default) in silenzio */
+            char *end;
+            errno = 0;
+            const long n = strtol(val, &end, 10);
+            if (!strcmp(val, "auto")) {
+                job->threads = SERVER_THREADS_AUTO;
+            } else if (end == val || *end || errno || n < 0 || n > INT_MAX) {
+                snprintf(err, errlen, "threads= vale un intero >= 0 o auto: %s", val);
+                return -1;
+            } else {
+                job->threads = (int)n;
+            }
+        }
+        else if (!strcmp(key, "planar"))  job->planar = atoi(val) != 0;
+        else if (!strcmp(key, "luma"))    job->luma = atoi(val) != 0;
+        else if (!strcmp(key, "level"))   job->level = atoi(val);
+        else if (!strcmp(key, "raw"))     job->raw = val;
+        else if (!strcmp(key, "stats"))   job->stats = atoi(val) != 0;
+        else if (!strcmp(key, "perf"))    job->perf = atoi(val) != 0;
+        else if (!strcmp(key, "histogram")) job->histogram = atoi(val) != 0;
+        else if (!strcmp(key, "pipeline")) job->pipeline = val;
+        else if (!strcmp(key, "depth"))   job->depth = atoi(val);
+        else {
+            snprintf(err, errlen, "campo sconosciuto: %s", key);
+            return -1;
+        }
+    }
+    if (!job->input || !job->output) {
+        snprintf(err, errlen, "servono in= e out=");
+        return -1;
+    }
+    if (job->depth != 0 && job->depth != 8 && job->depth != 16) {
+        snprintf(err, errlen, "depth= vale 8 o 16");
+        return -1;
+    }
+    if (job->passes < 1) job->passes = 1;
+    return 0;
+}
+
+int serve_stream(FILE *in, FILE *out, server_handler_fn handler)
+{
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+
+    while ((len = getline(&line, &cap, in)) >= 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        if (len == 0) continue;
+        if (!strcmp(line, "quit")) break;
+
+        server_job_t job;
+        char err[256] = "";
+        double secs = 0.0;
+        char *stats = NULL;
+        if (parse_job(line, &job, err, sizeof err) == 0 &&
+            handler(&job, &secs, &stats, err, sizeof err) == 0) {
+            if (stats) fprintf(out, "ok %.6f %s\n", secs, stats);
+            else       fprintf(out, "ok %.6f\n", secs);
+        } else {
+            fprintf(out, "error %s\n", err[0] ? err : "job fallito");
+        }
+        free(stats);
+        if (fflush(out) != 0) break;      /* il client ha chiuso la pipe */
+    }
+    free(line);
+    return 0;
+}
+
+int serve_unix_socket(const char *path, server_handler_fn handler)
+{
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof addr.sun_path) {
+        fprintf(stderr, "Percorso del socket troppo lungo: %s\n", path);
+        return -1;
+    }
+
+    /* un client che chiude a metà risposta non deve terminare il server */
+    signal(SIGPIPE, SIG_IGN);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof addr) < 0 || listen(fd, 16) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+
+    for (;;) {
+        int conn = accept(fd, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR) continue;
+            perror("accept");
+            break;
+        }
+        int conn_out = dup(conn);
+        FILE *rd = fdopen(conn, "r");
+        FILE *wr = conn_out >= 0 ? fdopen(conn_out, "w") : NULL;
+        if (rd && wr)
+            serve_stream(rd, wr, handler);
+        if (rd) fclose(rd); else close(conn);
+        if (wr) fclose(wr); else if (conn_out >= 0) close(conn_out);
+    }
+    close(fd);
+    unlink(path);
+    return -1;
+}
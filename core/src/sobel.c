@@ -0,0 +1,506 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include "sobel.h"
+#include "cpu_features.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define HAVE_NEON 1
+#endif
+
+/* modulo del gradiente, saturato a 255 */
+static inline unsigned char sobel_mag(int gx, int gy, sobel_mag_t mag)
+{
+    int m;
+    if (mag == SOBEL_MAG_L1) {
+        m = abs(gx) + abs(gy);
+    } else if (mag == SOBEL_MAG_MAXMIN) {
+        /* alpha max + beta min con alpha = 15/16, beta = 15/32 */
+        int ax = abs(gx), ay = abs(gy);
+        int hi = ax > ay ? ax : ay, lo = ax > ay ? ay : ax;
+        m = (15 * (2 * hi + lo)) >> 5;
+    } else {
+        /* floor(sqrt) esatto anche con -ffast-math, come sqrt_ps nei kernel SIMD */
+        int s = gx*gx + gy*gy;
+        m = (int)sqrtf((float)s);
+        while (m * m > s) --m;
+        while ((m + 1) * (m + 1) <= s) ++m;
+    }
+    return (unsigned char)(m > 255 ? 255 : m);
+}
+
+/* I kernel SIMD coprono i blocchi completi a partire da x = 1 e ritornano
+ * la prima colonna rimasta, che il percorso scalare completa fino a w-2.
+ * Accumulatori int16: |gx|, |gy| <= 4*255 = 1020. */
+typedef int (*sobel_row_fn)(const unsigned char *above, const unsigned char *row,
+                            const unsigned char *below, unsigned char *out,
+                            int w, sobel_mag_t mag);
+
+#if HAVE_X86_SIMD
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static inline __m256i ld16_avx2(const unsigned char *p)
+{
+    return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p));
+}
+
+AVX2 static int sobel_row_avx2(const unsigned char *above, const unsigned char *row,
+                               const unsigned char *below, unsigned char *out,
+                               int w, sobel_mag_t mag)
+{
+    int x = 1;
+    for (; x + 16 <= w - 1; x += 16) {
+        __m256i al = ld16_avx2(above + x - 1), ac = ld16_avx2(above + x), ar = ld16_avx2(above + x + 1);
+        __m256i rl = ld16_avx2(row + x - 1),                              rr = ld16_avx2(row + x + 1);
+        __m256i bl = ld16_avx2(below + x - 1), bc = ld16_avx2(below + x), br = ld16_avx2(below + x + 1);
+
+        __m256i gx = _mm256_add_epi16(_mm256_sub_epi16(ar, al), _mm256_sub_epi16(br, bl));
+        gx = _mm256_add_epi16(gx, _mm256_slli_epi16(_mm256_sub_epi16(rr, rl), 1));
+        __m256i gy = _mm256_sub_epi16(_mm256_add_epi16(al, ar), _mm256_add_epi16(bl, br));
+        gy = _mm256_add_epi16(gy, _mm256_slli_epi16(_mm256_sub_epi16(ac, bc), 1));
+
+        __m256i m;
+        if (mag == SOBEL_MAG_L2) {
+            /* gx²+gy² in int32 con madd su coppie (gx,gy); unpack e packs
+             * lavorano per lane, quindi l'ordine finale è quello originale */
+            __m256i lo = _mm256_unpacklo_epi16(gx, gy);
+            __m256i hi = _mm256_unpackhi_epi16(gx, gy);
+            lo = _mm256_cvttps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(_mm256_madd_epi16(lo, lo))));
+            hi = _mm256_cvttps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(_mm256_madd_epi16(hi, hi))));
+            m = _mm256_packs_epi32(lo, hi);
+        } else {
+            __m256i ax = _mm256_abs_epi16(gx), ay = _mm256_abs_epi16(gy);
+            if (mag == SOBEL_MAG_L1) {
+                m = _mm256_add_epi16(ax, ay);
+            } else {
+                __m256i t = _mm256_add_epi16(_mm256_slli_epi16(_mm256_max_epi16(ax, ay), 1),
+                                             _mm256_min_epi16(ax, ay));
+                /* 15*t <= 45900: sta in 16 bit senza segno, shift logico */
+                m = _mm256_srli_epi16(_mm256_mullo_epi16(t, _mm256_set1_epi16(15)), 5);
+            }
+        }
+        /* saturazione a 255; la pack per lane lascia i 16 byte nelle qword 0 e 2 */
+        m = _mm256_permute4x64_epi64(_mm256_packus_epi16(m, m), 0x08);
+        _mm_storeu_si128((__m128i *)(out + x), _mm256_castsi256_si128(m));
+    }
+    return x;
+}
+
+#define AVX512 __attribute__((target("avx512f,avx512bw")))
+
+AVX512 static inline __m512i ld32_avx512(const unsigned char *p)
+{
+    return _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)p));
+}
+
+AVX512 static inline __m128i l2_avx512(__m256i gx, __m256i gy)
+{
+    __m512i x = _mm512_cvtepi16_epi32(gx), y = _mm512_cvtepi16_epi32(gy);
+    __m512i s = _mm512_add_epi32(_mm512_mullo_epi32(x, x), _mm512_mullo_epi32(y, y));
+    return _mm512_cvtusepi32_epi8(_mm512_cvttps_epi32(_mm512_sqrt_ps(_mm512_cvtepi32_ps(s))));
+}
+
+AVX512 static int sobel_row_avx512(const unsigned char *above, const unsigned char *row,
+                                   const unsigned char *below, unsigned char *out,
+                                   int w, sobel_mag_t mag)
+{
+    int x = 1;
+    for (; x + 32 <= w - 1; x += 32) {
+        __m512i al = ld32_avx512(above + x - 1), ac = ld32_avx512(above + x), ar = ld32_avx512(above + x + 1);
+        __m512i rl = ld32_avx512(row + x - 1),                                rr = ld32_avx512(row + x + 1);
+        __m512i bl = ld32_avx512(below + x - 1), bc = ld32_avx512(below + x), br = ld32_avx512(below + x + 1);
+
+        __m512i gx = _mm512_add_epi16(_mm512_sub_epi16(ar, al), _mm512_sub_epi16(br, bl));
+        gx = _mm512_add_epi16(gx, _mm512_slli_epi16(_mm512_sub_epi16(rr, rl), 1));
+        __m512i gy = _mm512_sub_epi16(_mm512_add_epi16(al, ar), _mm512_add_epi16(bl, br));
+        gy = _mm512_add_epi16(gy, _mm512_slli_epi16(_mm512_sub_epi16(ac, bc), 1));
+
+        if (mag == SOBEL_MAG_L2) {
+            _mm_storeu_si128((__m128i *)(out + x),
+                             l2_avx512(_mm512_castsi512_si256(gx), _mm512_castsi512_si256(gy)));
+            _mm_storeu_si128((__m128i *)(out + x + 16),
+                             l2_avx512(_mm512_extracti64x4_epi64(gx, 1), _mm512_extracti64x4_epi64(gy, 1)));
+            continue;
+        }
+        __m512i ax = _mm512_abs_epi16(gx), ay = _mm512_abs_epi16(gy), m;
+        if (mag == SOBEL_MAG_L1) {
+            m = _mm512_add_epi16(ax, ay);
+        } else {
+            __m512i t = _mm512_add_epi16(_mm512_slli_epi16(_mm512_max_epi16(ax, ay), 1),
+                                         _mm512_min_epi16(ax, ay));
+            m = _mm512_srli_epi16(_mm512_mullo_epi16(t, _mm512_set1_epi16(15)), 5);
+        }
+        _mm256_storeu_si256((__m256i *)(out + x), _mm512_cvtusepi16_epi8(m));
+    }
+    return x;
+}
+#endif /* HAVE_X86_SIMD */
+
+#if HAVE_NEON
+static inline int16x8_t ld8_neon(const unsigned char *p)
+{
+    return vreinterpretq_s16_u16(vmovl_u8(vld1_u8(p)));
+}
+
+static int sobel_row_neon(const unsigned char *above, const unsigned char *row,
+                          const unsigned char *below, unsigned char *out,
+                          int w, sobel_mag_t mag)
+{
+    int x = 1;
+    for (; x + 8 <= w - 1; x += 8) {
+        int16x8_t al = ld8_neon(above + x - 1), ac = ld8_neon(above + x), ar = ld8_neon(above + x + 1);
+        int16x8_t rl = ld8_neon(row + x - 1),                             rr = ld8_neon(row + x + 1);
+        int16x8_t bl = ld8_neon(below + x - 1), bc = ld8_neon(below + x), br = ld8_neon(below + x + 1);
+
+        int16x8_t gx = vaddq_s16(vsubq_s16(ar, al), vsubq_s16(br, bl));
+        gx = vaddq_s16(gx, vshlq_n_s16(vsubq_s16(rr, rl), 1));
+        int16x8_t gy = vsubq_s16(vaddq_s16(al, ar), vaddq_s16(bl, br));
+        gy = vaddq_s16(gy, vshlq_n_s16(vsubq_s16(ac, bc), 1));
+
+        uint16x8_t m;
+        if (mag == SOBEL_MAG_L2) {
+            int32x4_t lo = vmlal_s16(vmull_s16(vget_low_s16(gx), vget_low_s16(gx)),
+                                     vget_low_s16(gy), vget_low_s16(gy));
+            int32x4_t hi = vmlal_s16(vmull_s16(vget_high_s16(gx), vget_high_s16(gx)),
+                                     vget_high_s16(gy), vget_high_s16(gy));
+            lo = vcvtq_s32_f32(vsqrtq_f32(vcvtq_f32_s32(lo)));
+            hi = vcvtq_s32_f32(vsqrtq_f32(vcvtq_f32_s32(hi)));
+            m = vcombine_u16(vqmovun_s32(lo), vqmovun_s32(hi));
+        } else {
+            uint16x8_t ax = vreinterpretq_u16_s16(vabsq_s16(gx));
+            uint16x8_t ay = vreinterpretq_u16_s16(vabsq_s16(gy));
+            if (mag == SOBEL_MAG_L1) {
+                m = vaddq_u16(ax, ay);
+            } else {
+                uint16x8_t t = vaddq_u16(vshlq_n_u16(vmaxq_u16(ax, ay), 1), vminq_u16(ax, ay));
+                m = vshrq_n_u16(vmulq_n_u16(t, 15), 5);
+            }
+        }
+        vst1_u8(out + x, vqmovn_u16(m));
+    }
+    return x;
+}
+#endif /* HAVE_NEON */
+
+static sobel_row_fn select_sobel_row(void)
+{
+    switch (simd_isa()) {
+#if HAVE_X86_SIMD
+    case SIMD_AVX512: return sobel_row_avx512;
+    case SIMD_AVX2:   return sobel_row_avx2;
+#endif
+#if HAVE_NEON
+    case SIMD_NEON:   return sobel_row_neon;
+#endif
+    default:          return NULL;
+    }
+}
+
+static inline void sobel_row_with(sobel_row_fn simd_row,
+                                  const unsigned char *above,
+                                  const unsigned char *row,
+                                  const unsigned char *below,
+                                  unsigned char *out, int w, sobel_mag_t mag)
+{
+    int x = simd_row ? simd_row(above, row, below, out, w, mag) : 1;
+    for (; x < w-1; ++x) {
+        int gx =
+            -above[x-1] - 2*row[x-1] - below[x-1] +
+             above[x+1] + 2*row[x+1] + below[x+1];
+        int gy =
+             above[x-1] + 2*above[x] + above[x+1] -
+             below[x-1] - 2*below[x] - below[x+1];
+        out[x] = sobel_mag(gx, gy, mag);
+    }
+}
+
+void sobel_row(const unsigned char *above,
+               const unsigned char *row,
+               const unsigned char *below,
+               unsigned char *out, int w, sobel_mag_t mag)
+{
+    sobel_row_with(select_sobel_row(), above, row, below, out, w, mag);
+}
+
+int sobel_border_index(int i, int n, sobel_border_t border)
+{
+    if (i >= 0 && i < n) return i;
+    switch (border) {
+    case SOBEL_BORDER_REPLICATE:
+        return i < 0 ? 0 : n - 1;
+    case SOBEL_BORDER_REFLECT:
+        i = i < 0 ? -i : 2 * n - 2 - i;
+        return i < 0 ? 0 : (i >= n ? n - 1 : i);     /* n == 1 */
+    default:
+        return -1;
+    }
+}
+
+static inline int px_at(const unsigned char *r, int x, int w,
+                        sobel_border_t border, unsigned char value)
+{
+    int m = sobel_border_index(x, w, border);
+    return m < 0 ? value : r[m];
+}
+
+/* colonna x calcolata con il bordo esplicito: solo per x = 0 e x = w-1 */
+static inline unsigned char sobel_px_border(const unsigned char *above,
+                                            const unsigned char *row,
+                                            const unsigned char *below,
+                                            int x, int w, sobel_mag_t mag,
+                                            sobel_border_t border,
+                                            unsigned char value)
+{
+    int al = px_at(above, x-1, w, border, value), ac = px_at(above, x, w, border, value);
+    int ar = px_at(above, x+1, w, border, value);
+    int rl = px_at(row,   x-1, w, border, value), rr = px_at(row,   x+1, w, border, value);
+    int bl = px_at(below, x-1, w, border, value), bc = px_at(below, x, w, border, value);
+    int br = px_at(below, x+1, w, border, value);
+    int gx = -al - 2*rl - bl + ar + 2*rr + br;
+    int gy =  al + 2*ac + ar - bl - 2*bc - br;
+    return sobel_mag(gx, gy, mag);
+}
+
+static inline void sobel_row_border_with(sobel_row_fn simd_row,
+                                         const unsigned char *above,
+                                         const unsigned char *row,
+                                         const unsigned char *below,
+                                         unsigned char *out, int w,
+                                         sobel_mag_t mag,
+                                         sobel_border_t border,
+                                         unsigned char value)
+{
+    if (border == SOBEL_BORDER_ZERO) value = 0;
+    /* interno senza rami, poi le due colonne ai lati */
+    sobel_row_with(simd_row, above, row, below, out, w, mag);
+    out[0] = sobel_px_border(above, row, below, 0, w, mag, border, value);
+    if (w > 1)
+        out[w-1] = sobel_px_border(above, row, below, w-1, w, mag, border, value);
+}
+
+void sobel_row_border(const unsigned char *above,
+                      const unsigned char *row,
+                      const unsigned char *below,
+                      unsigned char *out, int w, sobel_mag_t mag,
+                      sobel_border_t border, unsigned char value)
+{
+    sobel_row_border_with(select_sobel_row(), above, row, below, out, w,
+                          mag, border, value);
+}
+
+int sobel_edge_ex(const unsigned char *src,
+                  unsigned char *dst,
+                  int w, int h, sobel_mag_t mag,
+                  sobel_border_t border, unsigned char value)
+{
+    if (w < 1 || h < 1) return 0;
+    if (border == SOBEL_BORDER_ZERO) value = 0;
+    const sobel_row_fn simd_row = select_sobel_row();
+
+    /* righe interne: i vicini esistono sempre, il ciclo non ha rami */
+#pragma omp parallel for schedule(static)
+    for (int y = 1; y < h-1; ++y) {
+        const unsigned char *row = src + (long)y*w;
+        sobel_row_border_with(simd_row, row - w, row, row + w, dst + (long)y*w, w,
+                              mag, border, value);
+    }
+
+    /* prima e ultima riga sbucciate: la riga fuori immagine è una vicina
+     * (replicate/reflect) oppure una riga costante (zero/constant) */
+    unsigned char *pad = NULL;
+    if (border == SOBEL_BORDER_ZERO || border == SOBEL_BORDER_CONSTANT) {
+        pad = malloc(w);
+        if (!pad) return -1;
+        memset(pad, value, w);
+    }
+    const int edge_rows[2] = { 0, h - 1 };
+    for (int k = 0; k < (h > 1 ? 2 : 1); ++k) {
+        const int y = edge_rows[k];
+        const int ya = sobel_border_index(y - 1, h, border);
+        const int yb = sobel_border_index(y + 1, h, border);
+        sobel_row_border_with(simd_row,
+                              ya < 0 ? pad : src + (long)ya*w,
+                              src + (long)y*w,
+                              yb < 0 ? pad : src + (long)yb*w,
+                              dst + (long)y*w, w, mag, border, value);
+    }
+    free(pad);
+    return 0;
+}
+
+void sobel_edge(const unsigned char *src,
+                unsigned char *dst,
+                int w, int h)
+{
+    /* REPLICATE non alloca: non può fallire */
+    sobel_edge_ex(src, dst, w, h, SOBEL_MAG_L2, SOBEL_BORDER_REPLICATE, 0);
+}
+
+/* ---- 16 bit e float ----
+ *
+ * Stesso stencil con accumulatori int32 (16 bit) o float. Invece dei
+ * kernel scritti a mano un corpo sempre inline per tipo, con il modulo
+ * costante in ogni ciclo, istanziato per ISA con l'attributo target come
+ * in convolution.c: il compilatore vettorizza sui pixel (int32 e double
+ * per L2 a 16 bit). Bordo e righe sbucciate come a 8 bit. */
+
+#define INLINE static inline __attribute__((always_inline))
+
+INLINE int32_t mag_u16(int32_t gx, int32_t gy, sobel_mag_t mag)
+{
+    int32_t ax = gx < 0 ? -gx : gx, ay = gy < 0 ? -gy : gy, m;
+    if (mag == SOBEL_MAG_L1) {
+        m = ax + ay;
+    } else if (mag == SOBEL_MAG_MAXMIN) {
+        int32_t hi = ax > ay ? ax : ay, lo = ax > ay ? ay : ax;
+        m = (15 * (2 * hi + lo)) >> 5;          /* < 2^24 */
+    } else {
+        /* gx² + gy² < 2^37: esatto in double, e sqrt arrotondata
+         * correttamente non supera mai l'intero successivo */
+        m = (int32_t)sqrt((double)gx * gx + (double)gy * gy);
+    }
+    return m > 65535 ? 65535 : m;
+}
+
+INLINE float mag_f32(float gx, float gy, sobel_mag_t mag)
+{
+    float ax = fabsf(gx), ay = fabsf(gy);
+    if (mag == SOBEL_MAG_L1) return ax + ay;
+    if (mag == SOBEL_MAG_MAXMIN) {
+        float hi = ax > ay ? ax : ay, lo = ax > ay ? ay : ax;
+        return (15.0f / 16.0f) * hi + (15.0f / 32.0f) * lo;
+    }
+    return sqrtf(gx * gx + gy * gy);
+}
+
+/* out[1..w-2] da tre righe, per T campione e A accumulatore */
+#define SOBEL_WIDE_LOOP(A, MAGF, MAG)                                         \
+    for (int x = 1; x < w - 1; ++x) {                                         \
+        A gx = -(A)a[x-1] - 2*(A)r[x-1] - (A)b[x-1]                           \
+             +  (A)a[x+1] + 2*(A)r[x+1] + (A)b[x+1];                          \
+        A gy =  (A)a[x-1] + 2*(A)a[x] + (A)a[x+1]                             \
+             -  (A)b[x-1] - 2*(A)b[x] - (A)b[x+1];                            \
+        out[x] = MAGF(gx, gy, MAG);                                           \
+    }
+
+#define SOBEL_WIDE_BODY(T, A, SFX)                                            \
+    INLINE void sobel_row##SFX##_body(const T *restrict a, const T *restrict r, \
+                                      const T *restrict b, T *restrict out,   \
+                                      int w, sobel_mag_t mag)                 \
+    {                                                                         \
+        if (mag == SOBEL_MAG_L1)          { SOBEL_WIDE_LOOP(A, mag##SFX, SOBEL_MAG_L1) } \
+        else if (mag == SOBEL_MAG_MAXMIN) { SOBEL_WIDE_LOOP(A, mag##SFX, SOBEL_MAG_MAXMIN) } \
+        else                              { SOBEL_WIDE_LOOP(A, mag##SFX, SOBEL_MAG_L2) } \
+    }
+
+SOBEL_WIDE_BODY(uint16_t, int32_t, _u16)
+SOBEL_WIDE_BODY(float, float, _f32)
+
+typedef void (*sobel_u16_fn)(const uint16_t *a, const uint16_t *r, const uint16_t *b,
+                             uint16_t *out, int w, sobel_mag_t mag);
+typedef void (*sobel_f32_fn)(const float *a, const float *r, const float *b,
+                             float *out, int w, sobel_mag_t mag);
+
+typedef struct {
+    sobel_u16_fn u16;
+    sobel_f32_fn f32;
+} sobel_wide_ops_t;
+
+#define SOBEL_WIDE_ISA(ATTR, ISA)                                             \
+    ATTR static void sobel_row_u16##ISA(const uint16_t *a, const uint16_t *r, \
+                                        const uint16_t *b, uint16_t *out,     \
+                                        int w, sobel_mag_t mag)               \
+    { sobel_row_u16_body(a, r, b, out, w, mag); }                             \
+    ATTR static void sobel_row_f32##ISA(const float *a, const float *r,       \
+                                        const float *b, float *out,           \
+                                        int w, sobel_mag_t mag)               \
+    { sobel_row_f32_body(a, r, b, out, w, mag); }                             \
+    static const sobel_wide_ops_t sobel_wide##ISA = { sobel_row_u16##ISA,     \
+                                                      sobel_row_f32##ISA };
+
+SOBEL_WIDE_ISA(SIMD_SCALAR_ATTR, _scalar)
+#if HAVE_X86_SIMD
+SOBEL_WIDE_ISA(AVX2, _avx2)
+SOBEL_WIDE_ISA(AVX512, _avx512)
+#endif
+
+/* NEON è la base di aarch64: la versione generica è già vettorizzata */
+static const sobel_wide_ops_t *select_sobel_wide(void)
+{
+    switch (simd_isa()) {
+#if HAVE_X86_SIMD
+    case SIMD_AVX512: return &sobel_wide_avx512;
+    case SIMD_AVX2:   return &sobel_wide_avx2;
+#endif
+    default:          return &sobel_wide_scalar;
+    }
+}
+
+/* Colonne 0 e w-1, righe sbucciate e driver: come a 8 bit, per tipo */
+#define SOBEL_WIDE_EDGE(T, A, SFX, F)                                         \
+    static inline A px_at##SFX(const T *r, int x, int w, sobel_border_t border, \
+                               T value)                                       \
+    {                                                                         \
+        int m = sobel_border_index(x, w, border);                             \
+        return m < 0 ? (A)value : (A)r[m];                                    \
+    }                                                                         \
+                                                                              \
+    static void row_border##SFX(sobel##SFX##_fn row_fn, const T *a, const T *r, \
+                                const T *b, T *out, int w, sobel_mag_t mag,   \
+                                sobel_border_t border, T value)               \
+    {                                                                         \
+        row_fn(a, r, b, out, w, mag);                                         \
+        for (int k = 0; k < (w > 1 ? 2 : 1); ++k) {                           \
+            const int x = k ? w - 1 : 0;                                      \
+            A al = px_at##SFX(a, x-1, w, border, value), ac = px_at##SFX(a, x, w, border, value); \
+            A ar = px_at##SFX(a, x+1, w, border, value);                      \
+            A rl = px_at##SFX(r, x-1, w, border, value), rr = px_at##SFX(r, x+1, w, border, value); \
+            A bl = px_at##SFX(b, x-1, w, border, value), bc = px_at##SFX(b, x, w, border, value); \
+            A br = px_at##SFX(b, x+1, w, border, value);                      \
+            A gx = -al - 2*rl - bl + ar + 2*rr + br;                          \
+            A gy =  al + 2*ac + ar - bl - 2*bc - br;                          \
+            out[x] = mag##SFX(gx, gy, mag);                                   \
+        }                                                                     \
+    }                                                                         \
+                                                                              \
+    int sobel_edge##SFX(const T *src, T *dst, int w, int h, sobel_mag_t mag,  \
+                        sobel_border_t border, T value)                       \
+    {                                                                         \
+        if (w < 1 || h < 1) return 0;                                         \
+        if (border == SOBEL_BORDER_ZERO) value = 0;                           \
+        const sobel##SFX##_fn row_fn = select_sobel_wide()->F;                \
+                                                                              \
+        _Pragma("omp parallel for schedule(static)")                          \
+        for (int y = 1; y < h-1; ++y) {                                       \
+            const T *row = src + (long)y*w;                                   \
+            row_border##SFX(row_fn, row - w, row, row + w, dst + (long)y*w, w, \
+                            mag, border, value);                              \
+        }                                                                     \
+                                                                              \
+        T *pad = NULL;                                                        \
+        if (border == SOBEL_BORDER_ZERO || border == SOBEL_BORDER_CONSTANT) { \
+            pad = malloc((size_t)w * sizeof *pad);                            \
+            if (!pad) return -1;                                              \
+            for (int x = 0; x < w; ++x) pad[x] = value;                       \
+        }                                                                     \
+        const int edge_rows[2] = { 0, h - 1 };                                \
+        for (int k = 0; k < (h > 1 ? 2 : 1); ++k) {                           \
+            const int y = edge_rows[k];                                       \
+            const int ya = sobel_border_index(y - 1, h, border);              \
+            const int yb = sobel_border_index(y + 1, h, border);              \
+            row_border##SFX(row_fn, ya < 0 ? pad : src + (long)ya*w,          \
+                            src + (long)y*w, yb < 0 ? pad : src + (long)yb*w, \
+                            dst + (long)y*w, w, mag, border, value);          \
+        }                                                                     \
+        free(pad);                                                            \
+        return 0;                                                             \
+    }
+
+SOBEL_WIDE_EDGE(uint16_t, int32_t, _u16, u16)
+SOBEL_WIDE_EDGE(float, float, _f32, f32)
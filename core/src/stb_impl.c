@@ -0,0 +1,6 @@
+// stb_impl.c
+// Implementazioni stb in un'unica unità: le usano sia la CLI sia libgrayscale.so
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
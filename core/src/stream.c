@@ -0,0 +1,277 @@
+// stream.c
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <omp.h>
+#include "stream.h"
+#include "row_reader.h"
+#include "png_parallel.h"
+#include "buffer_pool.h"
+#include "frame_map.h"
+
+static void write_error(char *err, size_t errlen, const char *out_path)
+{
+    if (out_path) snprintf(err, errlen, "Errore nel salvataggio di \"%s\"", out_path);
+    else          snprintf(err, errlen, "Errore nella scrittura del PNG");
+}
+
+/* Ingresso delle bande: il decoder, oppure righe grezze contigue */
+typedef struct {
+    row_reader_t *r;
+    FILE *raw;
+} rows_in_t;
+
+static int read_rows(rows_in_t *in, unsigned char *dst, int nrows, size_t row,
+                     char *err, size_t errlen)
+{
+    if (in->r)
+        return row_reader_read(in->r, dst, nrows, err, errlen);
+    if (fread(dst, row, nrows, in->raw) != (size_t)nrows) {
+        snprintf(err, errlen, "Righe grezze troncate");
+        return -1;
+    }
+    return 0;
+}
+
+/* Le righe d'uscita [y_begin, y_end) a bande, da in (che parte dalla riga
+ * d'ingresso in_y0) a ps; non chiude né in né ps */
+static int run_bands(rows_in_t *in, int in_y0, int y_begin, int y_end,
+                     png_stream_t *ps, const char *out_path, int band_rows,
+                     const stream_kernel_t *k, stream_stats_t *st,
+                     char *err, size_t errlen)
+{
+    if (band_rows <= 0) band_rows = STREAM_BAND_DEFAULT;
+    const int halo = k->halo > 0 ? k->halo : 0;
+    const int width = st->width, height = st->height, channels = st->channels;
+    const int out_ch = k->out_channels > 0 ? k->out_channels : channels;
+
+    const size_t in_row = (size_t)width * channels, out_row = (size_t)width * out_ch;
+    const int win_cap = band_rows + 2 * halo;
+    unsigned char *win = pool_alloc(in_row * win_cap);
+    unsigned char *out = k->in_place ? NULL : pool_alloc(out_row * band_rows);
+    if (!win || (!k->in_place && !out)) {
+        snprintf(err, errlen, "Impossibile allocare i buffer delle bande");
+        goto fail;
+    }
+    st->peak_bytes = in_row * win_cap + (out ? out_row * band_rows : 0);
+
+    /* win contiene le righe [buf_y0, buf_y0 + buf_rows) */
+    int buf_y0 = in_y0, buf_rows = 0;
+    for (int y0 = y_begin; y0 < y_end; y0 += band_rows) {
+        const int n = y_end - y0 < band_rows ? y_end - y0 : band_rows;
+        const int need_y0 = y0 - halo > 0 ? y0 - halo : 0;
+        const int need_end = y0 + n + halo < height ? y0 + n + halo : height;
+
+        /* scarta le righe sopra l'alone, tiene il contesto già letto */
+        double t = omp_get_wtime();
+        const int drop = need_y0 - buf_y0;
+        if (drop > 0) {
+            const int keep = buf_rows > drop ? buf_rows - drop : 0;
+            memmove(win, win + (size_t)drop * in_row, (size_t)keep * in_row);
+            buf_y0 = need_y0;
+            buf_rows = keep;
+        }
+        const int fill = need_end - (buf_y0 + buf_rows);
+        if (fill > 0) {
+            if (read_rows(in, win + (size_t)buf_rows * in_row, fill, in_row,
+                          err, errlen) != 0)
+                goto fail;
+            buf_rows += fill;
+        }
+        st->read_secs += omp_get_wtime() - t;
+
+        t = omp_get_wtime();
+        unsigned char *dst = k->in_place ? win : out;
+        if (k->run(k->ctx, win, buf_y0, buf_rows, dst, y0, n, width, height, channels) != 0) {
+            snprintf(err, errlen, "Errore del kernel nella banda %d", st->bands);
+            goto fail;
+        }
+        st->kernel_secs += omp_get_wtime() - t;
+
+        t = omp_get_wtime();
+        if (png_stream_write_rows(ps, dst, n) != 0) {
+            write_error(err, errlen, out_path);
+            goto fail;
+        }
+        st->write_secs += omp_get_wtime() - t;
+        st->bands++;
+    }
+    pool_free(win);
+    pool_free(out);
+    return 0;
+
+fail:
+    pool_free(win);
+    pool_free(out);
+    return -1;
+}
+
+/* L'immagine intera da r a out_path (se non NULL) o a out; chiude r */
+static int run_image(row_reader_t *r, const char *out_path, FILE *out_f,
+                     int band_rows, int level, const stream_kernel_t *k,
+                     stream_stats_t *st, double start, char *err, size_t errlen)
+{
+    row_reader_dims(r, &st->width, &st->height, &st->channels);
+    const int out_ch = k->out_channels > 0 ? k->out_channels : st->channels;
+    png_stream_t *ps = out_path
+        ? png_stream_open(out_path, st->width, st->height, out_ch, level, 0)
+        : png_stream_fopen(out_f, st->width, st->height, out_ch, level, 0);
+    if (!ps) {
+        if (out_path) snprintf(err, errlen, "Errore aprendo \"%s\"", out_path);
+        else          write_error(err, errlen, NULL);
+        row_reader_close(r);
+        return -1;
+    }
+    rows_in_t in = { .r = r };
+    if (run_bands(&in, 0, 0, st->height, ps, out_path, band_rows, k, st,
+                  err, errlen) != 0) {
+        /* niente PNG a metà: come senza --stream, l'uscita non resta */
+        png_stream_close(ps);
+        if (out_path) remove(out_path);
+        row_reader_close(r);
+        return -1;
+    }
+
+    const double t = omp_get_wtime();
+    const int rc = png_stream_close(ps);
+    st->write_secs += omp_get_wtime() - t;
+    row_reader_close(r);
+    if (rc != 0) {
+        write_error(err, errlen, out_path);
+        if (out_path) remove(out_path);
+        return -1;
+    }
+    st->total_secs = omp_get_wtime() - start;
+    return 0;
+}
+
+static int check_kernel(const stream_kernel_t *k, char *err, size_t errlen)
+{
+    if (k->in_place && k->halo > 0) {
+        snprintf(err, errlen, "kernel in-place con alone non supportato");
+        return -1;
+    }
+    return 0;
+}
+
+int stream_process(const char *in_path, const char *out_path, int gray,
+                   int band_rows, int level, const stream_kernel_t *k,
+                   stream_stats_t *st, char *err, size_t errlen)
+{
+    stream_stats_t local = {0};
+    if (!st) st = &local;
+    memset(st, 0, sizeof *st);
+    const double start = omp_get_wtime();
+    if (check_kernel(k, err, errlen) != 0) return -1;
+    row_reader_t *r = row_reader_open(in_path, gray, err, errlen);
+    if (!r) return -1;
+    if (!frame_same_file(in_path, out_path))
+        return run_image(r, out_path, NULL, band_rows, level, k, st, start, err, errlen);
+
+    /* uscita sullo stesso file: troncarla cancellerebbe le righe non ancora
+     * lette. Si scrive accanto e si rinomina alla fine, così se qualcosa
+     * fallisce l'ingresso resta com'era */
+    char tmp[4096];
+    FILE *f = NULL;
+    int fd = -1;
+    if (snprintf(tmp, sizeof tmp, "%s.XXXXXX", out_path) < (int)sizeof tmp)
+        fd = mkstemp(tmp);
+    if (fd >= 0) {
+        fchmod(fd, 0644);
+        f = fdopen(fd, "wb");
+        if (!f) close(fd);
+    }
+    if (!f) {
+        snprintf(err, errlen, "Errore aprendo un file temporaneo accanto a \"%s\"", out_path);
+        if (fd >= 0) remove(tmp);
+        row_reader_close(r);
+        return -1;
+    }
+    int rc = run_image(r, NULL, f, band_rows, level, k, st, start, err, errlen);
+    if (fclose(f) != 0 && rc == 0) {
+        write_error(err, errlen, out_path);
+        rc = -1;
+    }
+    if (rc == 0 && rename(tmp, out_path) != 0) {
+        write_error(err, errlen, out_path);
+        rc = -1;
+    }
+    if (rc != 0) remove(tmp);
+    return rc;
+}
+
+int stream_process_file(FILE *in, FILE *out, int gray, int band_rows, int level,
+                        const stream_kernel_t *k, stream_stats_t *st,
+                        char *err, size_t errlen)
+{
+    stream_stats_t local = {0};
+    if (!st) st = &local;
+    memset(st, 0, sizeof *st);
+    const double start = omp_get_wtime();
+    if (check_kernel(k, err, errlen) != 0) return -1;
+    row_reader_t *r = row_reader_fopen(in, gray, err, errlen);
+    if (!r) return -1;
+    return run_image(r, NULL, out, band_rows, level, k, st, start, err, errlen);
+}
+
+/* ---- tile ---- */
+
+void stream_tile_window(int height, int y0, int rows, int halo, int *win_y0, int *win_rows)
+{
+    if (halo < 0) halo = 0;
+    /* la riga y0 - 1 è il contesto del filtro PNG del frammento */
+    const int first = y0 > 0 ? y0 - 1 : 0;
+    const int begin = first - halo > 0 ? first - halo : 0;
+    const int end = y0 + rows + halo < height ? y0 + rows + halo : height;
+    *win_y0 = begin;
+    *win_rows = end - begin;
+}
+
+int stream_tile_file(FILE *in, FILE *out, int width, int height, int channels,
+                     int y0, int rows, int band_rows, int level,
+                     const stream_kernel_t *k, stream_tile_t *tile,
+                     stream_stats_t *st, char *err, size_t errlen)
+{
+    stream_stats_t local = {0};
+    if (!st) st = &local;
+    memset(st, 0, sizeof *st);
+    const double start = omp_get_wtime();
+    if (check_kernel(k, err, errlen) != 0) return -1;
+    if (width <= 0 || height <= 0 || channels < 1 || channels > 4 ||
+        y0 < 0 || rows <= 0 || y0 + rows > height) {
+        snprintf(err, errlen, "tile [%d, %d) fuori da un'immagine %dx%dx%d",
+                 y0, y0 + rows, width, height, channels);
+        return -1;
+    }
+    st->width = width;
+    st->height = height;
+    st->channels = channels;
+
+    const int out_ch = k->out_channels > 0 ? k->out_channels : channels;
+    png_stream_t *ps = png_fragment_fopen(out, width, height, out_ch, level, 0, y0, rows);
+    if (!ps) {
+        write_error(err, errlen, NULL);
+        return -1;
+    }
+    int win_y0, win_rows;
+    stream_tile_window(height, y0, rows, k->halo, &win_y0, &win_rows);
+    rows_in_t src = { .raw = in };
+    if (run_bands(&src, win_y0, y0 > 0 ? y0 - 1 : 0, y0 + rows, ps, NULL, band_rows,
+                  k, st, err, errlen) != 0) {
+        png_stream_close(ps);
+        return -1;
+    }
+    const double t = omp_get_wtime();
+    const int rc = png_fragment_close(ps, &tile->adler, &tile->filtered);
+    st->write_secs += omp_get_wtime() - t;
+    if (rc != 0) {
+        write_error(err, errlen, NULL);
+        return -1;
+    }
+    st->total_secs = omp_get_wtime() - start;
+    return 0;
+}
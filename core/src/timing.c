@@ -0,0 +1,280 @@
+// timing.c
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <omp.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#include "timing.h"
+
+double timing_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int timing_report_init(timing_report_t *r, int passes)
+{
+    memset(r, 0, sizeof *r);
+    r->passes = passes;
+    r->depth = 8;
+    r->pass_secs = calloc(passes > 0 ? passes : 1, sizeof *r->pass_secs);
+    return r->pass_secs ? 0 : -1;
+}
+
+void timing_report_free(timing_report_t *r)
+{
+    free(r->pass_secs);
+    free(r->image);
+    r->pass_secs = NULL;
+    r->image = NULL;
+}
+
+/* ---- perf_event ---- */
+
+enum { PERF_CYCLES = 0, PERF_INSTRUCTIONS, PERF_LLC_MISSES, PERF_NCOUNTERS };
+
+struct perf_session {
+    int nthreads;
+    int (*fd)[PERF_NCOUNTERS];
+};
+
+#ifdef __linux__
+static int perf_open(uint64_t config, int group)
+{
+    struct perf_event_attr a;
+    memset(&a, 0, sizeof a);
+    a.size = sizeof a;
+    a.type = PERF_TYPE_HARDWARE;
+    a.config = config;
+    a.disabled = group < 0;         /* il leader abilita tutto il gruppo */
+    a.exclude_kernel = 1;           /* basta perf_event_paranoid <= 2 */
+    a.exclude_hv = 1;
+    a.read_format = PERF_FORMAT_GROUP;
+    /* pid 0, cpu -1: solo il thread chiamante, su qualunque CPU */
+    return (int)syscall(SYS_perf_event_open, &a, 0, -1, group, 0);
+}
+
+perf_session_t *perf_begin(void)
+{
+    static const uint64_t config[PERF_NCOUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES
+    };
+    perf_session_t *s = malloc(sizeof *s);
+    if (!s) return NULL;
+    s->nthreads = omp_get_max_threads();
+    s->fd = malloc(s->nthreads * sizeof *s->fd);
+    if (!s->fd) {
+        free(s);
+        return NULL;
+    }
+
+    int ok = 1;
+    #pragma omp parallel num_threads(s->nthreads)
+    {
+        int t = omp_get_thread_num();
+        int *fd = s->fd[t];
+        fd[PERF_CYCLES] = perf_open(config[PERF_CYCLES], -1);
+        for (int c = 1; c < PERF_NCOUNTERS; ++c)
+            fd[c] = fd[PERF_CYCLES] >= 0 ? perf_open(config[c], fd[PERF_CYCLES]) : -1;
+        if (fd[PERF_CYCLES] < 0) {
+            #pragma omp atomic write
+            ok = 0;
+        } else {
+            ioctl(fd[PERF_CYCLES], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(fd[PERF_CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+    if (!ok) {
+        perf_end(s, NULL);
+        return NULL;
+    }
+    return s;
+}
+
+void perf_end(perf_session_t *s, perf_counts_t *out)
+{
+    if (out) memset(out, 0, sizeof *out);
+    if (!s) return;
+
+    uint64_t sum[PERF_NCOUNTERS] = {0};
+    int complete = 1;
+    #pragma omp parallel num_threads(s->nthreads)
+    {
+        int *fd = s->fd[omp_get_thread_num()];
+        if (fd[PERF_CYCLES] >= 0) {
+            ioctl(fd[PERF_CYCLES], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            /* PERF_FORMAT_GROUP: nr, poi un valore per contatore */
+            uint64_t buf[1 + PERF_NCOUNTERS] = {0};
+            ssize_t n = read(fd[PERF_CYCLES], buf, sizeof buf);
+            if (n >= (ssize_t)(2 * sizeof(uint64_t))) {
+                for (uint64_t c = 0; c < buf[0] && c < PERF_NCOUNTERS; ++c) {
+                    #pragma omp atomic
+                    sum[c] += buf[1 + c];
+                }
+            }
+            if (n < (ssize_t)sizeof buf || buf[0] < PERF_NCOUNTERS) {
+                #pragma omp atomic write
+                complete = 0;
+            }
+        }
+        for (int c = 0; c < PERF_NCOUNTERS; ++c)
+            if (fd[c] >= 0) close(fd[c]);
+    }
+    if (out) {
+        out->available = complete;
+        out->cycles = sum[PERF_CYCLES];
+        out->instructions = sum[PERF_INSTRUCTIONS];
+        out->llc_misses = sum[PERF_LLC_MISSES];
+    }
+    free(s->fd);
+    free(s);
+}
+#else
+perf_session_t *perf_begin(void)
+{
+    return NULL;
+}
+
+void perf_end(perf_session_t *s, perf_counts_t *out)
+{
+    (void)s;
+    if (out) memset(out, 0, sizeof *out);
+}
+#endif
+
+/* ---- banda di riferimento ---- */
+
+#define BW_BYTES ((size_t)128 << 20)
+
+double timing_memory_bandwidth(void)
+{
+    static double cached = 0.0;
+    if (cached > 0.0) return cached;
+
+    unsigned char *src = malloc(BW_BYTES), *dst = malloc(BW_BYTES);
+    if (!src || !dst) {
+        free(src);
+        free(dst);
+        return 0.0;
+    }
+    /* first touch con la stessa partizione della copia */
+    #pragma omp parallel for schedule(static)
+    for (long i = 0; i < (long)(BW_BYTES >> 12); ++i) {
+        memset(src + (i << 12), 1, 4096);
+        memset(dst + (i << 12), 0, 4096);
+    }
+
+    double best = 0.0;
+    for (int rep = 0; rep < 3; ++rep) {
+        double t0 = timing_now();
+        #pragma omp parallel for schedule(static)
+        for (long i = 0; i < (long)(BW_BYTES >> 16); ++i)
+            memcpy(dst + (i << 16), src + (i << 16), 1 << 16);
+        double dt = timing_now() - t0;
+        /* lettura + scrittura */
+        double gbps = 2.0 * BW_BYTES / dt / 1e9;
+        if (gbps > best) best = gbps;
+    }
+    free(src);
+    free(dst);
+    cached = best;
+    return cached;
+}
+
+/* ---- output ---- */
+
+static const char *stage_names[STAGE_COUNT] = {
+    "decode", "threads", "alloc", "kernel", "encode"
+};
+
+static double kernel_gbps(const timing_report_t *r)
+{
+    double k = r->secs[STAGE_KERNEL];
+    return k > 0 ? r->kernel_bytes / k / 1e9 : 0.0;
+}
+
+/* byte portati dalla DRAM stimati come LLC miss × 64 */
+static double dram_gbps(const timing_report_t *r)
+{
+    double k = r->secs[STAGE_KERNEL];
+    return k > 0 ? r->perf.llc_misses * 64.0 / k / 1e9 : 0.0;
+}
+
+static void print_json_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; s && *s; ++s) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+        else if (c < 0x20)         fprintf(f, "\\u%04x", c);
+        else                       fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+void timing_csv_header(FILE *f)
+{
+    fputs("input,width,height,channels,threads,passes", f);
+    for (int s = 0; s < STAGE_COUNT; ++s)
+        fprintf(f, ",%s_s", stage_names[s]);
+    fputs(",total_s,kernel_gbps,mem_bw_gbps,cycles,instructions,llc_misses,dram_gbps\n", f);
+}
+
+void timing_print_csv(FILE *f, const timing_report_t *r, const char *input)
+{
+    fprintf(f, "%s,%d,%d,%d,%d,%d", input, r->width, r->height, r->channels,
+            r->threads, r->passes);
+    for (int s = 0; s < STAGE_COUNT; ++s)
+        fprintf(f, ",%.6f", r->secs[s]);
+    fprintf(f, ",%.6f,%.3f,", r->total, kernel_gbps(r));
+    if (r->mem_bw_gbps > 0) fprintf(f, "%.3f", r->mem_bw_gbps);
+    if (r->perf.available)
+        fprintf(f, ",%llu,%llu,%llu,%.3f\n",
+                (unsigned long long)r->perf.cycles,
+                (unsigned long long)r->perf.instructions,
+                (unsigned long long)r->perf.llc_misses, dram_gbps(r));
+    else
+        fputs(",,,,\n", f);
+}
+
+void timing_print_json(FILE *f, const timing_report_t *r, const char *input)
+{
+    fputs("{\"input\":", f);
+    print_json_string(f, input);
+    fprintf(f, ",\"width\":%d,\"height\":%d,\"channels\":%d,\"depth\":%d,\"threads\":%d,"
+               "\"passes\":%d", r->width, r->height, r->channels, r->depth, r->threads,
+            r->passes);
+    for (int s = 0; s < STAGE_COUNT; ++s)
+        fprintf(f, ",\"%s_s\":%.6f", stage_names[s], r->secs[s]);
+    fputs(",\"kernel_pass_s\":[", f);
+    for (int p = 0; p < r->passes; ++p)
+        fprintf(f, "%s%.6f", p ? "," : "", r->pass_secs[p]);
+    fprintf(f, "],\"total_s\":%.6f,\"kernel_gbps\":%.3f", r->total, kernel_gbps(r));
+    if (r->mem_bw_gbps > 0)
+        fprintf(f, ",\"mem_bw_gbps\":%.3f,\"mem_bw_pct\":%.1f", r->mem_bw_gbps,
+                100.0 * kernel_gbps(r) / r->mem_bw_gbps);
+    else
+        fputs(",\"mem_bw_gbps\":null", f);
+    if (r->perf.available)
+        fprintf(f, ",\"cycles\":%llu,\"instructions\":%llu,\"llc_misses\":%llu,"
+                   "\"dram_gbps\":%.3f",
+                (unsigned long long)r->perf.cycles,
+                (unsigned long long)r->perf.instructions,
+                (unsigned long long)r->perf.llc_misses, dram_gbps(r));
+    else
+        fputs(",\"cycles\":null,\"instructions\":null,\"llc_misses\":null,"
+              "\"dram_gbps\":null", f);
+    if (r->image) {
+        fputs(",\"image\":", f);
+        image_stats_print_json(f, r->image);
+    }
+    fputs("}\n", f);
+}
@@ -3,12 +3,26 @@ import os
 import uuid
 import time
 import threading
-from flask import Flask, request, send_file, render_template_string
+from flask import Flask, Response, request, send_file, render_template_string
 from minio import Minio
 import pika
 import json
+from collections import OrderedDict
+
+from grayscale_common.metrics import CONTENT_TYPE, REGISTRY, Counter, Gauge, Histogram
 
 BUCKET = 'images'
+# uploads up to this size travel in the AMQP message and the result comes
+# back in the reply: no MinIO round-trips (0 = always through MinIO)
+INLINE_MAX_BYTES = int(os.environ.get('GRAYSCALE_INLINE_BYTES', 256 * 1024))
+# total bytes of the inline originals and results kept for the page;
+# the oldest go first, the newest image always stays
+INLINE_KEEP_BYTES = int(os.environ.get('GRAYSCALE_INLINE_KEEP_BYTES', 64 * 1024 * 1024))
+# completion messages and submit times kept for /status, newest last
+PROCESSED_KEEP = 1024
+# seconds between two reads of the queue depths for /metrics
+METRICS_POLL = float(os.environ.get('GRAYSCALE_METRICS_POLL_S', 5))
+QUEUES = ('grayscale', 'grayscale_processed')
 
 minio_client = Minio(
     os.environ.get('MINIO_ENDPOINT', 'minio:9000'),
@@ -34,8 +48,49 @@ channel = connection.channel()
 channel.queue_declare(queue='grayscale')
 channel.queue_declare(queue='grayscale_processed')
 
-# dictionary storing processed results indexed by original key
-PROCESSED = {}
+# processed results indexed by original key
+PROCESSED = OrderedDict()
+# submit time of the jobs still running, for the end-to-end latency
+SUBMITTED = OrderedDict()
+# images of inline jobs by key, served by /image instead of MinIO
+INLINE = OrderedDict()
+inline_bytes = 0
+# the consumer thread and the Flask request threads share the three maps
+STATE_LOCK = threading.Lock()
+
+def keep_inline(key, data, mimetype='image/png'):
+    global inline_bytes
+    with STATE_LOCK:
+        old = INLINE.pop(key, None)
+        if old is not None:
+            inline_bytes -= len(old[0])
+        INLINE[key] = (data, mimetype)
+        inline_bytes += len(data)
+        while inline_bytes > INLINE_KEEP_BYTES and len(INLINE) > 1:
+            _, (dropped, _) = INLINE.popitem(last=False)
+            inline_bytes -= len(dropped)
+
+def keep(entries, key, value, limit=PROCESSED_KEEP):
+    with STATE_LOCK:
+        entries[key] = value
+        entries.move_to_end(key)
+        while len(entries) > limit:
+            entries.popitem(last=False)
+
+jobs_submitted = Counter('grayscale_frontend_jobs_total', 'Jobs published, inline or via MinIO',
+                         ['path'])
+upload_seconds = Histogram('grayscale_frontend_upload_seconds',
+                           'Seconds to upload an original to MinIO')
+job_seconds = Histogram('grayscale_frontend_job_seconds',
+                        'Seconds from publish to completion message, end to end')
+results_total = Counter('grayscale_frontend_results_total',
+                        'Completion messages, by whether the result was cached', ['cached'])
+queue_messages = Gauge('grayscale_queue_messages', 'Messages ready in the queue', ['queue'])
+queue_consumers = Gauge('grayscale_queue_consumers', 'Consumers of the queue', ['queue'])
+queue_lag = Histogram('grayscale_queue_lag_seconds',
+                      'Seconds from publish to delivery (consumer lag)', ['queue'])
+Gauge('grayscale_frontend_results', 'Results kept for /status',
+      function=lambda: len(PROCESSED))
 
 def consume_processed():
     """Background thread consuming completion messages."""
@@ -44,15 +99,39 @@ def consume_processed():
     proc_channel.queue_declare(queue='grayscale_processed')
 
     def cb(ch, method, properties, body):
-        msg = json.loads(body)
-        PROCESSED[msg['image_key']] = {
-            'processed_key': msg['processed_key'],
+        sent_at = (properties.headers or {}).get('sent_at')
+        if sent_at is not None:
+            queue_lag.observe(max(0.0, time.time() - sent_at), queue='grayscale_processed')
+        if properties.content_type == 'image/png':
+            # inline job: the body is the PNG, the result JSON a header
+            msg = json.loads(properties.headers['result'])
+            keep_inline(msg['processed_key'], body)
+        else:
+            msg = json.loads(body)
+        keep(PROCESSED, msg['image_key'], {
+            'processed_key': msg.get('processed_key'),
+            'error': msg.get('error'),
             'times': msg.get('times', {}),
+            'stages': msg.get('stages', {}),
             'passes': msg.get('passes'),
-        }
+            'cached': msg.get('cached', False),
+        })
+        with STATE_LOCK:
+            submitted = SUBMITTED.pop(msg['image_key'], None)
+        if submitted is not None:
+            job_seconds.observe(time.time() - submitted)
+        results_total.inc(cached=str(bool(msg.get('cached'))).lower())
         ch.basic_ack(delivery_tag=method.delivery_tag)
 
+    def poll_queues():
+        for name in QUEUES:
+            ok = proc_channel.queue_declare(queue=name, passive=True)
+            queue_messages.set(ok.method.message_count, queue=name)
+            queue_consumers.set(ok.method.consumer_count, queue=name)
+        proc_connection.call_later(METRICS_POLL, poll_queues)
+
     proc_channel.basic_consume(queue='grayscale_processed', on_message_callback=cb)
+    poll_queues()
     proc_channel.start_consuming()
 
 # start consumer thread
@@ -87,7 +166,7 @@ PAGE_TEMPLATE = """
       </div>
     </div>
     <p>Threads to test:</p>
-    {% for t in [1,2,4,6] %}
+    {% for t in [1,2,4,6,'auto'] %}
     <label>
       <input type='checkbox' name='threads' value='{{t}}' {% if t in threads_val %}checked{% endif %}>
       <span>{{t}}</span>
@@ -227,21 +306,32 @@ PAGE_TEMPLATE = """
       const res = await fetch('/status?key={{ key }}');
       const data = await res.json();
       
-      if (data.processed && !hasProcessed) {
+      if (data.processed && data.error) {
+        // failed job (e.g. a tile of a split one): nothing to show
+        document.getElementById('status').textContent = 'Processing failed: ' + data.error;
+        clearInterval(timer);
+      } else if (data.processed && !hasProcessed) {
         // Only update the charts once when data is available
         hasProcessed = true;
         
         document.getElementById('processed-img').src = '/image/' + encodeURIComponent(data.processed_key);
         document.getElementById('processed-img').style.display = 'block';
-        document.getElementById('status').textContent = 'Processing complete';
+        // a cached result was not run again: no times to chart
+        document.getElementById('status').textContent =
+          data.cached ? 'Processing complete (cached)' : 'Processing complete';
         
-        // Get thread numbers in ascending order
+        // Get thread numbers in ascending order, 'auto' last
         const threads = Object.keys(data.times)
+          .filter(t => t !== 'auto')
           .map(t => parseInt(t))
           .sort((a, b) => a - b);
+        if ('auto' in data.times) threads.push('auto');
         
         // Get execution times for each thread count
         const times = threads.map(t => data.times[t]);
+        // 'auto' is labelled with the count the worker picked
+        const label = t => t === 'auto' && data.stages.auto
+          ? `auto (${data.stages.auto.threads})` : t.toString();
         
         // Calculate base time (single thread or lowest thread count)
         const base = times[0];
@@ -250,12 +340,12 @@ PAGE_TEMPLATE = """
         const speedups = times.map(time => base / time);
         
         // Update time chart
-        timeChart.data.labels = threads.map(t => t.toString());
+        timeChart.data.labels = threads.map(label);
         timeChart.data.datasets[0].data = times;
         timeChart.update();
         
         // Update speedup chart
-        speedChart.data.labels = threads.map(t => t.toString());
+        speedChart.data.labels = threads.map(label);
         speedChart.data.datasets[0].data = speedups;
         speedChart.update();
         
@@ -284,38 +374,67 @@ def index():
         file = request.files['image']
         if not file:
             return 'no file', 400
-        threads = [int(t) for t in request.form.getlist('threads')] or [1]
+        threads = [t if t == 'auto' else int(t)
+                   for t in request.form.getlist('threads')] or [1]
         repeat = request.form.get('repeat') or '1'
-        key = f"uploads/{uuid.uuid4().hex}_{file.filename}"
-        minio_client.put_object(
-            BUCKET,
-            key,
-            file.stream,
-            length=-1,
-            part_size=10 * 1024 * 1024,
-            content_type=file.content_type,
-        )
+        name = f"{uuid.uuid4().hex}_{file.filename}"
+        head = file.stream.read(INLINE_MAX_BYTES + 1) if INLINE_MAX_BYTES > 0 else b''
+        inline = 0 < len(head) <= INLINE_MAX_BYTES
+        key = f"inline/{name}" if inline else f"uploads/{name}"
         msg = {
             'image_key': key,
             'threads': threads,
             'repeat': int(repeat)
         }
-        channel.basic_publish('', 'grayscale', json.dumps(msg).encode())
+        if inline:
+            keep_inline(key, head, file.mimetype or 'application/octet-stream')
+            keep(SUBMITTED, key, time.time())
+            # sent_at: the worker measures its lag from it
+            channel.basic_publish('', 'grayscale', head, properties=pika.BasicProperties(
+                content_type='application/octet-stream',
+                headers={'job': json.dumps(msg), 'sent_at': time.time()}))
+        else:
+            file.stream.seek(0)
+            start = time.time()
+            minio_client.put_object(
+                BUCKET,
+                key,
+                file.stream,
+                length=-1,
+                part_size=10 * 1024 * 1024,
+                content_type=file.content_type,
+            )
+            upload_seconds.observe(time.time() - start)
+            keep(SUBMITTED, key, time.time())
+            channel.basic_publish('', 'grayscale', json.dumps(msg).encode(),
+                                  properties=pika.BasicProperties(
+                                      headers={'sent_at': time.time()}))
+        jobs_submitted.inc(path='inline' if inline else 'minio')
         return render_template_string(PAGE_TEMPLATE, key=key, threads_val=threads, repeat_val=repeat)
     return render_template_string(PAGE_TEMPLATE, key=None, threads_val=[1], repeat_val=1)
 
 @app.route('/status')
 def status():
     key = request.args['key']
-    info = PROCESSED.get(key)
+    with STATE_LOCK:
+        info = PROCESSED.get(key)
     if not info:
         return {'processed': False}
     resp = {'processed': True}
     resp.update(info)
     return resp
 
+@app.route('/metrics')
+def metrics():
+    return Response(REGISTRY.render(), content_type=CONTENT_TYPE)
+
 @app.route('/image/<path:key>')
 def image(key):
+    with STATE_LOCK:
+        entry = INLINE.get(key)
+    if entry is not None:
+        data, mimetype = entry
+        return send_file(io.BytesIO(data), mimetype=mimetype)
     response = minio_client.get_object(BUCKET, key)
     return send_file(io.BytesIO(response.read()), mimetype='image/png')
 
@@ -1,15 +1,64 @@
+import contextlib
+import functools
 import io
 import json
 import os
+import queue
+import re
 import subprocess
 import tempfile
+import threading
 import time
+import traceback
+from concurrent.futures import ThreadPoolExecutor
 
 from minio import Minio
 import pika
 
+from batcher import Batcher
+from grayscale_common.grayscale_lib import AUTO, GrayscaleLib
+from grayscale_common.metrics import MPX_BUCKETS, Counter, Gauge, Histogram, serve as serve_metrics
+from grayscale_common.result_cache import MinioStore, ResultCache, cache_key
+from scheduler import CoreBudget, cpu_budget
+from tiler import Tiler
+
 BUCKET = 'images'
 BINARY_PATH = os.path.join(os.path.dirname(__file__), 'bin', 'grayscale')
+LIBRARY_PATH = os.path.join(os.path.dirname(__file__), 'bin', 'libgrayscale.so')
+# 'lib' (default when the .so is present) or 'worker'
+BACKEND = os.environ.get('GRAYSCALE_BACKEND',
+                         'lib' if os.path.exists(LIBRARY_PATH) else 'worker')
+# per-stage timings reported by both backends
+STAGE_KEYS = ('decode_s', 'kernel_s', 'encode_s', 'total_s', 'kernel_gbps')
+
+
+# cores this container may use (affinity and cgroup quota)
+CORES = cpu_budget()
+budget = CoreBudget(CORES)
+# messages in flight: while some compute, the others download and upload
+WORKERS = int(os.environ.get('GRAYSCALE_WORKERS', CORES + 2))
+# 'exclusive' default for jobs that do not say (1: every run alone)
+EXCLUSIVE = os.environ.get('GRAYSCALE_EXCLUSIVE', '0') == '1'
+# jobs whose body is the image itself (see process())
+INLINE_CONTENT_TYPE = 'application/octet-stream'
+# unacked deliveries RabbitMQ hands to this consumer
+PREFETCH = int(os.environ.get('GRAYSCALE_PREFETCH', WORKERS))
+# inputs up to this size wait GRAYSCALE_BATCH_MS for others to share one
+# kernel launch, at most GRAYSCALE_BATCH_MAX per batch (0 bytes = never)
+BATCH_BYTES = int(os.environ.get('GRAYSCALE_BATCH_BYTES', 256 * 1024))
+BATCH_WINDOW = float(os.environ.get('GRAYSCALE_BATCH_MS', 5)) / 1000
+BATCH_MAX = int(os.environ.get('GRAYSCALE_BATCH_MAX', 32))
+# pipelines GrayscaleLib.process_batch runs: one gray or sobel stage, or both
+BATCH_PIPELINE = re.compile(r'(gray|(gray,)?sobel(:[a-z0-9]+)*)')
+# objects from this size on are split into tiles of about GRAYSCALE_TILE_MPIX
+# megapixels for all the replicas (see tiler.py; 0 bytes = never)
+TILE_BYTES = int(os.environ.get('GRAYSCALE_TILE_BYTES', 64 * 1024 * 1024))
+TILE_PIXELS = float(os.environ.get('GRAYSCALE_TILE_MPIX', 64)) * 1e6
+# Prometheus /metrics on this port (0 = off); queue depths read every
+# GRAYSCALE_METRICS_POLL_S seconds
+METRICS_PORT = int(os.environ.get('GRAYSCALE_METRICS_PORT', 9100))
+METRICS_POLL = float(os.environ.get('GRAYSCALE_METRICS_POLL_S', 5))
+QUEUES = ('grayscale', 'grayscale_processed')
 
 minio_client = Minio(
     os.environ.get('MINIO_ENDPOINT', 'minio:9000'),
@@ -21,6 +70,218 @@ minio_client = Minio(
 if not minio_client.bucket_exists(BUCKET):
     minio_client.make_bucket(BUCKET)
 
+# results by content: memory first, then processed/<key>.png shared by all
+# the workers on the bucket (GRAYSCALE_CACHE_STORE=0 keeps only memory)
+cache = ResultCache(store=MinioStore(minio_client, BUCKET)
+                    if os.environ.get('GRAYSCALE_CACHE_STORE', '1') != '0' else None)
+
+stage_seconds = Histogram('grayscale_stage_seconds',
+                          'Seconds of a run per stage: decode, kernel and encode in C, '
+                          'transfer to and from MinIO', ['stage'])
+pixels_total = Counter('grayscale_pixels_total', 'Input pixels run through the kernel')
+megapixels = Histogram('grayscale_megapixels_per_second',
+                       'Megapixels per second of a run, decode to encode', buckets=MPX_BUCKETS)
+busy_seconds = Counter('grayscale_busy_seconds_total',
+                       'Seconds spent in the C core, summed over concurrent runs')
+job_seconds = Histogram('grayscale_job_seconds',
+                        'Wall time of a message from delivery to ack, by kind', ['kind'])
+jobs_total = Counter('grayscale_jobs_total', 'Messages handled, by kind and result',
+                     ['kind', 'result'])
+workers_busy = Gauge('grayscale_workers_busy', 'Pool threads running a message')
+Gauge('grayscale_workers', 'Pool threads (GRAYSCALE_WORKERS)', function=lambda: WORKERS)
+Gauge('grayscale_cores', 'Core budget of this worker', function=lambda: CORES)
+Gauge('grayscale_cores_reserved', 'Cores held by running kernels', function=lambda: budget.used)
+Gauge('grayscale_cores_waiting', 'Runs waiting for cores',
+      function=lambda: len(budget.waiting))
+queue_messages = Gauge('grayscale_queue_messages', 'Messages ready in the queue', ['queue'])
+queue_consumers = Gauge('grayscale_queue_consumers', 'Consumers of the queue', ['queue'])
+queue_lag = Histogram('grayscale_queue_lag_seconds',
+                      'Seconds from publish to delivery (consumer lag)', ['queue'])
+cache_requests = Counter('grayscale_cache_requests_total', 'Result cache lookups by result',
+                         ['result'])
+Gauge('grayscale_cache_bytes', 'Bytes in the memory tier of the result cache',
+      function=lambda: cache.memory.size if cache.memory is not None else 0)
+
+
+def observe_run(run):
+    """Stage times and throughput of one run of the C core."""
+    for stage in ('decode', 'kernel', 'encode'):
+        stage_seconds.observe(run[f'{stage}_s'], stage=stage)
+    busy_seconds.inc(run['total_s'])
+    px = run.get('pixels')
+    if px:
+        pixels_total.inc(px)
+        if run['total_s'] > 0:
+            megapixels.observe(px / run['total_s'] / 1e6)
+
+
+class GrayscaleWorker:
+    """Resident ``bin/grayscale --serve`` process fed one job per line.
+
+    The OpenMP team stays warm between jobs, so the thread sweep in
+    ``process()`` no longer pays fork/exec and thread start-up per run.
+    """
+
+    def __init__(self, binary):
+        self.binary = binary
+        self.proc = None
+        self.lock = threading.Lock()
+
+    def _ensure_running(self):
+        if self.proc is None or self.proc.poll() is not None:
+            self.proc = subprocess.Popen(
+                [self.binary, '--serve'],
+                stdin=subprocess.PIPE,
+                stdout=subprocess.PIPE,
+                text=True,
+                bufsize=1,
+            )
+
+    def run(self, in_path, out_path, passes=None, threads=None, level=None,
+            histogram=False, pipeline=None):
+        fields = [f'in={in_path}', f'out={out_path}', 'stats=1']
+        if histogram:
+            fields.append('histogram=1')
+        if pipeline:
+            fields.append(f'pipeline={pipeline}')
+        if passes:
+            fields.append(f'passes={passes}')
+        if threads:
+            fields.append(f'threads={threads}')
+        if level not in (None, ''):
+            fields.append(f'level={level}')
+        with self.lock:
+            self._ensure_running()
+            try:
+                self.proc.stdin.write('\t'.join(fields) + '\n')
+                self.proc.stdin.flush()
+                reply = self.proc.stdout.readline()
+            except BrokenPipeError:
+                reply = ''
+        if not reply:
+            raise RuntimeError('grayscale worker exited')
+        status, _, detail = reply.strip().partition(' ')
+        if status != 'ok':
+            raise RuntimeError(detail)
+        # ok <secs> <json>: the per-stage report of --stats=json
+        _, _, report = detail.partition(' ')
+        stats = json.loads(report)
+        stages = {k: stats[k] for k in STAGE_KEYS}
+        stages['pixels'] = stats['width'] * stats['height']
+        if threads == AUTO:
+            stages['threads'] = stats['threads']
+        if 'image' in stats:
+            stages['image'] = stats['image']
+        return stages
+
+
+class WorkerPool:
+    """Resident workers, started as needed; each job borrows an idle one.
+
+    The core budget bounds how many run at once, hence how many exist.
+    """
+
+    def __init__(self, binary):
+        self.binary = binary
+        self.idle = queue.SimpleQueue()
+
+    def run(self, *args, **kwargs):
+        try:
+            w = self.idle.get_nowait()
+        except queue.Empty:
+            w = GrayscaleWorker(self.binary)
+        try:
+            return w.run(*args, **kwargs)
+        finally:
+            self.idle.put(w)
+
+
+def process_bytes(data, passes=None, threads=None, level=None, histogram=False,
+                  pipeline=None):
+    """Grayscale the encoded image ``data``.
+
+    Return ``(png_bytes, stages)`` where ``stages`` maps ``STAGE_KEYS`` to
+    the seconds (and GB/s) measured inside the C code. With ``histogram``
+    it also holds ``'image'``: per-channel histograms and mean/min/max of
+    the input, computed on the same decode. ``pipeline`` (e.g.
+    ``'gray,blur5,sobel:l1,hist'``) replaces the grayscale kernel.
+    """
+    if library is not None:
+        return library.process(data, passes=passes, threads=threads, level=level,
+                               histogram=histogram, pipeline=pipeline)
+    with tempfile.TemporaryDirectory() as tmpdir:
+        # fixed name: the job line is TAB separated and stb sniffs the format
+        in_path = os.path.join(tmpdir, 'input')
+        out_path = os.path.join(tmpdir, 'out.png')
+        with open(in_path, 'wb') as f:
+            f.write(data)
+        stages = worker.run(in_path, out_path, passes=passes, threads=threads, level=level,
+                            histogram=histogram, pipeline=pipeline)
+        with open(out_path, 'rb') as f:
+            return f.read(), stages
+
+
+# concurrency is up to the core budget, not to the library
+library = GrayscaleLib(LIBRARY_PATH, slots=CORES) if BACKEND == 'lib' else None
+worker = WorkerPool(BINARY_PATH) if library is None else None
+# core/VERSION of the C build in use, from either backend
+CORE_VERSION = (library.version if library is not None else
+                subprocess.run([BINARY_PATH, '--version'], capture_output=True,
+                               text=True).stdout.split()[-1])
+Gauge('grayscale_build_info', 'Always 1, labelled with the version of the C core',
+      ['version']).set(1, version=CORE_VERSION)
+
+
+def resolve_threads(t, source, pipeline):
+    """``(cores, threads)`` of a run asked for ``t`` threads: what it takes
+    from the budget and what the backend gets. ``'auto'`` is sized to the
+    image within the budget; the worker backend sizes it itself, after the
+    decode, so it reserves the whole budget."""
+    if t != AUTO:
+        return int(t), int(t)
+    if library is None:
+        return None, AUTO
+    n = library.auto_threads(source, pipeline, CORES) or CORES
+    return n, n
+
+
+def run_batch(key, jobs):
+    """One ``process_batch`` call for the ``(data, threads)`` of ``jobs``.
+
+    The batch gets the threads its jobs asked for together, within the
+    budget: four single-threaded thumbnails become one 4-thread pass.
+    """
+    passes, level, pipeline = key
+    threads = min(CORES, sum(t for _, t in jobs))
+    with budget.reserve(threads):
+        results = library.process_batch([data for data, _ in jobs], passes=passes,
+                                        threads=threads, level=level, pipeline=pipeline)
+    # every job gets the stages of the whole batch: one run to count
+    for r in results:
+        if not isinstance(r, Exception):
+            observe_run(r[1])
+            break
+    return results
+
+
+batcher = Batcher(run_batch, window=BATCH_WINDOW, max_jobs=BATCH_MAX)
+
+
+def batchable(source, threads, repeats, histogram, pipeline, exclusive):
+    """Whether a job may share a kernel launch with others: a small input,
+    a single run, nothing per image (statistics) or alone (exclusive)."""
+    return (library is not None and len(source) <= BATCH_BYTES and len(threads) == 1
+            and repeats == 1 and not histogram and not exclusive
+            and (pipeline is None or BATCH_PIPELINE.fullmatch(pipeline) is not None))
+
+
+def tileable(threads, repeats, histogram, pipeline, exclusive):
+    """Whether a job may be split into tiles: a single run of a kernel
+    ``GrayscaleLib.tile`` runs, nothing that needs the whole image."""
+    return (library is not None and TILE_BYTES > 0 and len(threads) == 1 and repeats == 1
+            and not histogram and not exclusive
+            and (pipeline is None or BATCH_PIPELINE.fullmatch(pipeline) is not None))
+
 def connect_rabbitmq(url: str, retries: int = 10, delay: int = 5):
     for i in range(retries):
         try:
@@ -34,61 +295,267 @@ connection = connect_rabbitmq(os.environ.get('RABBITMQ_URL', 'amqp://guest:guest
 channel = connection.channel()
 channel.queue_declare(queue='grayscale')
 channel.queue_declare(queue='grayscale_processed')
+channel.basic_qos(prefetch_count=PREFETCH)
+# replies of the tiles of the jobs this worker coordinates
+reply_queue = channel.queue_declare(queue='', exclusive=True).method.queue
+executor = ThreadPoolExecutor(max_workers=WORKERS, thread_name_prefix='grayscale')
+
+
+def publish_json(route, body, reply_to=None, correlation_id=None):
+    """Publish from any thread: the message leaves on the connection thread."""
+    properties = pika.BasicProperties(reply_to=reply_to, correlation_id=correlation_id,
+                                      headers={'sent_at': time.time()})
+    connection.add_callback_threadsafe(functools.partial(
+        channel.basic_publish, exchange='', routing_key=route,
+        body=json.dumps(body).encode(), properties=properties))
+
+
+tiler = Tiler(library, minio_client, BUCKET, publish_json, reply_queue, budget.reserve,
+              CORES, TILE_BYTES, TILE_PIXELS)
 
-def process(ch, method, properties, body):
-    msg = json.loads(body)
+
+def process(msg, inline=None, properties=None):
+    """Run the job ``msg`` and return ``(payload, png)``.
+
+    Called on a pool thread: the download, the sweep and the upload of one
+    message overlap with those of the others in flight. ``inline`` is the
+    image carried by the message itself: MinIO is not touched (not even the
+    shared cache tier) and the PNG is returned for the reply instead of
+    being uploaded; otherwise ``png`` is None.
+
+    A tile of a split job (see tiler.py) returns its reply for the
+    coordinator. A job large enough to be split returns None: its tiles are
+    out and ``stitch`` sends the completion to the sender of
+    ``properties``.
+    """
+    if 'tile' in msg:
+        reply = tiler.run_tile(msg)
+        if 'stages' in reply:
+            observe_run(reply['stages'])
+        return reply, None
     image_key = msg['image_key']
-    threads = msg.get('threads') or [1]
-    if isinstance(threads, int):
+    # 'auto' entries are sized to the image (see resolve_threads)
+    threads = msg.get('threads') or [AUTO]
+    if isinstance(threads, (int, str)):
         threads = [threads]
     passes = msg.get('passes')
+    level = msg.get('level')
     repeats = int(msg.get('repeat', 1))
-    resp = minio_client.get_object(BUCKET, image_key)
-    with tempfile.TemporaryDirectory() as tmpdir:
-        in_path = os.path.join(tmpdir, os.path.basename(image_key))
-        with open(in_path, 'wb') as f:
-            for d in resp.stream(32 * 1024):
-                f.write(d)
-        out_path = os.path.join(tmpdir, 'out.png')
+    histogram = bool(msg.get('histogram'))
+    pipeline = msg.get('pipeline') or None
+    exclusive = bool(msg.get('exclusive', EXCLUSIVE))
+    if inline is not None:
+        source = inline
+    else:
+        # too large for one worker: split across the replicas, no cache
+        if (tileable(threads, repeats, histogram, pipeline, exclusive)
+                and tiler.split(msg, image_key, properties.reply_to,
+                                properties.correlation_id)):
+            return None
+        start = time.time()
+        resp = minio_client.get_object(BUCKET, image_key)
+        try:
+            source = resp.read()
+        finally:
+            resp.close()
+            resp.release_conn()
+        stage_seconds.observe(time.time() - start, stage='transfer')
+
+    key = cache_key(source, pipeline=pipeline, level=level)
+    shared = inline is None
+    # 'cache': false asks for a fresh sweep, e.g. to benchmark the same image again
+    hit = None
+    if msg.get('cache', True):
+        hit = cache.get(key, histogram=histogram, shared=shared)
+        cache_requests.inc(result='miss' if hit is None else 'hit')
+    batch = None
+    if hit is not None:
+        # nothing was run, so there are no times to report
+        data, image = hit
+        times, stages = {}, {}
+    elif batchable(source, threads, repeats, histogram, pipeline, exclusive):
+        # times are those of the whole batch, the wait for it included
+        t = threads[0]
+        n, _ = resolve_threads(t, source, pipeline)
+        start = time.time()
+        data, run = batcher.submit((passes, level, pipeline), (source, n))
+        batch = run.pop('batch')
+        if t == AUTO:
+            run['threads'] = n
+        image = None
+        times = {str(t): time.time() - start}
+        stages = {str(t): run}
+        cache.put(key, data, image, shared=shared)
+    else:
         times = {}
-        for t in threads:
-            env = os.environ.copy()
-            env['OMP_NUM_THREADS'] = str(t)
-            single = []
-            for _ in range(repeats):
-                cmd = [BINARY_PATH, in_path, out_path]
-                if passes:
-                    cmd.append(str(passes))
-                start = time.time()
-                subprocess.run(cmd, check=True, env=env)
-                single.append(time.time() - start)
-            times[str(t)] = sum(single) / len(single)
-
-        with open(out_path, 'rb') as outf:
-            data = outf.read()
-
-    processed_key = f"processed/{os.path.basename(image_key)}"
-    minio_client.put_object(
-        BUCKET,
-        processed_key,
-        io.BytesIO(data),
-        length=len(data),
-        content_type='image/png',
-    )
+        stages = {}
+        image = None
+        # exclusive: the whole sweep alone on the budget; otherwise each run
+        # takes its t cores and other jobs fill the rest in between
+        with budget.reserve(exclusive=True) if exclusive else contextlib.nullcontext():
+            for t in threads:
+                # 'auto' resolved once: every repeat runs the same count
+                cores, n = resolve_threads(t, source, pipeline)
+                single = []
+                runs = []
+                for _ in range(repeats):
+                    with contextlib.nullcontext() if exclusive else budget.reserve(cores):
+                        start = time.time()
+                        data, run = process_bytes(source, passes=passes, threads=n,
+                                                  level=level,
+                                                  histogram=histogram and image is None,
+                                                  pipeline=pipeline)
+                        single.append(time.time() - start)
+                    observe_run(run)
+                    # same input every run: the statistics are computed once
+                    image = run.pop('image', image)
+                    runs.append(run)
+                times[str(t)] = sum(single) / len(single)
+                stages[str(t)] = {k: sum(r[k] for r in runs) / len(runs) for k in STAGE_KEYS}
+                if t == AUTO:
+                    stages[t]['threads'] = runs[0].get('threads', n)
+        cache.put(key, data, image, shared=shared)
+
+    if inline is not None:
+        # only a name for the frontend: the PNG travels in the reply
+        processed_key = f"inline/{key}.png"
+    elif cache.store is not None:
+        processed_key = cache.store.object_name(key)
+    else:
+        processed_key = f"processed/{os.path.basename(image_key)}"
+        start = time.time()
+        minio_client.put_object(
+            BUCKET,
+            processed_key,
+            io.BytesIO(data),
+            length=len(data),
+            content_type='image/png',
+        )
+        stage_seconds.observe(time.time() - start, stage='transfer')
 
     payload = {
         'image_key': image_key,
         'processed_key': processed_key,
         'times': times,
+        'stages': stages,
         'passes': passes,
+        'pipeline': pipeline,
+        'cached': hit is not None,
+        'cores': CORES,
+        'exclusive': exclusive,
+        'inline': inline is not None,
+        'batch': batch,
     }
-    channel.basic_publish(
-        exchange='',
-        routing_key='grayscale_processed',
-        body=json.dumps(payload).encode(),
-    )
-    ch.basic_ack(delivery_tag=method.delivery_tag)
-
-channel.basic_consume(queue='grayscale', on_message_callback=process)
-print(' [*] Waiting for messages. To exit press CTRL+C')
+    if image is not None:
+        payload['image_stats'] = image
+    return payload, data if inline is not None else None
+
+
+# pika channels are not thread-safe: publish and ack go back to the
+# connection thread
+def finish(tag, properties, payload, png):
+    # reply_to (RPC style) if the sender asked for it
+    route = properties.reply_to or 'grayscale_processed'
+    # sent_at: the consumer measures its lag from it
+    if png is None:
+        channel.basic_publish(exchange='', routing_key=route,
+                              body=json.dumps(payload).encode(),
+                              properties=pika.BasicProperties(
+                                  correlation_id=properties.correlation_id,
+                                  headers={'sent_at': time.time()}))
+    else:
+        # the PNG is the body, the usual JSON rides in a header
+        channel.basic_publish(exchange='', routing_key=route, body=png,
+                              properties=pika.BasicProperties(
+                                  content_type='image/png',
+                                  correlation_id=properties.correlation_id,
+                                  headers={'result': json.dumps(payload),
+                                           'sent_at': time.time()}))
+    channel.basic_ack(delivery_tag=tag)
+
+
+def run_job(tag, properties, body):
+    start = time.time()
+    kind = 'inline' if properties.content_type == INLINE_CONTENT_TYPE else 'job'
+    with workers_busy.track():
+        try:
+            if kind == 'inline':
+                # image bytes as the body, the job as a header
+                result = process(json.loads(properties.headers['job']), inline=body)
+            else:
+                msg = json.loads(body)
+                kind = 'tile' if 'tile' in msg else 'job'
+                result = process(msg, properties=properties)
+        except Exception:
+            traceback.print_exc()
+            jobs_total.inc(kind=kind, result='error')
+            # dropped rather than requeued: the same message would fail again
+            connection.add_callback_threadsafe(
+                functools.partial(channel.basic_nack, delivery_tag=tag, requeue=False))
+            return
+    if result is None:
+        kind = 'split'
+    job_seconds.observe(time.time() - start, kind=kind)
+    # a tile that fails still replies, with the error
+    jobs_total.inc(kind=kind, result='error' if result and 'error' in result[0] else 'ok')
+    if result is None:
+        # split into tiles: they carry the job from here on
+        connection.add_callback_threadsafe(
+            functools.partial(channel.basic_ack, delivery_tag=tag))
+        return
+    payload, png = result
+    connection.add_callback_threadsafe(
+        functools.partial(finish, tag, properties, payload, png))
+
+
+def on_message(ch, method, properties, body):
+    sent_at = (properties.headers or {}).get('sent_at')
+    if sent_at is not None:
+        queue_lag.observe(max(0.0, time.time() - sent_at), queue=method.routing_key)
+    executor.submit(run_job, method.delivery_tag, properties, body)
+
+
+def poll_queues():
+    """Depth and consumers of QUEUES, on the connection thread."""
+    for name in QUEUES:
+        ok = channel.queue_declare(queue=name, passive=True)
+        queue_messages.set(ok.method.message_count, queue=name)
+        queue_consumers.set(ok.method.consumer_count, queue=name)
+    connection.call_later(METRICS_POLL, poll_queues)
+
+
+def run_stitch(job):
+    # the job was acked when its tiles went out: a failed tile or stitch
+    # still has to reach the sender, or it waits forever
+    try:
+        payload = tiler.stitch(job)
+    except Exception as exc:
+        traceback.print_exc()
+        jobs_total.inc(kind='tiled', result='error')
+        tiler.drop(job)
+        payload = tiler.failure(job, exc)
+    else:
+        job_seconds.observe(next(iter(payload['times'].values())), kind='tiled')
+        jobs_total.inc(kind='tiled', result='ok')
+    publish_json(job['reply_to'] or 'grayscale_processed', payload,
+                 correlation_id=job['correlation_id'])
+
+
+def on_tile_done(ch, method, properties, body):
+    sent_at = (properties.headers or {}).get('sent_at')
+    if sent_at is not None:
+        # the reply queue's name changes with every start: one label for all
+        queue_lag.observe(max(0.0, time.time() - sent_at), queue='tile_replies')
+    job = tiler.collect(json.loads(body))
+    if job is not None:
+        executor.submit(run_stitch, job)
+
+
+channel.basic_consume(queue='grayscale', on_message_callback=on_message)
+channel.basic_consume(queue=reply_queue, on_message_callback=on_tile_done, auto_ack=True)
+if METRICS_PORT > 0:
+    serve_metrics(METRICS_PORT)
+    poll_queues()
+print(f' [*] Waiting for messages (core {CORE_VERSION}, {WORKERS} workers, {CORES} cores, '
+      f'prefetch {PREFETCH}). To exit press CTRL+C')
 channel.start_consuming()
@@ -0,0 +1,64 @@
+"""Coalesce small jobs that arrive together into one library call.
+
+A thumbnail alone cannot keep a team of threads busy: starting the team
+costs about as much as the kernel. ``Batcher.submit`` parks a job for at
+most ``window`` seconds so that others with the same key can join it. The
+first job of a batch (its leader) then runs all of them with a single
+``run(key, items)`` call on its own thread, and every caller gets back its
+own result. There is no background thread: a batch lives as long as its
+leader waits.
+
+A batch closes when the window expires or when it holds ``max_jobs``
+items, whichever comes first. Jobs with different keys never share a
+batch.
+"""
+import threading
+
+
+class _Batch:
+    def __init__(self):
+        self.items = []
+        self.results = None
+        self.full = threading.Event()
+        self.done = threading.Event()
+
+
+class Batcher:
+    """Batches of up to ``max_jobs`` items, ``window`` seconds at most."""
+
+    def __init__(self, run, window=0.005, max_jobs=32):
+        self.run = run
+        self.window = window
+        self.max_jobs = max_jobs
+        self.open = {}              # key -> batch still taking items
+        self.lock = threading.Lock()
+
+    def submit(self, key, item):
+        """Result of ``item`` as returned by ``run``; an exception in that
+        list, or one raised by ``run`` itself, is raised here."""
+        with self.lock:
+            batch = self.open.get(key)
+            leader = batch is None
+            if leader:
+                batch = self.open[key] = _Batch()
+            index = len(batch.items)
+            batch.items.append(item)
+            if len(batch.items) >= self.max_jobs:
+                del self.open[key]
+                batch.full.set()
+        if leader:
+            batch.full.wait(self.window)
+            with self.lock:
+                if self.open.get(key) is batch:
+                    del self.open[key]
+            try:
+                batch.results = self.run(key, batch.items)
+            except Exception as exc:
+                batch.results = [exc] * len(batch.items)
+            batch.done.set()
+        else:
+            batch.done.wait()
+        result = batch.results[index]
+        if isinstance(result, Exception):
+            raise result
+        return result
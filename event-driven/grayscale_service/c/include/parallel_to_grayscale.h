@@ -1,5 +0,0 @@
-// parallel_to_grayscale.h
-#ifndef PARALLEL_TO_GRAYSCALE_H
-#define PARALLEL_TO_GRAYSCALE_H
-void convert_to_grayscale(unsigned char *data, int width, int height, int channels);
-#endif
@@ -0,0 +1,99 @@
+"""CPU budget of the container and a scheduler that keeps kernels within it.
+
+``cpu_budget()`` is the number of cores the worker may really use: the
+affinity mask, capped by the cgroup CPU quota (v2 ``cpu.max`` or v1
+``cpu.cfs_quota_us`` / ``cpu.cfs_period_us``), since a container limited to
+2 CPUs still sees every core of the node.
+
+``CoreBudget`` hands out cores to kernels. A run with ``threads=t`` reserves
+``t`` cores (at most the whole budget) and waits until they are free, so the
+thread counts of concurrent runs never add up to more than the budget.
+Requests are served in arrival order: a large or exclusive reservation is
+not overtaken forever by small ones. An exclusive reservation waits for all
+the others to finish and keeps the whole budget, so nothing else runs beside
+a benchmark.
+"""
+import math
+import os
+import threading
+from collections import deque
+from contextlib import contextmanager
+
+CGROUP_ROOT = '/sys/fs/cgroup'
+
+
+def _read(path):
+    try:
+        with open(path) as f:
+            return f.read().strip()
+    except OSError:
+        return None
+
+
+def cgroup_quota(root=CGROUP_ROOT):
+    """CPUs allowed by the cgroup quota (may be fractional), None if unlimited."""
+    v2 = _read(os.path.join(root, 'cpu.max'))
+    if v2 is not None:
+        quota, _, period = v2.partition(' ')
+        if quota != 'max' and period:
+            return int(quota) / int(period)
+        return None
+    quota = _read(os.path.join(root, 'cpu', 'cpu.cfs_quota_us')) or \
+        _read(os.path.join(root, 'cpu.cfs_quota_us'))
+    period = _read(os.path.join(root, 'cpu', 'cpu.cfs_period_us')) or \
+        _read(os.path.join(root, 'cpu.cfs_period_us'))
+    if quota and period and int(quota) > 0:
+        return int(quota) / int(period)
+    return None
+
+
+def cpu_budget(root=CGROUP_ROOT):
+    """Cores available to this process; ``GRAYSCALE_CORES`` overrides."""
+    forced = os.environ.get('GRAYSCALE_CORES')
+    if forced:
+        return max(1, int(forced))
+    try:
+        cores = len(os.sched_getaffinity(0))
+    except AttributeError:
+        cores = os.cpu_count() or 1
+    quota = cgroup_quota(root)
+    if quota is not None:
+        # 1.5 CPUs of quota: one thread more would only be throttled
+        cores = min(cores, max(1, math.floor(quota)))
+    return cores
+
+
+class CoreBudget:
+    """FIFO reservations of cores out of ``total``."""
+
+    def __init__(self, total):
+        self.total = total
+        self.used = 0
+        self.exclusive = False
+        self.waiting = deque()
+        self.cond = threading.Condition()
+
+    @contextmanager
+    def reserve(self, threads=None, exclusive=False):
+        """Hold ``threads`` cores (the whole budget if None, exclusive or
+        more than the budget) for the duration of the ``with`` block."""
+        n = self.total if exclusive or not threads else min(int(threads), self.total)
+        ticket = object()
+        with self.cond:
+            self.waiting.append(ticket)
+            while (self.waiting[0] is not ticket or self.exclusive or
+                   self.used + n > self.total):
+                self.cond.wait()
+            self.waiting.popleft()
+            self.used += n
+            self.exclusive = exclusive
+            # the next in line may fit in what is left
+            self.cond.notify_all()
+        try:
+            yield n
+        finally:
+            with self.cond:
+                self.used -= n
+                if exclusive:
+                    self.exclusive = False
+                self.cond.notify_all()
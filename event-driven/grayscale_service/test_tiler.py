@@ -0,0 +1,123 @@
+"""Tests of the tile worker that need neither RabbitMQ nor MinIO.
+
+Run from this directory with the repo root on the path:
+``PYTHONPATH=../.. python -m unittest test_tiler``.
+"""
+
+import contextlib
+import threading
+import unittest
+
+from tiler import Tiler, _Concat, _Upload
+
+TIMEOUT = 5
+
+
+class _Response:
+    """Stand-in for a MinIO ``get_object`` response."""
+
+    def __init__(self, data):
+        self.data = data
+        self.closed = False
+
+    def read(self, size=-1):
+        size = len(self.data) if size is None or size < 0 else size
+        data, self.data = self.data[:size], self.data[size:]
+        return data
+
+    def close(self):
+        self.closed = True
+
+    def release_conn(self):
+        pass
+
+
+class _FailingMinio:
+    """``put_object`` reads the whole stream, then fails."""
+
+    def __init__(self):
+        self.uploaded = b''
+
+    def get_object(self, bucket, name, offset=0, length=0):
+        return _Response(b'\0' * length)
+
+    def put_object(self, bucket, name, data, length=-1, **kwargs):
+        while True:
+            chunk = data.read(4096)
+            if not chunk:
+                break
+            self.uploaded += chunk
+        raise OSError('upload refused')
+
+
+class _Library:
+    """``tile`` writes a few chunks and reports success."""
+
+    def tile(self, read, write, width, height, channels, y0, rows, **kwargs):
+        read(width * rows * channels)
+        for _ in range(3):
+            write(b'x' * 1000)
+        return 1, 0, []
+
+
+def _within(test, fn):
+    """``fn()`` in a thread; fails ``test`` if it does not return in time."""
+    out = {}
+
+    def run():
+        try:
+            out['value'] = fn()
+        except Exception as exc:
+            out['error'] = exc
+
+    thread = threading.Thread(target=run, daemon=True)
+    thread.start()
+    thread.join(TIMEOUT)
+    test.assertFalse(thread.is_alive(), 'blocked')
+    return out
+
+
+class UploadTest(unittest.TestCase):
+
+    def test_failure_after_eof(self):
+        minio = _FailingMinio()
+        upload = _Upload(minio, 'bucket', 'name')
+        upload.write(b'abc')
+        out = _within(self, upload.close)
+        self.assertIsInstance(out.get('error'), OSError)
+        self.assertEqual(minio.uploaded, b'abc')
+
+
+class ConcatTest(unittest.TestCase):
+
+    def test_read_all(self):
+        resp = _Response(b'def')
+        concat = _Concat([b'abc', resp, b'gh'])
+        self.assertEqual(b''.join(iter(lambda: concat.read(), b'')), b'abcdefgh')
+        self.assertTrue(resp.closed)
+
+    def test_read_sized(self):
+        concat = _Concat([b'abc', _Response(b'def')])
+        self.assertEqual(concat.read(2), b'ab')
+        self.assertEqual(concat.read(None), b'c')
+        self.assertEqual(concat.read(5), b'def')
+        self.assertEqual(concat.read(), b'')
+
+
+class RunTileTest(unittest.TestCase):
+
+    def test_upload_failure_replies(self):
+        tiler = Tiler(_Library(), _FailingMinio(), 'bucket', publish=None,
+                      reply_queue=None, reserve=lambda cores: contextlib.nullcontext(),
+                      cores=2, tile_bytes=0, tile_pixels=0)
+        msg = {'tile': {'job': 'j', 'index': 0, 'source': 'src', 'offset': 0,
+                        'length': 48, 'width': 4, 'height': 4, 'channels': 3,
+                        'y0': 0, 'rows': 4}}
+        out = _within(self, lambda: tiler.run_tile(msg))
+        reply = out['value']
+        self.assertEqual(reply['error'], 'upload refused')
+        self.assertEqual(reply['tile'], {'job': 'j', 'index': 0})
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,397 @@
+"""Split one very large image across the grayscale_service replicas.
+
+A single worker streams a gigapixel scan a band at a time, but still on
+the cores of one box. ``Tiler`` cuts the output into row bands (tiles) and
+publishes each one as its own message on the ``grayscale`` queue, so every
+replica picks some up:
+
+- the coordinator, the worker that got the job, works out each tile's
+  input window: its rows plus the halo the kernel reads around them
+  (``GrayscaleLib.tile_window``). An 8-bit PGM/PPM window is a byte range
+  of the source object, read by the tile itself. Other formats are decoded
+  once by the coordinator, which uploads the raw rows of every window to
+  ``tiles/<job>/<i>.raw`` as the bands come out;
+- a tile worker streams its window through ``GrayscaleLib.tile`` into a
+  PNG fragment at ``tiles/<job>/<i>.png`` and replies to the
+  coordinator's reply queue;
+- when every fragment is in, the coordinator stitches them into
+  ``processed/<basename>`` (PNG head, fragments in order, tail: nothing is
+  recompressed), removes the tile objects and sends the completion
+  message.
+
+Nothing here touches pika: messages go out through the ``publish``
+callable, which must hand them to the connection thread.
+"""
+import io
+import math
+import queue
+import threading
+import time
+import uuid
+
+from grayscale_common.grayscale_lib import AUTO
+
+# header bytes read to size the image (gs_image_info)
+HEAD_BYTES = 256 * 1024
+# fragments have no known length: multipart upload by parts of this size
+PART_SIZE = 16 * 1024 * 1024
+# stages of every tile, summed into those of the job
+TILE_STAGE_KEYS = ('decode_s', 'kernel_s', 'encode_s', 'total_s')
+
+
+class _Pipe(io.RawIOBase):
+    """Bytes written on one thread and read by ``put_object`` on another.
+
+    At most ``depth`` chunks wait, so a slow upload pauses the writer
+    instead of piling up the image in memory.
+    """
+
+    def __init__(self, depth=8):
+        super().__init__()
+        self.chunks = queue.Queue(depth)
+        self.buffer = b''
+        self.eof = False
+
+    def readable(self):
+        return True
+
+    def write(self, data):
+        self.chunks.put(bytes(data))
+
+    def finish(self):
+        self.chunks.put(None)
+
+    def read(self, size=-1):
+        while not self.eof and (size < 0 or len(self.buffer) < size):
+            chunk = self.chunks.get()
+            if chunk is None:
+                self.eof = True
+            else:
+                self.buffer += chunk
+        if size < 0:
+            size = len(self.buffer)
+        data, self.buffer = self.buffer[:size], self.buffer[size:]
+        return data
+
+
+class _Upload:
+    """One object uploaded from a ``_Pipe`` by a thread of its own."""
+
+    def __init__(self, minio, bucket, name, length=-1, content_type=None):
+        self.pipe = _Pipe()
+        self.error = None
+        kwargs = {'part_size': PART_SIZE} if length < 0 else {}
+        if content_type:
+            kwargs['content_type'] = content_type
+
+        def run():
+            try:
+                minio.put_object(bucket, name, self.pipe, length=length, **kwargs)
+            except Exception as exc:
+                self.error = exc
+                # unblock the writer: the rest of the bytes go nowhere. If
+                # put_object already read the end, nothing else will come
+                while not self.pipe.eof and self.pipe.chunks.get() is not None:
+                    pass
+
+        self.thread = threading.Thread(target=run, daemon=True)
+        self.thread.start()
+
+    def write(self, data):
+        if self.error is None:
+            self.pipe.write(data)
+
+    def close(self):
+        self.pipe.finish()
+        self.thread.join()
+        if self.error is not None:
+            raise self.error
+
+
+class _Concat(io.RawIOBase):
+    """Reader over ``bytes`` and MinIO responses, one after the other."""
+
+    def __init__(self, parts):
+        super().__init__()
+        self.parts = list(parts)
+
+    def readable(self):
+        return True
+
+    def read(self, size=-1):
+        whole = size is None or size < 0
+        while self.parts:
+            part = self.parts[0]
+            if isinstance(part, bytes):
+                data = part if whole else part[:size]
+                self.parts[0] = part[len(data):]
+            else:
+                data = part.read() if whole else part.read(size)
+            if data:
+                return data
+            self.parts.pop(0)
+            if not isinstance(part, bytes):
+                part.close()
+                part.release_conn()
+        return b''
+
+
+class Tiler:
+    """Coordinator and tile worker of the jobs split into tiles.
+
+    ``publish(routing_key, body, reply_to, correlation_id)`` sends a JSON
+    message; ``reply_queue`` is this worker's exclusive queue for the tile
+    replies, fed to ``collect``. ``reserve(cores)`` is the core budget.
+    """
+
+    def __init__(self, library, minio, bucket, publish, reply_queue, reserve, cores,
+                 tile_bytes, tile_pixels):
+        self.library = library
+        self.minio = minio
+        self.bucket = bucket
+        self.publish = publish
+        self.reply_queue = reply_queue
+        self.reserve = reserve
+        self.cores = cores
+        self.tile_bytes = tile_bytes
+        self.tile_pixels = tile_pixels
+        self.jobs = {}              # job id -> state of a split job
+        self.lock = threading.Lock()
+
+    # ---- coordinator ----
+
+    def split(self, msg, image_key, reply_to=None, correlation_id=None):
+        """Split the job ``msg`` into tiles if its image is large enough.
+
+        Returns False when it is not (the caller runs it as usual). On True
+        the tile messages are out and the completion message will follow
+        from ``stitch``; the job itself can be acked.
+        """
+        if self.tile_bytes <= 0:
+            return False
+        if self.minio.stat_object(self.bucket, image_key).size < self.tile_bytes:
+            return False
+        resp = self.minio.get_object(self.bucket, image_key, offset=0, length=HEAD_BYTES)
+        try:
+            head = resp.read()
+        finally:
+            resp.close()
+            resp.release_conn()
+        width, height, channels, offset = self.library.info(head)
+        count = int(msg.get('tiles') or math.ceil(width * height / self.tile_pixels))
+        count = min(count, height)
+        if count <= 1:
+            return False
+
+        pipeline = msg.get('pipeline') or None
+        step = math.ceil(height / count)
+        tiles = []
+        for y0 in range(0, height, step):
+            rows = min(step, height - y0)
+            win_y0, win_rows, out_channels = self.library.tile_window(
+                height, channels, y0, rows, pipeline)
+            tiles.append((y0, rows, win_y0, win_rows))
+        job_id = uuid.uuid4().hex
+        threads = msg.get('threads') or [AUTO]
+        if isinstance(threads, list):
+            threads = threads[0]
+        with self.lock:
+            self.jobs[job_id] = {
+                'msg': msg, 'image_key': image_key, 'threads': threads,
+                'reply_to': reply_to, 'correlation_id': correlation_id,
+                'size': (width, height, out_channels), 'parts': {},
+                'count': len(tiles), 'start': time.time(), 'raw': offset < 0,
+            }
+        row = width * channels
+
+        def send(index, source, offset, length):
+            tile = {'job': job_id, 'index': index, 'count': len(tiles), 'source': source,
+                    'offset': offset, 'length': length, 'width': width, 'height': height,
+                    'channels': channels, 'y0': tiles[index][0], 'rows': tiles[index][1]}
+            body = {'tile': tile, 'passes': msg.get('passes'), 'level': msg.get('level'),
+                    'pipeline': pipeline, 'threads': threads}
+            self.publish('grayscale', body, self.reply_queue, job_id)
+
+        try:
+            if offset >= 0:
+                # PGM/PPM: each tile reads its own rows from the source
+                for i, (_, _, win_y0, win_rows) in enumerate(tiles):
+                    send(i, image_key, offset + win_y0 * row, win_rows * row)
+            else:
+                self._upload_windows(job_id, image_key, tiles, row, send)
+        except Exception:
+            with self.lock:
+                self.jobs.pop(job_id, None)
+            self._cleanup(job_id, len(tiles), offset < 0)
+            raise
+        return True
+
+    def _upload_windows(self, job_id, image_key, tiles, row, send):
+        """Decode the source once and upload the raw rows of each tile
+        window, sending the tile as soon as its window is stored. Windows
+        overlap by the halo, so two uploads at most are open at once."""
+        uploads = {}
+        nxt = [0]
+        resp = self.minio.get_object(self.bucket, image_key)
+
+        def on_rows(data, y0, n, width, height, channels):
+            while nxt[0] < len(tiles) and tiles[nxt[0]][2] < y0 + n:
+                i = nxt[0]
+                win_rows = tiles[i][3]
+                uploads[i] = _Upload(self.minio, self.bucket, f'tiles/{job_id}/{i}.raw',
+                                     length=win_rows * row)
+                nxt[0] += 1
+            for i in sorted(uploads):
+                _, _, win_y0, win_rows = tiles[i]
+                a = max(win_y0, y0)
+                b = min(win_y0 + win_rows, y0 + n)
+                if a < b:
+                    uploads[i].write(data[(a - y0) * row:(b - y0) * row])
+                if win_y0 + win_rows <= y0 + n:
+                    uploads.pop(i).close()
+                    send(i, f'tiles/{job_id}/{i}.raw', 0, win_rows * row)
+
+        try:
+            self.library.decode_rows(resp.read, on_rows)
+        finally:
+            resp.close()
+            resp.release_conn()
+            for u in uploads.values():
+                try:
+                    u.close()
+                except Exception:
+                    pass
+
+    def collect(self, reply):
+        """Record a tile reply; the job once every tile is in (or one has
+        failed), else None. Duplicate replies are ignored."""
+        tile = reply['tile']
+        with self.lock:
+            job = self.jobs.get(tile['job'])
+            if job is not None and tile['index'] not in job['parts']:
+                if 'error' in reply:
+                    job['error'] = f"tile {tile['index']}: {reply['error']}"
+                job['parts'][tile['index']] = reply
+                if 'error' not in job and len(job['parts']) < job['count']:
+                    return None
+                del self.jobs[tile['job']]
+                job['id'] = tile['job']
+                return job
+        if job is None and 'object' in reply:
+            # a late tile of a job already stitched or dropped: nobody will
+            # read its fragment
+            try:
+                self.minio.remove_object(self.bucket, reply['object'])
+            except Exception:
+                pass
+        return None
+
+    def stitch(self, job):
+        """Put the fragments of ``job`` together into ``processed/`` and
+        return the completion payload."""
+        msg = job['msg']
+        width, height, out_channels = job['size']
+        n = job['count']
+        processed_key = f"processed/{job['image_key'].rsplit('/', 1)[-1]}"
+        try:
+            if 'error' in job:
+                raise RuntimeError(job['error'])
+            parts = [job['parts'][i] for i in range(n)]
+            head = self.library.stitch_head(width, height, out_channels, msg.get('level'))
+            tail = self.library.stitch_tail([(p['adler32'], p['filtered']) for p in parts])
+            length = len(head) + sum(p['size'] for p in parts) + len(tail)
+            streams = [self.minio.get_object(self.bucket, p['object']) for p in parts]
+            self.minio.put_object(self.bucket, processed_key,
+                                  _Concat([head] + streams + [tail]), length=length,
+                                  content_type='image/png')
+        finally:
+            self._cleanup(job['id'], n, job['raw'])
+
+        t = str(job['threads'])
+        stages = {k: sum(p['stages'][k] for p in parts) for k in TILE_STAGE_KEYS}
+        # no single kernel to measure: the work is spread across replicas
+        stages['kernel_gbps'] = 0.0
+        return {
+            'image_key': job['image_key'],
+            'processed_key': processed_key,
+            'times': {t: time.time() - job['start']},
+            'stages': {t: stages},
+            'passes': msg.get('passes'),
+            'pipeline': msg.get('pipeline') or None,
+            'cached': False,
+            'cores': self.cores,
+            'exclusive': False,
+            'inline': False,
+            'batch': None,
+            'tiles': n,
+        }
+
+    def drop(self, job):
+        """Forget a job whose stitch failed and remove its ``tiles/``
+        objects; tiles still running are cleaned up as they reply."""
+        with self.lock:
+            self.jobs.pop(job['id'], None)
+        self._cleanup(job['id'], job['count'], job['raw'])
+
+    def failure(self, job, error):
+        """Completion message of a tiled job that failed: no
+        ``processed_key``, the reason in ``error``."""
+        return {
+            'image_key': job['image_key'],
+            'processed_key': None,
+            'error': str(error),
+            'times': {},
+            'stages': {},
+            'passes': job['msg'].get('passes'),
+            'pipeline': job['msg'].get('pipeline') or None,
+            'cached': False,
+            'tiles': job['count'],
+        }
+
+    def _cleanup(self, job_id, count, raw):
+        for i in range(count):
+            names = [f'tiles/{job_id}/{i}.png'] + ([f'tiles/{job_id}/{i}.raw'] if raw else [])
+            for name in names:
+                try:
+                    self.minio.remove_object(self.bucket, name)
+                except Exception:
+                    pass
+
+    # ---- tile worker ----
+
+    def run_tile(self, msg):
+        """Run the tile message ``msg``; the reply for the coordinator.
+
+        Failures are replied too, so the coordinator does not wait forever
+        for a fragment that will never come.
+        """
+        tile = msg['tile']
+        reply = {'tile': {'job': tile['job'], 'index': tile['index']}}
+        name = f"tiles/{tile['job']}/{tile['index']}.png"
+        try:
+            threads = msg.get('threads') or AUTO
+            cores = self.cores if threads == AUTO else min(int(threads), self.cores)
+            resp = self.minio.get_object(self.bucket, tile['source'], offset=tile['offset'],
+                                         length=tile['length'])
+            upload = _Upload(self.minio, self.bucket, name)
+            size = [0]
+
+            def write(chunk):
+                size[0] += len(chunk)
+                upload.write(chunk)
+
+            try:
+                with self.reserve(cores):
+                    adler, filtered, stages = self.library.tile(
+                        resp.read, write, tile['width'], tile['height'], tile['channels'],
+                        tile['y0'], tile['rows'], pipeline=msg.get('pipeline'),
+                        passes=msg.get('passes'), threads=cores, level=msg.get('level'))
+            finally:
+                resp.close()
+                resp.release_conn()
+                upload.close()
+            reply.update({'object': name, 'size': size[0], 'adler32': adler,
+                          'filtered': filtered, 'stages': stages})
+        except Exception as exc:
+            reply['error'] = str(exc)
+        return reply
@@ -0,0 +1,11 @@
+"""Python modules shared by the services, next to the C core in ``core/``.
+
+* ``grayscale_lib``: ctypes binding for ``libgrayscale.so``;
+* ``result_cache``: content-addressed cache of processed images;
+* ``metrics``: Prometheus metrics without a client library.
+
+The Flask service, the queue worker and the frontend import them from
+here. Their images copy this directory next to ``app.py`` (the build
+context is the repository root), and a local run needs the repository
+root on ``PYTHONPATH``.
+"""
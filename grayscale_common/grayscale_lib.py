@@ -0,0 +1,504 @@
+"""ctypes binding for ``bin/libgrayscale.so`` (see ``core/include/grayscale_api.h``).
+
+The image stays in memory end to end: the encoded bytes go in, the PNG
+bytes come out, with no temp files and no child process. ctypes releases
+the GIL for the duration of every call.
+"""
+import ctypes
+import json
+import threading
+import time
+
+
+class _Image(ctypes.Structure):
+    _fields_ = [
+        ('data', ctypes.POINTER(ctypes.c_ubyte)),
+        ('width', ctypes.c_int),
+        ('height', ctypes.c_int),
+        ('channels', ctypes.c_int),
+    ]
+
+
+class _StreamStats(ctypes.Structure):
+    _fields_ = [
+        ('width', ctypes.c_int),
+        ('height', ctypes.c_int),
+        ('channels', ctypes.c_int),
+        ('decode_secs', ctypes.c_double),
+        ('kernel_secs', ctypes.c_double),
+        ('encode_secs', ctypes.c_double),
+        ('total_secs', ctypes.c_double),
+        ('peak_bytes', ctypes.c_size_t),
+    ]
+
+
+class _Info(ctypes.Structure):
+    _fields_ = [
+        ('width', ctypes.c_int),
+        ('height', ctypes.c_int),
+        ('channels', ctypes.c_int),
+        ('pixels_offset', ctypes.c_longlong),
+    ]
+
+
+class _TileStats(ctypes.Structure):
+    _fields_ = [
+        ('stream', _StreamStats),
+        ('adler', ctypes.c_uint),
+        ('filtered', ctypes.c_ulonglong),
+    ]
+
+
+class _BatchItem(ctypes.Structure):
+    _fields_ = [
+        ('offset', ctypes.c_size_t),
+        ('width', ctypes.c_int),
+        ('height', ctypes.c_int),
+        ('channels', ctypes.c_int),
+    ]
+
+
+class _Batch(ctypes.Structure):
+    _fields_ = [
+        ('data', ctypes.POINTER(ctypes.c_ubyte)),
+        ('size', ctypes.c_size_t),
+        ('items', ctypes.POINTER(_BatchItem)),
+        ('count', ctypes.c_int),
+    ]
+
+
+_READ_FN = ctypes.CFUNCTYPE(ctypes.c_long, ctypes.c_void_p,
+                            ctypes.POINTER(ctypes.c_ubyte), ctypes.c_size_t)
+_WRITE_FN = ctypes.CFUNCTYPE(ctypes.c_int, ctypes.c_void_p,
+                             ctypes.POINTER(ctypes.c_ubyte), ctypes.c_size_t)
+_ROWS_FN = ctypes.CFUNCTYPE(ctypes.c_int, ctypes.c_void_p,
+                            ctypes.POINTER(ctypes.c_ubyte), ctypes.c_int, ctypes.c_int,
+                            ctypes.c_int, ctypes.c_int, ctypes.c_int)
+
+# bytes gs_stream_supported needs to recognise a format
+STREAM_HEAD_BYTES = 29
+
+# ``threads`` value that lets autotune.h pick the count from the image size
+AUTO = 'auto'
+
+# sizes of the PNG head and tail a stitch writes around the tile fragments
+STITCH_HEAD_BYTES = 47
+STITCH_TAIL_BYTES = 28
+
+
+def _callbacks(read, write, failure):
+    """C callbacks around ``read(n)`` and ``write(chunk)``: an exception
+    goes into ``failure`` and becomes -1, raising through C is not an option."""
+    def on_read(_ctx, buf, size):
+        try:
+            data = read(size)
+            ctypes.memmove(buf, data, len(data))
+            return len(data)
+        except Exception as exc:
+            failure.append(exc)
+            return -1
+
+    def on_write(_ctx, buf, size):
+        try:
+            write(ctypes.string_at(buf, size))
+            return 0
+        except Exception as exc:
+            failure.append(exc)
+            return -1
+
+    return _READ_FN(on_read), _WRITE_FN(on_write)
+
+
+class GrayscaleLib:
+    """In-process grayscale kernel.
+
+    Decode runs concurrently across callers; at most ``slots`` kernels and
+    parallel PNG encodes run at once (one by default, because each already
+    uses all the threads asked for).
+    """
+
+    def __init__(self, path, slots=1):
+        lib = ctypes.CDLL(path)
+        img_p = ctypes.POINTER(_Image)
+        lib.gs_decode.argtypes = [ctypes.c_char_p, ctypes.c_size_t, img_p]
+        lib.gs_decode_luma.argtypes = [ctypes.c_char_p, ctypes.c_size_t, img_p]
+        lib.gs_auto_threads.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.c_char_p,
+                                        ctypes.c_int]
+        lib.gs_process.argtypes = [img_p, ctypes.c_int, ctypes.c_int,
+                                   ctypes.c_int, ctypes.POINTER(ctypes.c_double)]
+        lib.gs_encode_png.argtypes = [img_p, ctypes.c_int, ctypes.c_int,
+                                      ctypes.POINTER(ctypes.POINTER(ctypes.c_ubyte)),
+                                      ctypes.POINTER(ctypes.c_size_t)]
+        lib.gs_pipeline.argtypes = [img_p, ctypes.c_char_p, ctypes.c_int, ctypes.c_int,
+                                    ctypes.POINTER(ctypes.c_double),
+                                    ctypes.POINTER(ctypes.c_char_p)]
+        lib.gs_stats_json.argtypes = [img_p, ctypes.c_int,
+                                      ctypes.POINTER(ctypes.c_char_p)]
+        lib.gs_stream.argtypes = [_READ_FN, _WRITE_FN, ctypes.c_void_p, ctypes.c_int,
+                                  ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_int,
+                                  ctypes.POINTER(_StreamStats)]
+        lib.gs_stream_supported.argtypes = [ctypes.c_char_p, ctypes.c_size_t]
+        lib.gs_image_info.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.POINTER(_Info)]
+        int_p = ctypes.POINTER(ctypes.c_int)
+        lib.gs_tile_window.argtypes = [ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_int,
+                                       ctypes.c_char_p, int_p, int_p, int_p]
+        lib.gs_tile.argtypes = [_READ_FN, _WRITE_FN, ctypes.c_void_p, ctypes.c_int,
+                                ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_int,
+                                ctypes.c_char_p, ctypes.c_int, ctypes.c_int, ctypes.c_int,
+                                ctypes.c_int, ctypes.POINTER(_TileStats)]
+        lib.gs_decode_rows.argtypes = [_READ_FN, _ROWS_FN, ctypes.c_void_p, ctypes.c_int]
+        lib.gs_stitch_head.argtypes = [ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_int,
+                                       ctypes.c_char_p, ctypes.POINTER(ctypes.c_size_t)]
+        lib.gs_stitch_tail.argtypes = [ctypes.POINTER(ctypes.c_uint),
+                                       ctypes.POINTER(ctypes.c_ulonglong), ctypes.c_int,
+                                       ctypes.c_char_p, ctypes.POINTER(ctypes.c_size_t)]
+        batch_p = ctypes.POINTER(_Batch)
+        lib.gs_batch_decode.argtypes = [ctypes.POINTER(ctypes.c_char_p),
+                                        ctypes.POINTER(ctypes.c_size_t), ctypes.c_int,
+                                        ctypes.c_int, batch_p]
+        lib.gs_batch_process.argtypes = [batch_p, ctypes.c_char_p, ctypes.c_int,
+                                         ctypes.c_int, ctypes.POINTER(ctypes.c_double)]
+        lib.gs_batch_encode_png.argtypes = [batch_p, ctypes.c_int, ctypes.c_int,
+                                            ctypes.POINTER(ctypes.POINTER(ctypes.c_ubyte)),
+                                            ctypes.POINTER(ctypes.c_size_t)]
+        lib.gs_batch_free.argtypes = [batch_p]
+        lib.gs_image_free.argtypes = [img_p]
+        lib.gs_free.argtypes = [ctypes.c_void_p]
+        lib.gs_last_error.restype = ctypes.c_char_p
+        lib.gs_version.restype = ctypes.c_char_p
+        for name in ('gs_decode', 'gs_decode_luma', 'gs_auto_threads', 'gs_process', 'gs_pipeline',
+                     'gs_stats_json', 'gs_encode_png', 'gs_stream', 'gs_stream_supported',
+                     'gs_image_info', 'gs_tile_window', 'gs_tile', 'gs_decode_rows',
+                     'gs_stitch_head', 'gs_stitch_tail',
+                     'gs_batch_decode', 'gs_batch_process', 'gs_batch_encode_png'):
+            getattr(lib, name).restype = ctypes.c_int
+        self.lib = lib
+        self.lock = threading.BoundedSemaphore(slots)
+        # core/VERSION of the build
+        self.version = lib.gs_version().decode()
+
+    def _check(self, rc):
+        if rc != 0:
+            raise RuntimeError(self.lib.gs_last_error().decode(errors='replace'))
+
+    def auto_threads(self, data, pipeline=None, max_threads=0):
+        """Thread count ``threads='auto'`` uses for the encoded image
+        ``data`` (only its header is read): one for a thumbnail, up to
+        ``max_threads`` (0 = the OpenMP default) for a large photo. 0 when
+        the format is not recognised."""
+        return self.lib.gs_auto_threads(data, len(data),
+                                        pipeline.encode() if pipeline else None,
+                                        int(max_threads or 0))
+
+    def process(self, data, passes=None, threads=None, planar=False, level=None,
+                luma=False, histogram=False, pipeline=None):
+        """Return ``(png_bytes, stages)`` for the encoded image ``data``.
+
+        ``stages`` holds the seconds spent in ``decode_s``, ``kernel_s`` and
+        ``encode_s``, their sum ``total_s`` and the nominal kernel bandwidth
+        ``kernel_gbps``: the same keys as ``grayscale --stats=json``, and
+        ``pixels``, the decoded width × height.
+        ``level`` is the PNG compression level (0 = store, None = default).
+        ``luma`` decodes straight to a single-channel Y plane (the JPEG luma
+        with libjpeg-turbo) and skips the kernel.
+        ``histogram`` adds ``stages['image']``: the per-channel 256-bin
+        histograms, mean, min and max of the decoded input (the same object
+        as ``"image"`` in ``grayscale --stats=json --histogram``).
+        ``pipeline`` runs a stage list such as ``'gray,blur5,sobel:l1,hist'``
+        (see ``pipeline.h``) instead of the grayscale kernel; its ``hist``
+        stage, if any, fills ``stages['image']``. ``kernel_gbps`` is 0 then.
+        ``threads='auto'`` picks the count with ``auto_threads`` and reports
+        it as ``stages['threads']``.
+        """
+        passes = int(passes or 1)
+        auto = threads == AUTO
+        if auto:
+            threads = self.auto_threads(data, pipeline)
+        img = _Image()
+        decode = self.lib.gs_decode_luma if luma else self.lib.gs_decode
+        t0 = time.perf_counter()
+        self._check(decode(data, len(data), ctypes.byref(img)))
+        t1 = time.perf_counter()
+        try:
+            image = None
+            if histogram:
+                js = ctypes.c_char_p()
+                self._check(self.lib.gs_stats_json(ctypes.byref(img), int(threads or 0),
+                                                   ctypes.byref(js)))
+                try:
+                    image = json.loads(js.value)
+                finally:
+                    self.lib.gs_free(js)
+            secs = ctypes.c_double()
+            px = img.width * img.height
+            if planar:
+                kernel_bytes = passes * px * (img.channels + 1)
+            elif img.channels >= 3:
+                kernel_bytes = passes * px * img.channels * 2
+            else:
+                kernel_bytes = 0
+            if pipeline:
+                kernel_bytes = 0
+                js = ctypes.c_char_p()
+                with self.lock:
+                    self._check(self.lib.gs_pipeline(ctypes.byref(img), pipeline.encode(),
+                                                     passes, int(threads or 0),
+                                                     ctypes.byref(secs), ctypes.byref(js)))
+                if js.value is not None:
+                    try:
+                        image = json.loads(js.value)
+                    finally:
+                        self.lib.gs_free(js)
+            elif not luma:
+                with self.lock:
+                    self._check(self.lib.gs_process(ctypes.byref(img), passes,
+                                                    int(threads or 0), int(bool(planar)),
+                                                    ctypes.byref(secs)))
+            out = ctypes.POINTER(ctypes.c_ubyte)()
+            size = ctypes.c_size_t()
+            level = -1 if level is None or level == '' else int(level)
+            with self.lock:
+                t2 = time.perf_counter()
+                self._check(self.lib.gs_encode_png(ctypes.byref(img), level,
+                                                   int(threads or 0), ctypes.byref(out),
+                                                   ctypes.byref(size)))
+                t3 = time.perf_counter()
+            try:
+                png = ctypes.string_at(out, size.value)
+            finally:
+                self.lib.gs_free(out)
+        finally:
+            self.lib.gs_image_free(ctypes.byref(img))
+        kernel = secs.value
+        stages = {
+            'decode_s': t1 - t0,
+            'kernel_s': kernel,
+            'encode_s': t3 - t2,
+            'total_s': (t1 - t0) + kernel + (t3 - t2),
+            'kernel_gbps': kernel_bytes / kernel / 1e9 if kernel > 0 else 0.0,
+            'pixels': px,
+        }
+        if auto:
+            stages['threads'] = threads
+        if image is not None:
+            stages['image'] = image
+        return png, stages
+
+    def process_batch(self, images, passes=None, threads=None, level=None, pipeline=None):
+        """Grayscale several small encoded images in one go.
+
+        The images are decoded into one buffer and a single kernel pass
+        covers them all, split by rows of the whole batch, so a team of
+        threads starts once rather than once per thumbnail. ``pipeline`` may
+        be a single ``gray`` or ``sobel`` stage or ``gray,sobel`` (anything
+        else raises). Returns one item per input: ``(png_bytes, stages)`` or
+        the ``RuntimeError`` of that image alone. ``stages`` has the keys of
+        ``process`` measured on the whole batch (``pixels`` of all the
+        images), plus ``batch``, its size.
+        """
+        n = len(images)
+        passes = int(passes or 1)
+        threads = int(threads or 0)
+        level = -1 if level is None or level == '' else int(level)
+        bufs = (ctypes.c_char_p * n)(*images)
+        lens = (ctypes.c_size_t * n)(*(len(d) for d in images))
+        batch = _Batch()
+        t0 = time.perf_counter()
+        self._check(self.lib.gs_batch_decode(bufs, lens, n, threads, ctypes.byref(batch)))
+        t1 = time.perf_counter()
+        try:
+            items = [batch.items[i] for i in range(n)]
+            if pipeline:
+                kernel_bytes = 0
+            else:
+                kernel_bytes = passes * sum(it.width * it.height * it.channels * 2
+                                            for it in items if it.channels >= 3)
+            secs = ctypes.c_double()
+            outs = (ctypes.POINTER(ctypes.c_ubyte) * n)()
+            sizes = (ctypes.c_size_t * n)()
+            with self.lock:
+                self._check(self.lib.gs_batch_process(ctypes.byref(batch),
+                                                      pipeline.encode() if pipeline else None,
+                                                      passes, threads, ctypes.byref(secs)))
+                t2 = time.perf_counter()
+                self._check(self.lib.gs_batch_encode_png(ctypes.byref(batch), level,
+                                                         threads, outs, sizes))
+                t3 = time.perf_counter()
+            pngs = []
+            for i in range(n):
+                if outs[i]:
+                    try:
+                        pngs.append(ctypes.string_at(outs[i], sizes[i]))
+                    finally:
+                        self.lib.gs_free(outs[i])
+                else:
+                    pngs.append(None)
+        finally:
+            self.lib.gs_batch_free(ctypes.byref(batch))
+        kernel = secs.value
+        stages = {
+            'decode_s': t1 - t0,
+            'kernel_s': kernel,
+            'encode_s': t3 - t2,
+            'total_s': (t1 - t0) + kernel + (t3 - t2),
+            'kernel_gbps': kernel_bytes / kernel / 1e9 if kernel > 0 else 0.0,
+            'pixels': sum(it.width * it.height for it in items),
+            'batch': n,
+        }
+        results = []
+        for it, png in zip(items, pngs):
+            if it.width == 0:
+                results.append(RuntimeError('decode failed'))
+            elif png is None:
+                results.append(RuntimeError('PNG encode failed'))
+            else:
+                results.append((png, dict(stages)))
+        return results
+
+    def can_stream(self, head):
+        """Whether ``stream`` decodes an image starting with ``head``
+        (at least ``STREAM_HEAD_BYTES`` of it)."""
+        return bool(self.lib.gs_stream_supported(head, len(head)))
+
+    def stream(self, read, write, passes=None, threads=None, planar=False, level=None,
+               band_rows=0):
+        """Grayscale an image pulled from ``read(n)`` into PNG pieces pushed
+        to ``write(chunk)``, a band of rows at a time.
+
+        ``read`` returns up to ``n`` bytes (``b''`` at the end); ``write``
+        gets ``bytes``. An exception in either aborts the job and is raised
+        again here. Only a band of
+        decoded rows is held at once, whatever the image size. Both run on
+        the calling thread. Unlike ``process`` the kernel is not serialized
+        against other callers: the bands interleave with the I/O. Returns the
+        same ``stages`` keys as ``process`` plus ``peak_bytes``. Only
+        images too large to hold at once get here, so ``threads='auto'``
+        means the default count.
+        """
+        failure = []
+        on_read, on_write = _callbacks(read, write, failure)
+        passes = int(passes or 1)
+        level = -1 if level is None or level == '' else int(level)
+        st = _StreamStats()
+        threads = 0 if threads == AUTO else int(threads or 0)
+        rc = self.lib.gs_stream(on_read, on_write, None, passes,
+                                threads, int(bool(planar)), level,
+                                int(band_rows), ctypes.byref(st))
+        if failure:
+            raise failure[0]
+        self._check(rc)
+        px = st.width * st.height
+        if planar:
+            kernel_bytes = passes * px * (st.channels + 1)
+        elif st.channels >= 3:
+            kernel_bytes = passes * px * st.channels * 2
+        else:
+            kernel_bytes = 0
+        kernel = st.kernel_secs
+        return {
+            'decode_s': st.decode_secs,
+            'kernel_s': kernel,
+            'encode_s': st.encode_secs,
+            'total_s': st.total_secs,
+            'kernel_gbps': kernel_bytes / kernel / 1e9 if kernel > 0 else 0.0,
+            'pixels': px,
+            'peak_bytes': st.peak_bytes,
+        }
+
+    # ---- tiles: one image split across several workers ----
+
+    def info(self, head):
+        """``(width, height, channels, pixels_offset)`` from the header in
+        ``head``, without decoding it. ``pixels_offset`` is where the rows
+        of an 8-bit PGM/PPM start, contiguous, so a tile can range-read its
+        own; -1 for the other formats."""
+        info = _Info()
+        self._check(self.lib.gs_image_info(head, len(head), ctypes.byref(info)))
+        return info.width, info.height, info.channels, info.pixels_offset
+
+    def tile_window(self, height, channels, y0, rows, pipeline=None):
+        """``(win_y0, win_rows, out_channels)``: the input rows the tile
+        ``[y0, y0 + rows)`` needs (its rows plus the pipeline's halo and
+        the row the PNG filters look back at) and the channels of the PNG.
+        Raises for a pipeline that cannot be tiled."""
+        win_y0, win_rows, out = ctypes.c_int(), ctypes.c_int(), ctypes.c_int()
+        self._check(self.lib.gs_tile_window(height, channels, y0, rows,
+                                            pipeline.encode() if pipeline else None,
+                                            ctypes.byref(win_y0), ctypes.byref(win_rows),
+                                            ctypes.byref(out)))
+        return win_y0.value, win_rows.value, out.value
+
+    def tile(self, read, write, width, height, channels, y0, rows, pipeline=None,
+             passes=None, threads=None, level=None, band_rows=0):
+        """Run the tile ``[y0, y0 + rows)`` of a ``width``×``height``×
+        ``channels`` image and push its PNG fragment to ``write``.
+
+        ``read`` gives the raw rows of ``tile_window``, ``width*channels``
+        bytes each, with no header. ``read`` and ``write`` behave as in
+        ``stream``. Returns ``(adler32, filtered, stages)``: the first two
+        go to ``stitch_tail``; ``decode_s`` in ``stages`` is the time spent
+        reading rows, ``pixels`` those of the tile's own rows.
+        """
+        failure = []
+        on_read, on_write = _callbacks(read, write, failure)
+        passes = int(passes or 1)
+        level = -1 if level is None or level == '' else int(level)
+        threads = 0 if threads == AUTO else int(threads or 0)
+        st = _TileStats()
+        rc = self.lib.gs_tile(on_read, on_write, None, width, height, channels, y0, rows,
+                              pipeline.encode() if pipeline else None, passes, threads,
+                              level, int(band_rows), ctypes.byref(st))
+        if failure:
+            raise failure[0]
+        self._check(rc)
+        s = st.stream
+        return st.adler, st.filtered, {
+            'decode_s': s.decode_secs,
+            'kernel_s': s.kernel_secs,
+            'encode_s': s.encode_secs,
+            'total_s': s.total_secs,
+            'pixels': width * rows,
+            'peak_bytes': s.peak_bytes,
+        }
+
+    def decode_rows(self, read, rows, band_rows=0):
+        """Decode the image pulled from ``read(n)`` a band at a time and
+        call ``rows(data, y0, n, width, height, channels)`` with the
+        ``bytes`` of each band, on the calling thread. Formats as in
+        ``stream``."""
+        failure = []
+        on_read, _ = _callbacks(read, None, failure)
+
+        def on_rows(_ctx, buf, y0, n, width, height, channels):
+            try:
+                rows(ctypes.string_at(buf, n * width * channels), y0, n, width, height,
+                     channels)
+                return 0
+            except Exception as exc:
+                failure.append(exc)
+                return -1
+
+        rc = self.lib.gs_decode_rows(on_read, _ROWS_FN(on_rows), None, int(band_rows))
+        if failure:
+            raise failure[0]
+        self._check(rc)
+
+    def stitch_head(self, width, height, out_channels, level=None):
+        """The PNG bytes that go before the first tile fragment."""
+        level = -1 if level is None or level == '' else int(level)
+        out = ctypes.create_string_buffer(STITCH_HEAD_BYTES)
+        size = ctypes.c_size_t()
+        self._check(self.lib.gs_stitch_head(width, height, out_channels, level, out,
+                                            ctypes.byref(size)))
+        return out.raw[:size.value]
+
+    def stitch_tail(self, parts):
+        """The PNG bytes that go after the last fragment, from the
+        ``(adler32, filtered)`` pairs ``tile`` returned, in tile order."""
+        n = len(parts)
+        adlers = (ctypes.c_uint * n)(*(a for a, _ in parts))
+        filtered = (ctypes.c_ulonglong * n)(*(f for _, f in parts))
+        out = ctypes.create_string_buffer(STITCH_TAIL_BYTES)
+        size = ctypes.c_size_t()
+        self._check(self.lib.gs_stitch_tail(adlers, filtered, n, out, ctypes.byref(size)))
+        return out.raw[:size.value]
@@ -0,0 +1,168 @@
+"""Content-addressed cache of processed images.
+
+The key is a SHA-256 over the input bytes and what decides the output: the
+pipeline spec and the output format (PNG and its compression level).
+``passes`` and ``threads`` are not part of it. Every pass starts again from
+the input, so repeating a pass does not change the pixels. The thread count
+does not change them either.
+
+An entry holds the PNG and, if it was computed, the ``image`` statistics
+of ``histogram=1``. Timings are never stored (not even ``stats_s`` inside
+the statistics), so a hit has none.
+
+Two tiers, checked in order:
+
+* ``LRUCache``: in process, bounded by bytes (``GRAYSCALE_CACHE_BYTES``,
+  default 256 MiB, 0 disables it);
+* ``MinioStore`` (optional): ``processed/<key>.png`` plus
+  ``processed/<key>.json`` holding the statistics, shared by every worker
+  on the bucket.
+"""
+import hashlib
+import io
+import json
+import os
+import threading
+from collections import OrderedDict
+
+DEFAULT_MAX_BYTES = 256 * 1024 * 1024
+
+
+def cache_key(data, pipeline=None, level=None, fmt='png'):
+    """Hex digest naming the result of processing ``data``."""
+    params = {
+        'pipeline': pipeline or 'gray',
+        'format': fmt,
+        'level': None if level in (None, '') else int(level),
+    }
+    h = hashlib.sha256(hashlib.sha256(data).digest())
+    h.update(json.dumps(params, sort_keys=True).encode())
+    return h.hexdigest()
+
+
+def _entry_size(png, image):
+    return len(png) + (len(json.dumps(image)) if image is not None else 0)
+
+
+class LRUCache:
+    """Least recently used entries first out, at most ``max_bytes`` kept."""
+
+    def __init__(self, max_bytes=DEFAULT_MAX_BYTES):
+        self.max_bytes = max_bytes
+        self.size = 0
+        self.entries = OrderedDict()    # key -> (png, image, local, size)
+        self.lock = threading.Lock()
+
+    def get(self, key):
+        """``(png, image, local)`` or None; ``local`` as given to ``put``."""
+        with self.lock:
+            entry = self.entries.get(key)
+            if entry is None:
+                return None
+            self.entries.move_to_end(key)
+            return entry[:3]
+
+    def put(self, key, png, image=None, local=False):
+        size = _entry_size(png, image)
+        if size > self.max_bytes:
+            return
+        with self.lock:
+            old = self.entries.pop(key, None)
+            if old is not None:
+                self.size -= old[3]
+            self.entries[key] = (png, image, local, size)
+            self.size += size
+            while self.size > self.max_bytes:
+                _, evicted = self.entries.popitem(last=False)
+                self.size -= evicted[3]
+
+
+class MinioStore:
+    """Results as objects under ``prefix`` in ``bucket``."""
+
+    def __init__(self, client, bucket, prefix='processed/'):
+        self.client = client
+        self.bucket = bucket
+        self.prefix = prefix
+
+    def object_name(self, key):
+        return f'{self.prefix}{key}.png'
+
+    def _read(self, name):
+        from minio.error import S3Error
+        try:
+            resp = self.client.get_object(self.bucket, name)
+        except S3Error as exc:
+            if exc.code in ('NoSuchKey', 'NoSuchObject'):
+                return None
+            raise
+        try:
+            return resp.read()
+        finally:
+            resp.close()
+            resp.release_conn()
+
+    def get(self, key, histogram=False):
+        image = None
+        if histogram:
+            stats = self._read(f'{self.prefix}{key}.json')
+            if stats is None:
+                return None
+            image = json.loads(stats)
+        png = self._read(self.object_name(key))
+        if png is None:
+            return None
+        return png, image
+
+    def put(self, key, png, image=None):
+        # statistics first: a .png without its .json is just a miss for histogram=1
+        if image is not None:
+            stats = json.dumps(image, separators=(',', ':')).encode()
+            self.client.put_object(self.bucket, f'{self.prefix}{key}.json',
+                                   io.BytesIO(stats), length=len(stats),
+                                   content_type='application/json')
+        self.client.put_object(self.bucket, self.object_name(key), io.BytesIO(png),
+                               length=len(png), content_type='image/png')
+
+
+class ResultCache:
+    """Memory tier in front of an optional shared ``store``.
+
+    ``get`` returns ``(png, image)`` or ``None``. With ``histogram`` an
+    entry only counts as a hit if its statistics were stored. A hit in
+    ``store`` is copied into memory. ``shared=False`` keeps ``get`` and
+    ``put`` to the memory tier; such an entry is written to ``store`` the
+    first time a shared ``get`` finds it, so that a hit always has its
+    object.
+    """
+
+    def __init__(self, max_bytes=None, store=None):
+        if max_bytes is None:
+            max_bytes = int(os.environ.get('GRAYSCALE_CACHE_BYTES', DEFAULT_MAX_BYTES))
+        self.memory = LRUCache(max_bytes) if max_bytes > 0 else None
+        self.store = store
+
+    def get(self, key, histogram=False, shared=True):
+        if self.memory is not None:
+            hit = self.memory.get(key)
+            if hit is not None and (not histogram or hit[1] is not None):
+                png, image, local = hit
+                if local and shared and self.store is not None:
+                    self.store.put(key, png, image)
+                    self.memory.put(key, png, image)
+                return png, image
+        if self.store is not None and shared:
+            hit = self.store.get(key, histogram=histogram)
+            if hit is not None:
+                if self.memory is not None:
+                    self.memory.put(key, *hit)
+                return hit
+        return None
+
+    def put(self, key, png, image=None, shared=True):
+        if image is not None:
+            image = {k: v for k, v in image.items() if k != 'stats_s'}
+        if self.memory is not None:
+            self.memory.put(key, png, image, local=not shared)
+        if self.store is not None and shared:
+            self.store.put(key, png, image)
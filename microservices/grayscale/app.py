@@ -1,45 +1,313 @@
+import io
+import json
 import os
+import queue
 import tempfile
 import subprocess
+import threading
 import time
-from flask import Flask, request, send_file, abort
+from flask import Flask, Response, request, send_file, abort, stream_with_context
+
+from grayscale_common.grayscale_lib import AUTO, GrayscaleLib, STREAM_HEAD_BYTES
+from grayscale_common.metrics import (CONTENT_TYPE, MPX_BUCKETS, REGISTRY, Counter, Gauge,
+                                      Histogram)
+from grayscale_common.result_cache import ResultCache, cache_key
 
 BINARY_PATH = os.path.join(os.path.dirname(__file__), 'bin', 'grayscale')
+LIBRARY_PATH = os.path.join(os.path.dirname(__file__), 'bin', 'libgrayscale.so')
+# 'lib' (default when the .so is present) or 'worker'
+BACKEND = os.environ.get('GRAYSCALE_BACKEND',
+                         'lib' if os.path.exists(LIBRARY_PATH) else 'worker')
+# per-stage timings reported by both backends
+STAGE_KEYS = ('decode_s', 'kernel_s', 'encode_s', 'total_s', 'kernel_gbps')
+# uploads from this size on go through GrayscaleLib.stream (lib backend only)
+STREAM_MIN_BYTES = int(os.environ.get('GRAYSCALE_STREAM_BYTES', 4 * 1024 * 1024))
+# PNG pieces a streamed request may hold while the client catches up
+STREAM_QUEUE_CHUNKS = 4
+# raw request bodies taken as the image, with the options in the query string
+RAW_MIMETYPES = ('application/octet-stream',)
 app = Flask(__name__)
 
-@app.route('/grayscale', methods=['POST'])
-def grayscale():
-    if 'image' not in request.files:
-        return 'missing image', 400
 
-    img_file = request.files['image']
-    passes = request.form.get('passes')
-    threads = request.form.get('threads')
+class GrayscaleWorker:
+    """Resident ``bin/grayscale --serve`` process fed one job per line.
+
+    Keeping the process alive avoids fork/exec and OpenMP thread-pool
+    start-up on every request. Jobs are serialized: each one already uses
+    all the threads it asked for.
+    """
+
+    def __init__(self, binary):
+        self.binary = binary
+        self.proc = None
+        self.lock = threading.Lock()
+
+    def _ensure_running(self):
+        if self.proc is None or self.proc.poll() is not None:
+            self.proc = subprocess.Popen(
+                [self.binary, '--serve'],
+                stdin=subprocess.PIPE,
+                stdout=subprocess.PIPE,
+                text=True,
+                bufsize=1,
+            )
+
+    def run(self, in_path, out_path, passes=None, threads=None, level=None,
+            histogram=False, pipeline=None):
+        fields = [f'in={in_path}', f'out={out_path}', 'stats=1']
+        if histogram:
+            fields.append('histogram=1')
+        if pipeline:
+            fields.append(f'pipeline={pipeline}')
+        if passes:
+            fields.append(f'passes={passes}')
+        if threads:
+            fields.append(f'threads={threads}')
+        if level not in (None, ''):
+            fields.append(f'level={level}')
+        with self.lock:
+            self._ensure_running()
+            try:
+                self.proc.stdin.write('\t'.join(fields) + '\n')
+                self.proc.stdin.flush()
+                reply = self.proc.stdout.readline()
+            except BrokenPipeError:
+                reply = ''
+        if not reply:
+            raise RuntimeError('grayscale worker exited')
+        status, _, detail = reply.strip().partition(' ')
+        if status != 'ok':
+            raise RuntimeError(detail)
+        # ok <secs> <json>: the per-stage report of --stats=json
+        _, _, report = detail.partition(' ')
+        stats = json.loads(report)
+        stages = {k: stats[k] for k in STAGE_KEYS}
+        stages['pixels'] = stats['width'] * stats['height']
+        if threads == AUTO:
+            stages['threads'] = stats['threads']
+        if 'image' in stats:
+            stages['image'] = stats['image']
+        return stages
+
+
+def process_bytes(data, passes=None, threads=None, level=None, histogram=False,
+                  pipeline=None):
+    """Grayscale the encoded image ``data``.
 
+    Return ``(png_bytes, stages)`` where ``stages`` maps ``STAGE_KEYS`` to
+    the seconds (and GB/s) measured inside the C code. With ``histogram``
+    it also holds ``'image'``: per-channel histograms and mean/min/max of
+    the input, computed on the same decode. ``pipeline`` (e.g.
+    ``'gray,blur5,sobel:l1,hist'``) replaces the grayscale kernel.
+    ``threads='auto'`` sizes the team to the image and adds the count it
+    chose as ``stages['threads']``.
+    """
+    if library is not None:
+        return library.process(data, passes=passes, threads=threads, level=level,
+                               histogram=histogram, pipeline=pipeline)
     with tempfile.TemporaryDirectory() as tmpdir:
-        in_path = os.path.join(tmpdir, img_file.filename)
+        # fixed name: the job line is TAB separated and stb sniffs the format
+        in_path = os.path.join(tmpdir, 'input')
         out_path = os.path.join(tmpdir, 'out.png')
-        img_file.save(in_path)
+        with open(in_path, 'wb') as f:
+            f.write(data)
+        stages = worker.run(in_path, out_path, passes=passes, threads=threads, level=level,
+                            histogram=histogram, pipeline=pipeline)
+        with open(out_path, 'rb') as f:
+            return f.read(), stages
 
-        cmd = [BINARY_PATH, in_path, out_path]
-        if passes:
-            cmd.append(passes)
 
-        env = os.environ.copy()
-        if threads:
-            env['OMP_NUM_THREADS'] = threads
+library = GrayscaleLib(LIBRARY_PATH) if BACKEND == 'lib' else None
+worker = GrayscaleWorker(BINARY_PATH) if library is None else None
+# core/VERSION of the C build in use, from either backend
+CORE_VERSION = (library.version if library is not None else
+                subprocess.run([BINARY_PATH, '--version'], capture_output=True,
+                               text=True).stdout.split()[-1])
+Gauge('grayscale_build_info', 'Always 1, labelled with the version of the C core',
+      ['version']).set(1, version=CORE_VERSION)
+# processed PNGs by content (GRAYSCALE_CACHE_BYTES, 0 disables it)
+cache = ResultCache()
+
+request_seconds = Histogram('grayscale_request_seconds',
+                            'Seconds of a /grayscale request by path: buffered, stream or cached',
+                            ['path'])
+requests_total = Counter('grayscale_requests_total', 'Requests to /grayscale by path and result',
+                         ['path', 'result'])
+requests_busy = Gauge('grayscale_requests_in_flight', 'Requests to /grayscale being served')
+stage_seconds = Histogram('grayscale_stage_seconds',
+                          'Seconds of a run per stage: decode, kernel and encode in C, '
+                          'transfer of the upload', ['stage'])
+pixels_total = Counter('grayscale_pixels_total', 'Input pixels run through the kernel')
+megapixels = Histogram('grayscale_megapixels_per_second',
+                       'Megapixels per second of a run, decode to encode', buckets=MPX_BUCKETS)
+busy_seconds = Counter('grayscale_busy_seconds_total',
+                       'Seconds spent in the C core, summed over concurrent runs')
+cache_requests = Counter('grayscale_cache_requests_total', 'Result cache lookups by result',
+                         ['result'])
+Gauge('grayscale_cache_bytes', 'Bytes in the memory tier of the result cache',
+      function=lambda: cache.memory.size if cache.memory is not None else 0)
+
+
+def observe_run(run):
+    """Stage times and throughput of one run of the C core."""
+    for stage in ('decode', 'kernel', 'encode'):
+        stage_seconds.observe(run[f'{stage}_s'], stage=stage)
+    busy_seconds.inc(run['total_s'])
+    px = run.get('pixels')
+    if px:
+        pixels_total.inc(px)
+        if run['total_s'] > 0:
+            megapixels.observe(px / run['total_s'] / 1e6)
+
 
+def stream_png(head, source, passes=None, threads=None, level=None):
+    """Response with the PNG of ``source`` sent as it is encoded.
+
+    ``head`` holds the bytes already read from ``source`` to pick the
+    format. A thread runs ``library.stream`` and hands the PNG pieces to the
+    response through a queue of ``STREAM_QUEUE_CHUNKS``: when the client is
+    slow the encoder waits, so a request never holds more than a band of
+    rows and a few pieces. Errors before the first piece are a 500 as
+    usual; later ones can only cut the body short.
+    """
+    pending = [head]
+    chunks = queue.Queue(maxsize=STREAM_QUEUE_CHUNKS)
+    gone = threading.Event()        # the client closed the response
+
+    def read(size):
+        return pending.pop() if pending else source.read(size)
+
+    def put(item):
+        while not gone.is_set():
+            try:
+                chunks.put(item, timeout=1)
+                return
+            except queue.Full:
+                pass
+        raise RuntimeError('client disconnected')
+
+    def run():
+        start = time.time()
+        try:
+            with requests_busy.track():
+                stages = library.stream(read, put, passes=passes, threads=threads,
+                                        level=level)
+            app.logger.info('streamed: %s', json.dumps(stages, separators=(',', ':')))
+            observe_run(stages)
+            request_seconds.observe(time.time() - start, path='stream')
+            requests_total.inc(path='stream', result='ok')
+            put(None)
+        except Exception as exc:
+            requests_total.inc(path='stream', result='error')
+            if not gone.is_set():
+                put(exc)
+
+    threading.Thread(target=run, daemon=True).start()
+    first = chunks.get()
+    if isinstance(first, Exception):
+        gone.set()
+        app.logger.error(str(first))
+        abort(500, 'processing failed')
+
+    def body():
+        try:
+            item = first
+            while item is not None:
+                if isinstance(item, Exception):
+                    app.logger.error(str(item))
+                    return
+                yield item
+                item = chunks.get()
+        finally:
+            gone.set()
+
+    # the request context (and the upload stream) lives until the body ends
+    response = Response(stream_with_context(body()), mimetype='image/png')
+    response.headers['X-Cache'] = 'bypass'
+    return response
+
+
+@app.route('/metrics')
+def metrics():
+    return Response(REGISTRY.render(), content_type=CONTENT_TYPE)
+
+
+@app.route('/grayscale', methods=['POST'])
+def grayscale():
+    if request.mimetype.startswith('image/') or request.mimetype in RAW_MIMETYPES:
+        params = request.args
+        source = request.stream
+    elif 'image' in request.files:
+        params = request.form
+        source = request.files['image'].stream
+    else:
+        return 'missing image', 400
+
+    passes = params.get('passes')
+    # no threads (or threads=auto): sized to the image; threads=0 is every
+    # OpenMP thread
+    threads = params.get('threads') or AUTO
+    level = params.get('level')
+    histogram = params.get('histogram') in ('1', 'true')
+    pipeline = params.get('pipeline') or None
+    if pipeline and any(c in pipeline for c in '\t\n'):
+        return 'invalid pipeline', 400
+
+    # big uploads: straight from the request into the decoder, PNG out in
+    # pieces; statistics and pipelines need the whole image. stream=0 keeps
+    # the buffered path (and its X-Timings)
+    size = request.content_length
+    if (library is not None and not histogram and pipeline is None
+            and params.get('stream') != '0'
+            and (size is None or size >= STREAM_MIN_BYTES)):
+        head = source.read(STREAM_HEAD_BYTES)
+        if library.can_stream(head):
+            return stream_png(head, source, passes=passes, threads=threads, level=level)
+        start = time.time()
+        data = head + source.read()
+    else:
         start = time.time()
-        result = subprocess.run(cmd, capture_output=True, env=env)
-        duration = time.time() - start
+        data = source.read()
+    stage_seconds.observe(time.time() - start, stage='transfer')
 
-        if result.returncode != 0:
-            app.logger.error(result.stderr.decode())
+    start = time.time()
+    key = cache_key(data, pipeline=pipeline, level=level)
+    # cache=0 forces a run, e.g. to benchmark the same image again
+    hit = None
+    if params.get('cache') != '0':
+        hit = cache.get(key, histogram=histogram)
+        cache_requests.inc(result='miss' if hit is None else 'hit')
+    if hit is not None:
+        png, image = hit
+        stages = None
+    else:
+        try:
+            with requests_busy.track():
+                png, stages = process_bytes(data, passes=passes, threads=threads,
+                                            level=level, histogram=histogram,
+                                            pipeline=pipeline)
+        except RuntimeError as exc:
+            app.logger.error(str(exc))
+            requests_total.inc(path='buffered', result='error')
             abort(500, 'processing failed')
+        image = stages.pop('image', None)
+        observe_run(stages)
+        cache.put(key, png, image)
+    duration = time.time() - start
+    path = 'cached' if hit is not None else 'buffered'
+    request_seconds.observe(duration, path=path)
+    requests_total.inc(path=path, result='ok')
 
-        response = send_file(out_path, mimetype='image/png')
-        response.headers['X-Elapsed'] = f'{duration:.4f}'
-        return response
+    response = send_file(io.BytesIO(png), mimetype='image/png')
+    response.headers['X-Elapsed'] = f'{duration:.4f}'
+    response.headers['X-Cache'] = 'hit' if hit is not None else 'miss'
+    if stages is not None:
+        # decode/kernel/encode as measured in C: X-Elapsed minus these is overhead
+        response.headers['X-Timings'] = json.dumps(stages, separators=(',', ':'))
+    if image is not None:
+        # histogram=1: at most 4 x 256 counts, well under the header line limits
+        response.headers['X-Image-Stats'] = json.dumps(image, separators=(',', ':'))
+    return response
 
 if __name__ == '__main__':
     app.run(host='0.0.0.0', port=5000)
@@ -22,7 +22,9 @@ for t in $THREADS; do
   echo ">> threads=$t  (×$RUNS runs)"
   sum_r=0; sum_r2=0; sum_s=0; sum_s2=0
   for run in $(seq 1 "$RUNS"); do
-    out=$(python3 "$CLIENT" "$IMG" /tmp/out.png --threads=$t --passes=$PASSES --url=$URL 2>/dev/null)
+    # same image every run: skip the result cache or only hits are timed;
+    # buffered, since streamed responses carry no X-Elapsed
+    out=$(python3 "$CLIENT" "$IMG" /tmp/out.png --threads=$t --passes=$PASSES --no-cache --buffered --url=$URL 2>/dev/null)
     req=$(echo "$out" | awk '/Request time/{print $3}' | tr -d 's')
     svc=$(echo "$out" | awk '/Service processing time/{print $4}' | tr -d 's')
     sum_r=$(awk "BEGIN{print $sum_r+$req}")
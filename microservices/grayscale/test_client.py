@@ -2,7 +2,7 @@ import sys
 import time
 import requests
 
-USAGE = "usage: python3 test_client.py <input_img> [output_img] [--threads=N] [--passes=N] [--url=http://localhost:5000]"
+USAGE = "usage: python3 test_client.py <input_img> [output_img] [--threads=N] [--passes=N] [--no-cache] [--buffered] [--raw] [--url=http://localhost:5000]"
 
 def parse_args(argv):
     input_path = None
@@ -10,11 +10,20 @@ def parse_args(argv):
     url = 'http://localhost:5000'
     threads = None
     passes = None
+    cache = True
+    raw = False
+    buffered = False
     for arg in argv[1:]:
         if arg.startswith('--threads='):
             threads = arg.split('=',1)[1]
         elif arg.startswith('--passes='):
             passes = arg.split('=',1)[1]
+        elif arg == '--no-cache':
+            cache = False
+        elif arg == '--raw':
+            raw = True
+        elif arg == '--buffered':
+            buffered = True
         elif arg.startswith('--url='):
             url = arg.split('=',1)[1]
         elif input_path is None:
@@ -27,26 +36,42 @@ def parse_args(argv):
     if not input_path:
         print(USAGE)
         sys.exit(1)
-    return input_path, output_path, url, threads, passes
+    return input_path, output_path, url, threads, passes, cache, raw, buffered
 
 def main(argv):
-    input_path, output_path, url, threads, passes = parse_args(argv)
-    files = {'image': open(input_path,'rb')}
+    input_path, output_path, url, threads, passes, cache, raw, buffered = parse_args(argv)
     data = {}
     if threads:
         data['threads'] = threads
     if passes:
         data['passes'] = passes
+    if not cache:
+        data['cache'] = '0'
+    if buffered:
+        data['stream'] = '0'
     t0 = time.time()
-    r = requests.post(f"{url}/grayscale", files=files, data=data)
+    with open(input_path, 'rb') as img:
+        if raw:
+            # the file as the body, streamed from disk; options in the query string
+            r = requests.post(f"{url}/grayscale", data=img, params=data, stream=True,
+                              headers={'Content-Type': 'application/octet-stream'})
+        else:
+            r = requests.post(f"{url}/grayscale", files={'image': img}, data=data,
+                              stream=True)
+        if r.ok:
+            with open(output_path, 'wb') as f:
+                for chunk in r.iter_content(chunk_size=65536):
+                    f.write(chunk)
     elapsed = time.time() - t0
     if r.ok:
-        with open(output_path, 'wb') as f:
-            f.write(r.content)
         print(f"Saved grayscale image to {output_path}")
         print(f"Request time: {elapsed:.3f}s")
         if 'X-Elapsed' in r.headers:
             print(f"Service processing time: {r.headers['X-Elapsed']}s")
+        if 'X-Cache' in r.headers:
+            print(f"Cache: {r.headers['X-Cache']}")
+        if 'X-Timings' in r.headers:
+            print(f"Stage timings: {r.headers['X-Timings']}")
     else:
         print(f"Error {r.status_code}: {r.text}")
         print(f"Request time: {elapsed:.3f}s")
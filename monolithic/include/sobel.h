@@ -1,6 +0,0 @@
-#ifndef SOBEL_H
-#define SOBEL_H
-void sobel_edge(const unsigned char *src,
-                unsigned char *dst,
-                int width, int height);
-#endif
@@ -13,53 +13,65 @@ PHYS_CORE=$(lscpu | awk '/[Cc]ore/ && /socket/ {print $NF; exit}')
 THREADS=${2:-"1 2 3 4 $PHYS_CORE"}
 RUNS=${3:-10}               # ripetizioni per media
 PASSES=${4:-1}              # ripetizioni del kernel dentro il programma
+# first touch parallelo + thread legati ai core: su più socket ogni thread
+# lavora sulla memoria del proprio nodo (AFFINITY_OPTS="" per disattivare)
+AFFINITY_OPTS=${AFFINITY_OPTS---first-touch --bind=close --places=cores}
 
 OUTDIR="$BASE_DIR/results"
 IMGDIR="$OUTDIR/images"
 CSV="$OUTDIR/monolithic_bench.csv"
-CFLAGS="-O3 -march=native -ffast-math -funroll-loops -fopenmp"
 EXE="$BASE_DIR/bin/grayscale"
-SRC_DIR="$BASE_DIR/src"
-INC_DIR="$BASE_DIR/include"
 
 mkdir -p "$OUTDIR" "$IMGDIR" "$(dirname "$EXE")"
 
 if [ ! -x "$EXE" ]; then
   echo "Compilo $EXE..."
-  gcc $CFLAGS -I"$INC_DIR" "$SRC_DIR/main.c" "$SRC_DIR/parallel_to_grayscale.c" -lm -o "$EXE"
+  # sorgenti e flag in core/Makefile
+  make -C "$BASE_DIR" cli
 fi
 
-echo "threads,avg_real_sec,std_real_sec,avg_cpu_pct,avg_mem_kb" > "$CSV"
+echo "threads,avg_real_sec,std_real_sec,avg_cpu_pct,avg_mem_kb,avg_decode_sec,avg_kernel_sec,avg_encode_sec" > "$CSV"
+STATS_TMP=$(mktemp)
+trap 'rm -f "$STATS_TMP"' EXIT
 
 for t in $THREADS; do
   echo ">> OMP_NUM_THREADS=$t  (×$RUNS run, kernel×$PASSES)"
   out_sub="$IMGDIR/$t"; mkdir -p "$out_sub"
 
   # accumulatori
-  sum_r=0; sum_r2=0; sum_cpu=0; sum_mem=0
+  sum_r=0; sum_r2=0; sum_cpu=0; sum_mem=0; sum_dec=0; sum_ker=0; sum_enc=0
 
   for run in $(seq 1 "$RUNS"); do
     out_img="$out_sub/output_${run}.png"
 
+    # stdout: riga CSV di --stats (tempi per stadio), stderr: /usr/bin/time
     read real cpu mem < <(
       (OMP_NUM_THREADS=$t /usr/bin/time -f "%e %P %M" \
-        "$EXE" "$IMG" "$out_img" "$PASSES") 2>&1 >/dev/null
+        "$EXE" --stats=csv $AFFINITY_OPTS "$IMG" "$out_img" "$PASSES") 2>&1 >"$STATS_TMP"
     )
     cpu=${cpu%\%}
+    IFS=, read -r _ _ _ _ _ _ dec _ _ ker enc _ < <(tail -n 1 "$STATS_TMP")
 
     # somma e somma dei quadrati per deviazione std
     sum_r=$(awk "BEGIN{print $sum_r+$real}")
     sum_r2=$(awk "BEGIN{print $sum_r2+($real*$real)}")
     sum_cpu=$(awk "BEGIN{print $sum_cpu+$cpu}")
     sum_mem=$(awk "BEGIN{print $sum_mem+$mem}")
+    sum_dec=$(awk "BEGIN{print $sum_dec+$dec}")
+    sum_ker=$(awk "BEGIN{print $sum_ker+$ker}")
+    sum_enc=$(awk "BEGIN{print $sum_enc+$enc}")
   done
 
   avg_r=$(awk "BEGIN{print $sum_r/$RUNS}")
   std_r=$(awk "BEGIN{print sqrt($sum_r2/$RUNS - ($avg_r)^2)}")
   avg_cpu=$(awk "BEGIN{print $sum_cpu/$RUNS}")
   avg_mem=$(awk "BEGIN{print $sum_mem/$RUNS}")
+  avg_dec=$(awk "BEGIN{print $sum_dec/$RUNS}")
+  avg_ker=$(awk "BEGIN{print $sum_ker/$RUNS}")
+  avg_enc=$(awk "BEGIN{print $sum_enc/$RUNS}")
 
-  printf "%s,%.5f,%.5f,%.1f,%.0f\n" "$t" "$avg_r" "$std_r" "$avg_cpu" "$avg_mem" >> "$CSV"
+  printf "%s,%.5f,%.5f,%.1f,%.0f,%.5f,%.5f,%.5f\n" "$t" "$avg_r" "$std_r" "$avg_cpu" "$avg_mem" \
+    "$avg_dec" "$avg_ker" "$avg_enc" >> "$CSV"
 done
 
 echo -e "\n== Risultati (medie) ==" && column -s, -t "$CSV"
@@ -82,6 +94,17 @@ plt.xlabel('Thread OpenMP'); plt.ylabel('Speed-up (×)')
 plt.title('Speed-up'); plt.grid()
 plt.savefig(os.path.join(outdir, 'speedup_vs_thread.png'), dpi=150)
 
+# stadi misurati dal programma stesso (--stats): dove va il tempo per thread
+plt.figure()
+bottom = 0
+for col, label in [('avg_decode_sec', 'decode'), ('avg_kernel_sec', 'kernel'),
+                   ('avg_encode_sec', 'encode')]:
+    plt.bar(df.threads.astype(str), df[col], bottom=bottom, label=label)
+    bottom = bottom + df[col]
+plt.xlabel('Thread OpenMP'); plt.ylabel('Tempo medio (s)')
+plt.title('Tempo per stadio'); plt.legend(); plt.grid(axis='y')
+plt.savefig(os.path.join(outdir, 'stadi_vs_thread.png'), dpi=150)
+
 print("\nGrafici in:", os.path.abspath(outdir))
 PY
 